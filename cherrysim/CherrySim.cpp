@@ -39,6 +39,7 @@
 #include <iostream>
 #include <string>
 #include <functional>
+#include <algorithm>
 #include <json.hpp>
 #include <fstream>
 
@@ -278,6 +279,10 @@ void CherrySim::Init()
 	if (simConfig.importFromJson) {
 		importDataFromJson();
 	}
+
+	if (simConfig.energyProfilePath[0] != '\0') {
+		LoadEnergyProfiles(simConfig.energyProfilePath);
+	}
 	
 	for (u32 i = 0; i<getNumNodes(); i++) {
 		initNode(i);
@@ -294,7 +299,45 @@ void CherrySim::Init()
 		LoadPresetNodePositions();
 	}
 
-	server = new FruitySimServer();
+	InitTrace();
+
+	if (simConfig.enableWebServer) server = new FruitySimServer();
+}
+
+void CherrySim::InitTrace()
+{
+	if (simConfig.traceRecordPath[0] != '\0' && simConfig.traceReplayPath[0] != '\0') {
+		//A replay must not be recorded again, the trace would only contain the replayed nodes
+		SIMEXCEPTION(IllegalArgumentException);
+		return;
+	}
+
+	if (simConfig.traceRecordPath[0] != '\0') {
+		if (!trace.OpenForRecording(simConfig.traceRecordPath, simConfig.seed, getNumNodes(), simConfig.simTickDurationMs)) {
+			printf("Could not open trace %s for recording" EOL, simConfig.traceRecordPath);
+			SIMEXCEPTION(IllegalArgumentException);
+		}
+	}
+
+	if (simConfig.traceReplayPath[0] != '\0') {
+		//The trace can only be replayed with the seed and scenario that it was recorded with
+		if (!trace.LoadForReplay(simConfig.traceReplayPath, simConfig.seed, getNumNodes(), simConfig.simTickDurationMs)) {
+			printf("Could not load trace %s for replaying" EOL, simConfig.traceReplayPath);
+			SIMEXCEPTION(CorruptOrOutdatedSavefile);
+			return;
+		}
+		//Which nodes were stepped in a tick is not part of the trace
+		if (simConfig.simulateJittering) {
+			SIMEXCEPTION(NotImplementedException);
+		}
+
+		for (u32 i = 0; i < getNumNodes(); i++) {
+			const bool replayed = simConfig.replayNodeIds.empty()
+				|| std::find(simConfig.replayNodeIds.begin(), simConfig.replayNodeIds.end(), (u32)nodes[i].id) != simConfig.replayNodeIds.end();
+			nodes[i].replayedFromTrace = replayed;
+			nodes[i].eventQueue.SetDropGeneratedEvents(replayed);
+		}
+	}
 }
 
 //This will load the site data from a json and will read the device json to import all devices
@@ -433,7 +476,7 @@ void CherrySim::SimulateStepForAllNodes()
 	CheckForMultiTensorflowUsage();
 
 	//Check if the webserver has some open requests to process
-	server->ProcessServerRequests();
+	if (server != nullptr) server->ProcessServerRequests();
 
 	int64_t sumOfAllSimulatedFrames = 0;
 	for (u32 i = 0; i < getNumNodes(); i++) {
@@ -445,7 +488,8 @@ void CherrySim::SimulateStepForAllNodes()
 	//printf("-- %u --" EOL, simState.simTimeMs);
 	for (u32 i = 0; i < getNumNodes(); i++) {
 		setNode(i);
-		bool simulateNode = true;
+		//While replaying, only the replayed nodes run, all others keep their state
+		bool simulateNode = !trace.IsReplaying() || currentNode->replayedFromTrace;
 		if (simConfig.simulateJittering)
 		{
 			const int64_t frameOffset = currentNode->simulatedFrames - avgSimulatedFrames;
@@ -462,33 +506,55 @@ void CherrySim::SimulateStepForAllNodes()
 			StackBaseSetter sbs;
 
 			currentNode->simulatedFrames++;
-			simulateTimer();
-			simulateTimeouts();
-			simulateBroadcast();
-			SimulateConnections();
-			SimulateServiceDiscovery();
-			SimulateUartInterrupts();
+			//Only the code that is executed by the firmware may draw random numbers inside of a SimTraceRandomScope.
+			//For replayed nodes, everything that the simulator would generate for the node is taken from the trace.
+			if (currentNode->replayedFromTrace) ReplayTraceInputs();
+			{
+				SimTraceRandomScope randomScope;
+				simulateTimer();
+			}
+			if (currentNode->replayedFromTrace) {
+				ReplayTraceBleEvents();
+			}
+			else {
+				simulateTimeouts();
+				simulateBroadcast();
+				SimulateConnections();
+				SimulateServiceDiscovery();
+			}
+			{
+				SimTraceRandomScope randomScope;
+				SimulateUartInterrupts();
+			}
 #ifndef GITHUB_RELEASE
-			SimulateClcData();
+			if (!currentNode->replayedFromTrace) SimulateClcData();
 #endif //GITHUB_RELEASE
 			try {
-				FruityHal::EventLooper();
-				simulateFlashCommit();
-				simulateBatteryUsage();
-				simulateWatchDog();
+				{
+					SimTraceRandomScope randomScope;
+					FruityHal::EventLooper();
+				}
+				if (currentNode->replayedFromTrace) ReplayTraceFlashCompletions();
+				else simulateFlashCommit();
+				{
+					SimTraceRandomScope randomScope;
+					simulateBatteryUsage();
+					simulateWatchDog();
+				}
 			}
 			catch (const NodeSystemResetException& e) {
 				UNUSED_PARAMETER(e);
 				//Node broke out of its current simulation and rebootet
 				if (simEventListener) simEventListener->CherrySimEventHandler("NODE_RESET");
 			}
+			if (currentNode->replayedFromTrace) CheckReplayDivergence();
 		}
 
 		globalBreakCounter++;
 	}
 
-	//Run a check on the current clustering state
-	if(simConfig.enableClusteringValidityCheck) CheckMeshingConsistency();
+	//Run a check on the current clustering state, nodes that are not replayed do not take part in the clustering of a replay
+	if(simConfig.enableClusteringValidityCheck && !trace.IsReplaying()) CheckMeshingConsistency();
 
 	simState.simTimeMs += simConfig.simTickDurationMs;
 	//Initialize RNG with new seed in order to be able to jump to a frame and resimulate it
@@ -496,7 +562,11 @@ void CherrySim::SimulateStepForAllNodes()
 
 	//Back up the flash every flashToFileWriteInterval's step.
 	flashToFileWriteCycle++;
-	if (flashToFileWriteCycle % flashToFileWriteInterval == 0) StoreFlashToFile();
+	if (flashToFileWriteCycle % flashToFileWriteInterval == 0) {
+		StoreFlashToFile();
+		//The trace should contain as much as possible if the simulator crashes
+		trace.Flush();
+	}
 }
 
 void CherrySim::quitSimulation()
@@ -532,6 +602,7 @@ TerminalCommandHandlerReturnType CherrySim::TerminalCommandHandler(const char* c
 		printf("Map Width (width): %u\n", simConfig.mapWidthInMeters);
 		printf("Map Height (height): %u\n", simConfig.mapHeightInMeters);
 		printf("ConnectionLossProbability (lossprob): %f\n", simConfig.connectionTimeoutProbabilityPerSec);
+		printf("Link layer model (linkmodel): %s\n", simConfig.linkLayerModel == LinkLayerModel::AIRTIME ? "airtime" : "legacy");
 		printf("Play delay (delay): %d\n", simConfig.playDelay);
 		printf("Import Json (json): %u\n", simConfig.importFromJson);
 		printf("Site json (site): %s\n", simConfig.siteJsonPath);
@@ -544,6 +615,8 @@ TerminalCommandHandlerReturnType CherrySim::TerminalCommandHandler(const char* c
 		sim_print_statistics();
 
 		printf("Enter 'sendstat {nodeId=0}' or 'routestat {nodeId=0}' for packet statistics" EOL);
+		printf("Enter 'eventstat' for event queue statistics" EOL);
+		printf("Enter 'energystat {nodeId=0}' for energy statistics" EOL);
 
 		return TerminalCommandHandlerReturnType::SUCCESS;
 	}
@@ -593,6 +666,20 @@ TerminalCommandHandlerReturnType CherrySim::TerminalCommandHandler(const char* c
 		quitSimulation();
 		return TerminalCommandHandlerReturnType::SUCCESS;
 	}
+	else if (TERMARGS(0, "linkmodel") && commandArgsSize == 2) {
+		if (TERMARGS(1, "airtime")) simConfig.linkLayerModel = LinkLayerModel::AIRTIME;
+		else if (TERMARGS(1, "legacy")) simConfig.linkLayerModel = LinkLayerModel::LEGACY;
+		else return TerminalCommandHandlerReturnType::WRONG_ARGUMENT;
+
+		//The legacy model does not advance the connection event timelines, so they continue from the current time of each node
+		for (u32 i = 0; i < simConfig.numNodes; i++) {
+			for (int k = 0; k < nodes[i].state.configuredTotalConnectionCount; k++) {
+				nodes[i].state.connections[k].linkLayer.nextConnectionEventUs = (uint64_t)nodes[i].state.timeMs * 1000;
+				nodes[i].state.connections[k].linkLayer.lastSuccessfulExchangeMs = nodes[i].state.timeMs;
+			}
+		}
+		return TerminalCommandHandlerReturnType::SUCCESS;
+	}
 	else if (TERMARGS(0, "lossprob") && commandArgsSize == 2) {
 		simConfig.connectionTimeoutProbabilityPerSec = atof(commandArgs[1]);
 		return TerminalCommandHandlerReturnType::SUCCESS;
@@ -635,6 +722,13 @@ TerminalCommandHandlerReturnType CherrySim::TerminalCommandHandler(const char* c
 	else if (TERMARGS(0, "nodestat")) {
 		printf("Node advertising %d (iv %d)\n", currentNode->state.advertisingActive, currentNode->state.advertisingIntervalMs);
 		printf("Node scanning %d (window %d, iv %d)\n", currentNode->state.scanningActive, currentNode->state.scanWindowMs, currentNode->state.scanIntervalMs);
+		printf("Node event queue %u (max %u, capacity %u)\n", currentNode->eventQueue.size(), currentNode->eventQueue.GetHighWaterMark(), currentNode->eventQueue.capacity());
+		for (int i = 0; i < currentNode->state.configuredTotalConnectionCount; i++) {
+			const SoftdeviceConnection& connection = currentNode->state.connections[i];
+			if (!connection.connectionActive) continue;
+			printf("Connection %d to %d (iv %d): events %u, missed %u, retransmissions %u, payload %u bytes\n", connection.connectionHandle, connection.partner->id, connection.connectionInterval,
+				connection.linkLayer.connectionEvents, connection.linkLayer.missedConnectionEvents, connection.linkLayer.retransmissions, connection.linkLayer.payloadBytesSent);
+		}
 
 		return TerminalCommandHandlerReturnType::SUCCESS;
 	}
@@ -678,6 +772,17 @@ TerminalCommandHandlerReturnType CherrySim::TerminalCommandHandler(const char* c
 	}
 
 	//For statistics
+	else if (TERMARGS(0, "eventstat")) {
+		//Print the nodes that had the most pending BLE events
+		PrintEventQueueStats();
+		return TerminalCommandHandlerReturnType::SUCCESS;
+	}
+	else if (TERMARGS(0, "energystat")) {
+		//Print the consumed charge of one or all nodes split by activity
+		NodeId nodeId = commandArgsSize >= 2 ? Utility::StringToU16(commandArgs[1]) : 0;
+		PrintEnergyStats(nodeId);
+		return TerminalCommandHandlerReturnType::SUCCESS;
+	}
 	else if (TERMARGS(0, "sendstat")) {
 		//Print statistics about all packets generated by a node
 		NodeId nodeId = commandArgsSize >= 2 ? Utility::StringToU16(commandArgs[1]) : 0;
@@ -761,6 +866,10 @@ void CherrySim::RegisterTerminalPrintListener(TerminalPrintListener* callback)
 //Called for all terminal output from all nodes
 void CherrySim::TerminalPrintHandler(const char* message)
 {
+	if (simConfig.enableSimStatistics && currentNode != nullptr) {
+		currentNode->terminalOutputBytes += strlen(message);
+	}
+
 	if (terminalPrintListener != nullptr) {
 		if (currentNode->id == simConfig.terminalId || simConfig.terminalId == 0) {
 			terminalPrintListener->TerminalPrintHandler(currentNode, message);
@@ -1005,13 +1114,13 @@ void CherrySim::bootCurrentNode()
 	erasePage(REGION_BOOTLOADER_SETTINGS_START);
 
 	simGlobalStatePtr = new (&currentNode->gs) GlobalState();
+	currentNode->gs.logger.jsonValidationSampleRate = simConfig.jsonValidationSampleRate;
 
 	//Reset our GPIO Peripheral
 	CheckedMemset(simGpioPtr, 0x00, sizeof(NRF_GPIO_Type));
 
 	//Create a queue for events	if (simGlobalStatePtr != nullptr) {
-	currentNode->eventQueue.~deque();
-	new (&(currentNode->eventQueue)) std::queue<simBleEvent>();
+	currentNode->eventQueue.clear();
 
 	//Set the Ble stack parameters in the node so that we can use them later
 	SetBleStack(currentNode);
@@ -1108,9 +1217,9 @@ void CherrySim::simulateFlashCommit() {
 void CherrySim::sim_commit_flash_operations()
 {
 	if (cherrySimInstance->simConfig.simulateAsyncFlash) {
+		SimTraceRandomScope randomScope;
 		while (cherrySimInstance->currentNode->state.numWaitingFlashOperations > 0) {
-			DispatchSystemEvents(FruityHal::SystemEvents::FLASH_OPERATION_SUCCESS);
-			cherrySimInstance->currentNode->state.numWaitingFlashOperations--;
+			DispatchFlashCompletion(FruityHal::SystemEvents::FLASH_OPERATION_SUCCESS);
 		}
 	}
 }
@@ -1120,15 +1229,232 @@ void CherrySim::sim_commit_some_flash_operations(const uint8_t* failData, uint16
 {
 	u32 i = 0;
 	if (cherrySimInstance->simConfig.simulateAsyncFlash) {
+		SimTraceRandomScope randomScope;
 		while (cherrySimInstance->currentNode->state.numWaitingFlashOperations > 0 && i < numMaxEvents) {
-			if (failData[i] == 0) DispatchSystemEvents(FruityHal::SystemEvents::FLASH_OPERATION_SUCCESS);
-			else DispatchSystemEvents(FruityHal::SystemEvents::FLASH_OPERATION_ERROR);
-			cherrySimInstance->currentNode->state.numWaitingFlashOperations--;
+			if (failData[i] == 0) DispatchFlashCompletion(FruityHal::SystemEvents::FLASH_OPERATION_SUCCESS);
+			else DispatchFlashCompletion(FruityHal::SystemEvents::FLASH_OPERATION_ERROR);
 			i++;
 		}
 	}
 }
 
+void CherrySim::DispatchFlashCompletion(FruityHal::SystemEvents event)
+{
+	const u8 eventType = (u8)event;
+	trace.Record(simState.simTimeMs, currentNode->index, SimTraceEntryType::FLASH_COMPLETION, &eventType, sizeof(eventType));
+
+	DispatchSystemEvents(event);
+	if (currentNode->state.numWaitingFlashOperations > 0) currentNode->state.numWaitingFlashOperations--;
+}
+
+//################################## Record and Replay ####################################
+// Records the inputs of the firmware into a trace and feeds replayed nodes from it
+//#########################################################################################
+
+SimTraceRandomScope::SimTraceRandomScope()
+{
+	CherrySim* sim = cherrySimInstance;
+	MersenneTwister& rnd = sim->simState.rnd;
+	if (rnd.recordTarget != nullptr || rnd.replaySource != nullptr) return;
+
+	nodeIndex = sim->currentNode->index;
+	if (sim->currentNode->replayedFromTrace) {
+		SimTraceNodeReplay& replay = sim->trace.replayNodes[nodeIndex];
+		rnd.replaySource = &replay.randomValues;
+		rnd.replayIndex = &replay.nextRandomValue;
+		active = true;
+	}
+	else if (sim->trace.IsRecording()) {
+		sim->traceRandomValues.clear();
+		rnd.recordTarget = &sim->traceRandomValues;
+		active = true;
+	}
+}
+
+SimTraceRandomScope::~SimTraceRandomScope()
+{
+	if (!active) return;
+
+	CherrySim* sim = cherrySimInstance;
+	MersenneTwister& rnd = sim->simState.rnd;
+	if (rnd.recordTarget != nullptr && !sim->traceRandomValues.empty()) {
+		sim->trace.Record(sim->simState.simTimeMs, nodeIndex, SimTraceEntryType::RANDOM, sim->traceRandomValues.data(), sim->traceRandomValues.size() * sizeof(u32));
+	}
+	rnd.recordTarget = nullptr;
+	rnd.replaySource = nullptr;
+	rnd.replayIndex = nullptr;
+}
+
+//Called for every event that the firmware fetches, events that were dropped from the queue are never part of the trace
+void CherrySim::RecordFetchedBleEvent(const simBleEvent& event)
+{
+	if (!trace.IsRecording()) return;
+
+	u8 buffer[sizeof(u32) + GlobalState::SIZE_OF_EVENT_BUFFER];
+	CheckedMemcpy(buffer, &event.globalId, sizeof(u32));
+	CheckedMemcpy(buffer + sizeof(u32), &event.bleEvent, GlobalState::SIZE_OF_EVENT_BUFFER);
+
+	//Most events only use a small part of the event buffer
+	u32 length = sizeof(buffer);
+	while (length > sizeof(u32) && buffer[length - 1] == 0) length--;
+
+	trace.Record(simState.simTimeMs, currentNode->index, SimTraceEntryType::BLE_EVENT, buffer, length);
+}
+
+void CherrySim::RecordTerminalInput(const nodeEntry* node, const char* line)
+{
+	trace.Record(simState.simTimeMs, node->index, SimTraceEntryType::TERMINAL_INPUT, line, strlen(line));
+}
+
+//Input that was recorded between two simulation steps is put into the node before its next step
+void CherrySim::ReplayTraceInputs()
+{
+	SimTraceNodeReplay& replay = trace.replayNodes[currentNode->index];
+	while (replay.nextInput < replay.inputs.size() && replay.inputs[replay.nextInput].timeMs <= simState.simTimeMs) {
+		const SimTraceEntry& entry = replay.inputs[replay.nextInput];
+		replay.nextInput++;
+
+		if (entry.type == SimTraceEntryType::UART_INPUT) {
+			SendUartCommand(currentNode->id, entry.data.data(), entry.data.size());
+		}
+		else {
+			const std::string line(entry.data.begin(), entry.data.end());
+			GS->terminal.PutIntoReadBuffer(line.c_str());
+		}
+	}
+}
+
+//All events that the node fetched during a step are queued before the firmware runs its event loop
+void CherrySim::ReplayTraceBleEvents()
+{
+	SimTraceNodeReplay& replay = trace.replayNodes[currentNode->index];
+	while (replay.nextBleEvent < replay.bleEvents.size() && replay.bleEvents[replay.nextBleEvent].timeMs <= simState.simTimeMs) {
+		const SimTraceEntry& entry = replay.bleEvents[replay.nextBleEvent];
+		replay.nextBleEvent++;
+
+		simBleEvent s;
+		CheckedMemset(&s, 0, sizeof(s));
+		if (entry.data.size() < sizeof(u32) || entry.data.size() > sizeof(u32) + GlobalState::SIZE_OF_EVENT_BUFFER) {
+			SIMEXCEPTION(CorruptOrOutdatedSavefile);
+			continue;
+		}
+		CheckedMemcpy(&s.globalId, entry.data.data(), sizeof(u32));
+		CheckedMemcpy((u8*)&s.bleEvent, entry.data.data() + sizeof(u32), entry.data.size() - sizeof(u32));
+
+		ApplyReplayedBleEventToSoftDevice(s);
+		currentNode->eventQueue.push_back_recorded(s);
+	}
+}
+
+//The simulator normally changes the SoftDevice state of a node together with generating an event. As a replayed
+//node is not simulated, the same changes are done based on the recorded events so that the return values of the
+//SoftDevice calls are the same as during the recording.
+void CherrySim::ApplyReplayedBleEventToSoftDevice(const simBleEvent& event)
+{
+	const ble_evt_t& bleEvent = event.bleEvent;
+	SoftdeviceState& state = currentNode->state;
+
+	if (bleEvent.header.evt_id == BLE_GAP_EVT_CONNECTED) {
+		const bool isCentral = bleEvent.evt.gap_evt.params.connected.role == BLE_GAP_ROLE_CENTRAL;
+
+		//Uses the same connection spot as ConnectMasterToSlave
+		SoftdeviceConnection* connection = nullptr;
+		int connIndex = 0;
+		for (int i = 0; i < state.configuredTotalConnectionCount; i++) {
+			if (!state.connections[i].connectionActive) {
+				connection = &state.connections[i];
+				connIndex = i;
+			}
+		}
+		nodeEntry* partner = findNodeByAddress(bleEvent.evt.gap_evt.params.connected.peer_addr);
+		if (connection == nullptr || partner == nullptr) {
+			SIMEXCEPTION(IllegalStateException);
+			return;
+		}
+
+		connection->connectionIndex = isCentral ? connIndex : 0;
+		connection->connectionActive = true;
+		connection->rssiMeasurementActive = false;
+		connection->connectionHandle = bleEvent.evt.gap_evt.conn_handle;
+		connection->connectionInterval = UNITS_TO_MSEC(Conf::getInstance().meshMinConnectionInterval, UNIT_1_25_MS);
+		connection->owningNode = currentNode;
+		connection->partner = partner;
+		connection->partnerConnection = nullptr;
+		connection->connectionMtu = GATT_MTU_SIZE_DEFAULT;
+		connection->isCentral = isCentral;
+		connection->linkLayer = SimLinkLayerState();
+
+		if (isCentral) state.connectingActive = false;
+		else state.advertisingActive = false;
+	}
+	else if (bleEvent.header.evt_id == BLE_GAP_EVT_DISCONNECTED) {
+		SoftdeviceConnection* connection = findConnectionByHandle(currentNode, bleEvent.evt.gap_evt.conn_handle);
+		if (connection != nullptr) {
+			CheckedMemset(connection->reliableBuffers, 0x00, sizeof(connection->reliableBuffers));
+			CheckedMemset(connection->unreliableBuffers, 0x00, sizeof(connection->unreliableBuffers));
+			connection->connectionActive = false;
+		}
+	}
+	else if (bleEvent.header.evt_id == BLE_GAP_EVT_TIMEOUT) {
+		if (bleEvent.evt.gap_evt.params.timeout.src == BLE_GAP_TIMEOUT_SRC_CONN) state.connectingActive = false;
+	}
+	else if (bleEvent.header.evt_id == BLE_GAP_EVT_CONN_SEC_UPDATE) {
+		SoftdeviceConnection* connection = findConnectionByHandle(currentNode, bleEvent.evt.gap_evt.conn_handle);
+		if (connection != nullptr) connection->connectionEncrypted = true;
+	}
+	else if (bleEvent.header.evt_id == BLE_EVT_TX_COMPLETE) {
+		//Packets are sent in the order in which they were queued
+		SoftdeviceConnection* connection = findConnectionByHandle(currentNode, bleEvent.evt.common_evt.conn_handle);
+		for (u32 i = 0; connection != nullptr && i < bleEvent.evt.common_evt.params.tx_complete.count; i++) {
+			SoftDeviceBufferedPacket* oldestPacket = nullptr;
+			for (int k = 0; k < SIM_NUM_UNRELIABLE_BUFFERS; k++) {
+				SoftDeviceBufferedPacket* packet = &connection->unreliableBuffers[k];
+				if (packet->sender != nullptr && (oldestPacket == nullptr || packet->globalPacketId < oldestPacket->globalPacketId)) {
+					oldestPacket = packet;
+				}
+			}
+			if (oldestPacket == nullptr) break;
+			oldestPacket->sender = nullptr;
+		}
+	}
+	else if (bleEvent.header.evt_id == BLE_GATTC_EVT_WRITE_RSP) {
+		SoftdeviceConnection* connection = findConnectionByHandle(currentNode, bleEvent.evt.gattc_evt.conn_handle);
+		if (connection != nullptr) connection->reliableBuffers[0].sender = nullptr;
+	}
+}
+
+void CherrySim::ReplayTraceFlashCompletions()
+{
+	SimTraceRandomScope randomScope;
+	SimTraceNodeReplay& replay = trace.replayNodes[currentNode->index];
+	while (replay.nextFlashCompletion < replay.flashCompletions.size() && replay.flashCompletions[replay.nextFlashCompletion].timeMs <= simState.simTimeMs) {
+		const SimTraceEntry& entry = replay.flashCompletions[replay.nextFlashCompletion];
+		replay.nextFlashCompletion++;
+		if (entry.data.empty()) continue;
+
+		DispatchFlashCompletion((FruityHal::SystemEvents)entry.data[0]);
+	}
+}
+
+//A replayed node must have drawn exactly the recorded amount of random numbers and must have fetched all recorded
+//events until now. Otherwise, its execution differs from the recording and the replay is no longer reliable.
+void CherrySim::CheckReplayDivergence()
+{
+	SimTraceNodeReplay& replay = trace.replayNodes[currentNode->index];
+	if (replay.diverged) return;
+
+	while (replay.nextRandomValueCheckpoint < replay.randomValueCheckpoints.size() && replay.randomValueCheckpoints[replay.nextRandomValueCheckpoint].first <= simState.simTimeMs) {
+		replay.nextRandomValueCheckpoint++;
+	}
+	const size_t expectedRandomValues = replay.nextRandomValueCheckpoint == 0 ? 0 : replay.randomValueCheckpoints[replay.nextRandomValueCheckpoint - 1].second;
+
+	if (replay.nextRandomValue != expectedRandomValues || currentNode->eventQueue.size() > 0) {
+		replay.diverged = true;
+		replayDivergenceCount++;
+		printf("Replay of node %d diverged from the trace at %u ms" EOL, currentNode->id, simState.simTimeMs);
+	}
+}
+
 //################################## GAP Simulation ################################
 // Simulates advertising, connections and disconnections
 //#########################################################################################
@@ -1250,6 +1576,9 @@ void CherrySim::ConnectMasterToSlave(nodeEntry* master, nodeEntry* slave)
 	freeInConnection->partner = master;
 	freeInConnection->connectionMtu = GATT_MTU_SIZE_DEFAULT;
 	freeInConnection->isCentral = false;
+	freeInConnection->linkLayer = SimLinkLayerState();
+	freeInConnection->linkLayer.nextConnectionEventUs = (uint64_t)slave->state.timeMs * 1000;
+	freeInConnection->linkLayer.lastSuccessfulExchangeMs = slave->state.timeMs;
 
 	//Generate an event for the current node
 	simBleEvent s2;
@@ -1301,6 +1630,9 @@ void CherrySim::ConnectMasterToSlave(nodeEntry* master, nodeEntry* slave)
 	freeOutConnection->partner = slave;
 	freeOutConnection->connectionMtu = GATT_MTU_SIZE_DEFAULT;
 	freeOutConnection->isCentral = true;
+	freeOutConnection->linkLayer = SimLinkLayerState();
+	freeOutConnection->linkLayer.nextConnectionEventUs = (uint64_t)master->state.timeMs * 1000;
+	freeOutConnection->linkLayer.lastSuccessfulExchangeMs = master->state.timeMs;
 
 	//Save connection references
 	freeInConnection->partnerConnection = freeOutConnection;
@@ -1351,18 +1683,22 @@ u32 CherrySim::DisconnectSimulatorConnection(SoftdeviceConnection* connection, u
 	}
 
 	//TODO: this is wrong, fix when this happens
-	if (partnerConnection == nullptr) {
+	//Connections of replayed nodes have no partner connection, the partner learns about the disconnect from its own trace
+	if (partnerConnection == nullptr && !connection->owningNode->replayedFromTrace) {
 		SIMEXCEPTION(IllegalStateException);
 	}
 
 	//Clear the transmitbuffers for both nodes
 	CheckedMemset(connection->reliableBuffers, 0x00, sizeof(connection->reliableBuffers));
 	CheckedMemset(connection->unreliableBuffers, 0x00, sizeof(connection->unreliableBuffers));
-	CheckedMemset(partnerConnection->reliableBuffers, 0x00, sizeof(connection->reliableBuffers));
-	CheckedMemset(partnerConnection->unreliableBuffers, 0x00, sizeof(connection->unreliableBuffers));
+	if (partnerConnection != nullptr) {
+		CheckedMemset(partnerConnection->reliableBuffers, 0x00, sizeof(connection->reliableBuffers));
+		CheckedMemset(partnerConnection->unreliableBuffers, 0x00, sizeof(connection->unreliableBuffers));
+	}
 
 	//#### Our own node
 	connection->connectionActive = false;
+	connection->owningNode->state.validityNeedsRecheck = true;
 
 	simBleEvent s1;
 	s1.globalId = simState.globalEventIdCounter++;
@@ -1373,7 +1709,9 @@ u32 CherrySim::DisconnectSimulatorConnection(SoftdeviceConnection* connection, u
 	connection->owningNode->eventQueue.push_back(s1);
 
 	//#### Remote node
+	if (partnerConnection == nullptr) return NRF_SUCCESS;
 	partnerConnection->connectionActive = false;
+	partnerNode->state.validityNeedsRecheck = true;
 
 	simBleEvent s2;
 	s2.globalId = simState.globalEventIdCounter++;
@@ -1419,6 +1757,8 @@ void CherrySim::SendUartCommand(NodeId nodeId, const u8* message, u32 messageLen
 		SIMEXCEPTION(MessageTooLongException);
 	}
 	CheckedMemcpy(state->uartBuffer.getRaw() + oldBufferLength, message, messageLength);
+
+	cherrySimInstance->trace.Record(cherrySimInstance->simState.simTimeMs, cherrySimInstance->findNodeById(nodeId)->index, SimTraceEntryType::UART_INPUT, message, messageLength);
 }
 //################################## GATT Simulation ######################################
 // Generates writes
@@ -1462,15 +1802,71 @@ void CherrySim::SendUnreliableTxCompleteEvent(nodeEntry* node, int connHandle, u
 	}
 }
 
+void CherrySim::SendWriteResponseEvent(nodeEntry* node, int connHandle, u32 globalPacketId)
+{
+	simBleEvent s2;
+	s2.globalId = simState.globalEventIdCounter++;
+	s2.bleEvent.header.evt_id = BLE_GATTC_EVT_WRITE_RSP;
+	s2.bleEvent.header.evt_len = s2.globalId;
+	s2.bleEvent.evt.gattc_evt.conn_handle = connHandle;
+	s2.bleEvent.evt.gattc_evt.gatt_status = (u16)FruityHal::BleGattEror::SUCCESS;
+	//Save the global packet id so that we can track where a packet was generated after we receive it
+	s2.additionalInfo = globalPacketId;
+	node->eventQueue.push_back(s2);
+}
+
 void CherrySim::SimulateConnections() {
+	if (blockConnections) return;
+
+	//Simulate sending data for each connection with the configured link layer model
+	if (simConfig.linkLayerModel == LinkLayerModel::AIRTIME) {
+		SimulateConnectionEventsAirtime();
+	}
+	else {
+		SimulateConnectionEventsLegacy();
+	}
+
+	// Simulate Connection RSSI measurements
+	for (int i = 0; i < currentNode->state.configuredTotalConnectionCount; i++) {
+		if (SHOULD_SIM_IV_TRIGGER(5000)) {
+			SoftdeviceConnection* connection = &currentNode->state.connections[i];
+			if (connection->connectionActive && connection->rssiMeasurementActive) {
+				nodeEntry* master = i == 0 ? connection->partner : currentNode;
+				nodeEntry* slave = i == 0 ? currentNode : connection->partner;
+
+				simBleEvent s;
+				s.globalId = simState.globalEventIdCounter++;
+				s.bleEvent.header.evt_id = BLE_GAP_EVT_RSSI_CHANGED;
+				s.bleEvent.header.evt_len = s.globalId;
+				s.bleEvent.evt.gap_evt.conn_handle = connection->connectionHandle;
+				s.bleEvent.evt.gap_evt.params.rssi_changed.rssi = (i8)GetReceptionRssi(master, slave);
+
+				currentNode->eventQueue.push_back(s);
+			}
+		}
+	}
+
+	//Simulate Connection Loss every second
+	if (simConfig.connectionTimeoutProbabilityPerSec != 0) {
+		for (int i = 0; i < currentNode->state.configuredTotalConnectionCount; i++) {
+			if (currentNode->state.connections[i].connectionActive) {
+				if (PSRNG() < simConfig.connectionTimeoutProbabilityPerSec) {
+					SIMSTATCOUNT("simulatedTimeouts");
+					printf("Simulated Connection Loss for node %d to partner %d (handle %d)" EOL, currentNode->id, currentNode->state.connections[i].partner->id, currentNode->state.connections[i].connectionHandle);
+					DisconnectSimulatorConnection(&currentNode->state.connections[i], BLE_HCI_CONNECTION_TIMEOUT, BLE_HCI_CONNECTION_TIMEOUT);
+				}
+			}
+		}
+	}
+}
+
+void CherrySim::SimulateConnectionEventsLegacy() {
 	/* Currently, the simulation will only take one connection event to transmit a reliable packet and both the packet event and the ACK will be generated
 	* at the same time. Also, all unreliable packets are always sent in one conneciton event.
 	* If many connections exist with short connection intervals, the behaviour is not realistic as the amount of packets that are being sent should decrease.
 	* There is also no probability of failure and the buffer is always emptied
 	*/
 
-	if (blockConnections) return;
-
 	//Simulate sending data for each connection individually
 	for (int i = 0; i < currentNode->state.configuredTotalConnectionCount; i++) {
 		SoftdeviceConnection* connection = &currentNode->state.connections[i];
@@ -1547,17 +1943,7 @@ void CherrySim::SimulateConnections() {
 
 						//Generate the event that the write was successful immediately
 						//TODO: Could be postponed a bit to better match the real world
-						simBleEvent s2;
-						s2.globalId = simState.globalEventIdCounter++;
-						s2.bleEvent.header.evt_id = BLE_GATTC_EVT_WRITE_RSP;
-						s2.bleEvent.header.evt_len = s2.globalId;
-						s2.bleEvent.evt.gattc_evt.conn_handle = connection->connectionHandle;
-						s2.bleEvent.evt.gattc_evt.gatt_status = (u16)FruityHal::BleGattEror::SUCCESS;
-						//Save the global packet id so that we can track where a packet was generated after we receive it
-						s2.additionalInfo = packet->globalPacketId;
-						currentNode->eventQueue.push_back(s2);
-
-
+						SendWriteResponseEvent(currentNode, connection->connectionHandle, packet->globalPacketId);
 
 						//Do not send any more packets this connectionEvent as we need to wait for an ACK
 						break;
@@ -1572,36 +1958,192 @@ void CherrySim::SimulateConnections() {
 			}
 		}
 	}
+}
 
-	// Simulate Connection RSSI measurements
-	for (int i = 0; i < currentNode->state.configuredTotalConnectionCount; i++) {
-		if (SHOULD_SIM_IV_TRIGGER(5000)) {
-			SoftdeviceConnection* connection = &currentNode->state.connections[i];
-			if (connection->connectionActive && connection->rssiMeasurementActive) {
-				nodeEntry* master = i == 0 ? connection->partner : currentNode;
-				nodeEntry* slave = i == 0 ? currentNode : connection->partner;
-
-				simBleEvent s;
-				s.globalId = simState.globalEventIdCounter++;
-				s.bleEvent.header.evt_id = BLE_GAP_EVT_RSSI_CHANGED;
-				s.bleEvent.header.evt_len = s.globalId;
-				s.bleEvent.evt.gap_evt.conn_handle = connection->connectionHandle;
-				s.bleEvent.evt.gap_evt.params.rssi_changed.rssi = (i8)GetReceptionRssi(master, slave);
+//Returns the time that a link layer PDU with the given payload occupies the radio
+static u32 GetPduAirtimeUs(u32 payloadBytes, bool encrypted)
+{
+	u32 bytes = SIM_LL_PDU_OVERHEAD_BYTES + payloadBytes;
+	if (encrypted && payloadBytes > 0) bytes += SIM_LL_MIC_BYTES;
+	return bytes * SIM_LL_US_PER_BYTE;
+}
 
-				currentNode->eventQueue.push_back(s);
-			}
+//The SimulateConnections interval field is in ms, 7 is used for the 7.5ms interval
+static u32 GetConnectionIntervalUs(const SoftdeviceConnection* connection)
+{
+	if (connection->connectionInterval == 7) return 7500;
+	return (u32)connection->connectionInterval * 1000;
+}
+
+/*
+* Each connection has its own timeline of connection events that is derived from its interval. All connection events
+* of a node, no matter if central or peripheral, share the radio of the node with its advertising. If the events of a step
+* do not fit on the timeline, a part of them is missed. A free radio extends the connection events up to the interval.
+* Scanning only uses the time that is left over as the SoftDevice schedules it with a lower priority.
+*
+* In each connection event, the sender transmits its packets fragmented into link layer PDUs. Each PDU is answered by the
+* partner with an empty PDU. Both directions are simulated from the side of the sender, so that traffic in both
+* directions at the same time is slightly optimistic. PDUs are lost depending on the reception probability and retransmitted.
+* WRITE_REQs are answered with a WRITE_RSP in the following connection event.
+* If only the acknowledgement of the last fragment is lost, the partner has already received the packet. The connection event
+* is closed and the packet stays in the buffer until it is acknowledged, if the connection is lost in between, it was delivered
+* without the sender knowing.
+*/
+void CherrySim::SimulateConnectionEventsAirtime() {
+	SoftdeviceState& state = currentNode->state;
+	const uint64_t stepUs = (uint64_t)simConfig.simTickDurationMs * 1000;
+	const uint64_t stepEndUs = (uint64_t)state.timeMs * 1000;
+
+	//Radio time that is available for connection events during this step
+	double radioUs = (double)stepUs;
+	if (state.advertisingActive && state.advertisingIntervalMs > 0) {
+		radioUs -= (double)stepUs * SIM_ADVERTISING_EVENT_US / (state.advertisingIntervalMs * 1000.0);
+	}
+	if (radioUs < 0) radioUs = 0;
+
+	//Time that all connection events of this step would need with their configured length
+	u32 numConnectionEvents = 0;
+	double demandUs = 0;
+	for (int i = 0; i < state.configuredTotalConnectionCount; i++) {
+		SoftdeviceConnection* connection = &state.connections[i];
+		if (!connection->connectionActive) continue;
+		const u32 intervalUs = GetConnectionIntervalUs(connection);
+		if (intervalUs == 0) continue;
+		for (uint64_t t = connection->linkLayer.nextConnectionEventUs; t < stepEndUs; t += intervalUs) {
+			numConnectionEvents++;
+			demandUs += simConfig.connectionEventLengthUs < intervalUs ? simConfig.connectionEventLengthUs : intervalUs;
 		}
 	}
 
-	//Simulate Connection Loss every second
-	if (simConfig.connectionTimeoutProbabilityPerSec != 0) {
-		for (int i = 0; i < currentNode->state.configuredTotalConnectionCount; i++) {
-			if (currentNode->state.connections[i].connectionActive) {
-				if (PSRNG() < simConfig.connectionTimeoutProbabilityPerSec) {
-					SIMSTATCOUNT("simulatedTimeouts");
-					printf("Simulated Connection Loss for node %d to partner %d (handle %d)" EOL, currentNode->id, currentNode->state.connections[i].partner->id, currentNode->state.connections[i].connectionHandle);
-					DisconnectSimulatorConnection(&currentNode->state.connections[i], BLE_HCI_CONNECTION_TIMEOUT, BLE_HCI_CONNECTION_TIMEOUT);
+	state.connectionEventShare = demandUs > radioUs ? radioUs / demandUs : 1.0;
+	const double extensionUs = (demandUs < radioUs && numConnectionEvents > 0) ? (radioUs - demandUs) / numConnectionEvents : 0;
+
+	for (int i = 0; i < state.configuredTotalConnectionCount; i++) {
+		SoftdeviceConnection* connection = &state.connections[i];
+		if (!connection->connectionActive) continue;
+		SimLinkLayerState& ll = connection->linkLayer;
+		const u32 intervalUs = GetConnectionIntervalUs(connection);
+		if (intervalUs == 0) continue;
+
+		const double receptionProbability = calculateReceptionProbability(connection->owningNode, connection->partner);
+		//The partner must also have time for the connection event on its own timeline
+		const double eventProbability = state.connectionEventShare * connection->partner->state.connectionEventShare;
+		double eventLengthUs = simConfig.connectionEventLengthUs + extensionUs;
+		if (eventLengthUs > intervalUs) eventLengthUs = intervalUs;
+		const u32 emptyExchangeUs = 2 * GetPduAirtimeUs(0, false) + 2 * SIM_LL_T_IFS_US;
+
+		for (; ll.nextConnectionEventUs < stepEndUs; ll.nextConnectionEventUs += intervalUs) {
+			ll.connectionEvents++;
+			if (PSRNG() >= eventProbability) {
+				ll.missedConnectionEvents++;
+				continue;
+			}
+
+			double elapsedUs = 0;
+			bool eventSynced = false;
+			u32 unreliablePacketsSent = 0;
+
+			//The partner answers a WRITE_REQ from the last connection event
+			if (ll.writeResponsePending) {
+				elapsedUs += emptyExchangeUs;
+				if (PSRNG() < receptionProbability) {
+					eventSynced = true;
+					ll.writeResponsePending = false;
+					SendWriteResponseEvent(currentNode, connection->connectionHandle, ll.writeResponseGlobalPacketId);
+				}
+			}
+
+			while (!ll.writeResponsePending) {
+				SoftDeviceBufferedPacket* packet = getNextPacketToWrite(connection);
+				//Without data, the connection event only consists of one empty exchange to keep the connection alive
+				if (packet == nullptr) {
+					if (elapsedUs == 0) {
+						elapsedUs += emptyExchangeUs;
+						if (PSRNG() < receptionProbability) eventSynced = true;
+					}
+					break;
+				}
+
+				const u32 dataLength = packet->isHvx ? (u32)packet->params.hvxParams.p_len : packet->params.writeParams.len;
+				const u32 numFragments = (dataLength + SIM_LL_L2CAP_ATT_HEADER_BYTES + SIM_LL_MAX_PAYLOAD_BYTES - 1) / SIM_LL_MAX_PAYLOAD_BYTES;
+				if (ll.currentPacketGlobalId != packet->globalPacketId) {
+					ll.currentPacketGlobalId = packet->globalPacketId;
+					ll.currentPacketFragmentsSent = 0;
+					ll.currentPacketDelivered = false;
+				}
+
+				//Send the fragments of the packet for as long as the connection event lasts
+				bool eventOver = false;
+				while (ll.currentPacketFragmentsSent < numFragments) {
+					const u32 fragmentBytes = ll.currentPacketFragmentsSent + 1 < numFragments
+						? SIM_LL_MAX_PAYLOAD_BYTES
+						: dataLength + SIM_LL_L2CAP_ATT_HEADER_BYTES - (numFragments - 1) * SIM_LL_MAX_PAYLOAD_BYTES;
+					const u32 exchangeUs = GetPduAirtimeUs(fragmentBytes, connection->connectionEncrypted) + GetPduAirtimeUs(0, connection->connectionEncrypted) + 2 * SIM_LL_T_IFS_US;
+					if (elapsedUs + exchangeUs > eventLengthUs) {
+						eventOver = true;
+						break;
+					}
+					elapsedUs += exchangeUs;
+					if (PSRNG() < receptionProbability) {
+						eventSynced = true;
+						ll.currentPacketFragmentsSent++;
+					}
+					else {
+						ll.retransmissions++;
+
+						//Given that the exchange failed, the data was received and only the acknowledgement was lost with p / (1 + p)
+						if (ll.currentPacketFragmentsSent + 1 == numFragments && !ll.currentPacketDelivered && PSRNG() < receptionProbability / (1 + receptionProbability)) {
+							ll.currentPacketDelivered = true;
+							if (packet->isHvx) GenerateNotification(packet);
+							else GenerateWrite(packet);
+
+							//The master closes the connection event if it does not receive a response
+							eventOver = true;
+							break;
+						}
+					}
+				}
+				if (eventOver) break;
+
+				//All fragments were acknowledged, the packet was received by the partner
+				ll.payloadBytesSent += dataLength;
+				ll.currentPacketGlobalId = 0;
+				const bool alreadyDelivered = ll.currentPacketDelivered;
+				ll.currentPacketDelivered = false;
+				if (packet->isHvx) {
+					if (!alreadyDelivered) GenerateNotification(packet);
+					packet->sender = nullptr;
+					unreliablePacketsSent++;
 				}
+				else if (packet->params.writeParams.write_op == BLE_GATT_OP_WRITE_CMD) {
+					if (!alreadyDelivered) GenerateWrite(packet);
+					packet->sender = nullptr;
+					unreliablePacketsSent++;
+				}
+				else if (packet->params.writeParams.write_op == BLE_GATT_OP_WRITE_REQ) {
+					SendUnreliableTxCompleteEvent(currentNode, connection->connectionHandle, unreliablePacketsSent);
+					unreliablePacketsSent = 0;
+
+					if (!alreadyDelivered) GenerateWrite(packet);
+					ll.writeResponsePending = true;
+					ll.writeResponseGlobalPacketId = packet->globalPacketId;
+					packet->sender = nullptr;
+				}
+				else {
+					SIMEXCEPTION(IllegalArgumentException);
+				}
+			}
+
+			SendUnreliableTxCompleteEvent(currentNode, connection->connectionHandle, unreliablePacketsSent);
+
+			const u32 eventTimeMs = (u32)(ll.nextConnectionEventUs / 1000);
+			if (eventSynced) {
+				ll.lastSuccessfulExchangeMs = eventTimeMs;
+			}
+			//The connection is lost if no PDU could be exchanged for the supervision timeout
+			else if (eventTimeMs - ll.lastSuccessfulExchangeMs > UNITS_TO_MSEC(Conf::meshConnectionSupervisionTimeout, UNIT_10_MS)) {
+				DisconnectSimulatorConnection(connection, BLE_HCI_CONNECTION_TIMEOUT, BLE_HCI_CONNECTION_TIMEOUT);
+				break;
 			}
 		}
 	}
@@ -1630,6 +2172,7 @@ void CherrySim::GenerateWrite(SoftDeviceBufferedPacket* bufferedPacket) {
 	}
 
 	cherrySimInstance->PacketHandler(sender->id, receiver->id, p_write_params.p_value, p_write_params.len);
+	AddEnergyCharge(sender, EnergyCategory::CONNECTION_EVENTS, GetEnergyProfileOfCurrentNode().radioChargePerPayloadByteNc * p_write_params.len);
 
 	//Generate WRITE event at our partners side
 	simBleEvent s;
@@ -1693,6 +2236,7 @@ void CherrySim::GenerateNotification(SoftDeviceBufferedPacket* bufferedPacket) {
 
 	// This is a workaround for hvxParams keeping only pointer to len.
 	cherrySimInstance->PacketHandler(sender->id, receiver->id, hvx_params.p_data, (u32)hvx_params.p_len);
+	AddEnergyCharge(sender, EnergyCategory::CONNECTION_EVENTS, GetEnergyProfileOfCurrentNode().radioChargePerPayloadByteNc * (u32)hvx_params.p_len);
 
 	//Generate HVX event at our partners side
 	simBleEvent s;
@@ -1723,6 +2267,17 @@ void CherrySim::PacketHandler(u32 senderId, u32 receiverId, u8* data, u32 dataLe
 			connPacketModule* modPacket = (connPacketModule*)packet;
 			break;
 		}
+	case MessageType::CLUSTER_WELCOME:
+	case MessageType::CLUSTER_ACK_1:
+	case MessageType::CLUSTER_ACK_2:
+	case MessageType::CLUSTER_INFO_UPDATE:
+	case MessageType::RECONNECT:
+		{
+			//Handshakes and cluster updates change the clusters of both nodes, so the validity check must look at them again
+			findNodeById(senderId)->state.validityNeedsRecheck = true;
+			findNodeById(receiverId)->state.validityNeedsRecheck = true;
+			break;
+		}
 	}
 }
 
@@ -1808,100 +2363,186 @@ void CherrySim::SimulateClcData() {
 // Checks the features that are activated on a node and estimates the battery usage
 //#########################################################################################
 
+//Interpolates linearly over the frequency of the activity between the two closest points. Outside of the
+//curve, the charge per activity of the closest point is used so that the current scales with the frequency.
+double EnergyProfile::GetCurrentForInterval(const std::vector<EnergyCurvePoint>& curve, u32 intervalMs)
+{
+	if (curve.empty() || intervalMs == 0) return 0;
+
+	const EnergyCurvePoint* lower = nullptr; //Closest point with a smaller interval
+	const EnergyCurvePoint* upper = nullptr; //Closest point with a bigger interval
+	for (const EnergyCurvePoint& point : curve) {
+		if (point.intervalMs == intervalMs) return point.currentUa;
+		if (point.intervalMs < intervalMs && (lower == nullptr || point.intervalMs > lower->intervalMs)) lower = &point;
+		if (point.intervalMs > intervalMs && (upper == nullptr || point.intervalMs < upper->intervalMs)) upper = &point;
+	}
+
+	if (lower == nullptr) return upper->currentUa * upper->intervalMs / intervalMs;
+	if (upper == nullptr) return lower->currentUa * lower->intervalMs / intervalMs;
+
+	const double frequency = 1.0 / intervalMs;
+	const double lowerFrequency = 1.0 / upper->intervalMs;
+	const double upperFrequency = 1.0 / lower->intervalMs;
+	const double t = (frequency - lowerFrequency) / (upperFrequency - lowerFrequency);
+	return upper->currentUa + t * (lower->currentUa - upper->currentUa);
+}
+
+static std::vector<EnergyCurvePoint> ParseEnergyCurve(const json& curveJson)
+{
+	std::vector<EnergyCurvePoint> curve;
+	for (const json& point : curveJson) {
+		curve.push_back({ point["intervalMs"].get<u32>(), point["currentUa"].get<double>() });
+	}
+	return curve;
+}
+
+//Loads the energy profiles for all chipsets that are given in the json file, values that are missing are taken from the built in profile
+void CherrySim::LoadEnergyProfiles(const char* path)
+{
+	std::ifstream energyJsonStream(path);
+	if (!energyJsonStream) {
+		printf("Could not open energy profiles %s" EOL, path);
+		SIMEXCEPTION(IllegalArgumentException);
+		return;
+	}
+	json energyJson;
+	energyJsonStream >> energyJson;
+
+	const std::pair<const char*, Chipset> chipsets[] = {
+		{ "nrf51", Chipset::CHIP_NRF51 },
+		{ "nrf52", Chipset::CHIP_NRF52 },
+		{ "nrf52840", Chipset::CHIP_NRF52840 },
+	};
+
+	energyProfiles.clear();
+	for (const auto& chipset : chipsets) {
+		if (energyJson.find(chipset.first) == energyJson.end()) continue;
+		const json& profileJson = energyJson[chipset.first];
+		EnergyProfile profile;
+		profile.idleCurrentUa               = profileJson.value("idleCurrentUa", profile.idleCurrentUa);
+		profile.ledCurrentUa                = profileJson.value("ledCurrentUa", profile.ledCurrentUa);
+		profile.scanCurrentUa               = profileJson.value("scanCurrentUa", profile.scanCurrentUa);
+		profile.radioChargePerPayloadByteNc = profileJson.value("radioChargePerPayloadByteNc", profile.radioChargePerPayloadByteNc);
+		profile.flashPageEraseChargeNc      = profileJson.value("flashPageEraseChargeNc", profile.flashPageEraseChargeNc);
+		profile.flashWriteChargePerWordNc   = profileJson.value("flashWriteChargePerWordNc", profile.flashWriteChargePerWordNc);
+		profile.cpuChargePerEventNc         = profileJson.value("cpuChargePerEventNc", profile.cpuChargePerEventNc);
+		if (profileJson.find("advertisingCurve") != profileJson.end()) profile.advertisingCurve = ParseEnergyCurve(profileJson["advertisingCurve"]);
+		if (profileJson.find("connectionCurve") != profileJson.end()) profile.connectionCurve = ParseEnergyCurve(profileJson["connectionCurve"]);
+		energyProfiles[chipset.second] = profile;
+	}
+}
+
+const EnergyProfile& CherrySim::GetEnergyProfileOfCurrentNode()
+{
+	auto it = energyProfiles.find(GET_CHIPSET());
+	if (it == energyProfiles.end()) return defaultEnergyProfile;
+	return it->second;
+}
+
+void CherrySim::AddEnergyCharge(nodeEntry* node, EnergyCategory category, double chargeNc)
+{
+	node->energy.chargeNc[(u32)category] += chargeNc;
+	//Saturate instead of overflowing the cast for very long simulations
+	const double totalChargeNc = node->energy.GetTotalChargeNc();
+	node->nanoAmperePerMsTotal = totalChargeNc < (double)UINT32_MAX ? (u32)totalChargeNc : UINT32_MAX;
+}
+
+//The radio-on time of a scan is split among the scan jobs that currently need it. The duty cycle that all jobs
+//need is shared by all of them, the part that only the more demanding jobs need is only shared among those.
+//This way, a job that forces a high duty cycle on the node is charged for it instead of the others.
+void CherrySim::AttributeScanRadioOnTime(nodeEntry* node, double radioOnMs)
+{
+	ScanController& scanController = node->gs.scanController;
+	std::pair<double, ModuleId> dutyCycles[SCAN_CONTROLLER_JOBS_MAX];
+	u32 numDutyCycles = 0;
+	for (int i = 0; i < scanController.GetAmountOfJobs() && numDutyCycles < SCAN_CONTROLLER_JOBS_MAX; i++) {
+		const ScanJob* job = scanController.GetJob(i);
+		if (!scanController.IsJobScanning(*job)) continue;
+		dutyCycles[numDutyCycles] = std::make_pair((double)job->window / job->interval, job->owner);
+		numDutyCycles++;
+	}
+	if (numDutyCycles == 0) return;
+
+	std::sort(dutyCycles, dutyCycles + numDutyCycles);
+	const double maxDutyCycle = dutyCycles[numDutyCycles - 1].first;
+	if (maxDutyCycle <= 0) return;
+
+	double previousDutyCycle = 0;
+	double dutyCycleShare = 0;
+	for (u32 i = 0; i < numDutyCycles; i++) {
+		dutyCycleShare += (dutyCycles[i].first - previousDutyCycle) / (numDutyCycles - i);
+		previousDutyCycle = dutyCycles[i].first;
+		node->energy.scanRadioOnMsByOwner[dutyCycles[i].second] += radioOnMs * dutyCycleShare / maxDutyCycle;
+	}
+}
+
 void CherrySim::simulateBatteryUsage()
 {
 	//Have a look at: https://devzone.nordicsemi.com/b/blog/posts/nrf51-current-consumption-for-common-scenarios
 	//or: https://github.com/mwaylabs/fruitymesh/wiki/Battery-Consumption
 
-	//TODO: Make measurements and check online resources to find out current consumption
-	//TODO: provide values for nrf51 and nrf52
 	//TODO: Take into account what changes at 0 dbm and at +4dmb
-	//TODO: Take into account that each sent packet consumes power in addition to the connectionInterval itself
 	//TODO: If too much activity happens at the same time, the scheduler will postpone tasks and use less energy (also relevant for connection / advertising, etc,... performance)
 
-	u32 divider = 1000UL / simConfig.simTickDurationMs;
-
-	//All current usages are given as nano ampere per step
-	u32 idleDraw = 10 * 1000 / divider; //10 uA idle current usage
-	u32 ledUsage = 10 * 1000 * 1000 / divider; //10 mA led on usage
-	u32 adv20Ms = 800 * 1000 / divider; //imaginary value for 20ms advertising
-	u32 adv100Ms = 220 * 1000 / divider; //220 uA advertising at 100ms interval
-	u32 adv200Ms = 110 * 1000 / divider; //110 uA advertising at 200ms interval
-	u32 adv400Ms = 84 * 1000 / divider; //84 uA advertising at 400ms interval
-	u32 adv1000Ms = 70 * 1000 / divider; //70 uA advertising at 1000ms interval
-	u32 adv2000Ms = 50 * 1000 / divider; //50 uA advertising at 2000ms interval
-	u32 adv4000Ms = 63 * 1000 / divider; //63 uA advertising at 4000ms interval
-	u32 adv30000Ms = 30 * 1000 / divider; //30 uA advertising at 30000ms interval
-	u32 conn100Ms = 130 * 1000 / divider; //70 uA per connection at 100ms interval
-	u32 conn7_5Ms = 1000 * 1000 / divider; //1000 uA per connection at 7.5ms interval (imaginary value)
-	u32 conn10Ms = 900 * 1000 / divider; //900 uA per connection at 10ms interval (imaginary value)
-	u32 conn15Ms = 750 * 1000 / divider; //750 uA per connection at 15ms interval (imaginary value)
-	u32 conn30Ms = 600 * 1000 / divider; //600 uA per connection at 30ms interval (imaginary value)
+	//Periodic activities are given as an average current, a current in uA over a step in ms is a charge in nC
+	const EnergyProfile& profile = GetEnergyProfileOfCurrentNode();
+	const double stepMs = simConfig.simTickDurationMs;
+	const SoftdeviceState& state = currentNode->state;
 
-	//Other values
-	u32 scanUsage = 11 * 1000 * 1000 / divider; //11mA for scanning at 100% duty cycle
-
-
-	//Next, we add up all the numbers for all active features
-	currentNode->nanoAmperePerMsTotal += idleDraw;
+	AddEnergyCharge(currentNode, EnergyCategory::IDLE, profile.idleCurrentUa * stepMs);
 
 	if (currentNode->ledOn) {
-		currentNode->nanoAmperePerMsTotal += ledUsage;
+		AddEnergyCharge(currentNode, EnergyCategory::LED, profile.ledCurrentUa * stepMs);
 	}
 
-	if (currentNode->state.advertisingActive) {
-		if (currentNode->state.advertisingIntervalMs == 20) currentNode->nanoAmperePerMsTotal += adv20Ms;
-		else if (currentNode->state.advertisingIntervalMs == 100) currentNode->nanoAmperePerMsTotal += adv100Ms;
-		else if (currentNode->state.advertisingIntervalMs == 200) currentNode->nanoAmperePerMsTotal += adv200Ms;
-		else if (currentNode->state.advertisingIntervalMs == 400) currentNode->nanoAmperePerMsTotal += adv400Ms;
-		else if (currentNode->state.advertisingIntervalMs == 1000) currentNode->nanoAmperePerMsTotal += adv1000Ms;
-		else if (currentNode->state.advertisingIntervalMs == 4000) currentNode->nanoAmperePerMsTotal += adv4000Ms;
-		else if (currentNode->state.advertisingIntervalMs == 2000) currentNode->nanoAmperePerMsTotal += adv2000Ms;
-		else if (currentNode->state.advertisingIntervalMs == 30000) currentNode->nanoAmperePerMsTotal += adv30000Ms;
-		else {
-			printf("Adv interval not integrated into battery test, %u" EOL, (u32)currentNode->state.advertisingIntervalMs);
-			SIMEXCEPTION(IllegalAdvertismentStateException);
-		}
+	if (state.advertisingActive) {
+		AddEnergyCharge(currentNode, EnergyCategory::ADVERTISING, EnergyProfile::GetCurrentForInterval(profile.advertisingCurve, state.advertisingIntervalMs) * stepMs);
 	}
 
-	if (currentNode->state.scanningActive) {
-		u32 scanDutyCycle = currentNode->state.scanWindowMs * 1000UL / currentNode->state.scanIntervalMs;
-		u32 usagePerStepWithGivenDutyCycle = scanUsage * scanDutyCycle / 1000;
-		currentNode->nanoAmperePerMsTotal += usagePerStepWithGivenDutyCycle;
+	if (state.scanningActive && state.scanIntervalMs > 0) {
+		const double scanDutyCycle = (double)state.scanWindowMs / state.scanIntervalMs;
+		AddEnergyCharge(currentNode, EnergyCategory::SCANNING, profile.scanCurrentUa * scanDutyCycle * stepMs);
+		AttributeScanRadioOnTime(currentNode, scanDutyCycle * stepMs);
 	}
 
-	if (currentNode->state.connectingActive) {
-		u32 scanDutyCycle = currentNode->state.connectingWindowMs * 1000UL / currentNode->state.connectingIntervalMs;
-		u32 usagePerStepWithGivenDutyCycle = scanUsage * scanDutyCycle / 1000;
-		currentNode->nanoAmperePerMsTotal += usagePerStepWithGivenDutyCycle;
+	if (state.connectingActive && state.connectingIntervalMs > 0) {
+		const double scanDutyCycle = (double)state.connectingWindowMs / state.connectingIntervalMs;
+		AddEnergyCharge(currentNode, EnergyCategory::SCANNING, profile.scanCurrentUa * scanDutyCycle * stepMs);
 	}
 
-	for (u32 i = 0; i < currentNode->state.configuredTotalConnectionCount; i++) {
-		SoftdeviceConnection* conn = currentNode->state.connections + i;
+	for (u32 i = 0; i < state.configuredTotalConnectionCount; i++) {
+		const SoftdeviceConnection* conn = state.connections + i;
 		if (conn->connectionActive) {
-			if (conn->connectionInterval == 100) {
-				currentNode->nanoAmperePerMsTotal += conn100Ms;
-			}
-			else if (conn->connectionInterval == 7) {
-				currentNode->nanoAmperePerMsTotal += conn7_5Ms;
-			}
-			else if (conn->connectionInterval == 10) {
-				currentNode->nanoAmperePerMsTotal += conn10Ms;
-			}
-			else if (conn->connectionInterval == 15) {
-				currentNode->nanoAmperePerMsTotal += conn15Ms;
-			}
-			else if (conn->connectionInterval == 30) {
-				currentNode->nanoAmperePerMsTotal += conn30Ms;
-			}
-			else {
-				printf("Conn interval not integrated into battery test" EOL);
-				SIMEXCEPTION(IllegalStateException);
-			}
+			AddEnergyCharge(currentNode, EnergyCategory::CONNECTION_EVENTS, EnergyProfile::GetCurrentForInterval(profile.connectionCurve, conn->connectionInterval) * stepMs);
 		}
 	}
+}
 
-	//TODO: Add up current for connections according to connectionIntervals of each connection
+void CherrySim::PrintEnergyStats(NodeId nodeId)
+{
+	static const char* categoryNames[] = { "idle", "led", "advertising", "scanning", "connection events", "flash", "cpu" };
+	static_assert(sizeof(categoryNames) / sizeof(categoryNames[0]) == (u32)EnergyCategory::NUM_CATEGORIES, "Missing category name");
+
+	printf(">----------------------------------------------------<" EOL);
+	printf("Average current in uA over %u ms" EOL, simState.simTimeMs);
+	printf("" EOL);
+	for (u32 i = 0; i < getNumNodes(); i++) {
+		const nodeEntry* node = nodes + i;
+		if (nodeId != 0 && node->id != nodeId) continue;
+		printf("node %d :: total %.1f", node->id, node->energy.GetAverageCurrentUa(simState.simTimeMs));
+		for (u32 k = 0; k < (u32)EnergyCategory::NUM_CATEGORIES; k++) {
+			printf(", %s %.1f", categoryNames[k], node->energy.GetAverageCurrentUa((EnergyCategory)k, simState.simTimeMs));
+		}
+		printf(EOL);
+		if (!node->energy.scanRadioOnMsByOwner.empty()) {
+			printf("node %d :: scan radio on in ms", node->id);
+			for (auto const& entry : node->energy.scanRadioOnMsByOwner) {
+				printf(", module %u %.0f", (u32)entry.first, entry.second);
+			}
+			printf(EOL);
+		}
+	}
+	printf(">----------------------------------------------------<" EOL);
 }
 
 //################################## Other Simulation #####################################
@@ -1936,6 +2577,41 @@ void CherrySim::simulateWatchDog()
 // This section contains methods that check the meshing for validity
 //#########################################################################################
 
+typedef struct MeshConnectionBond
+{
+	MeshConnection* startConnection;
+	MeshConnection* partnerConnection;
+} MeshConnectionBond;
+
+//This method is used for determining the two MeshConnections that link two nodes
+//the connections will only be returned if they are handshaked
+MeshConnectionBond findBond(nodeEntry* startNode, nodeEntry* partnerNode)
+{
+	//TODO: This currently uses nodeIds for matching, but should use something more safe that cannot change
+
+	if (startNode == nullptr || partnerNode == nullptr) SIMEXCEPTION(IllegalStateException);
+
+	MeshConnectionBond bond = { nullptr, nullptr };
+
+	//Find the connection on the startNode
+	MeshConnections conns = startNode->gs.cm.GetMeshConnections(ConnectionDirection::INVALID);
+	for (int i = 0; i < conns.count; i++) {
+		if (conns.connections[i]->handshakeDone() && conns.connections[i]->partnerId == partnerNode->id) {
+			bond.startConnection = conns.connections[i];
+		}
+	}
+
+	//Find the connection on the partnerNode
+	MeshConnections partnerConns = partnerNode->gs.cm.GetMeshConnections(ConnectionDirection::INVALID);
+	for (int i = 0; i < partnerConns.count; i++) {
+		if (partnerConns.connections[i]->handshakeDone() && partnerConns.connections[i]->partnerId == startNode->id) {
+			bond.partnerConnection = partnerConns.connections[i];
+		}
+	}
+
+	return bond;
+}
+
 //This method can be used to check the clustering for potential errors after each simulation step
 //Once a clustering error occurs, simply enable checking through the simConfig. Whenever a potential
 //clustering issue occurs, it will print a warning and break in the debugger. It might however generate
@@ -1953,11 +2629,93 @@ void CherrySim::simulateWatchDog()
 //      a MeshConnection while the other still thinks it is in the Handshaked state. In these cases, the MeshConnectionBond
 //      will not have a partnerConnection. It is however quite complicated to predict how the partner will react on the lost
 //      connection, but this would allow us to run the check for all clusterings in the automated test.
-void CherrySim::CheckMeshingConsistency()
+u32 CherrySim::CheckMeshingConsistency(bool fullCheck)
 {
+	const u32 numNodes = simConfig.numNodes;
+
+	//Only clusters with a node that changed since the last check are validated again. Handshakes, cluster updates
+	//and disconnects flag the nodes involved and the signature catches cluster changes that the simulator does not see,
+	//e.g. a MeshConnection that is removed by a timer. Packets moving through the queues do not change the prediction
+	//of an unchanged cluster, so mesh traffic does not cause the cluster to be validated again.
+	if (!meshingConsistencyChecked) fullCheck = true;
+	meshingConsistencyChecked = true;
+
+	std::vector<bool> nodeChanged(numNodes, false);
+	for (u32 i = 0; i < numNodes; i++)
+	{
+		u32 signature = GetMeshingConsistencySignature(nodes + i);
+		nodeChanged[i] = fullCheck || nodes[i].state.validityNeedsRecheck || signature != nodes[i].state.validitySignature;
+		nodes[i].state.validitySignature = signature;
+	}
+
+	//Group the nodes into clusters along their handshaked MeshConnections (union find)
+	std::vector<u32> clusterRoot(numNodes);
+	for (u32 i = 0; i < numNodes; i++) clusterRoot[i] = i;
+	auto findRoot = [&clusterRoot](u32 index) {
+		while (clusterRoot[index] != index) {
+			clusterRoot[index] = clusterRoot[clusterRoot[index]];
+			index = clusterRoot[index];
+		}
+		return index;
+	};
+
+	//A cluster is symmetric if every handshaked MeshConnection has exactly one counterpart on the partner. The cluster
+	//size is then the same from every node so it must only be determined once, otherwise every node is checked on its own
+	std::vector<bool> clusterSymmetric(numNodes, true);
+	for (u32 i = 0; i < numNodes; i++)
+	{
+		nodeEntry* node = nodes + i;
+		MeshConnections conns = node->gs.cm.GetMeshConnections(ConnectionDirection::INVALID);
+		for (u32 k = 0; k < conns.count; k++) {
+			if (!conns.connections[k]->handshakeDone()) continue;
+			nodeEntry* partner = findNodeById(conns.connections[k]->partnerId);
+			if (partner == nullptr) {
+				clusterSymmetric[i] = false;
+				continue;
+			}
+			u32 a = findRoot(i);
+			u32 b = findRoot((u32)(partner - nodes));
+			if (a != b) {
+				clusterRoot[b] = a;
+				clusterSymmetric[a] = clusterSymmetric[a] && clusterSymmetric[b];
+			}
+		}
+	}
+	std::vector<u32> clusterNodeCount(numNodes, 0);
+	std::vector<bool> clusterChanged(numNodes, false);
+	for (u32 i = 0; i < numNodes; i++)
+	{
+		u32 root = findRoot(i);
+		clusterNodeCount[root]++;
+		if (nodeChanged[i]) clusterChanged[root] = true;
+		if (!clusterSymmetric[i]) clusterSymmetric[root] = false;
+
+		MeshConnections conns = nodes[i].gs.cm.GetMeshConnections(ConnectionDirection::INVALID);
+		for (u32 k = 0; k < conns.count; k++) {
+			if (!conns.connections[k]->handshakeDone()) continue;
+			nodeEntry* partner = findNodeById(conns.connections[k]->partnerId);
+			if (partner == nullptr) continue;
+			MeshConnectionBond bond = findBond(nodes + i, partner);
+			u32 numConnsToPartner = 0;
+			for (u32 m = 0; m < conns.count; m++) {
+				if (conns.connections[m]->handshakeDone() && conns.connections[m]->partnerId == partner->id) numConnsToPartner++;
+			}
+			if (bond.partnerConnection == nullptr || numConnsToPartner != 1) clusterSymmetric[root] = false;
+		}
+	}
+
+	std::vector<bool> checkNode(numNodes, false);
+	meshingConsistencyCheckedNodes = 0;
+	for (u32 i = 0; i < numNodes; i++) {
+		checkNode[i] = clusterChanged[findRoot(i)];
+		if (checkNode[i]) meshingConsistencyCheckedNodes++;
+	}
+
 	//Reset all validity information
-	for (u32 i = 0; i < simConfig.numNodes; i++)
+	for (u32 i = 0; i < numNodes; i++)
 	{
+		if (!checkNode[i]) continue;
+
 		nodes[i].state.validityClusterSize = 0;
 
 		for (u32 k = 0; k < currentNode->state.configuredTotalConnectionCount; k++) {
@@ -1966,16 +2724,20 @@ void CherrySim::CheckMeshingConsistency()
 	}
 
 	//Grab information from the current clusterSize
-	for (u32 i = 0; i < simConfig.numNodes; i++)
+	for (u32 i = 0; i < numNodes; i++)
 	{
+		if (!checkNode[i]) continue;
+
 		nodes[i].state.validityClusterSize = nodes[i].gs.node.clusterSize;
 
 		//printf("NODE %u has clusterSize %d" EOL, nodes[i].id, nodes[i].gs.node.clusterSize);
 	}
 
 	//Grab information from the currentClusterInfoUpdatePacket
-	for (u32 i = 0; i < simConfig.numNodes; i++)
+	for (u32 i = 0; i < numNodes; i++)
 	{
+		if (!checkNode[i]) continue;
+
 		nodeEntry* node = nodes + i;
 
 		MeshConnections conns = node->gs.cm.GetMeshConnections(ConnectionDirection::INVALID);
@@ -1995,8 +2757,10 @@ void CherrySim::CheckMeshingConsistency()
 	}
 
 	//Grab information from the HighPrioQueue
-	for (u32 i = 0; i < simConfig.numNodes; i++)
+	for (u32 i = 0; i < numNodes; i++)
 	{
+		if (!checkNode[i]) continue;
+
 		nodeEntry* node = nodes + i;
 
 		MeshConnections conns = node->gs.cm.GetMeshConnections(ConnectionDirection::INVALID);
@@ -2036,8 +2800,10 @@ void CherrySim::CheckMeshingConsistency()
 
 	//Grab information from SoftDevice send buffers
 	//(Only reliable buffers as this is the place where cluster update packets are)
-	for (u32 i = 0; i < simConfig.numNodes; i++)
+	for (u32 i = 0; i < numNodes; i++)
 	{
+		if (!checkNode[i]) continue;
+
 		nodeEntry* node = nodes + i;
 
 		for (u32 k = 0; k < currentNode->state.configuredTotalConnectionCount; k++)
@@ -2073,13 +2839,15 @@ void CherrySim::CheckMeshingConsistency()
 	}
 
 	//Grab information from the SoftDevice event queue
-	for (u32 i = 0; i < simConfig.numNodes; i++)
+	for (u32 i = 0; i < numNodes; i++)
 	{
+		if (!checkNode[i]) continue;
+
 		nodeEntry* node = nodes + i;
 
 		for (u32 k = 0; k < node->eventQueue.size(); k++)
 		{
-			simBleEvent bleEvent = node->eventQueue[k];
+			simBleEvent& bleEvent = node->eventQueue[k];
 			if (bleEvent.bleEvent.header.evt_id == BLE_GATTS_EVT_WRITE) {
 				ble_gatts_evt_t* gattsEvt = (ble_gatts_evt_t*)&bleEvent.bleEvent.evt;
 
@@ -2109,61 +2877,112 @@ void CherrySim::CheckMeshingConsistency()
 	}
 
 	//Go through all nodes and its connections and recursively propagate the clusterUpdates
-	for (u32 i = 0; i < simConfig.numNodes; i++)
+	//A symmetric cluster is a tree whose updates are all collected with a single traversal from its root,
+	//otherwise the updates are propagated from every node of the cluster on its own
+	std::vector<i32> updatesOnPath(numNodes, 0);
+	std::vector<i32> updatesTowardsRoot(numNodes, 0);
+	for (u32 i = 0; i < numNodes; i++)
 	{
-		nodeEntry* node = nodes + i;
-		DetermineClusterSizeAndPropagateClusterUpdates(node, nullptr);
+		if (!checkNode[i]) continue;
 
+		nodeEntry* node = nodes + i;
+		u32 root = findRoot(i);
+		if (!clusterSymmetric[root]) {
+			DetermineClusterSizeAndPropagateClusterUpdates(node, nullptr);
+		}
+		else if (root == i) {
+			updatesTowardsRoot[root] = CollectClusterUpdates(node, nullptr, 0, updatesOnPath);
+		}
 	}
 
 	//For each cluster, calculate the totals for each node and check if they match with the clusterSize
-	for (u32 i = 0; i < simConfig.numNodes; i++)
+	//Nodes of unchanged clusters report the result of their last check
+	u32 numMismatches = 0;
+	for (u32 i = 0; i < numNodes; i++)
 	{
 		nodeEntry* node = nodes + i;
-		u32 realClusterSize = DetermineClusterSizeAndPropagateClusterUpdates(node, nullptr);
 
-		if (realClusterSize != node->state.validityClusterSize) {
-			printf("NODE %d has a real cluster size of %u and predicted size of %d, reported cluster size %d" EOL, node->id, realClusterSize, node->state.validityClusterSize, nodes[i].gs.node.clusterSize);
+		if (checkNode[i]) {
+			u32 root = findRoot(i);
+			if (clusterSymmetric[root]) {
+				//A node receives all updates flowing towards the root except those on its own path, which flow away from it
+				node->state.validityClusterSize += (i16)(updatesTowardsRoot[root] + updatesOnPath[i]);
+				node->state.validityRealClusterSize = clusterNodeCount[root];
+			}
+			else {
+				node->state.validityRealClusterSize = DetermineClusterSizeAndPropagateClusterUpdates(node, nullptr);
+			}
+			//Without a symmetric cluster, updates may be left over for the next check so it has to be repeated
+			node->state.validityNeedsRecheck = !clusterSymmetric[root];
+		}
+
+		if ((i32)node->state.validityRealClusterSize != node->state.validityClusterSize) {
+			numMismatches++;
+			printf("NODE %d has a real cluster size of %u and predicted size of %d, reported cluster size %d" EOL, node->id, node->state.validityRealClusterSize, node->state.validityClusterSize, nodes[i].gs.node.clusterSize);
 			printf("-------- POTENTIAL CLUSTERING MISMATCH -----------" EOL);
 			//std::cout << "Press Enter to Continue";
 			//std::cin.ignore();
 		}
 	}
+
+	return numMismatches;
 }
 
-typedef struct MeshConnectionBond
+//Hashes the cluster state of the given node, the packets in its queues are not part of it
+u32 CherrySim::GetMeshingConsistencySignature(nodeEntry* node)
 {
-	MeshConnection* startConnection;
-	MeshConnection* partnerConnection;
-} MeshConnectionBond;
+	u32 hash = 2166136261u;
+	auto add = [&hash](u32 value) {
+		hash = (hash ^ value) * 16777619u;
+	};
 
-//This method is used for determining the two MeshConnections that link two nodes
-//the connections will only be returned if they are handshaked
-MeshConnectionBond findBond(nodeEntry* startNode, nodeEntry* partnerNode)
+	add((u32)node->gs.node.clusterSize);
+
+	MeshConnections conns = node->gs.cm.GetMeshConnections(ConnectionDirection::INVALID);
+	add(conns.count);
+	for (u32 k = 0; k < conns.count; k++)
+	{
+		MeshConnection* conn = conns.connections[k];
+		add((u32)(uintptr_t)conn);
+		add(conn->handshakeDone());
+		add(conn->partnerId);
+		add(conn->connectionHandle);
+		add((u32)((connPacketClusterInfoUpdate*)&(conn->currentClusterInfoUpdatePacket))->payload.clusterSizeChange);
+	}
+
+	return hash;
+}
+
+//Collects and clears the updates pending on the connections of a symmetric cluster below the given node in a single traversal
+//An update sent towards a node reaches its whole subtree, an update sent towards its parent reaches all other nodes of the cluster
+//Stores the updates flowing away from the root minus those flowing towards it along the path of each node in updatesOnPath
+//and returns the sum of all updates flowing towards the root
+i32 CherrySim::CollectClusterUpdates(nodeEntry* node, nodeEntry* startNode, i32 pathUpdates, std::vector<i32>& updatesOnPath)
 {
-	//TODO: This currently uses nodeIds for matching, but should use something more safe that cannot change
+	updatesOnPath[node->index] = pathUpdates;
+	i32 updatesTowardsRoot = 0;
 
-	if (startNode == nullptr || partnerNode == nullptr) SIMEXCEPTION(IllegalStateException);
+	MeshConnections conns = node->gs.cm.GetMeshConnections(ConnectionDirection::INVALID);
+	for (int i = 0; i < conns.count; i++)
+	{
+		if (!conns.connections[i]->handshakeDone()) continue;
 
-	MeshConnectionBond bond = { nullptr, nullptr };
+		nodeEntry* nextPartner = findNodeById(conns.connections[i]->partnerId);
+		if (nextPartner == startNode) continue;
 
-	//Find the connection on the startNode
-	MeshConnections conns = startNode->gs.cm.GetMeshConnections(ConnectionDirection::INVALID);
-	for (int i = 0; i < conns.count; i++) {
-		if (conns.connections[i]->handshakeDone() && conns.connections[i]->partnerId == partnerNode->id) {
-			bond.startConnection = conns.connections[i];
-		}
-	}
+		MeshConnectionBond bond = findBond(node, nextPartner);
+		const i32 updatesAway = bond.startConnection->validityClusterUpdatesToSend + bond.partnerConnection->validityClusterUpdatesReceived;
+		const i32 updatesTowards = bond.partnerConnection->validityClusterUpdatesToSend + bond.startConnection->validityClusterUpdatesReceived;
+		bond.startConnection->validityClusterUpdatesToSend = 0;
+		bond.startConnection->validityClusterUpdatesReceived = 0;
+		bond.partnerConnection->validityClusterUpdatesToSend = 0;
+		bond.partnerConnection->validityClusterUpdatesReceived = 0;
 
-	//Find the connection on the partnerNode
-	MeshConnections partnerConns = partnerNode->gs.cm.GetMeshConnections(ConnectionDirection::INVALID);
-	for (int i = 0; i < partnerConns.count; i++) {
-		if (partnerConns.connections[i]->handshakeDone() && partnerConns.connections[i]->partnerId == startNode->id) {
-			bond.partnerConnection = partnerConns.connections[i];
-		}
+		updatesTowardsRoot += updatesTowards;
+		updatesTowardsRoot += CollectClusterUpdates(nextPartner, node, pathUpdates + updatesAway - updatesTowards, updatesOnPath);
 	}
 
-	return bond;
+	return updatesTowardsRoot;
 }
 
 //This will recursively go along all connections and add up the nodes in this cluster
@@ -2433,6 +3252,10 @@ SoftdeviceConnection* CherrySim::findConnectionByHandle(nodeEntry* node, int con
 }
 
 nodeEntry* CherrySim::findNodeById(int id) {
+	//Node ids are assigned in order during initialization, so the node can usually be accessed directly
+	if (id >= 1 && (u32)id <= getNumNodes() && nodes[id - 1].id == id) {
+		return &nodes[id - 1];
+	}
 	for (u32 i = 0; i < getNumNodes(); i++) {
 		if (nodes[i].id == id) {
 			return &nodes[i];
@@ -2441,6 +3264,16 @@ nodeEntry* CherrySim::findNodeById(int id) {
 	return nullptr;
 }
 
+nodeEntry* CherrySim::findNodeByAddress(const ble_gap_addr_t& address) {
+	for (u32 i = 0; i < getNumNodes(); i++) {
+		const ble_gap_addr_t nodeAddress = FruityHal::Convert(&nodes[i].address);
+		if (memcmp(&nodeAddress, &address, sizeof(ble_gap_addr_t)) == 0) {
+			return &nodes[i];
+		}
+	}
+	return nullptr;
+}
+
 u8 CherrySim::getNumSimConnections(const nodeEntry* node) {
 	u8 count = 0;
 	for (u32 i = 0; i < node->state.configuredTotalConnectionCount; i++) {
@@ -2473,29 +3306,82 @@ void CherrySim::disableTagForAll(const char * tag)
 }
 
 
+//Mixes the bits of a statistic key so that the few used keys spread over the whole table
+static u32 HashPacketStatKey(u32 key)
+{
+	key ^= key >> 16;
+	key *= 0x45d9f3b;
+	key ^= key >> 16;
+	return key;
+}
+
+//The stat array is an open addressing hash table with linear probing that is keyed
+//by (messageType, moduleId, actionType, isSplit). An entry with messageType INVALID and a count of 0 is empty
+//and ends a probe sequence. Tests clear single entries by only setting their messageType to INVALID, these
+//keep their count and act as tombstones that are skipped while searching and reused for inserting.
 void CherrySim::AddPacketToStats(PacketStat* statArray, PacketStat* packet)
 {
 	if (!simConfig.enableSimStatistics) return;
 	if (packet->messageType == MessageType::INVALID) return;
 
-	//Check if we can add it to a previous entry
-	PacketStat* emptySlot = nullptr;
+	u32 key = 0;
+	CheckedMemcpy(&key, packet, packetStatCompareBytes);
+	u32 slot = HashPacketStatKey(key);
+
+	PacketStat* freeEntry = nullptr;
 	for (u32 i = 0; i < PACKET_STAT_SIZE; i++) {
-		PacketStat* entry = statArray + i;
+		PacketStat* entry = statArray + ((slot + i) & (PACKET_STAT_SIZE - 1));
+
+		if (entry->messageType == MessageType::INVALID) {
+			if (freeEntry == nullptr) freeEntry = entry;
+			if (entry->count == 0) break;
+			continue;
+		}
 
 		if (memcmp(packet, entry, packetStatCompareBytes) == 0) {
 			entry->count += packet->count;
+			entry->bytes += packet->bytes;
 			return;
 		}
+	}
 
-		if (!emptySlot && entry->messageType == MessageType::INVALID) emptySlot = entry;
+	//If we did not find a free entry, the table is full
+	//We should increase our PacketStat array size or check if sth. went wrong
+	if (freeEntry == nullptr) {
+		SIMEXCEPTION(PacketStatBufferSizeNotEnough);
+		return;
 	}
 
-	//If we did not yet return, we have not found an empty slot
-	//If we do not have an empty slot for logging, we should increase our PacketStat array size or check if sth. went wrong
-	if (!emptySlot) SIMEXCEPTION(PacketStatBufferSizeNotEnough);
+	*freeEntry = *packet;
+}
+
+//Counts a message that the node queued for the given partner, the link table is keyed by the partner id
+//Once the table is full, the link with the least bytes is evicted so that the busiest links are kept
+void CherrySim::AddMessageToLinkStats(nodeEntry* node, const nodeEntry* partner, u16 messageLength)
+{
+	if (!simConfig.enableSimStatistics) return;
+	if (node == nullptr || partner == nullptr) return;
+
+	u32 slot = HashPacketStatKey((u32)partner->id);
+
+	PacketLinkStat* leastUsedEntry = nullptr;
+	for (u32 i = 0; i < PACKET_LINK_STAT_SIZE; i++) {
+		PacketLinkStat* entry = node->linkStats + ((slot + i) & (PACKET_LINK_STAT_SIZE - 1));
+
+		if (entry->partnerId == 0 || entry->partnerId == partner->id) {
+			entry->partnerId = partner->id;
+			entry->count++;
+			entry->bytes += messageLength;
+			return;
+		}
+
+		if (leastUsedEntry == nullptr || entry->bytes < leastUsedEntry->bytes) leastUsedEntry = entry;
+	}
 
-	*emptySlot = *packet;
+	//Slots are never emptied, so replacing the partner of a slot does not break the probe sequence of other partners
+	leastUsedEntry->partnerId = partner->id;
+	leastUsedEntry->count = 1;
+	leastUsedEntry->bytes = messageLength;
 }
 
 //Allows us to put a packet into the packet statistics. It will count all similar packets in slots depending on the messageType
@@ -2530,6 +3416,7 @@ void CherrySim::AddMessageToStats(PacketStat* statArray, u8* message, u16 messag
 	//Fill in basic packet info
 	packet.messageType = header->messageType;
 	packet.count = 1;
+	packet.bytes = messageLength;
 
 	//Fill in additional info if we have a module message
 	if (packet.messageType >= MessageType::MODULE_CONFIG && packet.messageType <= MessageType::COMPONENT_SENSE) {
@@ -2563,10 +3450,13 @@ void CherrySim::PrintPacketStats(NodeId nodeId, char* statId)
 	//We simply select the stat from the given nodeId
 	else {
 		nodeEntry* node = findNodeById(nodeId);
+		if (node == nullptr) return;
 		if (strcmp("SENT", statId) == 0) stat = node->sentPackets;
 		if (strcmp("ROUTED", statId) == 0) stat = node->routedPackets;
 	}
 
+	if (stat == nullptr) return;
+
 	//Print everything
 	printf(">----------------------------------------------------<" EOL);
 	printf("Message statistics for packets %s on node %u" EOL, statId, nodeId);
@@ -2578,14 +3468,49 @@ void CherrySim::PrintPacketStats(NodeId nodeId, char* statId)
 
 		if (entry->messageType != MessageType::INVALID) {
 			if (entry->messageType >= MessageType::MODULE_CONFIG && entry->messageType <= MessageType::COMPONENT_SENSE) {
-				printf("%u :: mt:%u (mId:%u, at:%u%s)" EOL, entry->count, (u32)entry->messageType, (u32)entry->moduleId, (u32)entry->actionType, entry->isSplit ? ", SPLIT" : "");
+				printf("%u (%u bytes) :: mt:%u (mId:%u, at:%u%s)" EOL, entry->count, entry->bytes, (u32)entry->messageType, (u32)entry->moduleId, (u32)entry->actionType, entry->isSplit ? ", SPLIT" : "");
 			}
 			else {
-				printf("%u :: mt:%u %s" EOL, entry->count, (u32)entry->messageType, entry->isSplit ? "(SPLIT)" : "");
+				printf("%u (%u bytes) :: mt:%u %s" EOL, entry->count, entry->bytes, (u32)entry->messageType, entry->isSplit ? "(SPLIT)" : "");
 			}
 		}
 	}
 
+	//Links are only tracked for the packets that a node queued itself
+	if (nodeId != 0 && strcmp("ROUTED", statId) == 0) {
+		nodeEntry* node = findNodeById(nodeId);
+		if (node == nullptr) return;
+		printf("" EOL);
+		for (u32 i = 0; i < PACKET_LINK_STAT_SIZE; i++)
+		{
+			PacketLinkStat* entry = node->linkStats + i;
+			if (entry->partnerId != 0) {
+				printf("%u (%u bytes) :: link to node %d" EOL, entry->count, entry->bytes, entry->partnerId);
+			}
+		}
+		printf("%u bytes of terminal output" EOL, node->terminalOutputBytes);
+	}
+
+	printf(">----------------------------------------------------<" EOL);
+}
+
+//Prints the nodes with the most BLE events that were pending at the same time
+void CherrySim::PrintEventQueueStats()
+{
+	std::vector<nodeEntry*> sortedNodes;
+	for (u32 i = 0; i < getNumNodes(); i++) {
+		sortedNodes.push_back(nodes + i);
+	}
+	std::sort(sortedNodes.begin(), sortedNodes.end(), [](const nodeEntry* a, const nodeEntry* b) {
+		return a->eventQueue.GetHighWaterMark() > b->eventQueue.GetHighWaterMark();
+	});
+
+	printf(">----------------------------------------------------<" EOL);
+	printf("Event queue high water marks" EOL);
+	printf("" EOL);
+	for (u32 i = 0; i < sortedNodes.size() && i < 10; i++) {
+		printf("node %u :: max %u, pending %u, capacity %u" EOL, sortedNodes[i]->id, sortedNodes[i]->eventQueue.GetHighWaterMark(), sortedNodes[i]->eventQueue.size(), sortedNodes[i]->eventQueue.capacity());
+	}
 	printf(">----------------------------------------------------<" EOL);
 }
 
@@ -43,6 +43,7 @@ into all files in order to rewrite macros and other calls.
 #include <Terminal.h>
 #include <LedWrapper.h>
 #include <CherrySimTypes.h>
+#include <CherrySimTrace.h>
 #include <map>
 
 
@@ -88,6 +89,10 @@ private:
 	void StoreFlashToFile();
 	void LoadFlashFromFile();
 	void PrepareSimulatedFeatureSets();
+	void InitTrace();
+
+	friend class SimTraceRandomScope;
+	std::vector<u32> traceRandomValues; //Random values drawn by the current node that are not yet written to the trace
 
 public:
 
@@ -151,6 +156,9 @@ public:
 
 	//GATT Simulation
 	void SimulateConnections();
+	void SimulateConnectionEventsLegacy();
+	void SimulateConnectionEventsAirtime();
+	void SendWriteResponseEvent(nodeEntry* node, int connHandle, u32 globalPacketId);
 	void SendUnreliableTxCompleteEvent(nodeEntry* node, int connHandle, u8 packetCount);
 	void GenerateWrite(SoftDeviceBufferedPacket* bufferedPacket);
 	void GenerateNotification(SoftDeviceBufferedPacket* bufferedPacket);
@@ -159,8 +167,28 @@ public:
 	//GPIO Simulation
 	void SetSimLed(bool state);
 
+	//Record and Replay
+	CherrySimTrace trace;
+	u32 replayDivergenceCount = 0; //Number of replayed nodes that did not behave as recorded at some point
+	void RecordFetchedBleEvent(const simBleEvent& event);
+	void RecordTerminalInput(const nodeEntry* node, const char* line);
+	void DispatchFlashCompletion(FruityHal::SystemEvents event);
+	void ReplayTraceInputs();
+	void ReplayTraceBleEvents();
+	void ApplyReplayedBleEventToSoftDevice(const simBleEvent& event);
+	void ReplayTraceFlashCompletions();
+	void CheckReplayDivergence();
+	nodeEntry* findNodeByAddress(const ble_gap_addr_t& address);
+
 	//Battery usage simulation
+	EnergyProfile defaultEnergyProfile;
+	std::map<Chipset, EnergyProfile> energyProfiles;
+	void LoadEnergyProfiles(const char* path);
+	const EnergyProfile& GetEnergyProfileOfCurrentNode();
+	void AddEnergyCharge(nodeEntry* node, EnergyCategory category, double chargeNc);
+	void AttributeScanRadioOnTime(nodeEntry* node, double radioOnMs);
 	void simulateBatteryUsage();
+	void PrintEnergyStats(NodeId nodeId);
 
 	//Service Discovery Simulation
 	void StartServiceDiscovery(u16 connHandle, const ble_uuid_t &p_uuid, int discoveryTimeMs);
@@ -176,8 +204,13 @@ public:
 	void simulateWatchDog();
 
 	//Validity Checking
-	void CheckMeshingConsistency();
+	bool meshingConsistencyChecked = false;
+	u32 meshingConsistencyCheckedNodes = 0; //Number of nodes that the last check had to validate again
+	u32 GetMeshingConsistencySignature(nodeEntry* node);
+	//Returns the number of nodes with a potential clustering mismatch, only clusters that changed are checked unless fullCheck is set
+	u32 CheckMeshingConsistency(bool fullCheck = false);
 	u32 DetermineClusterSizeAndPropagateClusterUpdates(nodeEntry* node, nodeEntry* startNode);
+	i32 CollectClusterUpdates(nodeEntry* node, nodeEntry* startNode, i32 pathUpdates, std::vector<i32>& updatesOnPath);
 
 	//Configuration
 	void SetCustomAdvertisingModuleConfig();
@@ -186,7 +219,9 @@ public:
 	//Statistics
 	void AddPacketToStats(PacketStat* statArray, PacketStat* packet);
 	void AddMessageToStats(PacketStat* statArray, u8* message, u16 messageLength);
+	void AddMessageToLinkStats(nodeEntry* node, const nodeEntry* partner, u16 messageLength);
 	void PrintPacketStats(NodeId nodeId, char* statId);
+	void PrintEventQueueStats();
 
 	//#### Helpers
 	bool IsClusteringDone();
@@ -211,6 +246,19 @@ public:
 	void disableTagForAll(const char* tag);
 };
 
+//While alive, the random numbers that the firmware of the current node draws are written to the trace or, if the
+//node is replayed, are taken from the trace. Only the outermost scope is active if scopes are nested.
+class SimTraceRandomScope
+{
+private:
+	bool active = false;
+	u32 nodeIndex = 0;
+
+public:
+	SimTraceRandomScope();
+	~SimTraceRandomScope();
+};
+
 //Throw this in the simulator in order to quit from the simulation
 struct CherrySimQuitException : public std::exception { char const * what() const noexcept override { return "CherrySimQuitException"; } };
 //Thrown by a node if the node should be reset
@@ -0,0 +1,451 @@
+////////////////////////////////////////////////////////////////////////////////
+// /****************************************************************************
+// **
+// ** Copyright (C) 2015-2020 M-Way Solutions GmbH
+// ** Contact: https://www.blureange.io/licensing
+// **
+// ** This file is part of the Bluerange/FruityMesh implementation
+// **
+// ** $BR_BEGIN_LICENSE:GPL-EXCEPT$
+// ** Commercial License Usage
+// ** Licensees holding valid commercial Bluerange licenses may use this file in
+// ** accordance with the commercial license agreement provided with the
+// ** Software or, alternatively, in accordance with the terms contained in
+// ** a written agreement between them and M-Way Solutions GmbH.
+// ** For licensing terms and conditions see https://www.bluerange.io/terms-conditions. For further
+// ** information use the contact form at https://www.bluerange.io/contact.
+// **
+// ** GNU General Public License Usage
+// ** Alternatively, this file may be used under the terms of the GNU
+// ** General Public License version 3 as published by the Free Software
+// ** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+// ** included in the packaging of this file. Please review the following
+// ** information to ensure the GNU General Public License requirements will
+// ** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+// **
+// ** $BR_END_LICENSE$
+// **
+// ****************************************************************************/
+////////////////////////////////////////////////////////////////////////////////
+#include <CherrySimBatchRunner.h>
+#include <Node.h>
+#include <ConnectionManager.h>
+#include <json.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <memory>
+#include <thread>
+#include <typeinfo>
+
+#ifdef __unix
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif // __unix
+
+using json = nlohmann::json;
+
+CherrySimBatchRunner::CherrySimBatchRunner(const CherrySimBatchConfig& config)
+	: config(config)
+{
+	if (this->config.variants.empty()) {
+		CherrySimBatchVariant variant;
+		variant.numNodes = config.baseConfig.numNodes;
+		variant.numAssetNodes = config.baseConfig.numAssetNodes;
+		variant.linkLayerModel = config.baseConfig.linkLayerModel;
+		this->config.variants.push_back(variant);
+	}
+
+	for (CherrySimBatchVariant& variant : this->config.variants) {
+		if (variant.name.empty()) {
+			variant.name = "nodes" + std::to_string(variant.numNodes);
+			if (variant.numAssetNodes > 0) variant.name += "_assets" + std::to_string(variant.numAssetNodes);
+			if (variant.linkLayerModel == LinkLayerModel::AIRTIME) variant.name += "_airtime";
+		}
+		for (u32 i = 0; i < config.numSeeds; i++) {
+			jobs.push_back({ variant, config.firstSeed + i });
+		}
+	}
+}
+
+std::string CherrySimBatchRunner::Run()
+{
+	results.clear();
+
+	u32 maxParallelJobs = config.maxParallelJobs;
+	if (maxParallelJobs == 0) maxParallelJobs = std::max(1u, std::thread::hardware_concurrency());
+
+	printf("Running %u batch jobs, up to %u at the same time" EOL, (u32)jobs.size(), maxParallelJobs);
+
+#ifdef __unix
+	RunJobsInWorkerProcesses(maxParallelJobs);
+#else
+	RunJobsSequentially();
+#endif // __unix
+
+	std::string report = GenerateReport();
+	if (!config.reportPath.empty()) {
+		std::ofstream file(config.reportPath);
+		file << report;
+		printf("Batch report written to %s" EOL, config.reportPath.c_str());
+	}
+
+	return report;
+}
+
+CherrySimBatchJobResult CherrySimBatchRunner::RunJob(const Job& job) const
+{
+	CherrySimBatchJobResult result;
+	result.variant = job.variant.name;
+	result.seed = job.seed;
+
+	SimConfiguration simConfig = config.baseConfig;
+	simConfig.seed = job.seed;
+	simConfig.numNodes = job.variant.numNodes;
+	simConfig.numAssetNodes = job.variant.numAssetNodes;
+	simConfig.linkLayerModel = job.variant.linkLayerModel;
+	simConfig.playDelay = 0;
+	simConfig.enableSimStatistics = true;
+	simConfig.enableWebServer = false;
+	simConfig.storeFlashToFile = nullptr;
+
+	try {
+		//The simulator holds the state of all nodes and is too big for the stack
+		std::unique_ptr<CherrySim> sim(new CherrySim(simConfig));
+		sim->Init();
+
+		u32 numNodes = sim->getNumNodes();
+		for (u32 i = 0; i < numNodes; i++) {
+#ifdef GITHUB_RELEASE
+			strcpy(sim->nodes[i].nodeConfiguration, "github_nrf52");
+#endif //GITHUB_RELEASE
+			sim->setNode(i);
+			sim->bootCurrentNode();
+		}
+
+		while (!sim->IsClusteringDone() && sim->simState.simTimeMs < config.clusteringTimeoutMs) {
+			sim->SimulateStepForAllNodes();
+		}
+		result.clustered = sim->IsClusteringDone();
+		result.clusteringTimeMs = sim->simState.simTimeMs;
+
+		u32 trafficEndTimeMs = sim->simState.simTimeMs + config.trafficDurationMs;
+		while (sim->simState.simTimeMs < trafficEndTimeMs) {
+			sim->SimulateStepForAllNodes();
+		}
+
+		for (u32 i = 0; i < numNodes; i++) {
+			nodeEntry* node = &sim->nodes[i];
+			result.droppedPackets += node->gs.cm.droppedMeshPackets;
+			result.sentPacketsReliable += node->gs.cm.sentMeshPacketsReliable;
+			result.sentPacketsUnreliable += node->gs.cm.sentMeshPacketsUnreliable;
+
+			//The routed packets hold everything that a node transmitted, no matter if it was generated by the node
+			for (u32 j = 0; j < PACKET_STAT_SIZE; j++) {
+				const PacketStat& stat = node->routedPackets[j];
+				if (stat.messageType != MessageType::INVALID && stat.moduleId != ModuleId::INVALID_MODULE) {
+					result.moduleMessageCounts[(u32)stat.moduleId] += stat.count;
+				}
+			}
+		}
+
+		result.finished = true;
+	}
+	catch (const std::exception& e) {
+		result.error = typeid(e).name();
+	}
+
+	return result;
+}
+
+static json JobResultToJson(const CherrySimBatchJobResult& result)
+{
+	json moduleMessages;
+	for (const auto& entry : result.moduleMessageCounts) {
+		moduleMessages[std::to_string(entry.first)] = entry.second;
+	}
+
+	json j;
+	j["variant"] = result.variant;
+	j["seed"] = result.seed;
+	j["finished"] = result.finished;
+	j["error"] = result.error;
+	j["clustered"] = result.clustered;
+	j["clusteringTimeMs"] = result.clusteringTimeMs;
+	j["droppedPackets"] = result.droppedPackets;
+	j["sentPacketsReliable"] = result.sentPacketsReliable;
+	j["sentPacketsUnreliable"] = result.sentPacketsUnreliable;
+	j["moduleMessages"] = moduleMessages.is_null() ? json::object() : moduleMessages;
+	return j;
+}
+
+static CherrySimBatchJobResult JobResultFromJson(const json& j)
+{
+	CherrySimBatchJobResult result;
+	result.variant = j["variant"].get<std::string>();
+	result.seed = j["seed"].get<u32>();
+	result.finished = j["finished"].get<bool>();
+	result.error = j["error"].get<std::string>();
+	result.clustered = j["clustered"].get<bool>();
+	result.clusteringTimeMs = j["clusteringTimeMs"].get<u32>();
+	result.droppedPackets = j["droppedPackets"].get<u32>();
+	result.sentPacketsReliable = j["sentPacketsReliable"].get<u32>();
+	result.sentPacketsUnreliable = j["sentPacketsUnreliable"].get<u32>();
+	for (auto it = j["moduleMessages"].begin(); it != j["moduleMessages"].end(); ++it) {
+		result.moduleMessageCounts[(u32)std::stoul(it.key())] = it.value().get<u32>();
+	}
+	return result;
+}
+
+void CherrySimBatchRunner::RunJobsSequentially()
+{
+	for (const Job& job : jobs) {
+		results.push_back(RunJob(job));
+		printf("Finished batch job %u/%u" EOL, (u32)results.size(), (u32)jobs.size());
+	}
+}
+
+void CherrySimBatchRunner::RunJobsInWorkerProcesses(u32 maxParallelJobs)
+{
+#ifdef __unix
+	//Each worker writes its result to a temporary file next to the report, the results are collected once it exited
+	std::map<pid_t, size_t> runningJobs;
+	std::vector<CherrySimBatchJobResult> jobResults(jobs.size());
+	std::string resultPathPrefix = (config.reportPath.empty() ? std::string("cherrysim_batch") : config.reportPath) + ".job";
+	size_t nextJob = 0;
+	size_t finishedJobs = 0;
+
+	while (finishedJobs < jobs.size()) {
+		while (nextJob < jobs.size() && runningJobs.size() < maxParallelJobs) {
+			fflush(stdout);
+			pid_t pid = fork();
+			if (pid == 0) {
+				CherrySimBatchJobResult result = RunJob(jobs[nextJob]);
+				std::ofstream file(resultPathPrefix + std::to_string(nextJob));
+				file << JobResultToJson(result).dump();
+				file.close();
+				_exit(0);
+			}
+			else if (pid < 0) {
+				//Could not fork, simply run the job in this process
+				jobResults[nextJob] = RunJob(jobs[nextJob]);
+				finishedJobs++;
+			}
+			else {
+				runningJobs[pid] = nextJob;
+			}
+			nextJob++;
+		}
+
+		if (runningJobs.empty()) continue;
+
+		int status = 0;
+		pid_t pid = waitpid(-1, &status, 0);
+		auto it = runningJobs.find(pid);
+		if (it == runningJobs.end()) continue;
+
+		size_t jobIndex = it->second;
+		runningJobs.erase(it);
+		finishedJobs++;
+
+		std::string resultPath = resultPathPrefix + std::to_string(jobIndex);
+		std::ifstream file(resultPath);
+		std::stringstream content;
+		content << file.rdbuf();
+		file.close();
+		std::remove(resultPath.c_str());
+
+		json resultJson;
+		try {
+			resultJson = json::parse(content.str());
+		}
+		catch (const std::exception&) {
+			//Reported as a crashed worker below
+		}
+
+		if (WIFEXITED(status) && WEXITSTATUS(status) == 0 && resultJson.is_object()) {
+			jobResults[jobIndex] = JobResultFromJson(resultJson);
+		}
+		else {
+			//The worker crashed, e.g. because of an assertion, this is reported but does not stop the batch
+			jobResults[jobIndex].variant = jobs[jobIndex].variant.name;
+			jobResults[jobIndex].seed = jobs[jobIndex].seed;
+			jobResults[jobIndex].error = WIFSIGNALED(status) ? "signal " + std::to_string(WTERMSIG(status)) : "exit " + std::to_string(WEXITSTATUS(status));
+		}
+		printf("Finished batch job %u/%u" EOL, (u32)finishedJobs, (u32)jobs.size());
+	}
+
+	results = std::move(jobResults);
+#else
+	UNUSED_PARAMETER(maxParallelJobs);
+	RunJobsSequentially();
+#endif // __unix
+}
+
+double CherrySimBatchRunner::GetPercentile(std::vector<double>& values, double percentile)
+{
+	if (values.empty()) return 0;
+
+	std::sort(values.begin(), values.end());
+	i32 rank = (i32)std::ceil(percentile / 100.0 * values.size());
+	rank = std::max(1, std::min(rank, (i32)values.size()));
+	return values[rank - 1];
+}
+
+static json SummarizeValues(std::vector<double> values)
+{
+	json summary;
+	summary["count"] = values.size();
+	if (values.empty()) return summary;
+
+	double sum = 0;
+	for (double value : values) sum += value;
+
+	summary["min"] = CherrySimBatchRunner::GetPercentile(values, 0);
+	summary["p50"] = CherrySimBatchRunner::GetPercentile(values, 50);
+	summary["p90"] = CherrySimBatchRunner::GetPercentile(values, 90);
+	summary["p99"] = CherrySimBatchRunner::GetPercentile(values, 99);
+	summary["max"] = CherrySimBatchRunner::GetPercentile(values, 100);
+	summary["mean"] = sum / values.size();
+	return summary;
+}
+
+std::string CherrySimBatchRunner::GenerateReport() const
+{
+	json report;
+	report["firstSeed"] = config.firstSeed;
+	report["numSeeds"] = config.numSeeds;
+	report["clusteringTimeoutMs"] = config.clusteringTimeoutMs;
+	report["trafficDurationMs"] = config.trafficDurationMs;
+	report["variants"] = json::object();
+	report["failedJobs"] = json::array();
+	report["runs"] = json::array();
+
+	for (const CherrySimBatchVariant& variant : config.variants) {
+		u32 numRuns = 0;
+		u32 numClustered = 0;
+		std::vector<double> clusteringTimes;
+		std::vector<double> droppedPackets;
+		std::map<u32, std::vector<double>> moduleMessages;
+
+		for (const CherrySimBatchJobResult& result : results) {
+			if (result.variant != variant.name || !result.finished) continue;
+			numRuns++;
+			if (result.clustered) {
+				numClustered++;
+				clusteringTimes.push_back(result.clusteringTimeMs);
+			}
+			droppedPackets.push_back(result.droppedPackets);
+			for (const auto& entry : result.moduleMessageCounts) {
+				moduleMessages[entry.first].push_back(entry.second);
+			}
+		}
+
+		//A module that did not send anything in a run still counts as a run with 0 messages
+		json moduleSummaries = json::object();
+		for (auto& entry : moduleMessages) {
+			entry.second.resize(numRuns, 0);
+			moduleSummaries[std::to_string(entry.first)] = SummarizeValues(entry.second);
+		}
+
+		json variantReport;
+		variantReport["numNodes"] = variant.numNodes;
+		variantReport["numAssetNodes"] = variant.numAssetNodes;
+		variantReport["linkLayerModel"] = variant.linkLayerModel == LinkLayerModel::AIRTIME ? "airtime" : "legacy";
+		variantReport["runs"] = numRuns;
+		variantReport["clustered"] = numClustered;
+		variantReport["clusteringTimeMs"] = SummarizeValues(clusteringTimes);
+		variantReport["droppedPackets"] = SummarizeValues(droppedPackets);
+		variantReport["moduleMessages"] = moduleSummaries;
+		report["variants"][variant.name] = variantReport;
+	}
+
+	for (const CherrySimBatchJobResult& result : results) {
+		if (!result.finished) {
+			report["failedJobs"].push_back({ {"variant", result.variant}, {"seed", result.seed}, {"error", result.error} });
+		}
+		report["runs"].push_back(JobResultToJson(result));
+	}
+
+	return report.dump(4);
+}
+
+static std::vector<u32> ParseNumberList(const std::string& list)
+{
+	std::vector<u32> numbers;
+	size_t start = 0;
+	while (start < list.size()) {
+		size_t end = list.find(',', start);
+		if (end == std::string::npos) end = list.size();
+		numbers.push_back((u32)std::stoul(list.substr(start, end - start)));
+		start = end + 1;
+	}
+	return numbers;
+}
+
+bool CherrySimBatchRunner::ParseArguments(int argc, char** argv, CherrySimBatchConfig& config)
+{
+	std::vector<u32> nodeCounts = { config.baseConfig.numNodes };
+	std::vector<LinkLayerModel> linkLayerModels = { config.baseConfig.linkLayerModel };
+	u32 numAssetNodes = config.baseConfig.numAssetNodes;
+
+	try {
+		for (int i = 0; i < argc; i++) {
+			std::string arg = argv[i];
+			size_t separator = arg.find('=');
+			if (separator == std::string::npos) {
+				std::cerr << "ERROR: batch parameters must look like key=value, got " << arg << "\n";
+				return false;
+			}
+			std::string key = arg.substr(0, separator);
+			std::string value = arg.substr(separator + 1);
+
+			if (key == "seeds") config.numSeeds = (u32)std::stoul(value);
+			else if (key == "firstSeed") config.firstSeed = (u32)std::stoul(value);
+			else if (key == "nodes") nodeCounts = ParseNumberList(value);
+			else if (key == "assets") numAssetNodes = (u32)std::stoul(value);
+			else if (key == "jobs") config.maxParallelJobs = (u32)std::stoul(value);
+			else if (key == "timeoutSec") config.clusteringTimeoutMs = (u32)std::stoul(value) * 1000;
+			else if (key == "trafficSec") config.trafficDurationMs = (u32)std::stoul(value) * 1000;
+			else if (key == "report") config.reportPath = value;
+			else if (key == "linkmodel") {
+				if (value == "legacy") linkLayerModels = { LinkLayerModel::LEGACY };
+				else if (value == "airtime") linkLayerModels = { LinkLayerModel::AIRTIME };
+				else if (value == "both") linkLayerModels = { LinkLayerModel::LEGACY, LinkLayerModel::AIRTIME };
+				else {
+					std::cerr << "ERROR: unknown link layer model " << value << "\n";
+					return false;
+				}
+			}
+			else {
+				std::cerr << "ERROR: unknown batch parameter " << key << "\n";
+				return false;
+			}
+		}
+	}
+	catch (const std::logic_error&) {
+		std::cerr << "ERROR: batch parameters must be numbers\n";
+		return false;
+	}
+
+	config.variants.clear();
+	for (u32 numNodes : nodeCounts) {
+		if (numNodes == 0 || numNodes + numAssetNodes > MAX_NUM_NODES) {
+			std::cerr << "ERROR: invalid number of nodes " << numNodes << "\n";
+			return false;
+		}
+		for (LinkLayerModel linkLayerModel : linkLayerModels) {
+			CherrySimBatchVariant variant;
+			variant.numNodes = numNodes;
+			variant.numAssetNodes = numAssetNodes;
+			variant.linkLayerModel = linkLayerModel;
+			config.variants.push_back(variant);
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,109 @@
+////////////////////////////////////////////////////////////////////////////////
+// /****************************************************************************
+// **
+// ** Copyright (C) 2015-2020 M-Way Solutions GmbH
+// ** Contact: https://www.blureange.io/licensing
+// **
+// ** This file is part of the Bluerange/FruityMesh implementation
+// **
+// ** $BR_BEGIN_LICENSE:GPL-EXCEPT$
+// ** Commercial License Usage
+// ** Licensees holding valid commercial Bluerange licenses may use this file in
+// ** accordance with the commercial license agreement provided with the
+// ** Software or, alternatively, in accordance with the terms contained in
+// ** a written agreement between them and M-Way Solutions GmbH.
+// ** For licensing terms and conditions see https://www.bluerange.io/terms-conditions. For further
+// ** information use the contact form at https://www.bluerange.io/contact.
+// **
+// ** GNU General Public License Usage
+// ** Alternatively, this file may be used under the terms of the GNU
+// ** General Public License version 3 as published by the Free Software
+// ** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+// ** included in the packaging of this file. Please review the following
+// ** information to ensure the GNU General Public License requirements will
+// ** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+// **
+// ** $BR_END_LICENSE$
+// **
+// ****************************************************************************/
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <CherrySim.h>
+#include <string>
+#include <vector>
+#include <map>
+
+/*
+ * The batch runner simulates many seeds and scenario variants and aggregates the results.
+ * As the simulator swaps global state for each node, only one simulation can run per process.
+ * On unix, every job therefore runs in a forked worker process so that all cores are used,
+ * other platforms run the jobs one after another.
+ */
+
+struct CherrySimBatchVariant
+{
+	std::string name;
+	u32 numNodes = 10;
+	u32 numAssetNodes = 0;
+	LinkLayerModel linkLayerModel = LinkLayerModel::LEGACY;
+};
+
+struct CherrySimBatchConfig
+{
+	SimConfiguration baseConfig; //Used for all jobs, seed, node counts and link layer model are set per job
+	std::vector<CherrySimBatchVariant> variants;
+	u32 firstSeed = 1;
+	u32 numSeeds = 10;
+	u32 maxParallelJobs = 0; //0 uses all available cores
+	u32 clusteringTimeoutMs = 10 * 60 * 1000; //Runs that did not cluster until then are reported as not clustered
+	u32 trafficDurationMs = 60 * 1000; //Simulated time after clustering during which the traffic is measured
+	std::string reportPath = "cherrysim_batch_report.json";
+};
+
+struct CherrySimBatchJobResult
+{
+	std::string variant;
+	u32 seed = 0;
+	bool finished = false; //False if the job crashed or threw an exception
+	std::string error;
+	bool clustered = false;
+	u32 clusteringTimeMs = 0;
+	u32 droppedPackets = 0;
+	u32 sentPacketsReliable = 0;
+	u32 sentPacketsUnreliable = 0;
+	std::map<u32, u32> moduleMessageCounts; //Module messages transmitted by all nodes, keyed by module id
+};
+
+class CherrySimBatchRunner
+{
+public:
+	explicit CherrySimBatchRunner(const CherrySimBatchConfig& config);
+
+	//Runs all jobs, writes the report to the configured path and returns the report
+	std::string Run();
+
+	const std::vector<CherrySimBatchJobResult>& GetResults() const { return results; }
+
+	//Parses the BatchRun arguments of the cherrySim_runner, e.g. "seeds=100 nodes=10,50 jobs=8"
+	static bool ParseArguments(int argc, char** argv, CherrySimBatchConfig& config);
+
+	//Nearest rank percentile of the given values, the values are sorted in place
+	static double GetPercentile(std::vector<double>& values, double percentile);
+
+private:
+	struct Job
+	{
+		CherrySimBatchVariant variant;
+		u32 seed;
+	};
+
+	CherrySimBatchConfig config;
+	std::vector<Job> jobs;
+	std::vector<CherrySimBatchJobResult> results;
+
+	CherrySimBatchJobResult RunJob(const Job& job) const;
+	void RunJobsSequentially();
+	void RunJobsInWorkerProcesses(u32 maxParallelJobs);
+	std::string GenerateReport() const;
+};
@@ -30,7 +30,10 @@
 #include "CherrySimRunner.h"
 #include "CherrySim.h"
 #include "CherrySimUtils.h"
+#include "CherrySimBatchRunner.h"
 #include <string>
+#include <sstream>
+#include <cstring>
 #include <iostream>
 #include <chrono>
 #include <cmath>
@@ -41,6 +44,12 @@
 /**
 The CherrySimRunner is used to start the simulator in a forever running loop.
 Terminal input into all nodes is possible and visualization works using FruityMap.
+
+Started with "BatchRun" as the first parameter, it instead simulates many seeds and
+scenario variants in parallel and writes an aggregated report, see CherrySimBatchRunner.
+
+With recordTrace=<file>, the inputs of all nodes are recorded. A later run with the same
+configuration and replayTrace=<file> (optionally with replayNodes=<id>,<id>) replays them, see CherrySimTrace.
 */
 
 static bool shortLived = false; //Used for making sure that the Runner is able to run on CI.
@@ -49,6 +58,24 @@ extern bool meshGwCommunication;
 
 #ifdef CHERRYSIM_RUNNER_ENABLED
 int main(int argc, char** argv) {
+	if (argc > 1 && std::string(argv[1]) == "BatchRun")
+	{
+		//e.g. cherrySim_runner BatchRun seeds=100 nodes=10,50 linkmodel=both jobs=8 report=report.json
+		CherrySimBatchConfig batchConfig;
+		batchConfig.baseConfig = CherrySimRunner::CreateDefaultRunConfiguration();
+		batchConfig.baseConfig.terminalId = -1;
+		batchConfig.baseConfig.verboseCommands = false;
+		if (!CherrySimBatchRunner::ParseArguments(argc - 2, argv + 2, batchConfig)) return 1;
+
+		Exceptions::ExceptionDisabler<ErrorCodeUnknownException> ecue;
+		Exceptions::ExceptionDisabler<CRCMissingException> crcme;
+		Exceptions::ExceptionDisabler<CRCInvalidException> crcie;
+
+		CherrySimBatchRunner batchRunner(batchConfig);
+		batchRunner.Run();
+		return 0;
+	}
+
 	printf("#################################################" EOL
 		   "#                  CherrySim                    #" EOL
 		   "#################################################" EOL
@@ -78,6 +105,24 @@ int main(int argc, char** argv) {
 		{
 			shortLived = true;
 		}
+		else if (s.rfind("recordTrace=", 0) == 0)
+		{
+			//Records the inputs of all nodes so that the run can be replayed later
+			snprintf(simConfig.traceRecordPath, sizeof(simConfig.traceRecordPath), "%s", s.c_str() + strlen("recordTrace="));
+		}
+		else if (s.rfind("replayTrace=", 0) == 0)
+		{
+			snprintf(simConfig.traceReplayPath, sizeof(simConfig.traceReplayPath), "%s", s.c_str() + strlen("replayTrace="));
+			//Resetting nodes for the next clustering would not match the trace
+			runnerConfig.enableClusteringTest = false;
+		}
+		else if (s.rfind("replayNodes=", 0) == 0)
+		{
+			//e.g. replayNodes=3,7 only replays these nodes from the trace, the others are not simulated
+			std::stringstream ids(s.substr(strlen("replayNodes=")));
+			std::string id;
+			while (std::getline(ids, id, ',')) simConfig.replayNodeIds.push_back(Utility::StringToU32(id.c_str()));
+		}
 		else
 		{
 			if (i != 0) std::cerr << "WARNING: unknown parameter " << s << "\n";
@@ -127,7 +172,24 @@ void CherrySimRunner::TerminalReaderMain() {
 			return;
 		}
 
-		sim->findNodeById(MESH_GW_NODE)->gs.terminal.PutIntoReadBuffer(input.c_str());
+		std::lock_guard<std::mutex> guard(terminalInputMutex);
+		pendingTerminalInputs.push_back(std::move(input));
+	}
+}
+
+//Must be called from the simulation thread so that the input is recorded at the current simulation time
+void CherrySimRunner::ProcessPendingTerminalInputs()
+{
+	std::vector<std::string> inputs;
+	{
+		std::lock_guard<std::mutex> guard(terminalInputMutex);
+		inputs.swap(pendingTerminalInputs);
+	}
+
+	nodeEntry* gatewayNode = sim->findNodeById(MESH_GW_NODE);
+	for (const std::string& input : inputs) {
+		gatewayNode->gs.terminal.PutIntoReadBuffer(input.c_str());
+		sim->RecordTerminalInput(gatewayNode, input.c_str());
 	}
 }
 
@@ -269,6 +331,8 @@ bool CherrySimRunner::Simulate()
 			}
 		}
 
+		ProcessPendingTerminalInputs();
+
 		try {
 			sim->SimulateStepForAllNodes();
 			if (shortLived)
@@ -31,6 +31,9 @@
 
 #include <CherrySim.h>
 #include <thread>
+#include <mutex>
+#include <vector>
+#include <string>
 
 struct CherrySimRunnerConfig
 {
@@ -74,6 +77,11 @@ public:
 	static SimConfiguration CreateDefaultRunConfiguration();
 
 private:
+	//Lines read by the terminal reader thread, they are handed to the gateway node by the simulation thread
+	std::mutex terminalInputMutex;
+	std::vector<std::string> pendingTerminalInputs;
+	void ProcessPendingTerminalInputs();
+
 	bool shouldRestartSim;
 	CherrySimRunnerConfig runnerConfig;
 	SimConfiguration simConfig;
@@ -39,6 +39,12 @@
 #include <iostream>
 #include "FruityHal.h"
 #include "Utility.h"
+
+#ifdef __unix
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif // __unix
  
 /***
 This class is a wrapper around the simulator and provides methods for injecting data into the simulator
@@ -207,6 +213,7 @@ SimConfiguration CherrySimTester::CreateDefaultSimConfiguration()
 
 	simConfig.verboseCommands = true;
 	simConfig.enableSimStatistics = false;
+	simConfig.jsonValidationSampleRate = 1; //Validate every json message, performance tests may sample less often
 
 
 	return simConfig;
@@ -260,6 +267,54 @@ void CherrySimTester::Start()
 	started = true;
 }
 
+static bool RunTestCase(CherrySimTester& tester, const CherrySimTester::TestCase& testCase)
+{
+	try {
+		testCase(tester);
+	}
+	catch (const std::exception& e) {
+		printf("Test case failed with %s" EOL, typeid(e).name());
+		return false;
+	}
+	return !::testing::Test::HasFailure();
+}
+
+std::vector<u32> CherrySimTester::RunCasesFromWarmedUpSimulation(const CherrySimTesterConfig& testerConfig, const SimConfiguration& simConfig, const TestCase& warmUp, const std::vector<TestCase>& cases)
+{
+	std::vector<u32> failedCases;
+
+#ifdef __unix
+	CherrySimTester tester = CherrySimTester(testerConfig, simConfig);
+	warmUp(tester);
+
+	for (u32 i = 0; i < cases.size(); i++) {
+		fflush(stdout);
+		pid_t pid = fork();
+		if (pid == 0) {
+			bool passed = RunTestCase(tester, cases[i]);
+			fflush(stdout);
+			//Skip all destructors and the gtest teardown, they belong to the parent
+			_exit(passed ? 0 : 1);
+		}
+
+		int status = 0;
+		if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			failedCases.push_back(i);
+		}
+	}
+#else
+	for (u32 i = 0; i < cases.size(); i++) {
+		CherrySimTester tester = CherrySimTester(testerConfig, simConfig);
+		warmUp(tester);
+		if (!RunTestCase(tester, cases[i])) {
+			failedCases.push_back(i);
+		}
+	}
+#endif // __unix
+
+	return failedCases;
+}
+
 void CherrySimTester::SimulateUntilClusteringDone(int timeoutMs)
 {
 	if (timeoutMs == 0) SIMEXCEPTION(ZeroTimeoutNotSupportedException);
@@ -402,7 +457,8 @@ void CherrySimTester::_SimulateUntilMessageReceived(int timeoutMs)
 {
 	if (timeoutMs == 0) SIMEXCEPTION(ZeroTimeoutNotSupportedException);
 	int startTimeMs = sim->simState.simTimeMs;
-	awaitedMessagesFound = false;
+	PrepareAwaitedMessages();
+	awaitedMessagesFound = awaitedMessagesOutstanding == 0;
 
 	while (!awaitedMessagesFound) {
 		sim->SimulateStepForAllNodes();
@@ -413,6 +469,67 @@ void CherrySimTester::_SimulateUntilMessageReceived(int timeoutMs)
 		}
 	}
 	awaitedTerminalOutputs = nullptr;
+	awaitedMessageIndicesByNode.clear();
+	awaitedMessageMatchersByNode.clear();
+}
+
+//Groups the awaited messages by node and builds one matcher per node so that each line of terminal
+//output is only scanned once, no matter how many messages are awaited
+void CherrySimTester::PrepareAwaitedMessages()
+{
+	awaitedMessageIndicesByNode.clear();
+	awaitedMessageMatchersByNode.clear();
+	awaitedMessagesOutstanding = 0;
+
+	std::vector<SimulationMessage>& awaited = *this->awaitedTerminalOutputs;
+	awaitedMessageMatches.assign(awaited.size(), false);
+	for (u32 i = 0; i < awaited.size(); i++) {
+		if (awaited[i].isFound()) continue;
+		awaitedMessagesOutstanding++;
+		awaitedMessageIndicesByNode[awaited[i].getNodeId()].push_back(i);
+		//Regular expressions can not be merged into the automaton, they are checked one by one
+		if (!useRegex) {
+			awaitedMessageMatchersByNode[awaited[i].getNodeId()].AddPattern(awaited[i].getMessagePart(), i);
+		}
+	}
+	for (auto& entry : awaitedMessageMatchersByNode) {
+		entry.second.Build();
+	}
+}
+
+//Validates at most one awaited message of the given node with the message, returns true if one was found
+bool CherrySimTester::CheckAwaitedMessages(NodeId nodeId, const char* message)
+{
+	auto indicesIt = awaitedMessageIndicesByNode.find(nodeId);
+	if (indicesIt == awaitedMessageIndicesByNode.end()) return false;
+	std::vector<u32>& indices = indicesIt->second;
+	std::vector<SimulationMessage>& awaited = *this->awaitedTerminalOutputs;
+
+	if (useRegex) {
+		for (u32 i = 0; i < indices.size(); i++) {
+			if (awaited[indices[i]].checkAndSet(message, true)) {
+				indices.erase(indices.begin() + i);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	const MultiPatternMatcher& matcher = awaitedMessageMatchersByNode[nodeId];
+	matcher.FindAll(message, awaitedMessageMatches);
+
+	//Indices are sorted so that the first awaited message wins, same as checking them in order
+	bool found = false;
+	for (u32 i = 0; i < indices.size(); i++) {
+		if (!found && awaitedMessageMatches[indices[i]] && awaited[indices[i]].checkAndSet(message, false)) {
+			indices.erase(indices.begin() + i);
+			found = true;
+			i--;
+			continue;
+		}
+		awaitedMessageMatches[indices[i]] = false;
+	}
+	return found;
 }
 
 //Simulates until an event with a specific eventId is received that contains the binary data if given (binary data can be a part of the event)
@@ -469,6 +586,7 @@ void CherrySimTester::SendTerminalCommand(NodeId nodeId, const char* message, ..
 				SIMEXCEPTION(IllegalStateException); //Terminal of node is not active, cannot send message
 			}
 			GS->terminal.PutIntoReadBuffer(buffer);
+			sim->RecordTerminalInput(sim->currentNode, buffer);
 			if (config.verbose) {
 				printf("NODE %d TERM_IN: %s" EOL, sim->currentNode->id, buffer);
 			}
@@ -480,6 +598,7 @@ void CherrySimTester::SendTerminalCommand(NodeId nodeId, const char* message, ..
 			SIMEXCEPTION(IllegalStateException); //Terminal of node is not active, cannot send message
 		}
 		GS->terminal.PutIntoReadBuffer(buffer);
+		sim->RecordTerminalInput(sim->currentNode, buffer);
 		if (config.verbose) {
 			printf("NODE %d TERM_IN: %s" EOL, sim->currentNode->id, buffer);
 		}
@@ -519,21 +638,13 @@ void CherrySimTester::TerminalPrintHandler(nodeEntry* currentNode, const char* m
 
 	if (awaitedMessageResult[awaitedMessagePointer - 1] == '\n') {
 		awaitedMessageResult[awaitedMessagePointer - 1] = '\0';
-		std::vector<SimulationMessage>& awaited = *this->awaitedTerminalOutputs;
-		for (unsigned int i = 0; i < awaited.size(); i++) {
-			if (!awaited[i].isFound()) {
-				if (sim->currentNode->id == awaited[i].getNodeId())
-				{
-					if (awaited[i].checkAndSet(awaitedMessageResult, useRegex))
-					{
-						break; //A received message should validate only one awaited message.
-					}
-				}
-			}
+		//A received message should validate only one awaited message.
+		if (CheckAwaitedMessages(sim->currentNode->id, awaitedMessageResult)) {
+			awaitedMessagesOutstanding--;
 		}
-		
-		awaitedMessagesFound = std::all_of(awaited.begin(), awaited.end(), [](SimulationMessage& sm) {return sm.isFound(); });
-		
+
+		awaitedMessagesFound = awaitedMessagesOutstanding == 0;
+
 		awaitedMessagePointer = 0;
 	}
 }
@@ -613,6 +724,11 @@ NodeId SimulationMessage::getNodeId() const
 	return nodeId;
 }
 
+const std::string& SimulationMessage::getMessagePart() const
+{
+	return messagePart;
+}
+
 bool SimulationMessage::matches(const std::string & message)
 {
 	return message.find(messagePart) != std::string::npos;
@@ -626,6 +742,80 @@ void SimulationMessage::makeFound(const std::string & messageComplete)
 
 bool SimulationMessage::matchesRegex(const std::string & message)
 {
-	std::regex reg(messagePart);
-	return std::regex_search(message, reg);
+	//Compiling a regex is much more expensive than searching with it, so it is only done once
+	if (compiledRegex == nullptr) {
+		compiledRegex = std::make_shared<std::regex>(messagePart);
+	}
+	return std::regex_search(message, *compiledRegex);
+}
+
+MultiPatternMatcher::MultiPatternMatcher()
+{
+	states.emplace_back();
+}
+
+void MultiPatternMatcher::AddPattern(const std::string& pattern, u32 patternId)
+{
+	u32 state = 0;
+	for (char c : pattern) {
+		auto it = states[state].next.find(c);
+		if (it == states[state].next.end()) {
+			states.emplace_back();
+			u32 newState = (u32)states.size() - 1;
+			states[state].next[c] = newState;
+			state = newState;
+		}
+		else {
+			state = it->second;
+		}
+	}
+	states[state].patternIds.push_back(patternId);
+	if (patternId + 1 > numPatterns) numPatterns = patternId + 1;
+}
+
+void MultiPatternMatcher::Build()
+{
+	//Breadth first traversal so that the fail link of each state is already known when its children are processed
+	std::vector<u32> queue;
+	for (auto& child : states[0].next) {
+		states[child.second].fail = 0;
+		queue.push_back(child.second);
+	}
+	for (u32 i = 0; i < queue.size(); i++) {
+		u32 state = queue[i];
+		for (auto& child : states[state].next) {
+			u32 fail = states[state].fail;
+			while (fail != 0 && states[fail].next.find(child.first) == states[fail].next.end()) {
+				fail = states[fail].fail;
+			}
+			auto failIt = states[fail].next.find(child.first);
+			u32 childFail = (failIt != states[fail].next.end() && failIt->second != child.second) ? failIt->second : 0;
+			states[child.second].fail = childFail;
+			states[child.second].patternIds.insert(states[child.second].patternIds.end(), states[childFail].patternIds.begin(), states[childFail].patternIds.end());
+			queue.push_back(child.second);
+		}
+	}
+}
+
+void MultiPatternMatcher::FindAll(const char* text, std::vector<bool>& matchesOut) const
+{
+	if (matchesOut.size() < numPatterns) matchesOut.resize(numPatterns, false);
+
+	//Empty patterns match every text
+	for (u32 id : states[0].patternIds) matchesOut[id] = true;
+
+	u32 state = 0;
+	for (const char* c = text; *c != '\0'; c++) {
+		while (state != 0 && states[state].next.find(*c) == states[state].next.end()) {
+			state = states[state].fail;
+		}
+		auto it = states[state].next.find(*c);
+		if (it != states[state].next.end()) state = it->second;
+		for (u32 id : states[state].patternIds) matchesOut[id] = true;
+	}
+}
+
+u32 MultiPatternMatcher::GetNumPatterns() const
+{
+	return numPatterns;
 }
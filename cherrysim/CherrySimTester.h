@@ -30,6 +30,10 @@
 #pragma once
 
 #include <CherrySim.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <regex>
 
 constexpr int MAX_TERMINAL_OUTPUT = 1024;
 
@@ -46,6 +50,7 @@ private:
 	std::string messagePart;
 	std::string messageComplete = "";
 	bool        found = false;
+	std::shared_ptr<std::regex> compiledRegex; //Compiled on first use, shared between copies
 
 	bool matches(const std::string &message);
 	void makeFound(const std::string &messageComplete);
@@ -57,6 +62,30 @@ public:
 	bool isFound() const;
 	const std::string& getCompleteMessage() const;
 	NodeId getNodeId() const;
+	const std::string& getMessagePart() const;
+};
+
+//Aho-Corasick automaton that finds all patterns occuring in a text with a single pass over the text
+class MultiPatternMatcher
+{
+private:
+	struct State
+	{
+		std::map<char, u32> next;
+		u32 fail = 0;
+		std::vector<u32> patternIds; //All patterns that end in this state, including those reached through fail links
+	};
+	std::vector<State> states;
+	u32 numPatterns = 0;
+
+public:
+	MultiPatternMatcher();
+	void AddPattern(const std::string& pattern, u32 patternId);
+	//Must be called after all patterns were added and before searching
+	void Build();
+	//Sets matchesOut[patternId] for all patterns that occur in the text
+	void FindAll(const char* text, std::vector<bool>& matchesOut) const;
+	u32 GetNumPatterns() const;
 };
 
 class CherrySimTester : public TerminalPrintListener, public CherrySimEventListener
@@ -67,6 +96,11 @@ public:
 	//Used for awaiting specific terminal messages
 	std::vector<SimulationMessage>* awaitedTerminalOutputs = nullptr;
 	bool useRegex;
+	//The awaited messages are grouped by node so that output of other nodes is not matched at all
+	std::map<NodeId, std::vector<u32>> awaitedMessageIndicesByNode;
+	std::map<NodeId, MultiPatternMatcher> awaitedMessageMatchersByNode;
+	std::vector<bool> awaitedMessageMatches;
+	u32 awaitedMessagesOutstanding = 0;
 	char awaitedMessageResult[MAX_TERMINAL_OUTPUT];
 	u16 awaitedMessagePointer;
 	bool awaitedMessagesFound;
@@ -81,6 +115,8 @@ private:
 	CherrySimTesterConfig config;
 	SimConfiguration simConfig;
 	void _SimulateUntilMessageReceived(int timeoutMs);
+	void PrepareAwaitedMessages();
+	bool CheckAwaitedMessages(NodeId nodeId, const char* message);
 	bool started = false;
 
 public:
@@ -92,6 +128,15 @@ public:
 	//### Starting
 	void Start();
 
+	//### Forking
+	typedef std::function<void(CherrySimTester& tester)> TestCase;
+	//Runs warmUp once, which must start the tester and e.g. simulate until clustering is done. Every case is then run
+	//on its own copy of the warmed up simulation. On unix the copy is a forked process, which holds the complete
+	//state including all GlobalStates, connections, event queues, timers and the RNG, so the cases are isolated
+	//and deterministic. Other platforms repeat the deterministic warm up for each case.
+	//Returns the indices of all cases that threw an exception or had a failed assertion.
+	static std::vector<u32> RunCasesFromWarmedUpSimulation(const CherrySimTesterConfig& testerConfig, const SimConfiguration& simConfig, const TestCase& warmUp, const std::vector<TestCase>& cases);
+
 	//### Simulation methods
 	void SimulateUntilClusteringDone(int timeoutMs);
 	void SimulateUntilClusteringDoneWithDifferentNetworkIds(int timeoutMs);
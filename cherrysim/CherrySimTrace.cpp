@@ -0,0 +1,183 @@
+////////////////////////////////////////////////////////////////////////////////
+// /****************************************************************************
+// **
+// ** Copyright (C) 2015-2020 M-Way Solutions GmbH
+// ** Contact: https://www.blureange.io/licensing
+// **
+// ** This file is part of the Bluerange/FruityMesh implementation
+// **
+// ** $BR_BEGIN_LICENSE:GPL-EXCEPT$
+// ** Commercial License Usage
+// ** Licensees holding valid commercial Bluerange licenses may use this file in
+// ** accordance with the commercial license agreement provided with the
+// ** Software or, alternatively, in accordance with the terms contained in
+// ** a written agreement between them and M-Way Solutions GmbH.
+// ** For licensing terms and conditions see https://www.bluerange.io/terms-conditions. For further
+// ** information use the contact form at https://www.bluerange.io/contact.
+// **
+// ** GNU General Public License Usage
+// ** Alternatively, this file may be used under the terms of the GNU
+// ** General Public License version 3 as published by the Free Software
+// ** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+// ** included in the packaging of this file. Please review the following
+// ** information to ensure the GNU General Public License requirements will
+// ** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+// **
+// ** $BR_END_LICENSE$
+// **
+// ****************************************************************************/
+////////////////////////////////////////////////////////////////////////////////
+#include <CherrySimTrace.h>
+#include <Utility.h>
+#include <cstring>
+
+static const char traceMagic[8] = { 'F', 'M', 'T', 'R', 'A', 'C', 'E', '\0' };
+
+CherrySimTrace::~CherrySimTrace()
+{
+	Close();
+}
+
+bool CherrySimTrace::OpenForRecording(const char* path, u32 seed, u32 numNodes, u32 simTickDurationMs)
+{
+	Close();
+
+	recordFile.open(path, std::ios::binary | std::ios::trunc);
+	if (!recordFile.good()) return false;
+
+	SimTraceFileHeader header;
+	CheckedMemset(&header, 0, sizeof(header));
+	CheckedMemcpy(header.magic, traceMagic, sizeof(header.magic));
+	header.version = VERSION;
+	header.seed = seed;
+	header.numNodes = numNodes;
+	header.simTickDurationMs = simTickDurationMs;
+
+	recordFile.write((const char*)&header, sizeof(header));
+
+	return recordFile.good();
+}
+
+bool CherrySimTrace::IsRecording() const
+{
+	return recordFile.is_open();
+}
+
+void CherrySimTrace::Record(u32 timeMs, u16 nodeIndex, SimTraceEntryType type, const void* data, u32 length)
+{
+	if (!IsRecording()) return;
+
+	std::lock_guard<std::mutex> guard(recordMutex);
+
+	const u8* dataPtr = (const u8*)data;
+	do {
+		SimTraceEntryHeader header;
+		header.timeMs = timeMs;
+		header.nodeIndex = nodeIndex;
+		header.type = type;
+		header.length = length > MAX_ENTRY_LENGTH ? MAX_ENTRY_LENGTH : (u16)length;
+
+		recordFile.write((const char*)&header, sizeof(header));
+		recordFile.write((const char*)dataPtr, header.length);
+
+		dataPtr += header.length;
+		length -= header.length;
+	} while (length > 0);
+}
+
+void CherrySimTrace::Flush()
+{
+	if (!IsRecording()) return;
+
+	std::lock_guard<std::mutex> guard(recordMutex);
+	recordFile.flush();
+}
+
+void CherrySimTrace::Close()
+{
+	if (!IsRecording()) return;
+
+	std::lock_guard<std::mutex> guard(recordMutex);
+	recordFile.close();
+}
+
+bool CherrySimTrace::LoadForReplay(const char* path, u32 seed, u32 numNodes, u32 simTickDurationMs)
+{
+	replayNodes.clear();
+
+	std::ifstream file(path, std::ios::binary);
+	if (!file.good()) return false;
+
+	SimTraceFileHeader header;
+	if (!file.read((char*)&header, sizeof(header))) return false;
+
+	if (
+		   memcmp(header.magic, traceMagic, sizeof(header.magic)) != 0
+		|| header.version           != VERSION
+		|| header.seed              != seed
+		|| header.numNodes          != numNodes
+		|| header.simTickDurationMs != simTickDurationMs
+		)
+	{
+		return false;
+	}
+
+	replayNodes.resize(numNodes);
+
+	SimTraceEntryHeader entryHeader;
+	while (file.read((char*)&entryHeader, sizeof(entryHeader)))
+	{
+		SimTraceEntry entry;
+		entry.timeMs = entryHeader.timeMs;
+		entry.type = entryHeader.type;
+		entry.data.resize(entryHeader.length);
+		if (entryHeader.length > 0 && !file.read((char*)entry.data.data(), entryHeader.length)) {
+			//The simulator probably crashed while the last entry was written, everything before is still usable
+			break;
+		}
+		if (entryHeader.nodeIndex >= numNodes) {
+			replayNodes.clear();
+			return false;
+		}
+
+		SimTraceNodeReplay& node = replayNodes[entryHeader.nodeIndex];
+		switch (entry.type)
+		{
+			case SimTraceEntryType::BLE_EVENT:
+				node.bleEvents.push_back(std::move(entry));
+				break;
+			case SimTraceEntryType::UART_INPUT:
+			case SimTraceEntryType::TERMINAL_INPUT:
+				node.inputs.push_back(std::move(entry));
+				break;
+			case SimTraceEntryType::FLASH_COMPLETION:
+				node.flashCompletions.push_back(std::move(entry));
+				break;
+			case SimTraceEntryType::RANDOM:
+			{
+				const size_t numValues = entry.data.size() / sizeof(u32);
+				const size_t oldSize = node.randomValues.size();
+				node.randomValues.resize(oldSize + numValues);
+				CheckedMemcpy(node.randomValues.data() + oldSize, entry.data.data(), numValues * sizeof(u32));
+
+				if (!node.randomValueCheckpoints.empty() && node.randomValueCheckpoints.back().first == entry.timeMs) {
+					node.randomValueCheckpoints.back().second = node.randomValues.size();
+				}
+				else {
+					node.randomValueCheckpoints.push_back(std::make_pair(entry.timeMs, node.randomValues.size()));
+				}
+				break;
+			}
+			default:
+				replayNodes.clear();
+				return false;
+		}
+	}
+
+	return true;
+}
+
+bool CherrySimTrace::IsReplaying() const
+{
+	return !replayNodes.empty();
+}
@@ -0,0 +1,123 @@
+////////////////////////////////////////////////////////////////////////////////
+// /****************************************************************************
+// **
+// ** Copyright (C) 2015-2020 M-Way Solutions GmbH
+// ** Contact: https://www.blureange.io/licensing
+// **
+// ** This file is part of the Bluerange/FruityMesh implementation
+// **
+// ** $BR_BEGIN_LICENSE:GPL-EXCEPT$
+// ** Commercial License Usage
+// ** Licensees holding valid commercial Bluerange licenses may use this file in
+// ** accordance with the commercial license agreement provided with the
+// ** Software or, alternatively, in accordance with the terms contained in
+// ** a written agreement between them and M-Way Solutions GmbH.
+// ** For licensing terms and conditions see https://www.bluerange.io/terms-conditions. For further
+// ** information use the contact form at https://www.bluerange.io/contact.
+// **
+// ** GNU General Public License Usage
+// ** Alternatively, this file may be used under the terms of the GNU
+// ** General Public License version 3 as published by the Free Software
+// ** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+// ** included in the packaging of this file. Please review the following
+// ** information to ensure the GNU General Public License requirements will
+// ** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+// **
+// ** $BR_END_LICENSE$
+// **
+// ****************************************************************************/
+////////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+#include <types.h>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+/*
+ * A trace contains everything that the firmware of the nodes received from the outside during a simulation:
+ * the BLE events fetched from the SoftDevice, UART and terminal input, completed flash operations and all
+ * random numbers that were drawn while the firmware was executing. The radio, the connections and everything
+ * else that the simulator generates are not part of the trace.
+ * During a replay, the replayed nodes are fed from the trace instead of the simulator so that a failure seen
+ * after a long run can be reproduced and debugged for a few nodes without simulating the rest of the mesh.
+ * A replay always starts with the boot of the nodes at time 0. Seeking to a later point is not supported as the
+ * trace contains no snapshot of the firmware state (RAM, flash and SoftDevice) that the nodes had at that point.
+ */
+
+enum class SimTraceEntryType : u8
+{
+	BLE_EVENT        = 0, //u32 globalId followed by the event buffer of the node, trailing zeros are removed
+	UART_INPUT       = 1, //Bytes that were put into the uart buffer of the node
+	TERMINAL_INPUT   = 2, //A line that was put into the terminal read buffer of the node
+	FLASH_COMPLETION = 3, //A u8 with the FruityHal::SystemEvents that was dispatched for a flash operation
+	RANDOM           = 4, //u32 values drawn from the simulator random number generator by the firmware
+};
+
+#pragma pack(push, 1)
+struct SimTraceFileHeader
+{
+	char magic[8];
+	u32 version;
+	u32 seed;
+	u32 numNodes;
+	u32 simTickDurationMs;
+};
+
+struct SimTraceEntryHeader
+{
+	u32 timeMs;
+	u16 nodeIndex;
+	SimTraceEntryType type;
+	u16 length;
+};
+#pragma pack(pop)
+
+struct SimTraceEntry
+{
+	u32 timeMs = 0;
+	SimTraceEntryType type = SimTraceEntryType::BLE_EVENT;
+	std::vector<u8> data;
+};
+
+//The recorded inputs of a single node together with the current replay position
+struct SimTraceNodeReplay
+{
+	std::vector<SimTraceEntry> bleEvents;
+	std::vector<SimTraceEntry> inputs; //Uart and terminal input
+	std::vector<SimTraceEntry> flashCompletions;
+	std::vector<u32> randomValues;
+	std::vector<std::pair<u32, size_t>> randomValueCheckpoints; //Number of random values drawn until the end of the given time
+
+	size_t nextBleEvent = 0;
+	size_t nextInput = 0;
+	size_t nextFlashCompletion = 0;
+	size_t nextRandomValue = 0;
+	size_t nextRandomValueCheckpoint = 0;
+	bool diverged = false;
+};
+
+class CherrySimTrace
+{
+private:
+	static constexpr u32 VERSION = 1;
+	static constexpr u16 MAX_ENTRY_LENGTH = 0xFFFC; //Longer data is split into several entries, keeps u32 values intact
+
+	std::ofstream recordFile;
+	std::mutex recordMutex; //Terminal input of the runner is recorded from its terminal thread
+
+public:
+	std::vector<SimTraceNodeReplay> replayNodes; //Only filled if a trace was loaded for replaying
+
+	~CherrySimTrace();
+
+	bool OpenForRecording(const char* path, u32 seed, u32 numNodes, u32 simTickDurationMs);
+	bool IsRecording() const;
+	void Record(u32 timeMs, u16 nodeIndex, SimTraceEntryType type, const void* data, u32 length);
+	void Flush();
+	void Close();
+
+	//Loads all entries of a trace, returns false if the file is missing or was recorded with another configuration
+	bool LoadForReplay(const char* path, u32 seed, u32 numNodes, u32 simTickDurationMs);
+	bool IsReplaying() const;
+};
@@ -31,6 +31,8 @@
 #include <types.h>
 #include <GlobalState.h>
 #include <queue>
+#include <vector>
+#include <map>
 #include "SimpleArray.h"
 #include "MersenneTwister.h"
 #ifndef GITHUB_RELEASE
@@ -53,10 +55,44 @@ constexpr int SIM_MAX_CONNECTION_NUM = 10; //Maximum total num of connections su
 constexpr int SIM_NUM_RELIABLE_BUFFERS   = 1;
 constexpr int SIM_NUM_UNRELIABLE_BUFFERS = 7;
 
+//Timings for the airtime link layer model, LE 1M PHY with a 27 byte link layer payload (no data length extension)
+constexpr u32 SIM_LL_US_PER_BYTE          = 8;
+constexpr u32 SIM_LL_PDU_OVERHEAD_BYTES   = 1 + 4 + 2 + 3; //Preamble, access address, header and CRC
+constexpr u32 SIM_LL_MIC_BYTES            = 4;
+constexpr u32 SIM_LL_MAX_PAYLOAD_BYTES    = 27;
+constexpr u32 SIM_LL_L2CAP_ATT_HEADER_BYTES = 4 + 3; //L2CAP header plus ATT opcode and handle
+constexpr u32 SIM_LL_T_IFS_US             = 150;
+constexpr u32 SIM_ADVERTISING_EVENT_US    = 1500; //Advertising on three channels including the radio ramp up
+
+enum class LinkLayerModel : u8 {
+	LEGACY  = 0, //A random number of packets is sent each connection interval, independent of timings
+	AIRTIME = 1, //Packets are sent in connection events according to their airtime on a shared radio timeline
+};
+
+//State and statistics of a connection that are only used by the airtime link layer model
+struct SimLinkLayerState {
+	uint64_t nextConnectionEventUs = 0; //Node time at which the next connection event starts
+	u32 lastSuccessfulExchangeMs = 0;
+	u32 currentPacketGlobalId = 0; //Packet whose link layer fragments are currently being sent
+	u32 currentPacketFragmentsSent = 0;
+	bool currentPacketDelivered = false; //The partner received the packet, but the acknowledgement of its last fragment was lost
+	bool writeResponsePending = false; //A WRITE_REQ was transmitted and is answered in the next connection event
+	u32 writeResponseGlobalPacketId = 0;
+
+	u32 connectionEvents = 0;
+	u32 missedConnectionEvents = 0;
+	u32 retransmissions = 0;
+	u32 payloadBytesSent = 0;
+};
+
 constexpr int SIM_NUM_SERVICES = 6;
 constexpr int SIM_NUM_CHARS    = 5;
 
+//Packet statistics are open addressing hash tables, both sizes must be a power of two
 constexpr int PACKET_STAT_SIZE = 2*1024;
+constexpr int PACKET_LINK_STAT_SIZE = 64;
+static_assert((PACKET_STAT_SIZE & (PACKET_STAT_SIZE - 1)) == 0, "PACKET_STAT_SIZE must be a power of two");
+static_assert((PACKET_LINK_STAT_SIZE & (PACKET_LINK_STAT_SIZE - 1)) == 0, "PACKET_LINK_STAT_SIZE must be a power of two");
 
 #define PSRNG() (cherrySimInstance->simState.rnd.nextDouble())
 #define PSRNGINT(min, max) ((u32)cherrySimInstance->simState.rnd.nextU32(min, max)) //Generates random int from min (inclusive) up to max (inclusive)
@@ -70,6 +106,150 @@ typedef struct {
 	u32 additionalInfo; //Can be used to store a pointer or other information
 } simBleEvent;
 
+//Energy is attributed to these categories for each node
+enum class EnergyCategory : u8 {
+	IDLE              = 0,
+	LED               = 1,
+	ADVERTISING       = 2,
+	SCANNING          = 3,
+	CONNECTION_EVENTS = 4,
+	FLASH             = 5,
+	CPU               = 6,
+	NUM_CATEGORIES    = 7,
+};
+
+//The average current of a periodic activity at a given interval, without the idle current
+struct EnergyCurvePoint {
+	u32 intervalMs;
+	double currentUa;
+};
+
+//Costs of a chipset that are used by the energy model, can be loaded from a json file (see energy_profiles.json)
+//The built in profile only contains the average currents that were measured for periodic activities, costs of single
+//operations are only known from a profile file.
+struct EnergyProfile {
+	double idleCurrentUa = 10;
+	double ledCurrentUa = 10 * 1000;
+	double scanCurrentUa = 11 * 1000; //At a 100% duty cycle, also used for connecting
+	std::vector<EnergyCurvePoint> advertisingCurve = { {20, 800}, {100, 220}, {200, 110}, {400, 84}, {1000, 70}, {2000, 50}, {4000, 63}, {30000, 30} };
+	std::vector<EnergyCurvePoint> connectionCurve = { {7, 1000}, {10, 900}, {15, 750}, {30, 600}, {100, 130} };
+	double radioChargePerPayloadByteNc = 0; //Additional charge for each byte that is sent in a connection
+	double flashPageEraseChargeNc = 0;
+	double flashWriteChargePerWordNc = 0;
+	double cpuChargePerEventNc = 0; //Charge for waking up and processing one BLE event
+
+	//Interpolates the current of a periodic activity for any interval
+	static double GetCurrentForInterval(const std::vector<EnergyCurvePoint>& curve, u32 intervalMs);
+};
+
+//Charge that a node consumed, split by category
+struct NodeEnergyStats {
+	double chargeNc[(u32)EnergyCategory::NUM_CATEGORIES] = {};
+	std::map<ModuleId, double> scanRadioOnMsByOwner; //Radio-on time of scanning, split among the owners of the scan jobs
+
+	double GetTotalChargeNc() const
+	{
+		double total = 0;
+		for (u32 i = 0; i < (u32)EnergyCategory::NUM_CATEGORIES; i++) total += chargeNc[i];
+		return total;
+	}
+	double GetAverageCurrentUa(EnergyCategory category, u32 timeMs) const
+	{
+		return timeMs == 0 ? 0 : chargeNc[(u32)category] / timeMs;
+	}
+	double GetAverageCurrentUa(u32 timeMs) const
+	{
+		return timeMs == 0 ? 0 : GetTotalChargeNc() / timeMs;
+	}
+};
+
+//A ring of BLE events that are pending for a node. The storage is allocated once and only grows if the
+//queue is ever full so that no allocation happens per event. Events are accessed in place.
+class SimBleEventQueue {
+private:
+	std::vector<simBleEvent> ring;
+	u32 readIndex = 0;
+	u32 numElements = 0;
+	u32 highWaterMark = 0;
+	bool dropGeneratedEvents = false;
+
+	void Grow()
+	{
+		std::vector<simBleEvent> newRing(ring.size() * 2);
+		for (u32 i = 0; i < numElements; i++) {
+			newRing[i] = (*this)[i];
+		}
+		ring.swap(newRing);
+		readIndex = 0;
+	}
+
+public:
+	static constexpr u32 INITIAL_CAPACITY = 64;
+
+	SimBleEventQueue() : ring(INITIAL_CAPACITY) {}
+
+	//Returns a slot at the end of the queue that the caller fills
+	simBleEvent& emplace_back()
+	{
+		if (numElements == ring.size()) Grow();
+		simBleEvent& slot = ring[(readIndex + numElements) % ring.size()];
+		numElements++;
+		if (numElements > highWaterMark) highWaterMark = numElements;
+		return slot;
+	}
+	void push_back(const simBleEvent& event)
+	{
+		if (dropGeneratedEvents) return;
+		emplace_back() = event;
+	}
+	//While a node is replayed from a trace, it must only receive the recorded events and
+	//all events generated by the simulator are dropped
+	void SetDropGeneratedEvents(bool drop)
+	{
+		dropGeneratedEvents = drop;
+	}
+	void push_back_recorded(const simBleEvent& event)
+	{
+		emplace_back() = event;
+	}
+	simBleEvent& front()
+	{
+		return ring[readIndex];
+	}
+	void pop_front()
+	{
+		if (numElements == 0) return;
+		readIndex = (readIndex + 1) % ring.size();
+		numElements--;
+	}
+	simBleEvent& operator[](u32 index)
+	{
+		return ring[(readIndex + index) % ring.size()];
+	}
+	const simBleEvent& operator[](u32 index) const
+	{
+		return ring[(readIndex + index) % ring.size()];
+	}
+	u32 size() const
+	{
+		return numElements;
+	}
+	u32 capacity() const
+	{
+		return (u32)ring.size();
+	}
+	//The high water mark is kept so that event storms are still visible after a reboot of the node
+	void clear()
+	{
+		readIndex = 0;
+		numElements = 0;
+	}
+	u32 GetHighWaterMark() const
+	{
+		return highWaterMark;
+	}
+};
+
 
 //A packet that is buffered in the SoftDevice for sending
 struct nodeEntry;
@@ -89,6 +269,7 @@ typedef struct {
 
 } SoftDeviceBufferedPacket;
 
+//The first packetStatCompareBytes bytes of a PacketStat are its key in the hash table
 constexpr int packetStatCompareBytes = 4;
 struct PacketStat {
 	MessageType messageType = MessageType::INVALID;
@@ -96,6 +277,14 @@ struct PacketStat {
 	u8 actionType = 0;
 	u8 isSplit = 0;
 	u32 count = 0;
+	u32 bytes = 0;
+};
+
+//Counts all packets that a node queued for a single connection partner
+struct PacketLinkStat {
+	int partnerId = 0; //0 marks an empty slot
+	u32 count = 0;
+	u32 bytes = 0;
 };
 
 
@@ -119,6 +308,8 @@ typedef struct SoftdeviceConnection {
 	//Clustering validity
 	i16 validityClusterSizeToSend;
 
+	SimLinkLayerState linkLayer;
+
 } SoftdeviceConnection;
 
 typedef struct
@@ -189,6 +380,9 @@ typedef struct {
 
 	uint32_t currentlyEnabledUartInterrupts = 0;
 
+	//Share of the connection events that fit on the radio timeline during the last step (airtime link layer model)
+	double connectionEventShare = 1.0;
+
 	//Memory configuration
 	u8 configuredPeripheralConnectionCount = 0;
 	u8 configuredCentralConnectionCount = 0;
@@ -196,6 +390,9 @@ typedef struct {
 
 	//Clustering validity
 	i16 validityClusterSize;
+	u32 validityRealClusterSize = 0;
+	u32 validitySignature = 0; //Hash over the cluster state of this node
+	bool validityNeedsRecheck = true; //Set by handshakes, cluster updates and disconnects and if the last check could not be sure that the result stays the same
 
 } SoftdeviceState;
 
@@ -216,10 +413,12 @@ typedef struct nodeEntry {
 	NRF_GPIO_Type gpio;
 	u8 flash[SIM_MAX_FLASH_SIZE];
 	SoftdeviceState state;
-	std::deque<simBleEvent> eventQueue;
-	simBleEvent currentEvent; //The event currently being processed, as a simBleEvent, this can have some additional data attached to it useful for debugging
+	SimBleEventQueue eventQueue;
+	u32 currentEventGlobalId = 0; //The globalId of the event currently being processed, useful for debugging
+	bool replayedFromTrace = false; //The inputs of the node are taken from the trace that is replayed
 	bool ledOn;
-	u32 nanoAmperePerMsTotal;
+	u32 nanoAmperePerMsTotal; //Total consumed charge in nC, same as energy.GetTotalChargeNc() but saturated at UINT32_MAX
+	NodeEnergyStats energy;
 	u8 *moduleMemoryBlock = nullptr;
 
 	uint32_t restartCounter = 0; //Counts how many times the node was restarted
@@ -249,6 +448,8 @@ typedef struct nodeEntry {
 	//Statistics
 	PacketStat sentPackets[PACKET_STAT_SIZE];
 	PacketStat routedPackets[PACKET_STAT_SIZE];
+	PacketLinkStat linkStats[PACKET_LINK_STAT_SIZE];
+	u32 terminalOutputBytes = 0; //All bytes that the node printed on its terminal, e.g. the uart of a sink
 
 } nodeEntry;
 
@@ -293,6 +494,15 @@ struct SimConfiguration {
 	const char* storeFlashToFile              = nullptr;
 
 	bool verboseCommands                      = false;
+	u32 jsonValidationSampleRate              = 0; //Parse every Nth json message of a node to validate it, 0 only parses json when it is accessed
+
+	char energyProfilePath[100]               = {}; //Json file with energy profiles per chipset, the built in profile is used if empty
+	LinkLayerModel linkLayerModel             = LinkLayerModel::LEGACY;
+	u32 connectionEventLengthUs               = 5000; //Must match the event_length configured for the SoftDevice, extended if the radio is free
+	bool enableWebServer                      = true; //Serves the fruitymap on port 5555, must be disabled if several simulators run at the same time
+	char traceRecordPath[100]                 = {}; //Records the inputs of all nodes into this file so that they can be replayed
+	char traceReplayPath[100]                 = {}; //Feeds the nodes with the inputs from this trace instead of simulating them
+	std::vector<u32> replayNodeIds; //Ids of the nodes that are replayed from the trace, empty for all nodes. Other nodes are not simulated
 
 
 	//BLE Stack capabilities
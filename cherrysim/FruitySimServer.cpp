@@ -56,6 +56,9 @@
 This provides a basic webserver that serves the fruitymap and information about the mesh.
 The only thing necessary to view the simulation is a browser, that's it :-)
 
+Besides polling /devices, the fruitymap can open /stream, which is a Server-Sent Events stream.
+It receives a full snapshot once and afterwards only the devices that changed since the last push.
+
 FIXME: Objects are currently not destroyed properly, so the application will crash when closing
 */
 
@@ -87,6 +90,181 @@ static WSACleanuper wsaCleanuper;
 
 #endif // SIM_SERVER_PRESENT
 
+#if defined(SIM_SERVER_PRESENT)
+static std::string GetDeviceUuid(u32 nodeIndex)
+{
+	//UUID is generated based on the node index
+	char uuid[50];
+	sprintf(uuid, "00000000-1111-2222-3333-00000000%04u", nodeIndex);
+	return uuid;
+}
+
+//Get the only handshaked inConnection
+//TODO: The inConnection is only used to draw the direction arrow in the fruitymap, but currently
+//the json only supports communicating 1 inConnection, this should be changed at some point so that
+//Each connection can report its direction and masterBit
+static MeshConnection* GetHandshakedInConnection(nodeEntry* node)
+{
+	auto inConnections = node->gs.cm.GetMeshConnections(ConnectionDirection::DIRECTION_IN);
+	MeshConnection* inConnection = nullptr;
+	for (int k = 0; k < inConnections.count; k++) {
+		if (inConnections.connections[k]->handshakeDone()) {
+			inConnection = inConnections.connections[k];
+		}
+	}
+	return inConnection;
+}
+
+//Returns the MeshConnection of the partner that belongs to the given inConnection
+static MeshConnection* GetPartnerConnection(nodeEntry* node, const MeshConnection* inConnection)
+{
+	SoftdeviceConnection* foundSoftdeviceConnection = cherrySimInstance->findConnectionByHandle(node, inConnection->connectionHandle);
+	//We must check if the simulator connection still exists as it might have been cleaned up already
+	if (foundSoftdeviceConnection == nullptr) return nullptr;
+
+	nodeEntry* partnerNode = foundSoftdeviceConnection->partner;
+	MeshConnections conn = partnerNode->gs.cm.GetMeshConnections(ConnectionDirection::DIRECTION_OUT);
+	for (int k = 0; k < conn.count; k++) {
+		if (conn.connections[k]->connectionHandle == inConnection->connectionHandle) {
+			return conn.connections[k];
+		}
+	}
+	return nullptr;
+}
+
+//Hashes everything that GenerateDeviceJson reads from the node. It does not allocate, so it can be
+//computed for all nodes on every push and only the devices whose signature changed are serialized.
+u32 FruitySimServer::GetDeviceSignature(nodeEntry* node)
+{
+	u32 hash = 2166136261u;
+	auto add = [&hash](u32 value) {
+		hash = (hash ^ value) * 16777619u;
+	};
+	auto addPosition = [&add](const nodeEntry* node) {
+		u32 bits[2];
+		CheckedMemcpy(&bits[0], &node->x, sizeof(u32));
+		CheckedMemcpy(&bits[1], &node->y, sizeof(u32));
+		add(bits[0]);
+		add(bits[1]);
+	};
+
+	add(node->gs.config.GetSerialNumberIndex());
+	add(node->ledOn);
+	add(node->gs.node.connectionLossCounter);
+	add(node->gs.node.clusterId);
+	add((u32)node->gs.node.clusterSize);
+	add(node->gs.node.configuration.nodeId);
+	add(node->gs.cm.freeMeshInConnections);
+	add(node->gs.cm.freeMeshOutConnections);
+	addPosition(node);
+
+	MeshConnection* inConnection = GetHandshakedInConnection(node);
+	if (inConnection != nullptr) {
+		add(inConnection->connectionHandle);
+		add(inConnection->partnerId);
+		add(inConnection->connectionMasterBit);
+		MeshConnection* partnerConnection = GetPartnerConnection(node, inConnection);
+		add(partnerConnection != nullptr && partnerConnection->connectionMasterBit);
+		SoftdeviceConnection* sdInConn = cherrySimInstance->findConnectionByHandle(node, inConnection->connectionHandle);
+		if (sdInConn != nullptr) addPosition(sdInConn->partner);
+	}
+
+	add(node->state.advertisingActive);
+	if (node->state.advertisingActive) {
+		add(node->state.advertisingDataLength);
+		for (u32 i = 0; i < node->state.advertisingDataLength; i++) add(node->state.advertisingData[i]);
+	}
+
+	for (int j = 0; j < node->state.configuredTotalConnectionCount; j++) {
+		if (node->state.connections[j].connectionActive) {
+			add(node->state.connections[j].connectionHandle);
+			add(node->state.connections[j].partner->gs.node.configuration.nodeId);
+		}
+	}
+
+	return hash;
+}
+
+template<typename Json>
+Json FruitySimServer::GenerateDeviceJson(nodeEntry* node)
+{
+	Json device;
+
+	MeshConnection* inConnection = GetHandshakedInConnection(node);
+
+	device["uuid"] = GetDeviceUuid(node->index);
+	device["deviceId"] = node->gs.config.GetSerialNumber();
+	device["platform"] = "BLENODE";
+	device["ledOn"] = node->ledOn;
+	device["inConnectionHasMasterBit"] = false;
+	device["inConnectionPartnerHasMasterBit"] = false;
+
+	//Find out who has the master bit of the inConnection
+	if(inConnection != nullptr) device["inConnectionHasMasterBit"] = inConnection->connectionMasterBit == 1;
+
+	bool partnerHasMB = false;
+
+	if (inConnection != nullptr) {
+		MeshConnection* partnerConnection = GetPartnerConnection(node, inConnection);
+		if (partnerConnection != nullptr) partnerHasMB = partnerConnection->connectionMasterBit;
+	}
+
+	device["inConnectionPartnerHasMasterBit"] = partnerHasMB;
+
+	device["connectionLossCounter"] = node->gs.node.connectionLossCounter;
+	device["inConnectionPartner"] = inConnection == nullptr ? 0 : inConnection->partnerId;
+
+
+	//FIXME: This mixes fruitymesh and simulator connections, but should only use simulator data
+	if (inConnection != nullptr) {
+		SoftdeviceConnection* sdInConn = cherrySimInstance->findConnectionByHandle(node, inConnection->connectionHandle);
+		if (sdInConn != nullptr) device["inConnectionRssi"] = (int)cherrySimInstance->GetReceptionRssi(node, sdInConn->partner);
+	}
+	else {
+		device["inConnectionRssi"] = 0;
+	}
+
+
+	char advData[200];
+	if (node->state.advertisingActive) {
+		Logger::convertBufferToHexString(node->state.advertisingData, node->state.advertisingDataLength, advData, sizeof(advData));
+	}
+	else {
+		sprintf(advData, "Not advertising");
+	}
+
+	device["details"] = {
+		{"platform", "BLENODE"},
+		{"clusterId", node->gs.node.clusterId},
+		{"clusterSize", node->gs.node.clusterSize},
+		{"nodeId", node->gs.node.configuration.nodeId},
+		{"serialNumber", node->gs.config.GetSerialNumber()},
+		{"connections", Json::array()},
+		{"nonConnections", Json::array()},
+		{"lastSentAdvertisingMessage", advData},
+		{"freeIn", node->gs.cm.freeMeshInConnections},
+		{"freeOut", node->gs.cm.freeMeshOutConnections}
+	};
+	for (int j = 0; j < node->state.configuredTotalConnectionCount; j++) {
+		if (node->state.connections[j].connectionActive) {
+			Json connection;
+			connection["handle"] = node->state.connections[j].connectionHandle;
+			connection["rssi"] = 7;
+			connection["target"] = node->state.connections[j].partner->gs.node.configuration.nodeId;
+
+			device["details"]["connections"].push_back(connection);
+		}
+	}
+	device["properties"] = {
+		{"onMap", "true"},
+		{"x", node->x},
+		{"y", node->y}
+	};
+
+	return device;
+}
+#endif // SIM_SERVER_PRESENT
+
 FruitySimServer::FruitySimServer()
 {
 	StartServer();
@@ -118,13 +296,13 @@ int FruitySimServer::StartServer()
 	char const SrvAddress[] = "0.0.0.0";
 	std::uint16_t SrvPort = 5555;
 	server = new std::unique_ptr<evhttp, decltype(&evhttp_free)>(evhttp_start(SrvAddress, SrvPort), &evhttp_free);
-	if (!server)
+	if (!*server)
 	{
 		std::cerr << "Failed to init http server." << std::endl;
 		return -1;
 	}
 
-	void(*OnReq)(evhttp_request *req, void *) = [](evhttp_request *req, void *)
+	void(*OnReq)(evhttp_request *req, void *) = [](evhttp_request *req, void * arg)
 	{
 		FILE* file = nullptr;
 	
@@ -132,7 +310,13 @@ int FruitySimServer::StartServer()
 		if (!OutBuf)
 			return;
 
-		if (strstr(req->uri, "/devices") != nullptr)
+		if (strstr(req->uri, "/stream") != nullptr)
+		{
+			//The reply is kept open and is completed once the client disconnects
+			((FruitySimServer*)arg)->OpenStream(req);
+			return;
+		}
+		else if (strstr(req->uri, "/devices") != nullptr)
 		{
 			std::string devices = GenerateDevicesJson();
 	
@@ -189,7 +373,7 @@ int FruitySimServer::StartServer()
 		evhttp_send_reply(req, HTTP_OK, "OK", OutBuf);
 	};
 	
-	evhttp_set_gencb(server->get(), OnReq, nullptr);
+	evhttp_set_gencb(server->get(), OnReq, this);
 #endif // SIM_SERVER_PRESENT
 	return 0;
 }
@@ -197,6 +381,12 @@ int FruitySimServer::StartServer()
 FruitySimServer::~FruitySimServer()
 {
 #if defined(SIM_SERVER_PRESENT)
+	//Freeing the server closes all connections, we do not want to be called back for our streams anymore
+	for (const StreamClient& client : streamClients) {
+		evhttp_connection_set_closecb(client.connection, nullptr, nullptr);
+	}
+	streamClients.clear();
+
 	if (server != nullptr) delete server;
 	server = nullptr;
 	event_base_free(eventBase);
@@ -207,9 +397,109 @@ void FruitySimServer::ProcessServerRequests()
 {
 #if defined(SIM_SERVER_PRESENT)
 	event_base_loop(eventBase, EVLOOP_NONBLOCK);
+
+	PushStreamDeltas();
 #endif // SIM_SERVER_PRESENT
 }
 
+#if defined(SIM_SERVER_PRESENT)
+void FruitySimServer::OpenStream(evhttp_request* req)
+{
+	evhttp_add_header(evhttp_request_get_output_headers(req), "Content-Type", "text/event-stream");
+	evhttp_add_header(evhttp_request_get_output_headers(req), "Cache-Control", "no-cache");
+	evhttp_send_reply_start(req, HTTP_OK, "OK");
+
+	StreamClient client;
+	client.request = req;
+	client.connection = evhttp_request_get_connection(req);
+	evhttp_connection_set_closecb(client.connection, &FruitySimServer::OnStreamClosed, this);
+
+	json devices = json::array();
+	u32 numNodes = cherrySimInstance->getNumNodes();
+	for (u32 i = 0; i < numNodes; i++) {
+		devices.push_back(GenerateDeviceJson<json>(&cherrySimInstance->nodes[i]));
+	}
+
+	//If nobody was listening, the signatures are outdated and the deltas start from this snapshot.
+	//Otherwise the next delta might repeat some devices for this client, which is harmless.
+	if (streamClients.empty()) {
+		lastPushedDeviceSignatures.resize(numNodes);
+		for (u32 i = 0; i < numNodes; i++) {
+			lastPushedDeviceSignatures[i] = GetDeviceSignature(&cherrySimInstance->nodes[i]);
+		}
+		lastStreamPush = std::chrono::steady_clock::now();
+	}
+	streamClients.push_back(client);
+
+	json snapshot;
+	snapshot["seq"] = streamSequenceNumber;
+	snapshot["result"] = std::move(devices);
+	SendStreamEvent(client, "snapshot", snapshot.dump());
+}
+
+void FruitySimServer::OnStreamClosed(evhttp_connection* connection, void* arg)
+{
+	FruitySimServer* self = (FruitySimServer*)arg;
+	for (auto it = self->streamClients.begin(); it != self->streamClients.end(); ) {
+		if (it->connection == connection) it = self->streamClients.erase(it);
+		else ++it;
+	}
+}
+
+void FruitySimServer::PushStreamDeltas()
+{
+	if (streamClients.empty()) return;
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (now - lastStreamPush < std::chrono::milliseconds(STREAM_PUSH_INTERVAL_MS)) return;
+	lastStreamPush = now;
+
+	json changed = json::array();
+	json removed = json::array();
+	u32 numNodes = cherrySimInstance->getNumNodes();
+	for (u32 i = 0; i < numNodes; i++) {
+		u32 signature = GetDeviceSignature(&cherrySimInstance->nodes[i]);
+		if (i >= lastPushedDeviceSignatures.size()) {
+			lastPushedDeviceSignatures.push_back(signature);
+		}
+		else if (lastPushedDeviceSignatures[i] == signature) {
+			continue;
+		}
+		lastPushedDeviceSignatures[i] = signature;
+		changed.push_back(GenerateDeviceJson<json>(&cherrySimInstance->nodes[i]));
+	}
+	for (u32 i = numNodes; i < lastPushedDeviceSignatures.size(); i++) {
+		removed.push_back(GetDeviceUuid(i));
+	}
+	lastPushedDeviceSignatures.resize(numNodes);
+
+	if (changed.empty() && removed.empty()) return;
+
+	streamSequenceNumber++;
+	json delta;
+	delta["seq"] = streamSequenceNumber;
+	delta["changed"] = std::move(changed);
+	delta["removed"] = std::move(removed);
+	std::string data = delta.dump();
+
+	for (const StreamClient& client : streamClients) {
+		SendStreamEvent(client, "delta", data);
+	}
+}
+
+void FruitySimServer::SendStreamEvent(const StreamClient& client, const char* eventName, const std::string& data) const
+{
+	//json::dump without indentation does not contain newlines, so the data fits in a single data field
+	evbuffer* buffer = evbuffer_new();
+	if (buffer == nullptr) return;
+	evbuffer_add_printf(buffer, "event: %s\ndata: ", eventName);
+	evbuffer_add(buffer, data.c_str(), data.size());
+	evbuffer_add(buffer, "\n\n", 2);
+	evhttp_send_reply_chunk(client.request, buffer);
+	evbuffer_free(buffer);
+}
+#endif // SIM_SERVER_PRESENT
+
 #if defined(SIM_SERVER_PRESENT)
 std::string FruitySimServer::GenerateSiteJson()
 {
@@ -231,103 +521,7 @@ std::string FruitySimServer::GenerateDevicesJson()
 	devices["status"] = "success";
 	u32 numNodes = cherrySimInstance->getNumNodes();
 	for (unsigned int i = 0; i < numNodes; i++) {
-		nodeEntry* node = &cherrySimInstance->nodes[i];
-		json device;
-
-		//Get the only handshaked inConnection
-		//TODO: The inConnection is only used to draw the direction arrow in the fruitymap, but currently
-		//the json only supports communicating 1 inConnection, this should be changed at some point so that
-		//Each connection can report its direction and masterBit
-		auto inConnections = node->gs.cm.GetMeshConnections(ConnectionDirection::DIRECTION_IN);
-		MeshConnection* inConnection = nullptr;
-		for (int k = 0; k < inConnections.count; k++) {
-			if (inConnections.connections[k]->handshakeDone()) {
-				inConnection = inConnections.connections[k];
-			}
-		}
-
-		//UUID is generated based on the node index
-		char uuid[50];
-		sprintf(uuid, "00000000-1111-2222-3333-00000000%04d", node->index);
-
-		device["uuid"] = uuid;
-		device["deviceId"] = node->gs.config.GetSerialNumber();
-		device["platform"] = "BLENODE";
-		device["ledOn"] = node->ledOn;
-		device["inConnectionHasMasterBit"] = false;
-		device["inConnectionPartnerHasMasterBit"] = false;
-
-		//Find out who has the master bit of the inConnection
-		if(inConnection != nullptr) device["inConnectionHasMasterBit"] = inConnection->connectionMasterBit == 1;
-
-		bool partnerHasMB = false;
-
-		if (inConnection != nullptr) {
-			SoftdeviceConnection* foundSoftdeviceConnection = cherrySimInstance->findConnectionByHandle(node, inConnection->connectionHandle);
-			//We must check if the simulator connection still exists as it might have been cleaned up already
-			if (foundSoftdeviceConnection != nullptr) {
-				nodeEntry* partnerNode = foundSoftdeviceConnection->partner;
-				MeshConnections conn = partnerNode->gs.cm.GetMeshConnections(ConnectionDirection::DIRECTION_OUT);
-				for (int k = 0; k < conn.count; k++) {
-					if (conn.connections[k]->connectionHandle == inConnection->connectionHandle) {
-						partnerHasMB = conn.connections[k]->connectionMasterBit;
-					}
-				}
-			}
-		}
-
-		device["inConnectionPartnerHasMasterBit"] = partnerHasMB;
-
-		device["connectionLossCounter"] = node->gs.node.connectionLossCounter;
-		device["inConnectionPartner"] = inConnection == nullptr ? 0 : inConnection->partnerId;
-
-
-		//FIXME: This mixes fruitymesh and simulator connections, but should only use simulator data
-		if (inConnection != nullptr) {
-			SoftdeviceConnection* sdInConn = cherrySimInstance->findConnectionByHandle(node, inConnection->connectionHandle);
-			if (sdInConn != nullptr) device["inConnectionRssi"] = (int)cherrySimInstance->GetReceptionRssi(node, sdInConn->partner);
-		}
-		else {
-			device["inConnectionRssi"] = 0;
-		}
-
-
-		char advData[200];
-		if (node->state.advertisingActive) {
-			Logger::convertBufferToHexString(node->state.advertisingData, node->state.advertisingDataLength, advData, sizeof(advData));
-		}
-		else {
-			sprintf(advData, "Not advertising");
-		}
-
-		device["details"] = {
-			{"platform", "BLENODE"},
-			{"clusterId", node->gs.node.clusterId},
-			{"clusterSize", node->gs.node.clusterSize},
-			{"nodeId", node->gs.node.configuration.nodeId},
-			{"serialNumber", node->gs.config.GetSerialNumber()},
-			{"connections", json::array()},
-			{"nonConnections", json::array()},
-			{"lastSentAdvertisingMessage", advData},
-			{"freeIn", node->gs.cm.freeMeshInConnections},
-			{"freeOut", node->gs.cm.freeMeshOutConnections}
-		};
-		for (int j = 0; j < node->state.configuredTotalConnectionCount; j++) {
-			if (node->state.connections[j].connectionActive) {
-				json connection;
-				connection["handle"] = node->state.connections[j].connectionHandle;
-				connection["rssi"] = 7;
-				connection["target"] = node->state.connections[j].partner->gs.node.configuration.nodeId;
-
-				device["details"]["connections"].push_back(connection);
-			}
-		}
-		device["properties"] = {
-			{"onMap", "true"},
-			{"x", node->x},
-			{"y", node->y}
-		};
-		devices["result"].push_back(device);
+		devices["result"].push_back(GenerateDeviceJson<json>(&cherrySimInstance->nodes[i]));
 	}
 
 	return devices.dump(4);
@@ -30,6 +30,13 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+struct evhttp_request;
+struct evhttp_connection;
+struct nodeEntry;
 
 class FruitySimServer
 {
@@ -40,9 +47,34 @@ public:
 	//Call periodically so that the server can process requests
 	void ProcessServerRequests();
 
+	//Minimum wall clock time between two delta frames pushed to the /stream clients
+	static constexpr int STREAM_PUSH_INTERVAL_MS = 100;
+
 private:
 	int StartServer();
 
+	//A fruitymap that keeps a Server-Sent Events connection open on /stream
+	struct StreamClient
+	{
+		evhttp_request* request;
+		evhttp_connection* connection;
+	};
+	std::vector<StreamClient> streamClients;
+
+	//Signature of every node when its json was last pushed, used to find out which devices changed
+	std::vector<uint32_t> lastPushedDeviceSignatures;
+	unsigned int streamSequenceNumber = 0;
+	std::chrono::steady_clock::time_point lastStreamPush;
+
+	void OpenStream(evhttp_request* req);
+	static void OnStreamClosed(evhttp_connection* connection, void* arg);
+	void PushStreamDeltas();
+	void SendStreamEvent(const StreamClient& client, const char* eventName, const std::string& data) const;
+
+	//Json must be nlohmann::json, which is only included by the implementation
+	template<typename Json>
+	static Json GenerateDeviceJson(nodeEntry* node);
+	static uint32_t GetDeviceSignature(nodeEntry* node);
 	static std::string GenerateDevicesJson();
 	static std::string GenerateSiteJson();
 };
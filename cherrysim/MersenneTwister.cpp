@@ -113,6 +113,13 @@ double MersenneTwister::nextNormal(double mean, double sigma)
 
 uint32_t MersenneTwister::nextU32()
 {
+	if (replaySource != nullptr)
+	{
+		//The index keeps counting once the source is exhausted so that additional draws can be detected
+		const size_t index = (*replayIndex)++;
+		if (index < replaySource->size()) return (*replaySource)[index];
+	}
+
 	if (m_index >= N)
 	{
 		twist();
@@ -126,5 +133,10 @@ uint32_t MersenneTwister::nextU32()
 	x ^= (x << T) & C;
 	x ^= (x >> L);
 
+	if (recordTarget != nullptr)
+	{
+		recordTarget->push_back(x);
+	}
+
 	return x;
 }
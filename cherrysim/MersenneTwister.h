@@ -24,6 +24,7 @@
 
 #include <stdint.h>
 #include <ctime>
+#include <vector>
 
 class MersenneTwister
 {
@@ -51,6 +52,12 @@ private:
 	void twist();
 
 public:
+	//If set, every generated number is appended to the recordTarget. If a replaySource is set, numbers
+	//are taken from it at *replayIndex instead of being generated until the source is exhausted.
+	std::vector<uint32_t>* recordTarget = nullptr;
+	const std::vector<uint32_t>* replaySource = nullptr;
+	size_t* replayIndex = nullptr;
+
 	MersenneTwister();
 	explicit MersenneTwister(uint32_t seed);
 
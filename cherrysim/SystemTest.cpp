@@ -41,7 +41,7 @@
 
 extern "C" {
 #include <app_timer.h>
-#include <aes.h>
+#include <aes_backend.h>
 }
 
 /**
@@ -676,6 +676,11 @@ extern "C"
 			return BLE_ERROR_INVALID_CONN_HANDLE;
 		}
 
+		//The partner of a replayed node might not be simulated, the result of the key check is part of the trace
+		if (cherrySimInstance->currentNode->replayedFromTrace) {
+			return NRF_SUCCESS;
+		}
+
 		//Check if the encryption key matches
 		if (
 			memcmp(connection->partner->state.currentLtkForEstablishingSecurity, p_enc_info->ltk, 16) == 0
@@ -950,7 +955,8 @@ extern "C"
 		SoftdeviceConnection* partnerConnection = connection->partnerConnection;
 
 		//Should not happen, sim connection is always terminated at both ends simultaniously
-		if (partnerConnection == nullptr) {
+		//Only the connections of replayed nodes do not have a partner connection
+		if (partnerConnection == nullptr && !cherrySimInstance->currentNode->replayedFromTrace) {
 			SIMEXCEPTION(IllegalStateException);
 		}
 
@@ -987,6 +993,7 @@ extern "C"
 		
 		//Record statistics for every packet queued in the SoftDevice
 		cherrySimInstance->AddMessageToStats(cherrySimInstance->currentNode->routedPackets, buffer->data, buffer->params.writeParams.len);
+		cherrySimInstance->AddMessageToLinkStats(cherrySimInstance->currentNode, partnerNode, buffer->params.writeParams.len);
 
 		//if (cherrySimInstance->currentNode->id == 37 && conn_handle == 680) printf("Q@NODE %u WRITES %s messageType %u" EOL, cherrySimInstance->currentNode->id, p_write_params->write_op == BLE_GATT_OP_WRITE_REQ ? "WRITE_REQ" : "WRITE_CMD", buffer->data[0]);
 
@@ -1008,6 +1015,7 @@ extern "C"
 		for (u32 i = 0; i < FruityHal::GetCodePageSize() / 4; i++) {
 			p[i] = 0xFFFFFFFF;
 		}
+		cherrySimInstance->AddEnergyCharge(cherrySimInstance->currentNode, EnergyCategory::FLASH, cherrySimInstance->GetEnergyProfileOfCurrentNode().flashPageEraseChargeNc);
 
 
 		if (cherrySimInstance->simConfig.simulateAsyncFlash) {
@@ -1055,6 +1063,7 @@ extern "C"
 		for (u32 i = 0; i < size; i++) {
 			p_dst[i] &= p_src[i];
 		}
+		cherrySimInstance->AddEnergyCharge(cherrySimInstance->currentNode, EnergyCategory::FLASH, cherrySimInstance->GetEnergyProfileOfCurrentNode().flashWriteChargePerWordNc * size);
 
 		if (cherrySimInstance->simConfig.simulateAsyncFlash) {
 			cherrySimInstance->currentNode->state.numWaitingFlashOperations++;
@@ -1105,20 +1114,21 @@ extern "C"
 	uint32_t sd_ble_evt_get(uint8_t* p_dest, uint16_t* p_len)
 	{
 		START_OF_FUNCTION();
-		if (cherrySimInstance->currentNode->eventQueue.size() > 0) {
-
-			simBleEvent bleEvent = cherrySimInstance->currentNode->eventQueue.front();
-			cherrySimInstance->currentNode->eventQueue.pop_front();
+		SimBleEventQueue& eventQueue = cherrySimInstance->currentNode->eventQueue;
+		if (eventQueue.size() > 0) {
+			//The event is copied only once, straight from the queue into the event buffer of the node
+			simBleEvent& bleEvent = eventQueue.front();
+			CheckedMemcpy(p_dest, &bleEvent.bleEvent, GlobalState::SIZE_OF_EVENT_BUFFER);
+			*p_len = GlobalState::SIZE_OF_EVENT_BUFFER;
+			cherrySimInstance->currentNode->currentEventGlobalId = bleEvent.globalId;
+			cherrySimInstance->AddEnergyCharge(cherrySimInstance->currentNode, EnergyCategory::CPU, cherrySimInstance->GetEnergyProfileOfCurrentNode().cpuChargePerEventNc);
+			cherrySimInstance->RecordFetchedBleEvent(bleEvent);
 
 			if (cherrySimInstance->simEventListener != nullptr) {
 				cherrySimInstance->simEventListener->CherrySimBleEventHandler(cherrySimInstance->currentNode, &bleEvent, GlobalState::SIZE_OF_EVENT_BUFFER);
 			}
 
-			//We copy the current event so that we can access it during debugging if we want to get more information
-			CheckedMemcpy(&cherrySimInstance->currentNode->currentEvent, &bleEvent, sizeof(simBleEvent));
-
-			CheckedMemcpy(p_dest, &bleEvent.bleEvent, GlobalState::SIZE_OF_EVENT_BUFFER);
-			*p_len = GlobalState::SIZE_OF_EVENT_BUFFER;
+			eventQueue.pop_front();
 
 			return NRF_SUCCESS;
 		}
@@ -1294,7 +1304,8 @@ extern "C"
 		SoftdeviceConnection*  partnerConnection = connection->partnerConnection;
 
 		//Should not happen, sim connection is always terminated at both ends simultaniously
-		if (partnerConnection == nullptr) {
+		//Only the connections of replayed nodes do not have a partner connection
+		if (partnerConnection == nullptr && !cherrySimInstance->currentNode->replayedFromTrace) {
 			SIMEXCEPTION(IllegalStateException);
 		}
 
@@ -1318,6 +1329,8 @@ extern "C"
 		buffer->params.hvxParams.p_data = buffer->data; //Reassign data pointer to our buffer
 		buffer->isHvx = true;
 
+		cherrySimInstance->AddMessageToLinkStats(cherrySimInstance->currentNode, partnerNode, *p_hvx_params->p_len);
+
 		//printf("Q@NODE %u WRITES NOTIFICATION messageType %02X" EOL, cherrySimInstance->currentNode->id, buffer->data[0]);
 
 		return 0;
@@ -1325,7 +1338,8 @@ extern "C"
 
 	uint32_t sd_ecb_block_encrypt(nrf_ecb_hal_data_t * p_ecb_data) {
 		START_OF_FUNCTION();
-		AES_ECB_encrypt(p_ecb_data->cleartext, p_ecb_data->key, p_ecb_data->ciphertext, 16);
+		//Uses AES-NI if the host supports it, this is also used by the software CCM implementation
+		aes_backend_ecb_encrypt(p_ecb_data->key, p_ecb_data->cleartext, p_ecb_data->ciphertext);
 
 		return 0;
 	}
@@ -0,0 +1,182 @@
+////////////////////////////////////////////////////////////////////////////////
+// /****************************************************************************
+// **
+// ** Copyright (C) 2015-2020 M-Way Solutions GmbH
+// ** Contact: https://www.blureange.io/licensing
+// **
+// ** This file is part of the Bluerange/FruityMesh implementation
+// **
+// ** $BR_BEGIN_LICENSE:GPL-EXCEPT$
+// ** Commercial License Usage
+// ** Licensees holding valid commercial Bluerange licenses may use this file in
+// ** accordance with the commercial license agreement provided with the
+// ** Software or, alternatively, in accordance with the terms contained in
+// ** a written agreement between them and M-Way Solutions GmbH.
+// ** For licensing terms and conditions see https://www.bluerange.io/terms-conditions. For further
+// ** information use the contact form at https://www.bluerange.io/contact.
+// **
+// ** GNU General Public License Usage
+// ** Alternatively, this file may be used under the terms of the GNU
+// ** General Public License version 3 as published by the Free Software
+// ** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+// ** included in the packaging of this file. Please review the following
+// ** information to ensure the GNU General Public License requirements will
+// ** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+// **
+// ** $BR_END_LICENSE$
+// **
+// ****************************************************************************/
+////////////////////////////////////////////////////////////////////////////////
+
+#include "aes_backend.h"
+#include "aes.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define AES_BACKEND_AES_NI_SUPPORTED 1
+#else
+#define AES_BACKEND_AES_NI_SUPPORTED 0
+#endif
+
+#if AES_BACKEND_AES_NI_SUPPORTED
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define AES_NI_TARGET
+#else
+#include <cpuid.h>
+//Only the AES-NI functions are compiled with AES instructions so that the simulator still runs on hosts without them
+#define AES_NI_TARGET __attribute__((target("aes,sse2")))
+#endif
+#endif
+
+static aes_backend_t selectedBackend = AES_BACKEND_AUTO;
+
+#if AES_BACKEND_AES_NI_SUPPORTED
+
+static bool aes_ni_cpu_supported(void)
+{
+	unsigned int ecx = 0;
+	unsigned int edx = 0;
+#if defined(_MSC_VER)
+	int cpuInfo[4];
+	__cpuid(cpuInfo, 1);
+	ecx = (unsigned int)cpuInfo[2];
+	edx = (unsigned int)cpuInfo[3];
+#else
+	unsigned int eax = 0;
+	unsigned int ebx = 0;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+#endif
+	//CPUID.01H:ECX.AESNI[bit 25] and CPUID.01H:EDX.SSE2[bit 26]
+	return (ecx & (1u << 25)) != 0 && (edx & (1u << 26)) != 0;
+}
+
+AES_NI_TARGET static inline __m128i aes_ni_expand_key_step(__m128i key, __m128i keygened)
+{
+	keygened = _mm_shuffle_epi32(keygened, _MM_SHUFFLE(3, 3, 3, 3));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	return _mm_xor_si128(key, keygened);
+}
+
+//The round constant must be an immediate value, therefore a macro is used
+#define AES_NI_EXPAND_KEY(roundKeys, i, rcon) \
+	roundKeys[i] = aes_ni_expand_key_step(roundKeys[i - 1], _mm_aeskeygenassist_si128(roundKeys[i - 1], rcon))
+
+AES_NI_TARGET static void aes_ni_ecb_encrypt(const uint8_t* key, const uint8_t* cleartext, uint8_t* ciphertext)
+{
+	__m128i roundKeys[11];
+	roundKeys[0] = _mm_loadu_si128((const __m128i*)key);
+	AES_NI_EXPAND_KEY(roundKeys, 1, 0x01);
+	AES_NI_EXPAND_KEY(roundKeys, 2, 0x02);
+	AES_NI_EXPAND_KEY(roundKeys, 3, 0x04);
+	AES_NI_EXPAND_KEY(roundKeys, 4, 0x08);
+	AES_NI_EXPAND_KEY(roundKeys, 5, 0x10);
+	AES_NI_EXPAND_KEY(roundKeys, 6, 0x20);
+	AES_NI_EXPAND_KEY(roundKeys, 7, 0x40);
+	AES_NI_EXPAND_KEY(roundKeys, 8, 0x80);
+	AES_NI_EXPAND_KEY(roundKeys, 9, 0x1B);
+	AES_NI_EXPAND_KEY(roundKeys, 10, 0x36);
+
+	__m128i block = _mm_loadu_si128((const __m128i*)cleartext);
+	block = _mm_xor_si128(block, roundKeys[0]);
+	for (int i = 1; i < 10; i++)
+	{
+		block = _mm_aesenc_si128(block, roundKeys[i]);
+	}
+	block = _mm_aesenclast_si128(block, roundKeys[10]);
+	_mm_storeu_si128((__m128i*)ciphertext, block);
+}
+
+#endif //AES_BACKEND_AES_NI_SUPPORTED
+
+bool aes_backend_is_available(aes_backend_t backend)
+{
+	switch (backend)
+	{
+	case AES_BACKEND_AUTO:
+	case AES_BACKEND_SOFTWARE:
+		return true;
+	case AES_BACKEND_AES_NI:
+#if AES_BACKEND_AES_NI_SUPPORTED
+	{
+		//The cpuid result does not change during runtime, so it is only queried once
+		static int available = -1;
+		if (available < 0) available = aes_ni_cpu_supported() ? 1 : 0;
+		return available == 1;
+	}
+#else
+		return false;
+#endif
+	default:
+		return false;
+	}
+}
+
+bool aes_backend_select(aes_backend_t backend)
+{
+	if (backend == AES_BACKEND_AUTO)
+	{
+		backend = aes_backend_is_available(AES_BACKEND_AES_NI) ? AES_BACKEND_AES_NI : AES_BACKEND_SOFTWARE;
+	}
+	if (!aes_backend_is_available(backend)) return false;
+
+	selectedBackend = backend;
+	return true;
+}
+
+aes_backend_t aes_backend_get_selected(void)
+{
+	if (selectedBackend == AES_BACKEND_AUTO) aes_backend_select(AES_BACKEND_AUTO);
+	return selectedBackend;
+}
+
+const char* aes_backend_get_name(aes_backend_t backend)
+{
+	switch (backend)
+	{
+	case AES_BACKEND_AUTO:     return "auto";
+	case AES_BACKEND_SOFTWARE: return "software";
+	case AES_BACKEND_AES_NI:   return "aes-ni";
+	default:                   return "invalid";
+	}
+}
+
+void aes_backend_ecb_encrypt(const uint8_t* key, const uint8_t* cleartext, uint8_t* ciphertext)
+{
+	aes_backend_ecb_encrypt_with(aes_backend_get_selected(), key, cleartext, ciphertext);
+}
+
+void aes_backend_ecb_encrypt_with(aes_backend_t backend, const uint8_t* key, const uint8_t* cleartext, uint8_t* ciphertext)
+{
+#if AES_BACKEND_AES_NI_SUPPORTED
+	if (backend == AES_BACKEND_AES_NI)
+	{
+		aes_ni_ecb_encrypt(key, cleartext, ciphertext);
+		return;
+	}
+#endif
+	AES_ECB_encrypt(cleartext, key, ciphertext, 16);
+}
@@ -0,0 +1,72 @@
+////////////////////////////////////////////////////////////////////////////////
+// /****************************************************************************
+// **
+// ** Copyright (C) 2015-2020 M-Way Solutions GmbH
+// ** Contact: https://www.blureange.io/licensing
+// **
+// ** This file is part of the Bluerange/FruityMesh implementation
+// **
+// ** $BR_BEGIN_LICENSE:GPL-EXCEPT$
+// ** Commercial License Usage
+// ** Licensees holding valid commercial Bluerange licenses may use this file in
+// ** accordance with the commercial license agreement provided with the
+// ** Software or, alternatively, in accordance with the terms contained in
+// ** a written agreement between them and M-Way Solutions GmbH.
+// ** For licensing terms and conditions see https://www.bluerange.io/terms-conditions. For further
+// ** information use the contact form at https://www.bluerange.io/contact.
+// **
+// ** GNU General Public License Usage
+// ** Alternatively, this file may be used under the terms of the GNU
+// ** General Public License version 3 as published by the Free Software
+// ** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+// ** included in the packaging of this file. Please review the following
+// ** information to ensure the GNU General Public License requirements will
+// ** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+// **
+// ** $BR_END_LICENSE$
+// **
+// ****************************************************************************/
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Pluggable AES-128 block cipher used by the simulated SoftDevice (sd_ecb_block_encrypt)
+ * and therefore also by the software CCM implementation. The AES-NI backend is used if
+ * the host CPU supports it, otherwise the software implementation from aes.c is used.
+ * Both backends produce bit-identical results.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+	AES_BACKEND_AUTO     = 0, //Uses AES-NI if available and the software implementation otherwise
+	AES_BACKEND_SOFTWARE = 1,
+	AES_BACKEND_AES_NI   = 2,
+} aes_backend_t;
+
+bool aes_backend_is_available(aes_backend_t backend);
+
+//Returns false and keeps the current backend if the requested one is not supported by the host
+bool aes_backend_select(aes_backend_t backend);
+
+//Returns the backend that is currently used, never AES_BACKEND_AUTO
+aes_backend_t aes_backend_get_selected(void);
+
+const char* aes_backend_get_name(aes_backend_t backend);
+
+//Encrypts a single 16 byte block with a 16 byte key using the selected backend
+void aes_backend_ecb_encrypt(const uint8_t* key, const uint8_t* cleartext, uint8_t* ciphertext);
+
+//Same as above but with an explicit backend, used for comparing and benchmarking the backends
+void aes_backend_ecb_encrypt_with(aes_backend_t backend, const uint8_t* key, const uint8_t* cleartext, uint8_t* ciphertext);
+
+#ifdef __cplusplus
+}
+#endif
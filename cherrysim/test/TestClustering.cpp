@@ -308,6 +308,57 @@ TEST(TestClustering, TestBasicClusteringWithNodeReset_scheduled) {
 	}
 }
 
+//Reports the time until clustering is done for different mesh sizes with the same node density, once with
+//the legacy cluster score as a baseline and once with the current one, which must not converge slower
+TEST(TestClustering, TestConvergenceTime_scheduled) {
+	const int maxClusteringTimeMs = 500 * 1000;
+	const int clusteringIterations = 10;
+	const u32 nodeCounts[] = { 50, 100, 200 };
+
+	for (u32 numNodes : nodeCounts)
+	{
+		u32 clusteringTimeTotalMs[2] = {};
+		u32 clusteringTimeMaxMs[2] = {};
+
+		for (u32 i = 0; i < clusteringIterations * 2; i++) {
+			const bool useLegacyClusterScore = i < clusteringIterations;
+
+			CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
+			SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
+
+			//About 600 square meters per node, 200 nodes use the same map as the other scheduled clustering tests
+			simConfig.mapWidthInMeters = 400 * numNodes / 200;
+			simConfig.mapHeightInMeters = 300;
+			simConfig.numNodes = numNodes;
+			simConfig.seed = i % clusteringIterations;
+			simConfig.simulateJittering = true;
+			//Validating every json message would dominate the runtime with this many nodes
+			simConfig.jsonValidationSampleRate = 16;
+
+			simConfig.defaultBleStackType = prod_mesh_nrf52.bleStack;
+			strcpy(simConfig.defaultNodeConfigName, prod_mesh_nrf52.featuresetName.c_str());
+
+			CherrySimTester tester = CherrySimTester(testerConfig, simConfig);
+			tester.Start();
+			for (u32 j = 0; j < tester.sim->getNumNodes(); j++) {
+				tester.sim->nodes[j].gs.config.useLegacyClusterScore = useLegacyClusterScore;
+			}
+			tester.SimulateUntilClusteringDone(maxClusteringTimeMs);
+
+			const u32 scoring = useLegacyClusterScore ? 0 : 1;
+			clusteringTimeTotalMs[scoring] += tester.sim->simState.simTimeMs;
+			if (tester.sim->simState.simTimeMs > clusteringTimeMaxMs[scoring]) clusteringTimeMaxMs[scoring] = tester.sim->simState.simTimeMs;
+		}
+
+		printf("Convergence with %u nodes: legacy score average %u seconds, maximum %u seconds, current score average %u seconds, maximum %u seconds" EOL,
+			numNodes,
+			clusteringTimeTotalMs[0] / clusteringIterations / 1000, clusteringTimeMaxMs[0] / 1000,
+			clusteringTimeTotalMs[1] / clusteringIterations / 1000, clusteringTimeMaxMs[1] / 1000);
+
+		ASSERT_LE(clusteringTimeTotalMs[1], clusteringTimeTotalMs[0]);
+	}
+}
+
 //FIXME: This will corrently result in an error
 // Tests reestablishing against errors, first we simulate connection timeouts for a period of 60 seconds
 // where some nodes will need to reestablish their connection, then we stop simulating timeouts and check
@@ -406,6 +457,160 @@ TEST(TestClustering, TestMeshingUnderLoad) {
 	printf("Clustering under load took %u seconds", tester.sim->simState.simTimeMs / 1000);
 }
 
+//Checks that the mesh also forms with the airtime link layer model and that it uses each connection event
+TEST(TestClustering, TestMeshingWithAirtimeLinkLayerModel) {
+	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
+	SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
+	simConfig.numNodes = 2;
+	simConfig.linkLayerModel = LinkLayerModel::AIRTIME;
+	CherrySimTester tester = CherrySimTester(testerConfig, simConfig);
+	tester.Start();
+	tester.SimulateUntilClusteringDone(10 * 1000);
+
+	SoftdeviceConnection* connection = nullptr;
+	for (int i = 0; i < SIM_MAX_CONNECTION_NUM; i++) {
+		if (tester.sim->nodes[0].state.connections[i].connectionActive) connection = &tester.sim->nodes[0].state.connections[i];
+	}
+	ASSERT_NE(connection, nullptr);
+
+	//Two nodes have enough radio time so that no connection event is missed
+	const u32 eventsBefore = connection->linkLayer.connectionEvents;
+	tester.SimulateForGivenTime(10 * 1000);
+	const u32 expectedEvents = 10 * 1000 * 1000 / (connection->connectionInterval == 7 ? 7500 : connection->connectionInterval * 1000);
+	ASSERT_NEAR(connection->linkLayer.connectionEvents - eventsBefore, expectedEvents, 1);
+	ASSERT_EQ(connection->linkLayer.missedConnectionEvents, 0);
+	ASSERT_GT(connection->linkLayer.payloadBytesSent, 0);
+}
+
+//Both outer nodes of a three node mesh flood the node in the middle with the airtime model, which is switched on at runtime
+TEST(TestClustering, TestThroughputWithAirtimeLinkLayerModel) {
+	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
+	SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
+	simConfig.numNodes = 3;
+	simConfig.linkLayerModel = LinkLayerModel::LEGACY;
+	CherrySimTester tester = CherrySimTester(testerConfig, simConfig);
+	tester.Start();
+	tester.SimulateUntilClusteringDone(10 * 1000);
+	tester.SimulateForGivenTime(10 * 1000);
+
+	//The mesh is a line, the node in the middle has both connections
+	nodeEntry* hub = nullptr;
+	std::vector<SoftdeviceConnection*> outerConnections;
+	for (u32 i = 0; i < simConfig.numNodes; i++) {
+		SoftdeviceConnection* lastConnection = nullptr;
+		u32 numConnections = 0;
+		for (int k = 0; k < SIM_MAX_CONNECTION_NUM; k++) {
+			if (!tester.sim->nodes[i].state.connections[k].connectionActive) continue;
+			lastConnection = &tester.sim->nodes[i].state.connections[k];
+			numConnections++;
+		}
+		if (numConnections == 2) hub = &tester.sim->nodes[i];
+		else if (numConnections == 1) outerConnections.push_back(lastConnection);
+	}
+	ASSERT_NE(hub, nullptr);
+	ASSERT_EQ(outerConnections.size(), 2);
+	auto getIntervalUs = [](const SoftdeviceConnection* connection) {
+		return connection->connectionInterval == 7 ? 7500u : (u32)connection->connectionInterval * 1000;
+	};
+
+	//Switching the model must not replay the connection events that passed while the legacy model was used
+	tester.SendTerminalCommand(1, "linkmodel airtime");
+	tester.SimulateForGivenTime(1000);
+	for (SoftdeviceConnection* connection : outerConnections) {
+		ASSERT_LE(connection->linkLayer.connectionEvents, 1000 * 1000 / getIntervalUs(connection) + 2);
+	}
+
+	for (SoftdeviceConnection* connection : outerConnections) {
+		tester.SendTerminalCommand(connection->owningNode->id, "action this debug flood %u 4 20000 30", hub->id);
+	}
+	tester.SimulateForGivenTime(2 * 1000);
+
+	std::vector<u32> eventsBefore;
+	std::vector<u32> bytesBefore;
+	for (SoftdeviceConnection* connection : outerConnections) {
+		eventsBefore.push_back(connection->linkLayer.connectionEvents - connection->linkLayer.missedConnectionEvents);
+		bytesBefore.push_back(connection->linkLayer.payloadBytesSent);
+	}
+	const u32 measuredTimeMs = 10 * 1000;
+	tester.SimulateForGivenTime(measuredTimeMs);
+
+	//A connection event lasts at most one interval and each full sized PDU needs an exchange with the partner
+	const u32 fullPduExchangeUs = (2 * SIM_LL_PDU_OVERHEAD_BYTES + SIM_LL_MAX_PAYLOAD_BYTES) * SIM_LL_US_PER_BYTE + 2 * SIM_LL_T_IFS_US;
+	u32 totalBytes = 0;
+	for (u32 i = 0; i < outerConnections.size(); i++) {
+		SoftdeviceConnection* connection = outerConnections[i];
+		const u32 events = connection->linkLayer.connectionEvents - connection->linkLayer.missedConnectionEvents - eventsBefore[i];
+		const u32 bytes = connection->linkLayer.payloadBytesSent - bytesBefore[i];
+		const u32 maxBytes = events * (getIntervalUs(connection) / fullPduExchangeUs) * SIM_LL_MAX_PAYLOAD_BYTES;
+		printf("Node %u sent %u bytes/s to node %u in %u connection events" EOL, connection->owningNode->id, bytes * 1000 / measuredTimeMs, hub->id, events);
+		ASSERT_GT(bytes, 0);
+		ASSERT_LE(bytes, maxBytes);
+		totalBytes += bytes;
+	}
+
+	//Both connections share the radio of the node in the middle and no PDU carries its bytes faster than a full sized one
+	ASSERT_LE((uint64_t)totalBytes * fullPduExchangeUs / SIM_LL_MAX_PAYLOAD_BYTES, (uint64_t)measuredTimeMs * 1000);
+}
+
+//Checks in every step that the incremental validity check reports the same potential mismatches as a forced
+//full check of the same state and that clusters with nothing but mesh traffic are not validated again
+TEST(TestClustering, TestIncrementalMeshingConsistencyCheck) {
+	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
+	SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
+	simConfig.numNodes = 20;
+	simConfig.seed = 5;
+	CherrySimTester tester = CherrySimTester(testerConfig, simConfig);
+	tester.Start();
+
+	//Runs the incremental and a forced full check after each step
+	u32 incrementalMismatches = 0;
+	u32 fullMismatches = 0;
+	u32 incrementalCheckedNodes = 0;
+	auto simulateStepAndCheck = [&]() {
+		tester.SimulateGivenNumberOfSteps(1);
+		incrementalMismatches = tester.sim->CheckMeshingConsistency(false);
+		incrementalCheckedNodes = tester.sim->meshingConsistencyCheckedNodes;
+		fullMismatches = tester.sim->CheckMeshingConsistency(true);
+	};
+	auto getSentMeshBytes = [&]() {
+		u32 bytes = 0;
+		for (u32 i = 0; i < simConfig.numNodes; i++) {
+			for (u32 k = 0; k < PACKET_LINK_STAT_SIZE; k++) bytes += tester.sim->nodes[i].linkStats[k].bytes;
+		}
+		return bytes;
+	};
+
+	//Compare both checks while the mesh is built and while some nodes are reset so that the check also sees broken up clusters
+	for (u32 step = 0; step < 3000; step++) {
+		if (step == 1500) {
+			tester.SendTerminalCommand(3, "reset");
+			tester.SendTerminalCommand(7, "reset");
+		}
+		simulateStepAndCheck();
+		ASSERT_EQ(tester.sim->meshingConsistencyCheckedNodes, simConfig.numNodes);
+		ASSERT_EQ(incrementalMismatches, fullMismatches) << "step " << step;
+	}
+
+	tester.SimulateUntilClusteringDone(100 * 1000);
+
+	//Let two nodes send data through the whole mesh without changing the clustering
+	tester.SendTerminalCommand(1, "action 2 node generate_load 20 10 250 1");
+	tester.SendTerminalCommand(1, "action 19 node generate_load 1 10 250 1");
+
+	const u32 numLoadSteps = 400;
+	const u32 sentBytesBefore = getSentMeshBytes();
+	u32 checkedNodesUnderLoad = 0;
+	for (u32 step = 0; step < numLoadSteps; step++) {
+		simulateStepAndCheck();
+		ASSERT_EQ(incrementalMismatches, fullMismatches) << "load step " << step;
+		checkedNodesUnderLoad += incrementalCheckedNodes;
+	}
+
+	ASSERT_GT(getSentMeshBytes() - sentBytesBefore, 250 * 10);
+	printf("Incremental check validated %u of %u nodes under load" EOL, checkedNodesUnderLoad, numLoadSteps * simConfig.numNodes);
+	ASSERT_LT(checkedNodesUnderLoad, numLoadSteps * simConfig.numNodes / 4);
+}
+
 TEST(TestClustering, SimulateLongevity_long) {
 	u32 numIterations = 10;
 
@@ -34,6 +34,7 @@
 #include <vector>
 #include <cmath>
 #include "MeshAccessModule.h"
+#include "EnrollmentModule.h"
 
 #ifndef GITHUB_RELEASE
 TEST(TestEnrollmentModule, TestCommands) {
@@ -256,6 +257,48 @@ TEST(TestEnrollmentModule, TestReceivingEnrollmentOverMeshResponses) {
 	tester.SimulateUntilMessageReceived(10 * 1000, 1, "{\"nodeId\":3,\"type\":\"enroll_response_serial\",\"module\":5,\"requestId\":1,\"serialNumber\":\"BBBBF\",\"code\":0}");
 }
 
+TEST(TestEnrollmentModule, TestEnrollingMultipleTargetsOverMesh) {
+	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
+	SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
+	simConfig.numNodes = 5;
+	simConfig.terminalId = 0;
+	//Nodes 4 and 5 are only reachable by node 3
+	simConfig.preDefinedPositions = { {0.2, 0.5}, {0.4, 0.55}, {0.6, 0.5}, {0.8, 0.55}, {0.8, 0.45} };
+	testerConfig.verbose = false;
+
+	CherrySimTester tester = CherrySimTester(testerConfig, simConfig);
+	tester.sim->nodes[3].uicr.CUSTOMER[9] = 123;
+	tester.sim->nodes[4].uicr.CUSTOMER[9] = 124;
+	tester.Start();
+
+	tester.SimulateForGivenTime(15 * 1000);
+
+	//Node 3 should work on both enrollments at the same time
+	tester.SendTerminalCommand(1, "action 3 enroll basic BBBBF 4 3678 11:11:11:11:11:11:11:11:11:11:11:11:11:11:11:11 22:22:22:22:22:22:22:22:22:22:22:22:22:22:22:22 33:33:33:33:33:33:33:33:33:33:33:33:33:33:33:33 04:00:00:00:04:00:00:00:04:00:00:00:04:00:00:00 20 0 1");
+	tester.SimulateGivenNumberOfSteps(1);
+	tester.SendTerminalCommand(1, "action 3 enroll basic BBBBG 5 3678 11:11:11:11:11:11:11:11:11:11:11:11:11:11:11:11 22:22:22:22:22:22:22:22:22:22:22:22:22:22:22:22 33:33:33:33:33:33:33:33:33:33:33:33:33:33:33:33 05:00:00:00:05:00:00:00:05:00:00:00:05:00:00:00 20 0 2");
+
+	//Both targets must have an enrollment connection of node 3 at the same time
+	EnrollmentModule* enrollmentModule = static_cast<EnrollmentModule*>(tester.sim->nodes[2].gs.node.GetModuleById(ModuleId::ENROLLMENT_MODULE));
+	const u32 endTimeMs = tester.sim->simState.simTimeMs + 20 * 1000;
+	u8 maxConnecting = 0;
+	while (tester.sim->simState.simTimeMs < endTimeMs && maxConnecting < 2)
+	{
+		tester.SimulateGivenNumberOfSteps(1);
+		if (enrollmentModule->GetNumOverMeshTargetsConnecting() > maxConnecting) maxConnecting = enrollmentModule->GetNumOverMeshTargetsConnecting();
+	}
+	ASSERT_EQ(maxConnecting, (u8)2);
+
+	//The requester is informed about the progress of the targets
+	tester.SimulateUntilRegexMessageReceived(10 * 1000, 1, "\\{\"nodeId\":3,\"type\":\"enroll_over_mesh_progress\",\"module\":5,\"targets\":\\[\\{\"serialNumber\":\"BBBB[FG]\",\"state\":\\d\\}");
+
+	std::vector<SimulationMessage> messages = {
+		SimulationMessage(1, "{\"nodeId\":3,\"type\":\"enroll_response_serial\",\"module\":5,\"requestId\":1,\"serialNumber\":\"BBBBF\",\"code\":0}"),
+		SimulationMessage(1, "{\"nodeId\":3,\"type\":\"enroll_response_serial\",\"module\":5,\"requestId\":2,\"serialNumber\":\"BBBBG\",\"code\":0}"),
+	};
+	tester.SimulateUntilMessagesReceived(30 * 1000, messages);
+}
+
 TEST(TestEnrollmentModule, TestEnrollmentMultipleTimes) {
 
 	for (u32 seed = 0; seed < 2; seed++) {
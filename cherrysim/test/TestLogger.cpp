@@ -33,6 +33,9 @@
 #include "CherrySimUtils.h"
 #include "Logger.h"
 #include <string>
+#include <json.hpp>
+
+using json = nlohmann::json;
 
 TEST(TestLogger, TestTags) {
 	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
@@ -251,3 +254,31 @@ TEST(TestLogger, TestBase64StringToBuffer)
 		checkMemoryGuard(td.memoryGuard_4, sizeof(td.memoryGuard_4));
 	}
 }
+
+//Json messages are only parsed when they are accessed or when they are sampled for validation
+TEST(TestLogger, TestJsonValidationSampling) {
+	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
+	SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
+	simConfig.numNodes = 1;
+	simConfig.jsonValidationSampleRate = 0;
+	CherrySimTester tester = CherrySimTester(testerConfig, simConfig);
+	tester.Start();
+
+	tester.sim->setNode(0);
+	Logger& logger = tester.sim->nodes[0].gs.logger;
+
+	logjson_partial("TEST", "{\"type\":\"test\",");
+	logjson("TEST", "\"value\":%u}" SEP, 7);
+	ASSERT_EQ(logger.GetLastJsonString(), "{\"type\":\"test\",\"value\":7}" SEP);
+	json j = logger.GetLastJson<json>();
+	ASSERT_EQ(j["type"].get<std::string>(), "test");
+	ASSERT_EQ(j["value"].get<int>(), 7);
+
+	//Broken json is not noticed as long as it is not accessed
+	logjson("TEST", "{\"type\":\"test\"" SEP);
+	ASSERT_THROW(logger.GetLastJson<json>(), json::parse_error);
+
+	//With validation of every message, the broken json is found immediately
+	logger.jsonValidationSampleRate = 1;
+	ASSERT_THROW(logjson("TEST", "{\"type\":\"test\"" SEP), json::parse_error);
+}
@@ -193,3 +193,39 @@ TEST(TestMeshAccessModule, TestRestrainedAccess) {
 
 	tester.SimulateUntilMessageReceived(10 * 1000, 1, "Received remote mesh data");
 }
+
+//Checks that the keystreams precomputed while idle are used and still produce valid packets
+TEST(TestMeshAccessModule, TestKeystreamPool) {
+	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
+	SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
+	simConfig.numNodes = 2;
+	simConfig.terminalId = 0;
+	//testerConfig.verbose = true;
+
+	CherrySimTester tester = CherrySimTester(testerConfig, simConfig);
+
+	tester.sim->nodes[1].uicr.CUSTOMER[9] = 123; // Change default network id of node 2
+
+	tester.Start();
+
+	//Connect to node 2 using a mesh access connection and the network key
+	tester.SendTerminalCommand(1, "action this ma connect 00:00:00:02:00:00 2 04:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00");
+	tester.SimulateUntilMessageReceived(10 * 1000, 1, "Received remote mesh data");
+
+	//Give both nodes some idle time to fill their pools
+	tester.SimulateForGivenTime(2 * 1000);
+
+	for (int i = 0; i < 5; i++) {
+		tester.SendTerminalCommand(1, "rawsend 50:01:00:D1:07:%02X:00:00:00", i); //DATA_1 to the virtual partner id 2001
+		tester.SimulateUntilMessageReceived(10 * 1000, 2, "Got Data packet");
+		tester.SimulateForGivenTime(1 * 1000);
+	}
+
+	for (int nodeIndex = 0; nodeIndex < 2; nodeIndex++) {
+		BaseConnections conns = tester.sim->nodes[nodeIndex].gs.cm.GetConnectionsOfType(ConnectionType::MESH_ACCESS, ConnectionDirection::INVALID);
+		ASSERT_EQ(conns.count, 1);
+		MeshAccessConnection* conn = (MeshAccessConnection*)tester.sim->nodes[nodeIndex].gs.cm.allConnections[conns.connectionIndizes[0]];
+		ASSERT_EQ(conn->connectionState, ConnectionState::HANDSHAKE_DONE);
+		ASSERT_GT(conn->keystreamPoolHits, 0u);
+	}
+}
@@ -33,10 +33,13 @@
 #include "CherrySimUtils.h"
 #include "Logger.h"
 #include <string>
+#include <functional>
 #include "GlobalState.h"
 #include "Config.h"
 #include "Node.h"
 
+extern std::map<std::string, int> simStatCounts;
+
 TEST(TestNode, TestCommands) {
 	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
 	SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
@@ -386,6 +389,292 @@ TEST(TestNode, DISABLED_TestDiscoveryStates) {
 
 }
 
+//Tests that the low discovery intervals are doubled after each backoff step until the maximum level is
+//reached and that a change in the topology switches back to high discovery without a backoff
+TEST(TestNode, TestDiscoveryBackoff) {
+	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
+	SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
+	simConfig.numNodes = 5;
+	simConfig.terminalId = 0;
+	strcpy(simConfig.defaultNodeConfigName, "prod_mesh_nrf52");
+	simConfig.preDefinedPositions = { {0.1, 0.5},{0.3, 0.5},{0.5, 0.5},{0.7, 0.5},{0.9, 0.5} };
+	//testerConfig.verbose = true;
+	CherrySimTester tester = CherrySimTester(testerConfig, simConfig);
+	tester.Start();
+
+	tester.SimulateUntilClusteringDone(100 * 1000);
+
+	const u32 stepTimeMs = 2 * 1000;
+	const u8 maxBackoffLevel = 7;
+	const u16 maxBackoffInterval = (u16)MSEC_TO_UNITS(10240, UNIT_0_625_MS);
+	for (u32 i = 0; i < simConfig.numNodes; i++) {
+		tester.sim->nodes[i].gs.config.highToLowDiscoveryTimeSec = 10;
+		tester.sim->nodes[i].gs.config.discoveryBackoffStepTimeSec = stepTimeMs / 1000;
+		tester.sim->nodes[i].gs.config.maxDiscoveryBackoffLevel = maxBackoffLevel;
+	}
+
+	Node& node = tester.sim->nodes[2].gs.node;
+	const u16 scanIntervalLow = tester.sim->nodes[2].gs.config.meshScanIntervalLow;
+
+	//Simulates until the condition is met and returns false on a timeout
+	auto simulateUntil = [&](std::function<bool()> condition, u32 timeoutMs) {
+		const u32 endTimeMs = tester.sim->simState.simTimeMs + timeoutMs;
+		while (!condition()) {
+			if (tester.sim->simState.simTimeMs >= endTimeMs) return false;
+			tester.SimulateGivenNumberOfSteps(1);
+		}
+		return true;
+	};
+
+	//Restart the discovery on all nodes so that they switch from high to low discovery
+	tester.SendTerminalCommand(1, "action 0 node discovery off");
+	tester.SimulateForGivenTime(1 * 1000);
+	tester.SendTerminalCommand(1, "action 0 node discovery on");
+	ASSERT_TRUE(simulateUntil([&]() { return node.currentDiscoveryState == DiscoveryState::LOW; }, 20 * 1000));
+	ASSERT_EQ(node.discoveryBackoffLevel, 0);
+
+	//Every level doubles the intervals and lasts twice as long as the previous one
+	for (u8 level = 1; level <= maxBackoffLevel; level++) {
+		const u32 levelStartTimeMs = tester.sim->simState.simTimeMs;
+		const u32 expectedLevelTimeMs = stepTimeMs << (level - 1);
+		ASSERT_TRUE(simulateUntil([&]() { return node.discoveryBackoffLevel == level; }, expectedLevelTimeMs + 1000));
+		ASSERT_NEAR(tester.sim->simState.simTimeMs - levelStartTimeMs, expectedLevelTimeMs, 1000);
+		ASSERT_EQ(node.currentDiscoveryState, DiscoveryState::LOW);
+
+		const u32 advertisingInterval = (u32)Conf::meshAdvertisingIntervalLow << level;
+		const u32 scanInterval = (u32)scanIntervalLow << level;
+		ASSERT_EQ(node.meshAdvJobHandle->advertisingInterval, advertisingInterval < maxBackoffInterval ? advertisingInterval : maxBackoffInterval);
+		ASSERT_EQ(node.p_scanJob->interval, scanInterval < maxBackoffInterval ? scanInterval : maxBackoffInterval);
+	}
+
+	//The maximum level is kept while the topology stays quiet
+	tester.SimulateForGivenTime((stepTimeMs << maxBackoffLevel) + 1000);
+	ASSERT_EQ(node.discoveryBackoffLevel, maxBackoffLevel);
+	ASSERT_EQ(node.meshAdvJobHandle->advertisingInterval, maxBackoffInterval);
+
+	//Losing a neighbour switches back to high discovery and resets the backoff
+	tester.SendTerminalCommand(4, "reset");
+	ASSERT_TRUE(simulateUntil([&]() { return node.currentDiscoveryState == DiscoveryState::HIGH; }, 30 * 1000));
+	ASSERT_EQ(node.discoveryBackoffLevel, 0);
+
+	//The reset node must be able to join again although its neighbours were fully backed off
+	tester.SimulateUntilClusteringDone(100 * 1000);
+}
+
+//Runs a quiet mesh in low discovery and measures the consumed charge as well as the time
+//that is needed to integrate a node again after it was reset
+static void SimulateQuietMeshDiscovery(bool backoffEnabled, double* quietChargeNc, u32* reclusteringTimeMs)
+{
+	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
+	SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
+	simConfig.numNodes = 5;
+	simConfig.terminalId = 0;
+	strcpy(simConfig.defaultNodeConfigName, "prod_mesh_nrf52");
+	simConfig.preDefinedPositions = { {0.1, 0.5},{0.3, 0.5},{0.5, 0.5},{0.7, 0.5},{0.9, 0.5} };
+	//testerConfig.verbose = true;
+	CherrySimTester tester = CherrySimTester(testerConfig, simConfig);
+	tester.Start();
+
+	tester.SimulateUntilClusteringDone(100 * 1000);
+
+	const u8 maxBackoffLevel = 5;
+	for (u32 i = 0; i < simConfig.numNodes; i++) {
+		tester.sim->nodes[i].gs.config.highToLowDiscoveryTimeSec = 10;
+		tester.sim->nodes[i].gs.config.discoveryBackoffStepTimeSec = backoffEnabled ? 10 : 0;
+		tester.sim->nodes[i].gs.config.maxDiscoveryBackoffLevel = maxBackoffLevel;
+	}
+
+	//Restart the discovery on all nodes so that they switch from high to low discovery
+	tester.SendTerminalCommand(1, "action 0 node discovery off");
+	tester.SimulateForGivenTime(1 * 1000);
+	tester.SendTerminalCommand(1, "action 0 node discovery on");
+	tester.SimulateForGivenTime(20 * 1000);
+
+	for (u32 i = 0; i < simConfig.numNodes; i++) {
+		ASSERT_EQ(tester.sim->nodes[i].gs.node.currentDiscoveryState, DiscoveryState::LOW);
+	}
+
+	double chargeBeforeNc = 0;
+	for (u32 i = 0; i < simConfig.numNodes; i++) chargeBeforeNc += tester.sim->nodes[i].energy.GetTotalChargeNc();
+
+	tester.SimulateForGivenTime(10 * 60 * 1000);
+
+	double chargeAfterNc = 0;
+	for (u32 i = 0; i < simConfig.numNodes; i++) chargeAfterNc += tester.sim->nodes[i].energy.GetTotalChargeNc();
+	*quietChargeNc = chargeAfterNc - chargeBeforeNc;
+
+	//All levels are reached after 10 + 20 + 40 + 80 + 160 seconds
+	for (u32 i = 0; i < simConfig.numNodes; i++) {
+		ASSERT_EQ(tester.sim->nodes[i].gs.node.discoveryBackoffLevel, backoffEnabled ? maxBackoffLevel : 0);
+	}
+
+	//A node in the middle of the line must be able to rejoin even if its neighbours are fully backed off
+	const u32 resetTimeMs = tester.sim->simState.simTimeMs;
+	tester.SendTerminalCommand(3, "reset");
+	tester.SimulateForGivenTime(1 * 1000);
+	tester.SimulateUntilClusteringDone(200 * 1000);
+	*reclusteringTimeMs = tester.sim->simState.simTimeMs - resetTimeMs;
+}
+
+//Tests that the backoff saves energy in a quiet mesh without keeping a reset node out of the mesh for much longer
+TEST(TestNode, TestDiscoveryBackoffCharge_long) {
+	double chargeWithoutBackoffNc = 0;
+	double chargeWithBackoffNc = 0;
+	u32 reclusteringWithoutBackoffMs = 0;
+	u32 reclusteringWithBackoffMs = 0;
+
+	SimulateQuietMeshDiscovery(false, &chargeWithoutBackoffNc, &reclusteringWithoutBackoffMs);
+	SimulateQuietMeshDiscovery(true, &chargeWithBackoffNc, &reclusteringWithBackoffMs);
+
+	printf("Quiet mesh charge without backoff %.0f nC, with backoff %.0f nC" EOL, chargeWithoutBackoffNc, chargeWithBackoffNc);
+	printf("Clustering after reset without backoff %u ms, with backoff %u ms" EOL, reclusteringWithoutBackoffMs, reclusteringWithBackoffMs);
+
+	ASSERT_LT(chargeWithBackoffNc, chargeWithoutBackoffNc);
+	//The neighbours of the reset node lose a connection and switch back to high discovery immediately,
+	//so the backoff may at most delay the rejoin by one maximum advertising interval
+	ASSERT_LE(reclusteringWithBackoffMs, reclusteringWithoutBackoffMs + 10240);
+}
+
+//Tests that a hub between two sinks moves its sink route once the path through the current sink is clearly more
+//loaded than the other one, and that smaller differences do not move it (hysteresis)
+TEST(TestNode, TestSinkRouteHysteresis) {
+	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
+	SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
+	simConfig.numNodes = 3;
+	simConfig.terminalId = 0;
+	simConfig.preDefinedPositions = { {0.5, 0.3}, {0.5, 0.7}, {0.5, 0.5} };
+	//testerConfig.verbose = true;
+	CherrySimTester tester = CherrySimTester(testerConfig, simConfig);
+	strcpy(tester.sim->nodes[1].nodeConfiguration, "prod_sink_nrf52");
+
+	//Only the hub (node 3) connects the two sinks
+	tester.sim->nodes[0].impossibleConnection.push_back(1);
+
+	tester.Start();
+	tester.SimulateUntilClusteringDone(100 * 1000);
+
+	//Only the hub weighs the load, the sinks do not report any load that would overwrite the one set below
+	for (u32 i = 0; i < simConfig.numNodes; i++) {
+		tester.sim->nodes[i].gs.config.enableSinkRouting = true;
+		tester.sim->nodes[i].gs.config.sinkLoadReportIntervalDs = i == 2 ? SEC_TO_DS(1) : 0;
+	}
+	tester.SimulateForGivenTime(2 * 1000);
+
+	ConnectionManager& cm = tester.sim->nodes[2].gs.cm;
+	tester.sim->setNode(2);
+	MeshConnection* currentRoute = cm.GetMeshConnectionToShortestSink(nullptr);
+	ASSERT_NE(currentRoute, nullptr);
+	MeshConnection* otherRoute = nullptr;
+	MeshConnections conns = cm.GetMeshConnections(ConnectionDirection::INVALID);
+	for (u32 i = 0; i < conns.count; i++) {
+		if (conns.connections[i] != currentRoute && cm.GetSinkPathCost(conns.connections[i]) != UINT32_MAX) otherRoute = conns.connections[i];
+	}
+	ASSERT_NE(otherRoute, nullptr);
+
+	//A load below the hysteresis keeps the route
+	currentRoute->advertisedSinkPathQueueLoad = 15;
+	tester.SimulateForGivenTime(2 * 1000);
+	tester.sim->setNode(2);
+	ASSERT_EQ(cm.GetMeshConnectionToShortestSink(nullptr), currentRoute);
+
+	//A clearly higher load moves the route to the other sink
+	currentRoute->advertisedSinkPathQueueLoad = 50;
+	tester.SimulateForGivenTime(2 * 1000);
+	tester.sim->setNode(2);
+	ASSERT_EQ(cm.GetMeshConnectionToShortestSink(nullptr), otherRoute);
+
+	//Once the old path is free again, both routes cost the same and the traffic stays where it is
+	currentRoute->advertisedSinkPathQueueLoad = 0;
+	tester.SimulateForGivenTime(2 * 1000);
+	tester.sim->setNode(2);
+	ASSERT_EQ(cm.GetMeshConnectionToShortestSink(nullptr), otherRoute);
+}
+
+struct MultiSinkLoadResult
+{
+	u32 deliveredChunks = 0; //Packets that arrived at any of the sinks
+	u32 bytesToSink[2] = {}; //Bytes that the hub sent to each sink while the load was generated
+	u8 maxLoadReportedToLeaves = 0; //Highest path load that the hub reported to the nodes that send the load
+};
+
+//Four nodes send packets to the shortest sink through a hub that is connected to two sinks at the same distance.
+//With hop-only routing, the hub sends everything to one of the sinks. With load reports, the hub and the nodes
+//behind it weigh the queue load of the paths and the hub moves traffic to the other sink once its path is busy.
+TEST(TestNode, TestMultiSinkLoadBalancing) {
+	auto simulateMultiSinkLoad = [](bool loadBalancingEnabled) {
+		CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
+		SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
+		simConfig.numNodes = 7;
+		simConfig.terminalId = 0;
+		simConfig.enableSimStatistics = true;
+		simConfig.preDefinedPositions = { {0.5, 0.3}, {0.5, 0.7}, {0.5, 0.5}, {0.3, 0.5}, {0.7, 0.5}, {0.4, 0.45}, {0.6, 0.55} };
+		//testerConfig.verbose = true;
+		CherrySimTester tester = CherrySimTester(testerConfig, simConfig);
+		strcpy(tester.sim->nodes[1].nodeConfiguration, "prod_sink_nrf52");
+
+		//Only the hub (node 3) can reach the sinks and the other nodes can only reach the hub
+		tester.sim->nodes[0].impossibleConnection.push_back(1);
+		for (u32 i = 3; i < simConfig.numNodes; i++) {
+			tester.sim->nodes[0].impossibleConnection.push_back(i);
+			tester.sim->nodes[1].impossibleConnection.push_back(i);
+			for (u32 k = i + 1; k < simConfig.numNodes; k++) {
+				tester.sim->nodes[i].impossibleConnection.push_back(k);
+			}
+		}
+
+		tester.Start();
+		tester.SimulateUntilClusteringDone(100 * 1000);
+
+		for (u32 i = 0; i < simConfig.numNodes; i++) {
+			tester.sim->nodes[i].gs.config.enableSinkRouting = true;
+			tester.sim->nodes[i].gs.config.sinkLoadReportIntervalDs = loadBalancingEnabled ? SEC_TO_DS(1) : 0;
+		}
+
+		auto getBytesToSink = [&](u32 sink) {
+			u32 bytes = 0;
+			for (u32 j = 0; j < PACKET_LINK_STAT_SIZE; j++) {
+				if (tester.sim->nodes[2].linkStats[j].partnerId == (int)sink + 1) bytes += tester.sim->nodes[2].linkStats[j].bytes;
+			}
+			return bytes;
+		};
+		const u32 bytesToSinkBefore[2] = { getBytesToSink(0), getBytesToSink(1) };
+		simStatCounts.clear();
+
+		//Each node sends 200 packets of 150 bytes, one every 100ms
+		for (u32 i = 4; i <= simConfig.numNodes; i++) {
+			tester.SendTerminalCommand(i, "action this node generate_load %u 150 200 1", (u32)NODE_ID_SHORTEST_SINK);
+		}
+
+		MultiSinkLoadResult result;
+		for (u32 second = 0; second < 60; second++) {
+			tester.SimulateForGivenTime(1000);
+			for (u32 i = 3; i < simConfig.numNodes; i++) {
+				MeshConnections conns = tester.sim->nodes[i].gs.cm.GetMeshConnections(ConnectionDirection::INVALID);
+				for (u32 k = 0; k < conns.count; k++) {
+					result.maxLoadReportedToLeaves = std::max(result.maxLoadReportedToLeaves, conns.connections[k]->advertisedSinkPathQueueLoad);
+				}
+			}
+		}
+
+		result.deliveredChunks = simStatCounts["generateLoadChunkReceived"];
+		for (u32 sink = 0; sink < 2; sink++) result.bytesToSink[sink] = getBytesToSink(sink) - bytesToSinkBefore[sink];
+		return result;
+	};
+
+	const MultiSinkLoadResult hopOnly = simulateMultiSinkLoad(false);
+	const MultiSinkLoadResult loadBalanced = simulateMultiSinkLoad(true);
+
+	//Without load reports, the second sink only receives control traffic
+	const u32 lessUsedSinkHopOnly = std::min(hopOnly.bytesToSink[0], hopOnly.bytesToSink[1]);
+	const u32 lessUsedSinkLoadBalanced = std::min(loadBalanced.bytesToSink[0], loadBalanced.bytesToSink[1]);
+	ASSERT_GT(lessUsedSinkLoadBalanced, lessUsedSinkHopOnly);
+	ASSERT_GE(loadBalanced.deliveredChunks, hopOnly.deliveredChunks);
+
+	//The load of the path was reported to the nodes behind the hub
+	ASSERT_EQ(hopOnly.maxLoadReportedToLeaves, 0);
+	ASSERT_GT(loadBalanced.maxLoadReportedToLeaves, 0);
+}
+
 //Tests sending various length packets (split/not split) over normal prio queue concurrently
 //with high prio packets over a MeshConnection to see if acknowledgement works as expected
 TEST(TestNode, TestMeshConnectionPacketQueuing) {
@@ -587,6 +876,100 @@ TEST(TestNode, TestReconnectionPacketQueuing) {
 	tester.SimulateUntilMessageReceived(200 * 1000, 2, "Counter correct at");
 }
 
+//Checks that packets which the partner received shortly before the connection was lost are not sent again after reestablishing
+TEST(TestNode, TestReconnectionWithoutDuplicates) {
+	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
+	SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
+	simConfig.numNodes = 2;
+	simConfig.sdBusyProbability = 0;
+	//The airtime model loses acknowledgements so that packets can be delivered without the sender knowing
+	simConfig.linkLayerModel = LinkLayerModel::AIRTIME;
+
+	strcpy(simConfig.defaultNodeConfigName, "prod_mesh_nrf52");
+	//testerConfig.verbose = true;
+	CherrySimTester tester = CherrySimTester(testerConfig, simConfig);
+	tester.Start();
+
+	tester.sim->nodes[1].gs.logger.enableTag("DEBUGMOD");
+
+	tester.SimulateUntilClusteringDone(10 * 1000);
+
+	//The connection must be stable before it is reestablished
+	tester.SimulateForGivenTime(11 * 1000);
+	simStatCounts.clear();
+
+	//Keep the connection busy so that packets are in flight whenever the connection is lost
+	tester.SendTerminalCommand(1, "action this debug counter 2 200 1000000");
+
+	for (int i = 0; i < 100; i++) {
+		tester.SimulateForGivenTime(PSRNGINT(1000, 3000));
+
+		for (int j = 0; j < SIM_MAX_CONNECTION_NUM; j++) {
+			tester.sim->DisconnectSimulatorConnection(&tester.sim->nodes[0].state.connections[j], BLE_HCI_CONNECTION_TIMEOUT, BLE_HCI_CONNECTION_TIMEOUT);
+		}
+	}
+
+	//A single duplicate or lost counter message would break the sequence
+	tester.SimulateUntilMessageReceived(10 * 1000, 2, "Counter correct at");
+
+	printf("Resends avoided: %d, duplicates dropped: %d" EOL, simStatCounts["reestablishResendAvoided"], simStatCounts["reestablishDuplicateDropped"]);
+	ASSERT_GT(simStatCounts["reestablishResendAvoided"], 0);
+	ASSERT_EQ(simStatCounts["reestablishDuplicateDropped"], 0);
+	ASSERT_EQ(simStatCounts["ClusterUpdateCountMismatch"], 0);
+}
+
+//A partner that starts the reconnection before it knows our counters resends writes that we already received.
+//The RECONNECT packet tells us where the partner resumes, so these writes must be dropped.
+TEST(TestNode, TestReconnectionDropsResentWrites) {
+	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
+	SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
+	simConfig.numNodes = 2;
+	simConfig.sdBusyProbability = 0;
+	strcpy(simConfig.defaultNodeConfigName, "prod_mesh_nrf52");
+	//testerConfig.verbose = true;
+	CherrySimTester tester = CherrySimTester(testerConfig, simConfig);
+	tester.Start();
+
+	tester.SimulateUntilClusteringDone(10 * 1000);
+	tester.SimulateForGivenTime(5 * 1000);
+	simStatCounts.clear();
+
+	MeshConnections conns = tester.sim->nodes[1].gs.cm.GetMeshConnections(ConnectionDirection::INVALID);
+	ASSERT_EQ(conns.count, 1);
+	MeshConnection* connection = conns.connections[0];
+	ASSERT_TRUE(connection->handshakeDone());
+	ASSERT_GT(connection->receivedWriteCount, 2);
+
+	connPacketReconnect packet;
+	CheckedMemset(&packet, 0, sizeof(packet));
+	packet.header.messageType = MessageType::RECONNECT;
+	packet.header.sender = connection->partnerId;
+	packet.header.receiver = tester.sim->nodes[1].id;
+	packet.payload.receivedWrites = connection->sentWriteCount;
+
+	//A partner that knows all our received writes does not resend anything
+	packet.payload.resumeWrite = connection->receivedWriteCount;
+	tester.sim->setNode(1);
+	connection->ReceiveReconnectionHandshakePacket(&packet, SIZEOF_CONN_PACKET_RECONNECT);
+	ASSERT_EQ(connection->duplicateWritesToDrop, 0);
+
+	//The partner resumes two writes before the last one that we received
+	packet.payload.resumeWrite = connection->receivedWriteCount - 2;
+	tester.sim->setNode(1);
+	connection->ReceiveReconnectionHandshakePacket(&packet, SIZEOF_CONN_PACKET_RECONNECT);
+	ASSERT_EQ(connection->duplicateWritesToDrop, 2);
+
+	//The next two writes of the partner are dropped, all later ones are received again
+	const u16 receivedWritesBefore = connection->receivedWriteCount;
+	tester.SendTerminalCommand(1, "action this debug counter 2 50 20");
+	tester.SimulateForGivenTime(5 * 1000);
+
+	ASSERT_EQ(connection->duplicateWritesToDrop, 0);
+	ASSERT_EQ(connection->droppedDuplicateWrites, 2);
+	ASSERT_EQ(simStatCounts["reestablishDuplicateDropped"], 2);
+	ASSERT_GT(connection->receivedWriteCount, receivedWritesBefore);
+}
+
 TEST(TestNode, TestReestablishmentTimesOut) {
 	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
 	SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
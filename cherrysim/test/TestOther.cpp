@@ -36,11 +36,17 @@
 #include "StatusReporterModule.h"
 #include "CherrySimUtils.h"
 #include "RingIndexGenerator.h"
+#include "CherrySimBatchRunner.h"
 
 
 extern "C"{
 #include <ccm_soft.h>
+#include <aes_backend.h>
 }
+#include <chrono>
+#include <fstream>
+#include <cstdio>
+#include <filesystem>
 
 
 TEST(TestOther, BatteryTest)
@@ -62,6 +68,244 @@ TEST(TestOther, BatteryTest)
 	}
 }
 
+//Checks the interpolation of the energy model and that the charge of each node is attributed to its activities
+TEST(TestOther, TestEnergyProfiler)
+{
+	const std::vector<EnergyCurvePoint> curve = { {20, 800}, {100, 220}, {200, 110}, {30000, 30} };
+	ASSERT_DOUBLE_EQ(EnergyProfile::GetCurrentForInterval(curve, 100), 220);
+	ASSERT_NEAR(EnergyProfile::GetCurrentForInterval(curve, 150), 110 + 110 / 3.0, 0.001);
+	ASSERT_DOUBLE_EQ(EnergyProfile::GetCurrentForInterval(curve, 10), 1600);
+	ASSERT_DOUBLE_EQ(EnergyProfile::GetCurrentForInterval(curve, 60000), 15);
+
+	//The profile is written to the temp directory and removed again when the test ends, also if an assertion fails
+	struct RemoveFileOnExit {
+		const std::string path;
+		~RemoveFileOnExit() { std::remove(path.c_str()); }
+	};
+	const RemoveFileOnExit temporaryProfile{ (std::filesystem::temp_directory_path() / "TestEnergyProfiler.json").string() };
+	const char* profilePath = temporaryProfile.path.c_str();
+	ASSERT_LT(temporaryProfile.path.size(), sizeof(SimConfiguration::energyProfilePath));
+	{
+		std::ofstream profileFile(profilePath);
+		profileFile << "{\"nrf52\":{\"idleCurrentUa\":5,\"cpuChargePerEventNc\":400,\"flashPageEraseChargeNc\":200000,\"flashWriteChargePerWordNc\":300,"
+			"\"advertisingCurve\":[{\"intervalMs\":100,\"currentUa\":200}]}}";
+	}
+
+	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
+	SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
+	simConfig.numNodes = 3;
+	strcpy(simConfig.energyProfilePath, profilePath);
+	CherrySimTester tester = CherrySimTester(testerConfig, simConfig);
+	tester.Start();
+
+	tester.SimulateUntilClusteringDone(10 * 1000);
+	tester.SendTerminalCommand(1, "energystat");
+	tester.SimulateGivenNumberOfSteps(1);
+
+	for (u32 i = 0; i < simConfig.numNodes; i++) {
+		const NodeEnergyStats& energy = tester.sim->nodes[i].energy;
+		ASSERT_NEAR(energy.chargeNc[(u32)EnergyCategory::IDLE], 5.0 * tester.sim->simState.simTimeMs, 5.0 * simConfig.simTickDurationMs);
+		ASSERT_GT(energy.chargeNc[(u32)EnergyCategory::ADVERTISING], 0);
+		ASSERT_GT(energy.chargeNc[(u32)EnergyCategory::CONNECTION_EVENTS], 0);
+		ASSERT_GT(energy.chargeNc[(u32)EnergyCategory::CPU], 0);
+		ASSERT_EQ(tester.sim->nodes[i].nanoAmperePerMsTotal, (u32)energy.GetTotalChargeNc());
+	}
+}
+
+TEST(TestOther, TestBatchRunner)
+{
+	std::vector<double> values = { 5, 1, 4, 2, 3 };
+	ASSERT_DOUBLE_EQ(CherrySimBatchRunner::GetPercentile(values, 0), 1);
+	ASSERT_DOUBLE_EQ(CherrySimBatchRunner::GetPercentile(values, 50), 3);
+	ASSERT_DOUBLE_EQ(CherrySimBatchRunner::GetPercentile(values, 90), 5);
+	ASSERT_DOUBLE_EQ(CherrySimBatchRunner::GetPercentile(values, 100), 5);
+
+	CherrySimBatchConfig batchConfig;
+	batchConfig.baseConfig = CherrySimTester::CreateDefaultSimConfiguration();
+	batchConfig.baseConfig.terminalId = -1;
+	batchConfig.numSeeds = 3;
+	batchConfig.maxParallelJobs = 2;
+	batchConfig.trafficDurationMs = 10 * 1000;
+	batchConfig.reportPath = "TestBatchRunner.json";
+
+	char* args[] = { (char*)"nodes=4,6", (char*)"timeoutSec=60" };
+	ASSERT_TRUE(CherrySimBatchRunner::ParseArguments(2, args, batchConfig));
+	ASSERT_EQ(batchConfig.variants.size(), 2);
+	ASSERT_EQ(batchConfig.clusteringTimeoutMs, 60 * 1000);
+
+	CherrySimBatchRunner batchRunner(batchConfig);
+	std::string report = batchRunner.Run();
+
+	//Every seed of every variant must have clustered, the results are ordered like the jobs
+	const std::vector<CherrySimBatchJobResult>& results = batchRunner.GetResults();
+	ASSERT_EQ(results.size(), 6);
+	for (u32 i = 0; i < results.size(); i++) {
+		ASSERT_TRUE(results[i].finished);
+		ASSERT_TRUE(results[i].clustered);
+		ASSERT_EQ(results[i].seed, batchConfig.firstSeed + i % 3);
+		ASSERT_GT(results[i].clusteringTimeMs, 0);
+		ASSERT_GT(results[i].sentPacketsReliable + results[i].sentPacketsUnreliable, 0);
+	}
+	ASSERT_EQ(results[0].variant, "nodes4");
+	ASSERT_EQ(results[3].variant, "nodes6");
+
+	ASSERT_NE(report.find("\"nodes6\""), std::string::npos);
+	std::ifstream reportFile(batchConfig.reportPath);
+	ASSERT_TRUE(reportFile.good());
+	reportFile.close();
+	std::remove(batchConfig.reportPath.c_str());
+}
+
+TEST(TestOther, TestRunCasesFromWarmedUpSimulation)
+{
+	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
+	SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
+	simConfig.numNodes = 10;
+
+	u32 warmedUpTimeMs = 0;
+	auto warmUp = [&](CherrySimTester& tester) {
+		tester.Start();
+		tester.SimulateUntilClusteringDone(100 * 1000);
+		warmedUpTimeMs = tester.sim->simState.simTimeMs;
+	};
+
+	//Every case must start from the converged mesh, no matter what the cases before did
+	auto resetNodes = [&](CherrySimTester& tester) {
+		ASSERT_EQ(tester.sim->simState.simTimeMs, warmedUpTimeMs);
+		ASSERT_TRUE(tester.sim->IsClusteringDone());
+		tester.SendTerminalCommand(2, "reset");
+		tester.SendTerminalCommand(5, "reset");
+		tester.SimulateUntilClusteringDone(100 * 1000);
+	};
+	auto checkConverged = [&](CherrySimTester& tester) {
+		ASSERT_EQ(tester.sim->simState.simTimeMs, warmedUpTimeMs);
+		ASSERT_TRUE(tester.sim->IsClusteringDone());
+		tester.SimulateForGivenTime(10 * 1000);
+		ASSERT_TRUE(tester.sim->IsClusteringDone());
+	};
+	auto throwing = [](CherrySimTester&) {
+		throw TimeoutException();
+	};
+
+	//Running the same case twice from the warm-up must produce the exact same node state
+	std::vector<std::vector<u32>> recordedStates;
+	auto recordState = [&](CherrySimTester& tester) {
+		tester.SendTerminalCommand(4, "reset");
+		tester.SendTerminalCommand(1, "action 0 status get_status");
+		tester.SimulateForGivenTime(20 * 1000);
+		std::vector<u32> state;
+		state.push_back(tester.sim->simState.simTimeMs);
+		for (u32 i = 0; i < tester.sim->getNumNodes(); i++) {
+			const nodeEntry& node = tester.sim->nodes[i];
+			state.push_back(node.gs.node.clusterId);
+			state.push_back((u32)node.gs.node.clusterSize);
+			state.push_back(node.gs.cm.sentMeshPacketsReliable);
+			state.push_back(node.gs.cm.sentMeshPacketsUnreliable);
+			state.push_back(node.gs.node.connectionLossCounter);
+		}
+		recordedStates.push_back(std::move(state));
+	};
+
+	std::vector<u32> failedCases = CherrySimTester::RunCasesFromWarmedUpSimulation(testerConfig, simConfig, warmUp, { resetNodes, recordState, checkConverged, throwing, resetNodes, recordState });
+	ASSERT_GT(warmedUpTimeMs, 0);
+	ASSERT_EQ(failedCases.size(), 1);
+	ASSERT_EQ(failedCases[0], 3);
+	ASSERT_EQ(recordedStates.size(), 2);
+	ASSERT_EQ(recordedStates[0], recordedStates[1]);
+}
+
+TEST(TestOther, TestRecordAndReplayTrace)
+{
+	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
+	SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
+	simConfig.numNodes = 10;
+	const char* tracePath = "TestRecordAndReplayTrace.bin";
+
+	u32 recordedTimeMs = 0;
+	ClusterId recordedClusterId = 0;
+	ClusterSize recordedClusterSize = 0;
+	u32 recordedSentPackets = 0;
+	{
+		SimConfiguration recordConfig = simConfig;
+		strcpy(recordConfig.traceRecordPath, tracePath);
+		CherrySimTester tester = CherrySimTester(testerConfig, recordConfig);
+		tester.Start();
+		tester.SimulateUntilClusteringDone(100 * 1000);
+		tester.SendTerminalCommand(3, "action this status get_status");
+		tester.SimulateForGivenTime(10 * 1000);
+
+		recordedTimeMs = tester.sim->simState.simTimeMs;
+		recordedClusterId = tester.sim->nodes[2].gs.node.clusterId;
+		recordedClusterSize = tester.sim->nodes[2].gs.node.clusterSize;
+		recordedSentPackets = tester.sim->nodes[2].gs.cm.sentMeshPacketsReliable + tester.sim->nodes[2].gs.cm.sentMeshPacketsUnreliable;
+	}
+
+	//Node 3 must behave exactly as recorded although none of its partners is simulated
+	{
+		SimConfiguration replayConfig = simConfig;
+		strcpy(replayConfig.traceReplayPath, tracePath);
+		replayConfig.replayNodeIds = { 3 };
+		CherrySimTester tester = CherrySimTester(testerConfig, replayConfig);
+		tester.Start();
+		tester.SimulateForGivenTime(recordedTimeMs);
+
+		ASSERT_EQ(tester.sim->replayDivergenceCount, 0);
+		ASSERT_EQ(tester.sim->nodes[2].gs.node.clusterId, recordedClusterId);
+		ASSERT_EQ(tester.sim->nodes[2].gs.node.clusterSize, recordedClusterSize);
+		ASSERT_EQ(tester.sim->nodes[2].gs.cm.sentMeshPacketsReliable + tester.sim->nodes[2].gs.cm.sentMeshPacketsUnreliable, recordedSentPackets);
+		ASSERT_EQ(tester.sim->nodes[1].simulatedFrames, 0);
+	}
+
+	std::remove(tracePath);
+}
+
+//Checks that acknowledged module messages are delivered once, retransmitted and given up if the receiver does not exist
+TEST(TestOther, TestAcknowledgedModuleMessages)
+{
+	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
+	SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
+	simConfig.numNodes = 3;
+	simConfig.terminalId = 0;
+	CherrySimTester tester = CherrySimTester(testerConfig, simConfig);
+	tester.Start();
+
+	tester.SimulateUntilClusteringDone(100 * 1000);
+
+	const ReliableMessaging& sender = tester.sim->nodes[0].gs.reliableMessaging;
+	const ReliableMessaging& receiver = tester.sim->nodes[2].gs.reliableMessaging;
+	const u8 getStatus = (u8)StatusReporterModule::StatusModuleTriggerActionMessages::GET_STATUS;
+
+	//The request is acknowledged by node 3 and answered as usual
+	tester.sim->setNode(0);
+	ASSERT_EQ(GS->cm.SendModuleActionMessageAcknowledged(MessageType::MODULE_TRIGGER_ACTION, ModuleId::STATUS_REPORTER_MODULE, 3, getStatus, 0, nullptr, 0), ErrorType::SUCCESS);
+	tester.SimulateUntilMessageReceived(10 * 1000, 1, "{\"nodeId\":3,\"type\":\"status\",\"module\":3");
+	tester.SimulateForGivenTime(1000);
+	ASSERT_EQ(sender.acknowledgedMessages, 1);
+	ASSERT_EQ(sender.GetNumPendingMessages(), 0);
+	ASSERT_EQ(receiver.deliveredMessages, 1);
+
+	//A retransmission that is sent before the ack arrives must not be dispatched twice
+	tester.sim->setNode(0);
+	ASSERT_EQ(GS->cm.SendModuleActionMessageAcknowledged(MessageType::MODULE_TRIGGER_ACTION, ModuleId::STATUS_REPORTER_MODULE, 3, getStatus, 0, nullptr, 0), ErrorType::SUCCESS);
+	GS->reliableMessaging.TimerEventHandler(ReliableMessaging::RETRANSMISSION_TIMEOUT_DS);
+	tester.SimulateForGivenTime(5 * 1000);
+	ASSERT_EQ(sender.retransmissions, 1);
+	ASSERT_EQ(sender.acknowledgedMessages, 2);
+	ASSERT_EQ(receiver.deliveredMessages, 2);
+	ASSERT_EQ(receiver.duplicateMessages, 1);
+
+	//Nobody acknowledges messages for a missing node, so it is given up after all retries
+	tester.sim->setNode(0);
+	ASSERT_EQ(GS->cm.SendModuleActionMessageAcknowledged(MessageType::MODULE_TRIGGER_ACTION, ModuleId::STATUS_REPORTER_MODULE, 50, getStatus, 0, nullptr, 0), ErrorType::SUCCESS);
+	tester.SimulateForGivenTime(120 * 1000);
+	ASSERT_EQ(sender.retransmissions, 1 + ReliableMessaging::MAX_RETRIES);
+	ASSERT_EQ(sender.givenUpMessages, 1);
+	ASSERT_EQ(sender.GetNumPendingMessages(), 0);
+
+	tester.SendTerminalCommand(1, "reliablestats");
+	tester.SimulateUntilMessageReceived(10 * 1000, 1, "{\"type\":\"reliable_stats\",\"sent\":3,\"acked\":2,\"retries\":6,\"givenUp\":1,");
+}
+
 TEST(TestOther, TestRebootReason)
 {
 	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
@@ -301,6 +545,160 @@ TEST(TestOther, TestEncryption) {
 	ccm_soft_encrypt(&ccme);
 }
 
+//Restores the previously selected AES backend when a test ends, also if an assertion fails
+class AesBackendGuard
+{
+private:
+	const aes_backend_t previousBackend;
+public:
+	AesBackendGuard() : previousBackend(aes_backend_get_selected()) {}
+	~AesBackendGuard() { aes_backend_select(previousBackend); }
+};
+
+static std::vector<aes_backend_t> GetAvailableAesBackends()
+{
+	std::vector<aes_backend_t> backends = { AES_BACKEND_SOFTWARE };
+	if (aes_backend_is_available(AES_BACKEND_AES_NI)) backends.push_back(AES_BACKEND_AES_NI);
+	return backends;
+}
+
+static void SetupCcmEncryption(ccm_soft_data_t& ccme, uint8_t* key, uint8_t* nonce, uint8_t* cleartext, uint8_t* out)
+{
+	CheckedMemset(key, 0x77, 16);
+	CheckedMemset(nonce, 0x01, 13);
+	CheckedMemset(cleartext, 0x11, 16);
+	ccme.a_len = 0;
+	ccme.mic_len = 4;
+	ccme.m_len = 16;
+	ccme.p_a = nullptr;
+	ccme.p_key = key;
+	ccme.p_m = cleartext;
+	ccme.p_mic = &(out[16]);
+	ccme.p_nonce = nonce;
+	ccme.p_out = out;
+}
+
+//Checks that all available AES backends produce identical results
+TEST(TestOther, TestAesBackends) {
+	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
+	SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
+	simConfig.numNodes = 1;
+	CherrySimTester tester = CherrySimTester(testerConfig, simConfig);
+	tester.Start();
+
+	StackBaseSetter sbs;
+	AesBackendGuard backendGuard;
+	const std::vector<aes_backend_t> backends = GetAvailableAesBackends();
+
+	//FIPS-197 Appendix C.1 test vector
+	const uint8_t fipsKey[16]        = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+	const uint8_t fipsCleartext[16]  = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff };
+	const uint8_t fipsCiphertext[16] = { 0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a };
+	for (aes_backend_t backend : backends)
+	{
+		uint8_t ciphertext[16];
+		aes_backend_ecb_encrypt_with(backend, fipsKey, fipsCleartext, ciphertext);
+		ASSERT_EQ(memcmp(ciphertext, fipsCiphertext, 16), 0) << aes_backend_get_name(backend);
+	}
+
+	//Compare all backends against the software implementation with random input
+	MersenneTwister mt(1);
+	for (int i = 0; i < 10000; i++)
+	{
+		uint8_t key[16];
+		uint8_t cleartext[16];
+		for (int k = 0; k < 16; k++) {
+			key[k] = (uint8_t)mt.nextU32(0, 255);
+			cleartext[k] = (uint8_t)mt.nextU32(0, 255);
+		}
+
+		uint8_t expected[16];
+		aes_backend_ecb_encrypt_with(AES_BACKEND_SOFTWARE, key, cleartext, expected);
+		for (aes_backend_t backend : backends)
+		{
+			uint8_t ciphertext[16];
+			aes_backend_ecb_encrypt_with(backend, key, cleartext, ciphertext);
+			ASSERT_EQ(memcmp(ciphertext, expected, 16), 0) << aes_backend_get_name(backend);
+		}
+	}
+
+	//The CCM implementation uses the simulated SoftDevice ECB and therefore the selected backend
+	uint8_t ccmKey[16];
+	uint8_t ccmNonce[13];
+	uint8_t ccmCleartext[16];
+	uint8_t expectedCcm[20];
+	bool expectedCcmSet = false;
+	for (aes_backend_t backend : backends)
+	{
+		ASSERT_TRUE(aes_backend_select(backend));
+
+		uint8_t ccmOut[20];
+		ccm_soft_data_t ccme;
+		SetupCcmEncryption(ccme, ccmKey, ccmNonce, ccmCleartext, ccmOut);
+		ccm_soft_encrypt(&ccme);
+		if (!expectedCcmSet) {
+			CheckedMemcpy(expectedCcm, ccmOut, 20);
+			expectedCcmSet = true;
+		}
+		ASSERT_EQ(memcmp(ccmOut, expectedCcm, 20), 0) << aes_backend_get_name(backend);
+	}
+}
+
+//Prints the throughput of all available AES backends for the operations used by MeshAccess connections
+TEST(TestOther, TestAesBackendThroughput_long) {
+	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
+	SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
+	simConfig.numNodes = 1;
+	CherrySimTester tester = CherrySimTester(testerConfig, simConfig);
+	tester.Start();
+
+	StackBaseSetter sbs;
+	AesBackendGuard backendGuard;
+
+	constexpr int numOperations = 20000;
+	for (aes_backend_t backend : GetAvailableAesBackends())
+	{
+		ASSERT_TRUE(aes_backend_select(backend));
+
+		uint8_t ccmKey[16];
+		uint8_t ccmNonce[13];
+		uint8_t ccmCleartext[16];
+		uint8_t ccmOut[20];
+		ccm_soft_data_t ccme;
+		SetupCcmEncryption(ccme, ccmKey, ccmNonce, ccmCleartext, ccmOut);
+
+		//A MeshAccess handshake derives a session key with one block encryption using a new key each time
+		uint8_t block[16];
+		CheckedMemset(block, 0x00, 16);
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < numOperations; i++) {
+			Utility::Aes128BlockEncrypt((Aes128Block*)block, (Aes128Block*)block, (Aes128Block*)block);
+		}
+		double sessionKeySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		//A MeshAccess packet needs three block encryptions with the session key if its keystreams were not precomputed
+		start = std::chrono::steady_clock::now();
+		for (int i = 0; i < numOperations; i++) {
+			for (int k = 0; k < 3; k++) {
+				Utility::Aes128BlockEncrypt((Aes128Block*)block, (Aes128Block*)ccmKey, (Aes128Block*)block);
+			}
+		}
+		double packetSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		start = std::chrono::steady_clock::now();
+		for (int i = 0; i < numOperations; i++) {
+			ccm_soft_encrypt(&ccme);
+		}
+		double ccmSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		printf("AES backend %s: %.0f session keys/s, %.0f MeshAccess packets/s, %.0f CCM packets/s" EOL,
+			aes_backend_get_name(backend),
+			numOperations / sessionKeySeconds,
+			numOperations / packetSeconds,
+			numOperations / ccmSeconds);
+	}
+}
+
 #ifndef GITHUB_RELEASE
 TEST(TestOther, TestConnectionAllocator) {
 	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
@@ -377,6 +775,113 @@ TEST(TestOther, TestMultiMessageSimulation) {
 	}
 }
 
+//Tests the matcher that is used by SimulateUntilMessagesReceived to check all awaited messages in one pass
+TEST(TestOther, TestMultiPatternMatcher) {
+	MultiPatternMatcher matcher;
+	matcher.AddPattern("he", 0);
+	matcher.AddPattern("she", 1);
+	matcher.AddPattern("his", 2);
+	matcher.AddPattern("hers", 3);
+	matcher.AddPattern("", 4);
+	matcher.AddPattern("she", 5);
+	matcher.Build();
+	ASSERT_EQ(matcher.GetNumPatterns(), 6);
+
+	std::vector<bool> matches;
+	matcher.FindAll("ushers", matches);
+	ASSERT_EQ(matches, std::vector<bool>({ true, true, false, true, true, true }));
+
+	matches.assign(matches.size(), false);
+	matcher.FindAll("this", matches);
+	ASSERT_EQ(matches, std::vector<bool>({ false, false, true, false, true, false }));
+
+	matches.assign(matches.size(), false);
+	matcher.FindAll("", matches);
+	ASSERT_EQ(matches, std::vector<bool>({ false, false, false, false, true, false }));
+
+	//Every pattern must be found the same way as with a plain substring search
+	MersenneTwister mt(3);
+	const char alphabet[] = "ab";
+	MultiPatternMatcher randomMatcher;
+	std::vector<std::string> patterns;
+	for (u32 i = 0; i < 50; i++) {
+		std::string pattern;
+		u32 length = mt.nextU32(1, 5);
+		for (u32 k = 0; k < length; k++) pattern += alphabet[mt.nextU32(0, 1)];
+		patterns.push_back(pattern);
+		randomMatcher.AddPattern(pattern, i);
+	}
+	randomMatcher.Build();
+	for (u32 i = 0; i < 200; i++) {
+		std::string text;
+		u32 length = mt.nextU32(0, 20);
+		for (u32 k = 0; k < length; k++) text += alphabet[mt.nextU32(0, 1)];
+		std::vector<bool> randomMatches(patterns.size(), false);
+		randomMatcher.FindAll(text.c_str(), randomMatches);
+		for (u32 k = 0; k < patterns.size(); k++) {
+			ASSERT_EQ((bool)randomMatches[k], text.find(patterns[k]) != std::string::npos);
+		}
+	}
+}
+
+//Awaited regex messages must also be validated only once per line of output
+TEST(TestOther, TestMultiRegexMessageSimulation) {
+	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
+	SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
+	simConfig.numNodes = 3;
+	simConfig.terminalId = 0;
+	CherrySimTester tester = CherrySimTester(testerConfig, simConfig);
+	tester.Start();
+
+	std::vector<SimulationMessage> msgs = {
+		SimulationMessage(1, "Handshake (starting|done)"),
+		SimulationMessage(1, "Handshake (starting|done)"),
+		SimulationMessage(2, "Handshake done"),
+		SimulationMessage(3, "Handshake done"),
+	};
+
+	tester.SimulateUntilRegexMessagesReceived(10 * 1000, msgs);
+
+	for (unsigned i = 0; i < msgs.size(); i++) {
+		ASSERT_TRUE(msgs[i].isFound());
+	}
+}
+
+//A line of output that matches several awaited messages must only validate the first one of them
+TEST(TestOther, TestAwaitedMessagesAreValidatedOncePerLine) {
+	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
+	SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
+	simConfig.numNodes = 1;
+	simConfig.terminalId = 0;
+	CherrySimTester tester = CherrySimTester(testerConfig, simConfig);
+	tester.Start();
+	tester.SimulateForGivenTime(1000);
+
+	//gettime prints a single line that contains both messages
+	std::vector<SimulationMessage> msgs = {
+		SimulationMessage(1, "Time is"),
+		SimulationMessage(1, "is currently"),
+	};
+	tester.SendTerminalCommand(1, "gettime");
+	ASSERT_THROW(tester.SimulateUntilMessagesReceived(1000, msgs), TimeoutException);
+	ASSERT_TRUE(msgs[0].isFound());
+	ASSERT_FALSE(msgs[1].isFound());
+
+	std::vector<SimulationMessage> regexMsgs = {
+		SimulationMessage(1, "Time (is|was)"),
+		SimulationMessage(1, "is currently"),
+	};
+	tester.SendTerminalCommand(1, "gettime");
+	ASSERT_THROW(tester.SimulateUntilRegexMessagesReceived(1000, regexMsgs), TimeoutException);
+	ASSERT_TRUE(regexMsgs[0].isFound());
+	ASSERT_FALSE(regexMsgs[1].isFound());
+
+	//A second line validates the remaining message
+	tester.SendTerminalCommand(1, "gettime");
+	tester.SimulateUntilRegexMessagesReceived(1000, regexMsgs);
+	ASSERT_TRUE(regexMsgs[1].isFound());
+}
+
 //This test should make sure that Gattc timeout events are reported properly through the error log and live reports
 TEST(TestOther, TestGattcEvtTimeoutReporting) {
 	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
@@ -900,6 +1405,54 @@ TEST(TestOther, TestBoards) {
 }
 #endif //GITHUB_RELEASE
 
+//The event queue of a node must keep its order while wrapping around and growing
+TEST(TestOther, TestSimBleEventQueue) {
+	SimBleEventQueue queue;
+	ASSERT_EQ(queue.capacity(), SimBleEventQueue::INITIAL_CAPACITY);
+
+	u32 nextPush = 0;
+	u32 nextPop = 0;
+	//Wrap around a few times without growing
+	for (u32 i = 0; i < 3 * SimBleEventQueue::INITIAL_CAPACITY; i++) {
+		queue.emplace_back().globalId = nextPush++;
+		queue.emplace_back().globalId = nextPush++;
+		ASSERT_EQ(queue.front().globalId, nextPop++);
+		queue.pop_front();
+		ASSERT_EQ(queue.front().globalId, nextPop++);
+		queue.pop_front();
+	}
+	ASSERT_EQ(queue.size(), 0);
+	ASSERT_EQ(queue.capacity(), SimBleEventQueue::INITIAL_CAPACITY);
+	ASSERT_EQ(queue.GetHighWaterMark(), 2);
+
+	//Fill the queue from the middle of the ring so that growing must unwrap it
+	queue.emplace_back().globalId = nextPush++;
+	queue.pop_front();
+	nextPop++;
+	for (u32 i = 0; i < 2 * SimBleEventQueue::INITIAL_CAPACITY + 5; i++) {
+		simBleEvent event;
+		event.globalId = nextPush++;
+		queue.push_back(event);
+	}
+	ASSERT_EQ(queue.size(), 2 * SimBleEventQueue::INITIAL_CAPACITY + 5);
+	ASSERT_EQ(queue.capacity(), 4 * SimBleEventQueue::INITIAL_CAPACITY);
+	ASSERT_EQ(queue.GetHighWaterMark(), 2 * SimBleEventQueue::INITIAL_CAPACITY + 5);
+	for (u32 i = 0; i < queue.size(); i++) {
+		ASSERT_EQ(queue[i].globalId, nextPop + i);
+	}
+	while (queue.size() > 0) {
+		ASSERT_EQ(queue.front().globalId, nextPop++);
+		queue.pop_front();
+	}
+	ASSERT_EQ(nextPop, nextPush);
+
+	//The high water mark survives clearing the queue, e.g. on a reboot
+	queue.emplace_back();
+	queue.clear();
+	ASSERT_EQ(queue.size(), 0);
+	ASSERT_EQ(queue.GetHighWaterMark(), 2 * SimBleEventQueue::INITIAL_CAPACITY + 5);
+}
+
 TEST(TestOther, TestRingIndexGenerator) {
 	Exceptions::DisableDebugBreakOnException ddboe;
 
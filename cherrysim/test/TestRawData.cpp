@@ -245,3 +245,96 @@ TEST(TestRawData, TestRandomTransmissions) {
 		}
 	}
 }
+
+//Plays the receiver of a raw data transfer and checks that only the reported chunks are sent again
+TEST(TestRawData, TestTransferSelectiveRetransmission) {
+	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
+	SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
+	simConfig.numNodes = 2;
+	simConfig.terminalId = 0;
+	//testerConfig.verbose = true;
+
+	CherrySimTester tester = CherrySimTester(testerConfig, simConfig);
+
+	tester.Start();
+	tester.SimulateUntilClusteringDone(100 * 1000);
+
+	static u8 data[10 * MAX_RAW_CHUNK_SIZE];
+	for (u32 i = 0; i < sizeof(data); i++) data[i] = (u8)i;
+
+	tester.sim->setNode(0);
+	ASSERT_EQ(GS->rawDataTransfer.StartTransfer(ModuleId::NODE, 2, ModuleId::NODE, RawDataProtocol::UNSPECIFIED, 7, data, sizeof(data)), ErrorType::SUCCESS);
+	ASSERT_EQ(GS->rawDataTransfer.StartTransfer(ModuleId::NODE, 2, ModuleId::NODE, RawDataProtocol::UNSPECIFIED, 7, data, sizeof(data)), ErrorType::BUSY);
+	tester.SimulateUntilMessageReceived(10 * 1000, 2, "{\"nodeId\":1,\"type\":\"raw_data_start\",\"module\":0,\"numChunks\":10,\"protocol\":0,\"fmKeyId\":0,\"requestHandle\":7}");
+
+	tester.SendTerminalCommand(2, "raw_data_start_received 1 0 7");
+	tester.SimulateUntilMessageReceived(10 * 1000, 2, "{\"nodeId\":1,\"type\":\"raw_data_chunk\",\"module\":0,\"chunkId\":10,");
+
+	std::vector<SimulationMessage> retransmissions = {
+		SimulationMessage(2, "{\"nodeId\":1,\"type\":\"raw_data_chunk\",\"module\":0,\"chunkId\":3,"),
+		SimulationMessage(2, "{\"nodeId\":1,\"type\":\"raw_data_chunk\",\"module\":0,\"chunkId\":7,"),
+	};
+	tester.SendTerminalCommand(2, "raw_data_report 1 0 3,7 7");
+	tester.SimulateUntilMessagesReceived(10 * 1000, retransmissions);
+
+	tester.SendTerminalCommand(2, "raw_data_report 1 0 - 7");
+	tester.SimulateUntilMessageReceived(10 * 1000, 1, "{\"nodeId\":1,\"type\":\"raw_data_transfer_result\",\"receiver\":2,\"module\":0,\"result\":0,\"bytes\":600,\"sentChunks\":12,\"retransmittedChunks\":2,");
+
+	const RawDataTransfer& sender = tester.sim->nodes[0].gs.rawDataTransfer;
+	ASSERT_EQ(sender.completedTransfers, 1);
+	ASSERT_EQ(sender.retransmittedChunks, 2);
+	ASSERT_EQ(sender.GetNumActiveTransfers(), 0);
+}
+
+//Sends a transfer over three hops while the relays are busy with other traffic and connections on the path time out
+TEST(TestRawData, TestTransferOverLossyMultiHopPath) {
+	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
+	SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
+	simConfig.numNodes = 4;
+	simConfig.terminalId = 0;
+	simConfig.preDefinedPositions = { {0.4, 0.5}, {0.45, 0.5}, {0.5, 0.5}, {0.55, 0.5} };
+	//testerConfig.verbose = true;
+
+	CherrySimTester tester = CherrySimTester(testerConfig, simConfig);
+
+	//Forces the nodes into a line
+	tester.sim->nodes[0].impossibleConnection.push_back(2);
+	tester.sim->nodes[0].impossibleConnection.push_back(3);
+	tester.sim->nodes[1].impossibleConnection.push_back(3);
+
+	tester.Start();
+	tester.SimulateUntilClusteringDone(100 * 1000);
+
+	tester.sim->nodes[3].gs.config.enableRawDataReceiver = true;
+
+	static u8 data[50 * MAX_RAW_CHUNK_SIZE];
+	for (u32 i = 0; i < sizeof(data); i++) data[i] = (u8)(i * 7);
+
+	tester.SendTerminalCommand(2, "action this node generate_load 4 100 100 1");
+	tester.SendTerminalCommand(3, "action this node generate_load 4 100 100 1");
+
+	tester.sim->setNode(0);
+	ASSERT_EQ(GS->rawDataTransfer.StartTransfer(ModuleId::NODE, 4, ModuleId::NODE, RawDataProtocol::UNSPECIFIED, 1, data, sizeof(data)), ErrorType::SUCCESS);
+
+	const RawDataTransfer& sender = tester.sim->nodes[0].gs.rawDataTransfer;
+	const RawDataTransfer& receiver = tester.sim->nodes[3].gs.rawDataTransfer;
+
+	//Connections on the path time out until the first chunk had to be sent again, afterwards the mesh may recover
+	tester.sim->simConfig.connectionTimeoutProbabilityPerSec = 0.005;
+	for (u32 i = 0; i < 120 && sender.retransmittedChunks == 0 && sender.GetNumActiveTransfers() > 0; i++) {
+		tester.SimulateForGivenTime(1000);
+	}
+	tester.sim->simConfig.connectionTimeoutProbabilityPerSec = 0;
+	ASSERT_GT(sender.retransmittedChunks, 0);
+
+	for (u32 i = 0; i < 180 && sender.GetNumActiveTransfers() > 0; i++) {
+		tester.SimulateForGivenTime(1000);
+	}
+
+	ASSERT_EQ(sender.GetNumActiveTransfers(), 0);
+	ASSERT_EQ(sender.failedTransfers, 0);
+	ASSERT_EQ(sender.completedTransfers, 1);
+	ASSERT_EQ(receiver.receivedTransfers, 1);
+	ASSERT_EQ(receiver.receivedChunks, 50);
+	ASSERT_EQ(sender.sentChunks, 50 + sender.retransmittedChunks);
+}
@@ -454,6 +454,118 @@ TEST_F(TestRecordStorage, TestAsyncQueuing) {
 
 }
 
+TEST_F(TestRecordStorage, TestBatchedSaves) {
+	logt("WARNING", "---- CLEANUP ----");
+
+	//Setup
+	CheckedMemset(startPage, 0xff, numPages*FruityHal::GetCodePageSize());
+	RepairPages();
+
+	cherrySimInstance->sim_commit_flash_operations();
+
+	logt("WARNING", "---- TEST BATCHED SAVES ----");
+
+	//The first save is executed immediately, the others are queued while it is still in progress
+	u8 data[] = { 1,2,3,4,5,6,7,8 };
+	for (u8 i = 1; i <= 5; i++) {
+		data[0] = i;
+		GS->recordStorage.SaveRecord(i, data, sizeof(data), this, 1);
+	}
+
+	//One flash operation for the first record and a single coalesced one for all other records
+	u8 successData[] = { 0,0 };
+	cherrySimInstance->sim_commit_some_flash_operations(successData, sizeof(successData));
+
+	if (GS->flashStorage.GetNumberOfActiveTasks() != 0) {
+		FAIL() << "Queued records should have been written with a single flash operation"; //LCOV_EXCL_LINE assertion
+	}
+
+	for (u8 i = 1; i <= 5; i++) {
+		SizedData dataB = GS->recordStorage.GetRecordData(i);
+		if (dataB.length != sizeof(data) || dataB.data[0] != i) {
+			FAIL() << "Batched record " << (u32)i << " not stored"; //LCOV_EXCL_LINE assertion
+		}
+	}
+}
+
+TEST_F(TestRecordStorage, TestBackgroundDefragmentation) {
+	logt("WARNING", "---- CLEANUP ----");
+
+	//Setup
+	CheckedMemset(startPage, 0xff, numPages*FruityHal::GetCodePageSize());
+	RepairPages();
+
+	cherrySimInstance->sim_commit_flash_operations();
+
+	logt("WARNING", "---- TEST BACKGROUND DEFRAGMENTATION ----");
+
+	//Updating the same record leaves lots of outdated versions behind
+	u8 data[40];
+	for (u8 i = 0; i < 40; i++) {
+		CheckedMemset(data, i, sizeof(data));
+		GS->recordStorage.SaveRecord(5, data, sizeof(data), this, 1);
+		cherrySimInstance->sim_commit_flash_operations();
+	}
+
+	RecordStorageFragmentationInfo before = GS->recordStorage.GetFragmentationInfo();
+	if (before.fragmentationPercent < RECORD_STORAGE_BACKGROUND_DEFRAGMENTATION_THRESHOLD_PERCENT) {
+		FAIL() << "Record storage should be fragmented"; //LCOV_EXCL_LINE assertion
+	}
+
+	//Nothing must happen before the node was idle for long enough
+	GS->recordStorage.TimerEventHandler(RECORD_STORAGE_BACKGROUND_DEFRAGMENTATION_IDLE_TIME_DS - 1);
+	if (GS->recordStorage.GetNumDefragmentations(true) != 0) {
+		FAIL() << "Defragmentation started too early"; //LCOV_EXCL_LINE assertion
+	}
+
+	GS->recordStorage.TimerEventHandler(1);
+	cherrySimInstance->sim_commit_flash_operations();
+
+	RecordStorageFragmentationInfo after = GS->recordStorage.GetFragmentationInfo();
+	if (GS->recordStorage.GetNumDefragmentations(true) != 1 || after.reclaimableSpace != 0 || after.usedSpace != before.usedSpace) {
+		FAIL() << "Background defragmentation should have reclaimed all outdated records"; //LCOV_EXCL_LINE assertion
+	}
+
+	SizedData dataB = GS->recordStorage.GetRecordData(5);
+	if (dataB.length != sizeof(data) || memcmp(dataB.data, data, sizeof(data)) != 0) {
+		FAIL() << "Record corrupted by background defragmentation"; //LCOV_EXCL_LINE assertion
+	}
+}
+
+TEST_F(TestRecordStorage, TestWritesOfDifferentTransactionsAreNotCoalesced) {
+	logt("WARNING", "---- CLEANUP ----");
+
+	//Setup
+	CheckedMemset(startPage, 0xff, numPages*FruityHal::GetCodePageSize());
+	cherrySimInstance->sim_commit_flash_operations();
+
+	logt("WARNING", "---- TEST TRANSACTION BOUNDARIES ----");
+
+	u32 data[] = { 0x11111111, 0x22222222, 0x33333333 };
+	u32* destination = (u32*)startPage;
+
+	//The first write is started immediately so that both transactions are queued behind it
+	GS->flashStorage.CacheAndWriteData(&data[0], destination, sizeof(u32), nullptr, 0);
+
+	ASSERT_EQ(GS->flashStorage.StartTransaction(), FlashStorageError::SUCCESS);
+	GS->flashStorage.CacheAndWriteData(&data[1], destination + 1, sizeof(u32), nullptr, 0);
+	GS->flashStorage.EndTransaction();
+
+	ASSERT_EQ(GS->flashStorage.StartTransaction(), FlashStorageError::SUCCESS);
+	GS->flashStorage.CacheAndWriteData(&data[2], destination + 2, sizeof(u32), nullptr, 0);
+	GS->flashStorage.EndTransaction();
+
+	//The write of the second transaction continues the first one but must not be merged into it
+	u8 successData[] = { 0,0 };
+	cherrySimInstance->sim_commit_some_flash_operations(successData, sizeof(successData));
+	ASSERT_EQ(GS->flashStorage.GetNumberOfActiveTasks(), 1);
+	ASSERT_EQ(destination[1], data[1]);
+
+	cherrySimInstance->sim_commit_some_flash_operations(successData, 1);
+	ASSERT_EQ(GS->flashStorage.GetNumberOfActiveTasks(), 0);
+	ASSERT_EQ(destination[2], data[2]);
+}
+
 //Must be below 256 because of test limit when storing length in byte
 #define MULTI_RECORD_TEST_NUM_RECORD_IDS 20
 //Must be below 256 because of test limit when storing length in byte
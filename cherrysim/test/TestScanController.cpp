@@ -96,7 +96,7 @@ TEST(TestScanController, TestIfScannerGetsEnabled) {
 
 	tester.SimulateUntilClusteringDone(100 * 1000);
 
-	ScanJob job;
+	ScanJob job = ScanJob();
 	job.timeMode = ScanJobTimeMode::ENDLESS;
 	job.interval = MSEC_TO_UNITS(100, UNIT_0_625_MS);
 	job.window = MSEC_TO_UNITS(50, UNIT_0_625_MS);
@@ -121,7 +121,7 @@ TEST(TestScanController, TestScannerStopsAfterTimeoutTime) {
 	tester.SimulateUntilClusteringDone(100 * 1000);
 	ForceStopAllScanJobs(tester);
 
-	ScanJob job;
+	ScanJob job = ScanJob();
 	job.timeMode = ScanJobTimeMode::TIMED;
 	job.timeLeftDs = SEC_TO_DS(10);
 	job.interval = MSEC_TO_UNITS(50, UNIT_0_625_MS);
@@ -149,7 +149,7 @@ TEST(TestScanController, TestScannerChooseJobWithHighestDutyCycle) {
 	tester.SimulateUntilClusteringDone(100 * 1000);
 	ForceStopAllScanJobs(tester);
 
-	ScanJob job;
+	ScanJob job = ScanJob();
 	job.timeMode = ScanJobTimeMode::ENDLESS;
 	job.interval = MSEC_TO_UNITS(100, UNIT_0_625_MS);
 	job.window = MSEC_TO_UNITS(50, UNIT_0_625_MS);
@@ -195,7 +195,7 @@ TEST(TestScanController, TestScannerWillStopOnceAllJobsTimeout) {
 	tester.SimulateUntilClusteringDone(100 * 1000);
 	ForceStopAllScanJobs(tester);
 
-	ScanJob job;
+	ScanJob job = ScanJob();
 	job.timeMode = ScanJobTimeMode::TIMED;
 	job.timeLeftDs = SEC_TO_DS(10);
 	job.interval = MSEC_TO_UNITS(100, UNIT_0_625_MS);
@@ -228,7 +228,7 @@ TEST(TestScanController, TestScannerWillStopOnceAllJobsAreDeleted) {
 	tester.SimulateUntilClusteringDone(100 * 1000);
 	ForceStopAllScanJobs(tester);
 
-	ScanJob job;
+	ScanJob job = ScanJob();
 	job.timeMode = ScanJobTimeMode::ENDLESS;
 	job.interval = MSEC_TO_UNITS(100, UNIT_0_625_MS);
 	job.window = MSEC_TO_UNITS(50, UNIT_0_625_MS);
@@ -248,4 +248,63 @@ TEST(TestScanController, TestScannerWillStopOnceAllJobsAreDeleted) {
 	RemoveJob(p_job_2, tester);
 
 	simulateAndCheckScanning(1000, false, tester);
-}
\ No newline at end of file
+}
+
+//Tests that a job with a detection goal only raises the scan duty cycle during its bursts
+//and that the radio-on time is attributed to the owners of the jobs that needed it
+TEST(TestScanController, TestScanJobBursts) {
+	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
+	SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
+	simConfig.numNodes = 2;
+	simConfig.terminalId = 1;
+	//testerConfig.verbose = true;
+
+	CherrySimTester tester = CherrySimTester(testerConfig, simConfig);
+	strcpy(tester.sim->nodes[0].nodeConfiguration, "prod_sink_nrf52");
+	tester.Start();
+
+	tester.SimulateUntilClusteringDone(100 * 1000);
+	ForceStopAllScanJobs(tester);
+
+	ScanJob job = ScanJob();
+	job.timeMode = ScanJobTimeMode::ENDLESS;
+	job.interval = MSEC_TO_UNITS(100, UNIT_0_625_MS);
+	job.window = MSEC_TO_UNITS(5, UNIT_0_625_MS);
+	job.state = ScanJobState::ACTIVE;
+	job.type = ScanState::CUSTOM;
+	job.owner = ModuleId::NODE;
+	AddJob(job, tester);
+
+	//Find an advertiser with an advertising interval of 100ms within 5 seconds
+	ScanJob burstJob = ScanJob();
+	burstJob.timeMode = ScanJobTimeMode::ENDLESS;
+	burstJob.state = ScanJobState::ACTIVE;
+	burstJob.owner = ModuleId::SCANNING_MODULE;
+	ScanController::SetDetectionGoal(burstJob, 100, SEC_TO_DS(5), 100);
+	ASSERT_EQ(burstJob.burstDurationDs, 2);
+	ASSERT_EQ(burstJob.burstPeriodDs, SEC_TO_DS(5) - 2);
+	AddJob(burstJob, tester);
+
+	//The first burst starts right away
+	ASSERT_EQ(tester.sim->nodes[0].state.scanWindowMs, 100);
+
+	const NodeEnergyStats& energy = tester.sim->nodes[0].energy;
+	const double nodeRadioOnBeforeMs = energy.scanRadioOnMsByOwner.count(ModuleId::NODE) ? energy.scanRadioOnMsByOwner.at(ModuleId::NODE) : 0;
+
+	u32 burstTimeMs = 0;
+	for (u32 timeMs = 0; timeMs < 10 * 1000; timeMs += 100) {
+		tester.SimulateForGivenTime(100);
+		if (tester.sim->nodes[0].state.scanWindowMs == 100) burstTimeMs += 100;
+	}
+
+	//Two periods with a burst of 200ms each, the radio is not kept busy in between
+	ASSERT_GE(burstTimeMs, 200u);
+	ASSERT_LE(burstTimeMs, 800u);
+
+	//The scanning module pays for its bursts, the node for its 5% duty cycle
+	const double scanningModuleRadioOnMs = energy.scanRadioOnMsByOwner.at(ModuleId::SCANNING_MODULE);
+	const double nodeRadioOnMs = energy.scanRadioOnMsByOwner.at(ModuleId::NODE) - nodeRadioOnBeforeMs;
+	ASSERT_GT(scanningModuleRadioOnMs, 0);
+	ASSERT_LT(scanningModuleRadioOnMs, 1000);
+	ASSERT_NEAR(nodeRadioOnMs, 500, 100);
+}
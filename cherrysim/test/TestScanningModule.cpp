@@ -36,6 +36,10 @@
 #include "AssetModule.h"
 #endif //GITHUB_RELEASE
 #include "ScanningModule.h"
+#include <set>
+#include <json.hpp>
+
+using json = nlohmann::json;
 
 TEST(TestScanningModule, TestCommands) {
 	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
@@ -73,4 +77,256 @@ TEST(TestScanningModule, TestCommands) {
 	tester.SimulateGivenNumberOfSteps(1);
 
 	//jstodo This test currently doesn't do much. Investigate if it is still needed.
-}
\ No newline at end of file
+}
+
+static void DispatchAssetAdvertisement(CherrySimTester& tester, u32 nodeIndex, u32 serialNumberIndex, i8 rssi)
+{
+	alignas(ble_evt_t) u8 buffer[1024];
+	CheckedMemset(buffer, 0, sizeof(buffer));
+	ble_evt_t& evt = *(ble_evt_t*)buffer;
+	advPacketServiceAndDataHeader* packet = (advPacketServiceAndDataHeader*)evt.evt.gap_evt.params.adv_report.data;
+	advPacketAssetServiceData* assetPacket = (advPacketAssetServiceData*)&packet->data;
+	evt.header.evt_id = BLE_GAP_EVT_ADV_REPORT;
+	evt.evt.gap_evt.params.adv_report.dlen = SIZEOF_ADV_STRUCTURE_ASSET_SERVICE_DATA;
+	evt.evt.gap_evt.params.adv_report.rssi = rssi;
+	packet->flags.len = SIZEOF_ADV_STRUCTURE_FLAGS - 1;
+	packet->uuid.len = SIZEOF_ADV_STRUCTURE_UUID16 - 1;
+	packet->data.uuid.type = BLE_GAP_AD_TYPE_SERVICE_DATA;
+	packet->data.uuid.uuid = SERVICE_DATA_SERVICE_UUID16;
+	packet->data.messageType = ServiceDataMessageType::STANDARD_ASSET;
+	assetPacket->serialNumberIndex = serialNumberIndex;
+
+	tester.sim->setNode(nodeIndex);
+	FruityHal::DispatchBleEvents(&evt);
+}
+
+TEST(TestScanningModule, TestDeltaAssetReporting) {
+	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
+	SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
+	simConfig.numNodes = 2;
+	simConfig.terminalId = 0;
+	//testerConfig.verbose = true;
+
+	CherrySimTester tester = CherrySimTester(testerConfig, simConfig);
+	tester.Start();
+
+	tester.SimulateUntilClusteringDone(100 * 1000);
+
+	ScanningModule* scanningModule = static_cast<ScanningModule*>(tester.sim->nodes[1].gs.node.GetModuleById(ModuleId::SCANNING_MODULE));
+	scanningModule->assetReportingIntervalDs = SEC_TO_DS(1);
+	scanningModule->configuration.assetReportingMode = AssetReportingMode::DELTA;
+	scanningModule->configuration.assetLostTimeoutDs = SEC_TO_DS(5);
+	scanningModule->configuration.assetFullReportIntervalDs = 0;
+
+	//Both assets are scanned once per reporting interval so that they are not lost
+	auto dispatchAndAssertNotReported = [&](i8 rssi200, i8 rssi201) {
+		for (u32 i = 0; i < 5; i++) {
+			DispatchAssetAdvertisement(tester, 1, 200, rssi200);
+			DispatchAssetAdvertisement(tester, 1, 201, rssi201);
+			ASSERT_THROW(tester.SimulateUntilRegexMessageReceived(1000, 1, "\\{\"id\":20[01],"), TimeoutException);
+		}
+	};
+
+	//New assets are reported
+	DispatchAssetAdvertisement(tester, 1, 200, -45);
+	DispatchAssetAdvertisement(tester, 1, 201, -45);
+	tester.SimulateUntilRegexMessageReceived(3 * 1000, 1, "\\{\"nodeId\":2,\"type\":\"tracked_assets\",\"assets\":\\[\\{\"id\":20[01],\"rssi1\":45,.*\"lost\":0\\},\\{\"id\":20[01],\"rssi1\":45,.*\"lost\":0\\}");
+
+	//Unchanged assets are not reported again
+	dispatchAndAssertNotReported(-45, -45);
+
+	//A change of the rssi below the threshold is suppressed
+	dispatchAndAssertNotReported(-45 - (i8)scanningModule->configuration.assetRssiDeltaThreshold + 1, -45);
+
+	//A moved asset is reported again
+	DispatchAssetAdvertisement(tester, 1, 200, -45 - (i8)scanningModule->configuration.assetRssiDeltaThreshold);
+	DispatchAssetAdvertisement(tester, 1, 201, -45);
+	tester.SimulateUntilRegexMessageReceived(3 * 1000, 1, "\\[\\{\"id\":200,\"rssi1\":%u,.*\"lost\":0\\}\\]", 45 + scanningModule->configuration.assetRssiDeltaThreshold);
+
+	//The full report sends all assets again, although none of them changed
+	scanningModule->configuration.assetFullReportIntervalDs = SEC_TO_DS(10);
+	DispatchAssetAdvertisement(tester, 1, 200, -45 - (i8)scanningModule->configuration.assetRssiDeltaThreshold);
+	DispatchAssetAdvertisement(tester, 1, 201, -45);
+	tester.SimulateUntilRegexMessageReceived(3 * 1000, 1, "\\{\"id\":20[01],.*\"lost\":0\\},\\{\"id\":20[01],.*\"lost\":0\\}");
+	scanningModule->configuration.assetFullReportIntervalDs = 0;
+
+	//Assets that are not scanned anymore are reported as lost
+	tester.SimulateUntilRegexMessageReceived(10 * 1000, 1, "\\{\"id\":200,\"rssi1\":-1,.*\"lost\":1\\}");
+
+	//More assets than fit into the buffer, the first ones are evicted after they were reported
+	for (u32 i = 1; i <= ASSET_PACKET_BUFFER_SIZE; i++) {
+		DispatchAssetAdvertisement(tester, 1, 300 + i, -45);
+	}
+	tester.SimulateUntilRegexMessageReceived(3 * 1000, 1, "\\{\"id\":%u,\"rssi1\":45,.*\"lost\":0\\}", 300 + ASSET_PACKET_BUFFER_SIZE);
+	for (u32 i = 1; i <= 3; i++) {
+		DispatchAssetAdvertisement(tester, 1, 400 + i, -45);
+	}
+
+	//An evicted asset that is scanned again is not reported as new
+	DispatchAssetAdvertisement(tester, 1, 301, -45);
+	ASSERT_THROW(tester.SimulateUntilRegexMessageReceived(1000, 1, "\\{\"id\":301,"), TimeoutException);
+
+	//The evicted assets that were not scanned again are still reported as lost
+	tester.SimulateUntilRegexMessageReceived(10 * 1000, 1, "\\{\"id\":302,\"rssi1\":-1,.*\"lost\":1\\}");
+}
+
+//Four nodes behind a relay scan the same asset and report it every second. The sink holds the aggregated
+//reports back for a while and must then print a single record that lists every observer exactly once
+TEST(TestScanningModule, TestAssetAggregation) {
+	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
+	SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
+	simConfig.numNodes = 6;
+	simConfig.terminalId = 0;
+	simConfig.preDefinedPositions = { {0.1, 0.5}, {0.3, 0.5}, {0.5, 0.45}, {0.5, 0.55}, {0.55, 0.5}, {0.5, 0.5} };
+	//testerConfig.verbose = true;
+
+	CherrySimTester tester = CherrySimTester(testerConfig, simConfig);
+	tester.Start();
+
+	tester.SimulateUntilClusteringDone(100 * 1000);
+
+	for (u32 i = 0; i < simConfig.numNodes; i++) {
+		tester.sim->nodes[i].gs.config.enableSinkRouting = true;
+		ScanningModule* scanningModule = static_cast<ScanningModule*>(tester.sim->nodes[i].gs.node.GetModuleById(ModuleId::SCANNING_MODULE));
+		scanningModule->assetReportingIntervalDs = SEC_TO_DS(1);
+		scanningModule->configuration.assetAggregationEnabled = true;
+		//Only the sink holds the reports back, so that it receives several reports of each observer
+		scanningModule->configuration.assetAggregationDelayDs = i == 0 ? SEC_TO_DS(10) : 0;
+	}
+
+	auto dispatchRounds = [&](u32 rounds) {
+		for (u32 round = 0; round < rounds; round++) {
+			for (u32 i = 2; i < simConfig.numNodes; i++) {
+				DispatchAssetAdvertisement(tester, i, 1337, -50 - (i8)i);
+			}
+			tester.SimulateForGivenTime(1000);
+		}
+	};
+
+	//Wait for a first record so that the sink starts the next aggregation with an empty buffer
+	dispatchRounds(3);
+	tester.SimulateUntilRegexMessageReceived(20 * 1000, 1, "\\{\"nodeId\":1,\"type\":\"tracked_asset\",\"module\":2,\"id\":1337,");
+
+	//Every observer reports the asset three times while the sink aggregates
+	dispatchRounds(3);
+	std::vector<SimulationMessage> messages = {
+		SimulationMessage(1, "\\{\"nodeId\":1,\"type\":\"tracked_asset\",\"module\":2,\"id\":1337,"),
+	};
+	tester.SimulateUntilRegexMessagesReceived(20 * 1000, messages);
+
+	const json record = json::parse(messages[0].getCompleteMessage());
+	const json& observers = record["observers"];
+	ASSERT_EQ(observers.size(), 4u);
+	std::set<u32> observerIds;
+	for (const json& observer : observers) {
+		const u32 observerId = observer["nodeId"].get<u32>();
+		observerIds.insert(observerId);
+		//The rssi of node index i was -50 - i
+		ASSERT_EQ(observer["rssi"].get<u32>(), 50 + observerId - 1);
+	}
+	ASSERT_EQ(observerIds, std::set<u32>({ 3, 4, 5, 6 }));
+}
+
+struct AssetReportingLoad
+{
+	u32 sinkLinkBytes = 0; //Bytes sent to the sink by its mesh partners
+	u32 sinkTerminalBytes = 0; //Bytes printed by the sink, e.g. on its uart
+};
+
+static AssetReportingLoad GetAssetReportingLoad(CherrySimTester& tester)
+{
+	AssetReportingLoad load;
+	for (u32 i = 0; i < tester.sim->getNumNodes(); i++) {
+		for (u32 j = 0; j < PACKET_LINK_STAT_SIZE; j++) {
+			if (tester.sim->nodes[i].linkStats[j].partnerId == 1) load.sinkLinkBytes += tester.sim->nodes[i].linkStats[j].bytes;
+		}
+	}
+	load.sinkTerminalBytes = tester.sim->findNodeById(1)->terminalOutputBytes;
+	return load;
+}
+
+//Lets four nodes behind a relay report the same asset and measures the load near the sink. With aggregation,
+//every node including the relay holds the reports back for a while so that they can be merged
+static AssetReportingLoad SimulateAssetReporting(bool aggregationEnabled)
+{
+	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
+	SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
+	simConfig.numNodes = 6;
+	simConfig.terminalId = 0;
+	simConfig.enableSimStatistics = true;
+	simConfig.preDefinedPositions = { {0.1, 0.5}, {0.3, 0.5}, {0.5, 0.45}, {0.5, 0.55}, {0.55, 0.5}, {0.5, 0.5} };
+	//testerConfig.verbose = true;
+
+	CherrySimTester tester = CherrySimTester(testerConfig, simConfig);
+	tester.Start();
+
+	tester.SimulateUntilClusteringDone(100 * 1000);
+
+	for (u32 i = 0; i < simConfig.numNodes; i++) {
+		tester.sim->nodes[i].gs.config.enableSinkRouting = true;
+		ScanningModule* scanningModule = static_cast<ScanningModule*>(tester.sim->nodes[i].gs.node.GetModuleById(ModuleId::SCANNING_MODULE));
+		scanningModule->assetReportingIntervalDs = SEC_TO_DS(2);
+		scanningModule->configuration.assetAggregationEnabled = aggregationEnabled;
+		scanningModule->configuration.assetAggregationDelayDs = SEC_TO_DS(3);
+	}
+
+	const AssetReportingLoad loadBefore = GetAssetReportingLoad(tester);
+
+	for (u32 round = 0; round < 30; round++) {
+		for (u32 i = 2; i < simConfig.numNodes; i++) {
+			DispatchAssetAdvertisement(tester, i, 1337, -50 - (i8)i);
+		}
+		tester.SimulateForGivenTime(1000);
+	}
+
+	AssetReportingLoad load = GetAssetReportingLoad(tester);
+	load.sinkLinkBytes -= loadBefore.sinkLinkBytes;
+	load.sinkTerminalBytes -= loadBefore.sinkTerminalBytes;
+	return load;
+}
+
+TEST(TestScanningModule, TestAssetAggregationReducesSinkLoad) {
+	const AssetReportingLoad withoutAggregation = SimulateAssetReporting(false);
+	const AssetReportingLoad withAggregation = SimulateAssetReporting(true);
+
+	ASSERT_GT(withAggregation.sinkLinkBytes, 0u);
+	ASSERT_GT(withAggregation.sinkTerminalBytes, 0u);
+	ASSERT_LT(withAggregation.sinkLinkBytes, withoutAggregation.sinkLinkBytes);
+	ASSERT_LT(withAggregation.sinkTerminalBytes, withoutAggregation.sinkTerminalBytes);
+}
+
+//Measures the scan radio-on time that is attributed to the scanning module for the given reporting interval
+static double SimulateAssetScanRadioOnMs(u16 assetReportingIntervalDs)
+{
+	CherrySimTesterConfig testerConfig = CherrySimTester::CreateDefaultTesterConfiguration();
+	SimConfiguration simConfig = CherrySimTester::CreateDefaultSimConfiguration();
+	simConfig.numNodes = 2;
+	simConfig.terminalId = 0;
+	//testerConfig.verbose = true;
+
+	CherrySimTester tester = CherrySimTester(testerConfig, simConfig);
+	tester.Start();
+
+	tester.SimulateUntilClusteringDone(100 * 1000);
+
+	tester.sim->setNode(1);
+	ScanningModule* scanningModule = static_cast<ScanningModule*>(tester.sim->nodes[1].gs.node.GetModuleById(ModuleId::SCANNING_MODULE));
+	scanningModule->assetReportingIntervalDs = assetReportingIntervalDs;
+	scanningModule->ConfigurationLoadedHandler(nullptr, 0);
+
+	const NodeEnergyStats& energy = tester.sim->nodes[1].energy;
+	const double radioOnBeforeMs = energy.scanRadioOnMsByOwner.count(ModuleId::SCANNING_MODULE) ? energy.scanRadioOnMsByOwner.at(ModuleId::SCANNING_MODULE) : 0;
+	tester.SimulateForGivenTime(120 * 1000);
+	return energy.scanRadioOnMsByOwner.at(ModuleId::SCANNING_MODULE) - radioOnBeforeMs;
+}
+
+//With a long reporting interval, assets only need to be found once per interval, so the scanning module scans
+//in short bursts instead of keeping the high discovery scan running all the time
+TEST(TestScanningModule, TestAssetScanUsesDetectionGoal) {
+	//A reporting interval of one second is too short for bursts and keeps the high discovery scan
+	const double continuousRadioOnMs = SimulateAssetScanRadioOnMs(SEC_TO_DS(1));
+	const double burstRadioOnMs = SimulateAssetScanRadioOnMs(SEC_TO_DS(30));
+
+	ASSERT_GT(burstRadioOnMs, 0);
+	ASSERT_LT(burstRadioOnMs, continuousRadioOnMs / 2);
+}
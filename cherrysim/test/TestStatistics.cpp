@@ -58,6 +58,22 @@ TEST(TestStatistics, TestNumberClusteringMessagesSent) {
 		}
 	}
 
+	//Every packet is also counted for the link it was sent on, split parts are only counted once in the packet stats
+	u32 routedCount = 0;
+	u32 linkCount = 0;
+	for (u32 i = 0; i < PACKET_STAT_SIZE; i++) routedCount += stat[i].count;
+	for (u32 i = 0; i < simConfig.numNodes; i++) {
+		for (u32 j = 0; j < PACKET_LINK_STAT_SIZE; j++) {
+			PacketLinkStat* entry = tester.sim->nodes[i].linkStats + j;
+			if (entry->partnerId == 0) continue;
+			ASSERT_NE(tester.sim->findNodeById(entry->partnerId), nullptr);
+			ASSERT_GT(entry->bytes, entry->count);
+			linkCount += entry->count;
+		}
+	}
+	ASSERT_GT(routedCount, 0u);
+	ASSERT_GE(linkCount, routedCount);
+
 	//We check for all known message types with some min and max values
 	checkAndClearStat(stat, MessageType::CLUSTER_WELCOME, 10, 50);
 	checkAndClearStat(stat, MessageType::CLUSTER_ACK_1, 10, 50);
@@ -93,6 +109,7 @@ void clearStat(PacketStat* stat)
 	for (u32 i = 0; i < PACKET_STAT_SIZE; i++) {
 		PacketStat* entry = stat + i;
 		entry->messageType = MessageType::INVALID;
+		entry->count = 0;
 	}
 }
 
@@ -29376,7 +29376,56 @@ define("test/tests/mesh/testSimulatorMap", ["require", "exports", "src/app/relut
         fruityMap.toggleLayerVisibility("connections", false);
         // Updating
         let intervalDurationMs = 1000;
-        startUpdatingDeviceModels(fruityMap, serverUrl, intervalDurationMs);
+        if (window.EventSource) {
+            startStreamingDeviceModels(fruityMap, serverUrl, () => {
+                startUpdatingDeviceModels(fruityMap, serverUrl, intervalDurationMs);
+            });
+        }
+        else {
+            startUpdatingDeviceModels(fruityMap, serverUrl, intervalDurationMs);
+        }
+    }
+    // Receives a full snapshot of all devices once and then only the devices that changed.
+    // Falls back to polling if the stream could not be opened at all.
+    function startStreamingDeviceModels(fruityMap, serverUrl, fallback) {
+        let devicesByUuid = new Map();
+        let receivedSnapshot = false;
+        let eventSource = new EventSource(serverUrl + "/stream");
+        let applyDevices = () => {
+            let devicesObject = Array.from(devicesByUuid.values());
+            let deviceModels = RelutionMapModelLoader_5.RelutionMapModelLoader.loadModels(devicesObject, DeviceModel_9.DeviceModel, false);
+            fruityMap.getBuilding().getCurrentFloor().updateDevices(deviceModels);
+        };
+        eventSource.addEventListener("snapshot", (event) => {
+            let snapshotObject = JSON.parse(event.data);
+            receivedSnapshot = true;
+            devicesByUuid.clear();
+            for (let device of snapshotObject.result) {
+                devicesByUuid.set(device.uuid, device);
+            }
+            applyDevices();
+        });
+        eventSource.addEventListener("delta", (event) => {
+            if (!receivedSnapshot) {
+                return;
+            }
+            let deltaObject = JSON.parse(event.data);
+            for (let device of deltaObject.changed) {
+                devicesByUuid.set(device.uuid, device);
+            }
+            for (let uuid of deltaObject.removed) {
+                devicesByUuid.delete(uuid);
+            }
+            applyDevices();
+        });
+        eventSource.onerror = () => {
+            // The EventSource reconnects by itself and will receive a new snapshot
+            if (!receivedSnapshot) {
+                eventSource.close();
+                Logger_13.Logger.logDebug("Streaming device models not possible, polling instead.");
+                fallback();
+            }
+        };
     }
     function startUpdatingDeviceModels(fruityMap, serverUrl, intervalDurationMs) {
         let lastDevicesObject = "";
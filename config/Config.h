@@ -417,6 +417,14 @@ class Conf
 		static constexpr u16 maxTimeUntilDecisionDs = SEC_TO_DS(2);
 		//Switch to low discovery if no other nodes were found for # seconds, set to 0 to disable low discovery state
 		u16 highToLowDiscoveryTimeSec = 0; // if is not configured in featureset, low discovery will be disabled and will always be in high discovery mode
+		//In low discovery, the advertising and scan intervals are doubled after the topology did not change for this time
+		//Each further step takes twice as long as the previous one, set to 0 to disable the backoff
+		u16 discoveryBackoffStepTimeSec = 0;
+		//Maximum number of times that the low discovery intervals are doubled, limited to 15
+		u8 maxDiscoveryBackoffLevel = 5;
+		//Scores joinMe packets only by their free connections and the RSSI as in older versions,
+		//which allows to compare the convergence time of both scorings
+		bool useLegacyClusterScore = false;
 
 		LedMode defaultLedMode = LedMode::OFF;
 
@@ -424,6 +432,13 @@ class Conf
 		TerminalMode terminalMode : 8;
 
 		bool enableSinkRouting = false;
+		//If several sinks are reachable, nodes report the load on their path to a sink to their neighbours in this
+		//interval and weigh it against the hop count when choosing a sink, set to 0 to always use the fewest hops
+		u16 sinkLoadReportIntervalDs = 0;
+
+		//Answers raw data transmissions to this node with raw_data_start_received and raw_data_report messages,
+		//otherwise this is left to the gateway that receives the logged chunks
+		bool enableRawDataReceiver = false;
 		// ########### TIMINGS ################################################
 
 		//Mesh connection parameters (used when a connection is set up)
@@ -94,6 +94,8 @@ enum class MessageType : u8
 
 	TIME_SYNC = 60,
 	DEAD_DATA = 61, //Used by the MeshAccessConnection when malformed data was received.
+	RELIABLE_DATA = 62, //Wraps a mesh packet that is delivered end-to-end by the ReliableMessaging
+	RELIABLE_ACK = 63, //Acknowledges RELIABLE_DATA packets
 
 	//Other packets: User space (IDs 80 - 110)
 	DATA_1 = 80,
@@ -224,12 +226,15 @@ STATIC_ASSERT_SIZE(connPacketClusterInfoUpdate, 14);
 
 
 //CLUSTER_RECONNECT
-#define SIZEOF_CONN_PACKET_PAYLOAD_RECONNECT 0
+//The write counters count all writes of the connection that were not sent directly, split packets count once per part
+//Older firmware sends this packet without a payload, in this case all packets are sent again
+#define SIZEOF_CONN_PACKET_PAYLOAD_RECONNECT 4
 typedef struct
 {
-
+	u16 receivedWrites; //Writes that the sender received from its partner, the partner continues sending after these
+	u16 resumeWrite; //Writes after which the sender continues sending, the partner drops writes that it received already
 }connPacketPayloadReconnect;
-STATIC_ASSERT_SIZE(connPacketPayloadReconnect, 1);
+STATIC_ASSERT_SIZE(connPacketPayloadReconnect, 4);
 
 #define SIZEOF_CONN_PACKET_RECONNECT (SIZEOF_CONN_PACKET_HEADER + SIZEOF_CONN_PACKET_PAYLOAD_RECONNECT)
 typedef struct
@@ -237,7 +242,7 @@ typedef struct
 	connPacketHeader header;
 	connPacketPayloadReconnect payload;
 }connPacketReconnect;
-STATIC_ASSERT_SIZE(connPacketReconnect, 6);
+STATIC_ASSERT_SIZE(connPacketReconnect, 9);
 
 
 //Packets for CUSTOM ENC Handshake
@@ -470,6 +475,30 @@ struct TimeSyncCorrectionReply
 	TimeSyncHeader header;
 };
 STATIC_ASSERT_SIZE(TimeSyncCorrectionReply, 6);
+
+//RELIABLE_DATA
+//The wrapped packet follows directly after this header and keeps its own connPacketHeader
+#define SIZEOF_RELIABLE_DATA_MESSAGE_HEADER 11
+struct ReliableDataMessage
+{
+	connPacketHeader header;
+	u16 sessionId;   //Chosen randomly by the sender for each destination, the receiver resets its state if it changes
+	u16 sequenceNumber;
+	u16 windowStart; //All sequence numbers before this one were either acknowledged or given up by the sender
+	u8 payload[1];
+};
+STATIC_ASSERT_SIZE(ReliableDataMessage, SIZEOF_RELIABLE_DATA_MESSAGE_HEADER + 1);
+
+//RELIABLE_ACK
+struct ReliableAckMessage
+{
+	connPacketHeader header;
+	NodeId destination;    //The receiver of the acknowledged data packets, e.g. NODE_ID_SHORTEST_SINK
+	u16 sessionId;
+	u16 cumulativeAck;     //All sequence numbers before this one were received
+	u32 selectiveAcks;     //Bit n is set if cumulativeAck + n was received
+};
+STATIC_ASSERT_SIZE(ReliableAckMessage, 15);
 #endif
 
 //End Packing
@@ -118,6 +118,8 @@ void Conf::LoadDefaults(){
 	defaultLedMode = LedMode::CONNECTIONS;
 
 	enableSinkRouting = false;
+	sinkLoadReportIntervalDs = 0;
+	enableRawDataReceiver = false;
 	//Check if the BLE stack supports the number of connections and correct if not
 #ifdef SIM_ENABLED
 	BleStackType stackType = FruityHal::GetBleStackType();
@@ -151,6 +153,8 @@ void Conf::LoadDefaults(){
 	CheckedMemset(&staticAccessAddress.addr, 0xFF, 6);
 	staticAccessAddress.addr_type = FruityHal::BleGapAddrType::INVALID;
 	highToLowDiscoveryTimeSec = 0;
+	discoveryBackoffStepTimeSec = 0;
+	maxDiscoveryBackoffLevel = 5;
 }
 
 void Conf::LoadDeviceConfiguration(){
@@ -42,6 +42,8 @@
 #include "Config.h"
 #include "Boardconfig.h"
 #include "ConnectionManager.h"
+#include "ReliableMessaging.h"
+#include "RawDataTransfer.h"
 #include "Logger.h"
 #include "Terminal.h"
 #include "FlashStorage.h"
@@ -117,6 +119,8 @@ class GlobalState
 		Conf config;
 		Boardconf boardconf;
 		ConnectionManager cm;
+		ReliableMessaging reliableMessaging;
+		RawDataTransfer rawDataTransfer;
 		Logger logger;
 		Terminal terminal;
 		FlashStorage flashStorage;
@@ -52,8 +52,14 @@ void ScanController::TimerEventHandler(u16 passedTimeDs)
 {
 	for (u8 i = 0; i < jobs.length; i++)
 	{
-		if ((jobs[i].state == ScanJobState::ACTIVE) &&
-			(jobs[i].timeMode == ScanJobTimeMode::TIMED))
+		if (jobs[i].state != ScanJobState::ACTIVE) continue;
+
+		if (jobs[i].burstPeriodDs != 0)
+		{
+			jobs[i].burstPhaseDs = (jobs[i].burstPhaseDs + passedTimeDs) % jobs[i].burstPeriodDs;
+		}
+
+		if (jobs[i].timeMode == ScanJobTimeMode::TIMED)
 		{
 			jobs[i].timeLeftDs -= passedTimeDs;
 			if (jobs[i].timeLeftDs <= 0)
@@ -63,6 +69,9 @@ void ScanController::TimerEventHandler(u16 passedTimeDs)
 			}
 		}
 	}
+	//Bursts might have started or ended, scanning is only restarted if this changes the plan
+	RefreshJobs();
+
 	//To be absolutely sure that scanning is in the correct state, we call this function
 	//within the timerHandler
 	TryConfiguringScanState();
@@ -100,6 +109,20 @@ ScanJob* ScanController::AddJob(ScanJob& job)
 		return nullptr;
 	}
 
+	//Bursts of jobs with the same period are aligned so that they share their radio-on time
+	job.burstPhaseDs = 0;
+	if (job.burstPeriodDs != 0)
+	{
+		for (u8 i = 0; i < jobs.length; i++)
+		{
+			if (jobs[i].state == ScanJobState::ACTIVE && jobs[i].burstPeriodDs == job.burstPeriodDs)
+			{
+				job.burstPhaseDs = jobs[i].burstPhaseDs;
+				break;
+			}
+		}
+	}
+
 	for (u8 i = 0; i < jobs.length; i++)
 	{
 		if (jobs[i].state != ScanJobState::INVALID) continue;
@@ -112,36 +135,34 @@ ScanJob* ScanController::AddJob(ScanJob& job)
 	return nullptr;
 }
 
-// Checks duty cycle of given job and compares to current. If new one has higher duty cycle
-// scannit will be restarted with new params.
+// Merges all jobs that currently need scanning into one plan. Each job only states which share of the time
+// it needs the radio for, so the job with the highest duty cycle satisfies all others. Jobs with a burst period
+// only take part during their bursts, they do not keep the radio busy for the other jobs in between.
+// Scanning is only restarted if the resulting parameters differ from the ones that are in use.
 void ScanController::RefreshJobs()
 {
-	u8 currentDutyCycle = currentScanParams.interval != 0 ? (currentScanParams.window * 100) / currentScanParams.interval : 0;
-	u8 newDutyCycle = 0;
-	ScanJob * p_job = nullptr;
+	const ScanJob * p_job = nullptr;
 	for (u8 i = 0; i < jobs.length; i++)
 	{
-		if (jobs[i].state == ScanJobState::ACTIVE)
+		if (!IsJobScanning(jobs[i])) continue;
+		if (p_job == nullptr || HasHigherDutyCycle(jobs[i], *p_job))
 		{
-			u8 tempDutyCycle = (jobs[i].window * 100) / jobs[i].interval;
-			if (tempDutyCycle > newDutyCycle)
-			{
-				newDutyCycle = tempDutyCycle;
-				p_job = &jobs[i];
-			}
+			p_job = &jobs[i];
 		}
 	}
-	
+
 	// no active jobs
-	if ((newDutyCycle != currentDutyCycle) && (newDutyCycle == 0))
+	if (p_job == nullptr)
 	{
+		if (currentScanParams.window == 0 && currentScanParams.interval == 0) return;
 		scanStateOk = false;
 		CheckedMemset(&currentScanParams, 0, sizeof(currentScanParams));
 		TryConfiguringScanState();
+		return;
 	}
 
-	// new highest duty cycle
-	if ((newDutyCycle != currentDutyCycle) && (p_job != nullptr))
+	// new plan
+	if (currentScanParams.window != p_job->window || currentScanParams.interval != p_job->interval)
 	{
 		scanStateOk = false;
 		currentScanParams.window = p_job->window;
@@ -151,6 +172,51 @@ void ScanController::RefreshJobs()
 	}
 }
 
+//Jobs with the same duty cycle are ordered by their interval as a shorter interval finds devices earlier
+bool ScanController::HasHigherDutyCycle(const ScanJob& job, const ScanJob& otherJob)
+{
+	const u32 dutyCycle = (u32)job.window * otherJob.interval;
+	const u32 otherDutyCycle = (u32)otherJob.window * job.interval;
+	if (dutyCycle != otherDutyCycle) return dutyCycle > otherDutyCycle;
+	return job.interval < otherJob.interval;
+}
+
+bool ScanController::IsJobScanning(const ScanJob& job) const
+{
+	if (job.state != ScanJobState::ACTIVE || job.interval == 0) return false;
+	return job.burstPeriodDs == 0 || job.burstPhaseDs < job.burstDurationDs;
+}
+
+//A scan that is longer than the advertising interval plus the maximum random advertising delay of 10ms
+//always receives one advertising event, a shorter scan receives one with a proportional probability.
+//The bursts are scheduled so that an advertiser that appears right after a burst is found in the next one.
+void ScanController::SetDetectionGoal(ScanJob& job, u16 advertisingIntervalMs, u16 maxLatencyDs, u8 probabilityPercent)
+{
+	if (probabilityPercent == 0 || probabilityPercent > 100 || maxLatencyDs == 0)
+	{
+		SIMEXCEPTION(IllegalArgumentException); //LCOV_EXCL_LINE assertion
+		probabilityPercent = 100;
+	}
+
+	const u32 requiredScanTimeMs = ((u32)advertisingIntervalMs + 10) * probabilityPercent / 100;
+
+	job.type = ScanState::CUSTOM;
+	job.interval = (u16)MSEC_TO_UNITS(100, UNIT_0_625_MS);
+	job.window = job.interval;
+	job.burstDurationDs = (u16)((requiredScanTimeMs + 99) / 100);
+
+	if ((u32)job.burstDurationDs * 2 >= maxLatencyDs)
+	{
+		//The goal can only be met by scanning all the time
+		job.burstPeriodDs = 0;
+		job.burstDurationDs = 0;
+	}
+	else
+	{
+		job.burstPeriodDs = maxLatencyDs - job.burstDurationDs;
+	}
+}
+
 void ScanController::RemoveJob(ScanJob * p_jobHandle)
 {
 	for (int i = 0; i < jobs.length; i++) {
@@ -162,12 +228,13 @@ void ScanController::RemoveJob(ScanJob * p_jobHandle)
 	RefreshJobs();
 }
 
-void ScanController::UpdateJobPointer(ScanJob **outUpdatePtr, ScanState type, ScanJobState state)
+void ScanController::UpdateJobPointer(ScanJob **outUpdatePtr, ScanState type, ScanJobState state, ModuleId owner)
 {
 	GS->scanController.RemoveJob(*outUpdatePtr);
 	ScanJob scanJob = ScanJob();
 	scanJob.type = type;
 	scanJob.state = state;
+	scanJob.owner = owner;
 	*outUpdatePtr = GS->scanController.AddJob(scanJob);
 }
 
@@ -59,6 +59,12 @@ typedef struct ScanJob
 	u16				window;
 	ScanJobState	state;
 	ScanState		type;
+	//A job with a burst period only needs its interval and window during the first burstDurationDs of
+	//every period and does not take part in the scan plan in between, 0 if it needs scanning all the time
+	u16				burstPeriodDs;
+	u16				burstDurationDs;
+	u16				burstPhaseDs; //Position within the current burst period, managed by the ScanController
+	ModuleId		owner; //The module that created the job, only used for statistics
 }ScanJob;
 
 class ScanController
@@ -71,6 +77,7 @@ private:
 
 
 	void TryConfiguringScanState();
+	static bool HasHigherDutyCycle(const ScanJob& job, const ScanJob& otherJob);
 
 public:
 	ScanController();
@@ -82,7 +89,12 @@ public:
 	void RemoveJob(ScanJob * p_jobHandle);
 	//Helper for a common use, where an old job should be removed (if set), and
 	//a new one should be created with a given ScanState and ScanJobState.
-	void UpdateJobPointer(ScanJob **outUpdatePtr, ScanState type, ScanJobState state);
+	void UpdateJobPointer(ScanJob **outUpdatePtr, ScanState type, ScanJobState state, ModuleId owner);
+	//Configures a job that finds an advertiser with the given advertising interval within maxLatencyDs
+	//with the given probability, using short bursts instead of scanning all the time
+	static void SetDetectionGoal(ScanJob& job, u16 advertisingIntervalMs, u16 maxLatencyDs, u8 probabilityPercent);
+	//Returns true if the job is active and currently takes part in the scan plan
+	bool IsJobScanning(const ScanJob& job) const;
 
 	void TimerEventHandler(u16 passedTimeDs);
 
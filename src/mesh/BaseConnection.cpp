@@ -253,6 +253,8 @@ void BaseConnection::FillTransmitBuffers()
 
 		if(err == (u32)ErrorType::SUCCESS)
 		{
+			queuedWriteCount++;
+
 			//FIXME: This is not using the preprocessed data (sentData)
 			PacketSuccessfullyQueuedWithSoftdevice(activeQueue, sendDataPacked, data, &sentData);
 		}
@@ -313,89 +315,96 @@ void BaseConnection::HandlePacketSent(u8 sentUnreliable, u8 sentReliable)
 			continue;
 		}
 
-		//Find the queue from which the packet was sent
-		PacketQueue* activeQueue;
+		RemoveSentPacket(sentReliable > 0);
+	}
 
-		SizedData packet = packetSendQueue.PeekNext();
-		BaseConnectionSendDataPacked* sendDataPacked = (BaseConnectionSendDataPacked*)packet.data;
-		u8 handle = sendDataPacked != nullptr ? sendDataPacked->sendHandle : PACKET_QUEUED_HANDLE_NOT_QUEUED_IN_SD;
+	//Log how many packets have been sent
+	this->sentUnreliable += sentUnreliable;
+	this->sentReliable += sentReliable;
+}
+
+void BaseConnection::RemoveSentPacket(bool sentReliable)
+{
+	sentWriteCount++;
 
-		packet = packetSendQueueHighPrio.PeekNext();
-		BaseConnectionSendDataPacked* sendDataPackedHighPrio = (BaseConnectionSendDataPacked*)packet.data;
-		u8 handleHighPrio = sendDataPackedHighPrio != nullptr ? sendDataPackedHighPrio->sendHandle : PACKET_QUEUED_HANDLE_NOT_QUEUED_IN_SD;
+	//Find the queue from which the packet was sent
+	PacketQueue* activeQueue;
 
-		//If no queue has a handle, the packets must be from the normal queue because it was sending a split packet (but not all parts yet)
-		if (handle < PACKET_QUEUED_HANDLE_COUNTER_START && handleHighPrio < PACKET_QUEUED_HANDLE_COUNTER_START) {
-			activeQueue = &packetSendQueue;
+	SizedData packet = packetSendQueue.PeekNext();
+	BaseConnectionSendDataPacked* sendDataPacked = (BaseConnectionSendDataPacked*)packet.data;
+	u8 handle = sendDataPacked != nullptr ? sendDataPacked->sendHandle : PACKET_QUEUED_HANDLE_NOT_QUEUED_IN_SD;
+
+	packet = packetSendQueueHighPrio.PeekNext();
+	BaseConnectionSendDataPacked* sendDataPackedHighPrio = (BaseConnectionSendDataPacked*)packet.data;
+	u8 handleHighPrio = sendDataPackedHighPrio != nullptr ? sendDataPackedHighPrio->sendHandle : PACKET_QUEUED_HANDLE_NOT_QUEUED_IN_SD;
+
+	//If no queue has a handle, the packets must be from the normal queue because it was sending a split packet (but not all parts yet)
+	if (handle < PACKET_QUEUED_HANDLE_COUNTER_START && handleHighPrio < PACKET_QUEUED_HANDLE_COUNTER_START) {
+		activeQueue = &packetSendQueue;
 #ifdef SIM_ENABLED
-			if (packetSendQueue.packetSentRemaining == 0) {
-				SIMEXCEPTION(IllegalStateException);
-			}
-#endif
+		if (packetSendQueue.packetSentRemaining == 0) {
+			SIMEXCEPTION(IllegalStateException);
 		}
-		//Check if we do not have a queued packet in the normal queue
-		else if (handle < PACKET_QUEUED_HANDLE_COUNTER_START) {
+#endif
+	}
+	//Check if we do not have a queued packet in the normal queue
+	else if (handle < PACKET_QUEUED_HANDLE_COUNTER_START) {
+		activeQueue = &packetSendQueueHighPrio;
+	}
+	//Check if we do not have a queued packet in the high prio queue
+	else if (handleHighPrio < PACKET_QUEUED_HANDLE_COUNTER_START) {
+		activeQueue = &packetSendQueue;
+	}
+	//Check which handle is lower than the other handle using unsigned variables that will wrap
+	else {
+		//Must be casted to u8, otherwhise type promotion results in an integer!
+		if ((u8)(handle - handleHighPrio) < 100) {
 			activeQueue = &packetSendQueueHighPrio;
 		}
-		//Check if we do not have a queued packet in the high prio queue
-		else if (handleHighPrio < PACKET_QUEUED_HANDLE_COUNTER_START) {
-			activeQueue = &packetSendQueue;
-		}
-		//Check which handle is lower than the other handle using unsigned variables that will wrap
 		else {
-			//Must be casted to u8, otherwhise type promotion results in an integer!
-			if ((u8)(handle - handleHighPrio) < 100) {
-				activeQueue = &packetSendQueueHighPrio;
-			}
-			else {
-				activeQueue = &packetSendQueue;
-			}
+			activeQueue = &packetSendQueue;
 		}
+	}
 
 
-		if(activeQueue->_numElements == 0){
-			//TODO: Save Error
-			logt("ERROR", "Fail: Queue");
-			SIMEXCEPTION(IllegalStateException);
+	if(activeQueue->_numElements == 0){
+		//TODO: Save Error
+		logt("ERROR", "Fail: Queue");
+		SIMEXCEPTION(IllegalStateException);
 
-			GS->logger.logCustomError(CustomErrorTypes::FATAL_HANDLE_PACKET_SENT_ERROR, partnerId);
-		}
+		GS->logger.logCustomError(CustomErrorTypes::FATAL_HANDLE_PACKET_SENT_ERROR, partnerId);
+	}
 
-		//Check if a split packet should be acknowledged
-		bool ackForSplitPacket = false;
-		if (activeQueue == &packetSendQueue && activeQueue->packetSentRemaining > 0 && sendDataPacked != nullptr && sendDataPacked->dataLength > connectionPayloadSize) {
-			activeQueue->packetSentRemaining--;
-			ackForSplitPacket = true;
-		}
+	//Check if a split packet should be acknowledged
+	bool ackForSplitPacket = false;
+	if (activeQueue == &packetSendQueue && activeQueue->packetSentRemaining > 0 && sendDataPacked != nullptr && sendDataPacked->dataLength > connectionPayloadSize) {
+		activeQueue->packetSentRemaining--;
+		ackForSplitPacket = true;
+	}
 
-		//Otherwise, either a normal packet or a split packet can be removed
-		if (!ackForSplitPacket || activeQueue->packetSentRemaining == 0) {
-			SizedData data = activeQueue->PeekNext();
+	//Otherwise, either a normal packet or a split packet can be removed
+	if (!ackForSplitPacket || activeQueue->packetSentRemaining == 0) {
+		SizedData data = activeQueue->PeekNext();
 
-			BaseConnectionSendDataPacked* sendData = (BaseConnectionSendDataPacked*)data.data;
+		BaseConnectionSendDataPacked* sendData = (BaseConnectionSendDataPacked*)data.data;
 
-			//We must only remove the packet if it has a handle, it might have only been sent partially so far
-			if (sendData->sendHandle != 0) {
+		//We must only remove the packet if it has a handle, it might have only been sent partially so far
+		if (sendData->sendHandle != 0) {
 
 #ifdef SIM_ENABLED
-				if (GS->node.configuration.nodeId == 37 && connectionHandle == 680) {
-					//printf("Q@NODE %u DISCARDS %s (packetHandle %u), gid %u (%u)" EOL, GS->node.configuration.nodeId, sendData->deliveryOption == (u8)DeliveryOption::WRITE_REQ ? "WRITE_REQ" : "WRITE_CMD", sendData->sendHandle, *((u32*)(packetHeader + 1)), sendData->dataLength);
-				}
-				//A quick check if a wrong packet was removed (not a 100% check, but helps)
-				if (sendData->deliveryOption == (u8)DeliveryOption::WRITE_REQ && !sentReliable) {
-					SIMEXCEPTION(IllegalStateException);
-				}
+			if (GS->node.configuration.nodeId == 37 && connectionHandle == 680) {
+				//printf("Q@NODE %u DISCARDS %s (packetHandle %u), gid %u (%u)" EOL, GS->node.configuration.nodeId, sendData->deliveryOption == (u8)DeliveryOption::WRITE_REQ ? "WRITE_REQ" : "WRITE_CMD", sendData->sendHandle, *((u32*)(packetHeader + 1)), sendData->dataLength);
+			}
+			//A quick check if a wrong packet was removed (not a 100% check, but helps)
+			if (sendData->deliveryOption == (u8)DeliveryOption::WRITE_REQ && !sentReliable) {
+				SIMEXCEPTION(IllegalStateException);
+			}
 #endif
 
-				DataSentHandler(data.data + SIZEOF_BASE_CONNECTION_SEND_DATA_PACKED, data.length - SIZEOF_BASE_CONNECTION_SEND_DATA_PACKED);
-				activeQueue->DiscardNext();
-			}
+			DataSentHandler(data.data + SIZEOF_BASE_CONNECTION_SEND_DATA_PACKED, data.length - SIZEOF_BASE_CONNECTION_SEND_DATA_PACKED);
+			activeQueue->DiscardNext();
 		}
 	}
-
-	//Log how many packets have been sent
-	this->sentUnreliable += sentUnreliable;
-	this->sentReliable += sentReliable;
 }
 
 void BaseConnection::HandlePacketQueuingFail(PacketQueue& activeQueue, BaseConnectionSendDataPacked* sendDataPacked, u32 err)
@@ -233,6 +233,8 @@ class BaseConnection
 		void HandlePacketQueued(PacketQueue* activeQueue, BaseConnectionSendDataPacked* sendDataPacked);
 		void HandlePacketQueuingFail(PacketQueue& activeQueue, BaseConnectionSendDataPacked* sendDataPacked, u32 err);
 		void HandlePacketSent(u8 sentUnreliable, u8 sentReliable);
+		//Removes the packet (or split part) that was sent first from the queues
+		void RemoveSentPacket(bool sentReliable);
 
 		void ResendAllPackets(PacketQueue& queueToReset) const;
 
@@ -269,6 +271,10 @@ class BaseConnection
 
 		u8 packetQueuedHandleCounter = PACKET_QUEUED_HANDLE_COUNTER_START; //Used to assign handles to queued packets
 
+		//Writes from the packet queues, split packets count once per part, manually sent packets are not counted
+		u16 queuedWriteCount = 0; //Writes that were queued in the softdevice
+		u16 sentWriteCount = 0; //Writes that the softdevice reported as sent
+
 		SimpleArray<u8, PACKET_REASSEMBLY_BUFFER_SIZE> packetReassemblyBuffer;
 		u8 packetReassemblyPosition = 0; //Set to 0 if no reassembly is in progress
 
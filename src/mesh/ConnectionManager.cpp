@@ -395,6 +395,12 @@ void ConnectionManager::DispatchMeshMessage(BaseConnection* connection, BaseConn
 			packet = modifiedPacket;
 		}
 
+		//Acknowledged messages are unwrapped first and dispatched again by the ReliableMessaging
+		if (GS->reliableMessaging.MeshMessageReceivedHandler(connection, sendData, packet)) return;
+
+		//Raw data messages are still passed to the modules afterwards, e.g. so that the node logs them
+		GS->rawDataTransfer.MeshMessageReceivedHandler(sendData, packet);
+
 		//Now we must pass the message to all of our modules for further processing
 		for(u32 i=0; i<GS->amountOfModules; i++){
 			if(GS->activeModules[i]->configurationPointer->moduleActive){
@@ -427,6 +433,28 @@ void ConnectionManager::SendModuleActionMessage(MessageType messageType, ModuleI
 	GS->cm.SendMeshMessageInternal(buffer, SIZEOF_CONN_PACKET_MODULE + additionalDataSize, DeliveryPriority::LOW, false, loopback, true);
 }
 
+//Same as SendModuleActionMessage, but the message is retransmitted until the receiver acknowledged it
+ErrorType ConnectionManager::SendModuleActionMessageAcknowledged(MessageType messageType, ModuleId moduleId, NodeId toNode, u8 actionType, u8 requestHandle, const u8* additionalData, u16 additionalDataSize) const
+{
+	DYNAMIC_ARRAY(buffer, SIZEOF_CONN_PACKET_MODULE + additionalDataSize);
+
+	connPacketModule* outPacket = (connPacketModule*)buffer;
+	outPacket->header.messageType = messageType;
+	outPacket->header.sender = GS->node.configuration.nodeId;
+	outPacket->header.receiver = toNode;
+
+	outPacket->moduleId = moduleId;
+	outPacket->requestHandle = requestHandle;
+	outPacket->actionType = actionType;
+
+	if (additionalData != nullptr && additionalDataSize > 0)
+	{
+		CheckedMemcpy(&outPacket->data, additionalData, additionalDataSize);
+	}
+
+	return GS->reliableMessaging.SendMeshMessage(buffer, SIZEOF_CONN_PACKET_MODULE + additionalDataSize);
+}
+
 void ConnectionManager::BroadcastMeshPacket(u8* data, u16 dataLength, DeliveryPriority priority, bool reliable) const
 {
 	MeshConnections conn = GetMeshConnections(ConnectionDirection::INVALID);
@@ -487,6 +515,9 @@ void ConnectionManager::GattDataTransmittedEventHandler(const FruityHal::GattDat
 		{
 			ConnectionManager::getInstance().fillTransmitBuffers();
 		}
+
+		//Raw data transfers can now put more chunks into the queues
+		GS->rawDataTransfer.PacketsSentHandler();
 	}
 }
 
@@ -1102,25 +1133,101 @@ BaseConnections ConnectionManager::GetConnectionsByUniqueId(u32 uniqueConnection
 	return fc;
 }
 
-//TODO: Only return mesh connections, check
+//Returns the connection that packets to NODE_ID_SHORTEST_SINK are sent to. This is not necessarily the one with the
+//fewest hops as the path cost also weighs the load on the way. The preferred connection is kept until another one is
+//clearly cheaper so that the traffic does not flap between several sinks.
 MeshConnection* ConnectionManager::GetMeshConnectionToShortestSink(const BaseConnection* excludeConnection) const
 {
-	ClusterSize min = INT16_MAX;
+	BaseConnection* preferredConnection = GetConnectionByUniqueId(preferredSinkConnectionUniqueId);
+	if (
+		preferredConnection != nullptr
+		&& preferredConnection != excludeConnection
+		&& preferredConnection->connectionType == ConnectionType::FRUITYMESH
+		&& GetSinkPathCost((MeshConnection*)preferredConnection) != UINT32_MAX
+	) {
+		return (MeshConnection*)preferredConnection;
+	}
+
+	return GetCheapestSinkConnection(excludeConnection);
+}
+
+MeshConnection* ConnectionManager::GetCheapestSinkConnection(const BaseConnection* excludeConnection) const
+{
+	u32 minCost = UINT32_MAX;
 	MeshConnection* c = nullptr;
 	MeshConnections conn = GetMeshConnections(ConnectionDirection::INVALID);
 	for (int i = 0; i < conn.count; i++)
 	{
 		if (excludeConnection != nullptr && conn.connections[i] == excludeConnection)
 			continue;
-		if (conn.connections[i]->handshakeDone() && conn.connections[i]->hopsToSink > -1 && conn.connections[i]->hopsToSink < min)
+		const u32 cost = GetSinkPathCost(conn.connections[i]);
+		if (cost < minCost)
 		{
-			min = conn.connections[i]->hopsToSink;
+			minCost = cost;
 			c = conn.connections[i];
 		}
 	}
 	return c;
 }
 
+//Each hop to the sink adds a fixed cost. If load balancing is enabled, the fullest queue on the path, either the one
+//of our own connection or the one that the partner reported for its onward path, adds its occupancy and every packet
+//that was recently dropped on the way adds a penalty.
+u32 ConnectionManager::GetSinkPathCost(const MeshConnection* connection) const
+{
+	if (!connection->handshakeDone() || connection->hopsToSink < 0) return UINT32_MAX;
+
+	if (GS->config.sinkLoadReportIntervalDs == 0) return (u32)connection->hopsToSink * SINK_ROUTE_HOP_COST;
+
+	const u8 localQueueLoad = connection->packetSendQueue.GetUsagePercent();
+	const u32 queueLoad = localQueueLoad > connection->advertisedSinkPathQueueLoad ? localQueueLoad : connection->advertisedSinkPathQueueLoad;
+	const u32 recentDrops = (u32)connection->recentDroppedPackets + connection->advertisedSinkPathRecentDrops;
+
+	return (u32)connection->hopsToSink * SINK_ROUTE_HOP_COST + queueLoad + recentDrops * SINK_ROUTE_DROP_COST;
+}
+
+//Calculates the load that is reported to the partner of the excluded connection. A sink does not forward
+//packets to other sinks, so its path is always free.
+bool ConnectionManager::GetSinkPathLoad(const BaseConnection* excludeConnection, u8* outQueueLoad, u8* outRecentDrops) const
+{
+	*outQueueLoad = 0;
+	*outRecentDrops = 0;
+
+	if (GET_DEVICE_TYPE() == DeviceType::SINK) return true;
+
+	const MeshConnection* connection = GetMeshConnectionToShortestSink(excludeConnection);
+	if (connection == nullptr) return false;
+
+	const u8 localQueueLoad = connection->packetSendQueue.GetUsagePercent();
+	*outQueueLoad = localQueueLoad > connection->advertisedSinkPathQueueLoad ? localQueueLoad : connection->advertisedSinkPathQueueLoad;
+	const u32 recentDrops = (u32)connection->recentDroppedPackets + connection->advertisedSinkPathRecentDrops;
+	*outRecentDrops = recentDrops > UINT8_MAX ? UINT8_MAX : (u8)recentDrops;
+
+	return true;
+}
+
+void ConnectionManager::UpdatePreferredSinkConnection()
+{
+	MeshConnection* cheapestConnection = GetCheapestSinkConnection(nullptr);
+	if (cheapestConnection == nullptr)
+	{
+		preferredSinkConnectionUniqueId = 0;
+		return;
+	}
+
+	//Returns the cheapest connection if the preferred one is gone
+	const MeshConnection* preferredConnection = GetMeshConnectionToShortestSink(nullptr);
+	if (preferredConnection == cheapestConnection)
+	{
+		preferredSinkConnectionUniqueId = cheapestConnection->uniqueConnectionId;
+	}
+	else if (GetSinkPathCost(cheapestConnection) + SINK_ROUTE_HYSTERESIS < GetSinkPathCost(preferredConnection))
+	{
+		logt("SINK", "Sink route moved from partner %u to %u", preferredConnection->partnerId, cheapestConnection->partnerId);
+		preferredSinkConnectionUniqueId = cheapestConnection->uniqueConnectionId;
+	}
+}
+
 ClusterSize ConnectionManager::GetMeshHopsToShortestSink(const BaseConnection* excludeConnection) const
 {
 	if (GET_DEVICE_TYPE() == DeviceType::SINK)
@@ -1243,6 +1350,20 @@ void ConnectionManager::TimerEventHandler(u16 passedTimeDs)
 		}
 	}
 
+	// Sink Routing
+	if (SHOULD_IV_TRIGGER(GS->appTimerDs, passedTimeDs, SINK_ROUTE_DROP_DECAY_INTERVAL_DS))
+	{
+		MeshConnections conns = GetMeshConnections(ConnectionDirection::INVALID);
+		for (u32 i = 0; i < conns.count; i++)
+		{
+			MeshConnection* conn = conns.connections[i];
+			const u32 recentDrops = conn->recentDroppedPackets / 2 + (u16)(conn->droppedPackets - conn->droppedPacketsAtLastDecay);
+			conn->recentDroppedPackets = recentDrops > UINT8_MAX ? UINT8_MAX : (u8)recentDrops;
+			conn->droppedPacketsAtLastDecay = conn->droppedPackets;
+		}
+	}
+	UpdatePreferredSinkConnection();
+
 	// Time Syncing
 	timeSinceLastTimeSyncIntervalDs += passedTimeDs;
 	if(GS->timeManager.IsTimeCorrected() && timeSinceLastTimeSyncIntervalDs >= TIME_BETWEEN_TIME_SYNC_INTERVALS_DS)
@@ -63,6 +63,16 @@ private:
 	static constexpr u16 TIME_BETWEEN_TIME_SYNC_INTERVALS_DS = SEC_TO_DS(5);
 	u16 timeSinceLastTimeSyncIntervalDs = 0;	//Let's not spam the connections with time syncs.
 
+	//Sink routing weighs the hops to a sink against the load on the way, see GetSinkPathCost
+	static constexpr u32 SINK_ROUTE_HOP_COST = 25; //One hop weighs as much as 25% of queue occupancy
+	static constexpr u32 SINK_ROUTE_DROP_COST = 10; //Cost of each recently dropped packet
+	static constexpr u32 SINK_ROUTE_HYSTERESIS = 20; //Another route must be cheaper by this much before the traffic is moved
+	static constexpr u16 SINK_ROUTE_DROP_DECAY_INTERVAL_DS = SEC_TO_DS(5);
+	u32 preferredSinkConnectionUniqueId = 0;
+
+	MeshConnection* GetCheapestSinkConnection(const BaseConnection* excludeConnection) const;
+	void UpdatePreferredSinkConnection();
+
 	u32 uniqueConnectionIdCounter = 0; //Counts all created connections to assign "unique" ids
 
 public:
@@ -113,6 +123,8 @@ public:
 	void SendMeshMessage(u8* data, u16 dataLength, DeliveryPriority priority) const;
 
 	void SendModuleActionMessage(MessageType messageType, ModuleId moduleId, NodeId toNode, u8 actionType, u8 requestHandle, const u8* additionalData, u16 additionalDataSize, bool reliable, bool lookback) const;
+	//Delivers the message end-to-end through the ReliableMessaging, only for unicast receivers and NODE_ID_SHORTEST_SINK
+	ErrorType SendModuleActionMessageAcknowledged(MessageType messageType, ModuleId moduleId, NodeId toNode, u8 actionType, u8 requestHandle, const u8* additionalData, u16 additionalDataSize) const;
 
 	void BroadcastMeshPacket(u8* data, u16 dataLength, DeliveryPriority priority, bool reliable) const;
 
@@ -140,6 +152,10 @@ public:
 
 	MeshConnection* GetMeshConnectionToShortestSink(const BaseConnection* excludeConnection) const;
 	ClusterSize GetMeshHopsToShortestSink(const BaseConnection* excludeConnection) const;
+	//Returns UINT32_MAX if no sink can be reached through the connection
+	u32 GetSinkPathCost(const MeshConnection* connection) const;
+	//Returns false if no sink can be reached without the excluded connection
+	bool GetSinkPathLoad(const BaseConnection* excludeConnection, u8* outQueueLoad, u8* outRecentDrops) const;
 
 	u16 GetPendingPackets() const;
 
@@ -52,6 +52,7 @@
 #include <Utility.h>
 #include <types.h>
 #include <FlashStorage.h>
+#include <RecordStorage.h>
 
 #ifndef GITHUB_RELEASE
 #if IS_ACTIVE(ASSET_MODULE)
@@ -347,8 +348,14 @@ void DispatchTimerEvents(u16 passedTimeDs)
 
 	GS->cm.TimerEventHandler(passedTimeDs);
 
+	GS->reliableMessaging.TimerEventHandler(passedTimeDs);
+
+	GS->rawDataTransfer.TimerEventHandler(passedTimeDs);
+
 	FlashStorage::getInstance().TimerEventHandler(passedTimeDs);
 
+	RecordStorage::getInstance().TimerEventHandler(passedTimeDs);
+
 	AdvertisingController::getInstance().TimerEventHandler(passedTimeDs);
 
 	ScanController::getInstance().TimerEventHandler(passedTimeDs);
@@ -84,6 +84,9 @@ MeshAccessConnection::MeshAccessConnection(u8 id, ConnectionDirection direction,
 
 	this->lastProcessedMessageType = MessageType::INVALID;
 
+	ResetKeystreamPool(encryptionKeystreamPool);
+	ResetKeystreamPool(decryptionKeystreamPool);
+
 	this->tunnelType = tunnelType;
 
 	//The partner is assigned a unique nodeId in our mesh network that is not already taken
@@ -290,6 +293,7 @@ void MeshAccessConnection::HandshakeANonce(connPacketEncryptCustomStart const *
 
 	//Generate the session key for decryption
 	bool keyValid = GenerateSessionKey((u8*)decryptionNonce, partnerId, fmKeyId, sessionDecryptionKey);
+	ResetKeystreamPool(decryptionKeystreamPool);
 
 	if(!keyValid){
 		logt("ERROR", "Invalid Key");
@@ -337,6 +341,8 @@ void MeshAccessConnection::HandshakeSNonce(connPacketEncryptCustomANonce const *
 	//Generate the session keys for encryption and decryption
 	bool keyValidA = GenerateSessionKey((u8*)encryptionNonce, GS->node.configuration.nodeId, fmKeyId, sessionEncryptionKey);
 	bool keyValidB = GenerateSessionKey((u8*)decryptionNonce, GS->node.configuration.nodeId, fmKeyId, sessionDecryptionKey);
+	ResetKeystreamPool(encryptionKeystreamPool);
+	ResetKeystreamPool(decryptionKeystreamPool);
 
 	if(!keyValidA || !keyValidB){
 		logt("ERROR", "Invalid Key %u %u", (u32)keyValidA, (u32)keyValidB);
@@ -387,6 +393,7 @@ void MeshAccessConnection::HandshakeDone(connPacketEncryptCustomSNonce const * i
 
 	//Generate key for encryption
 	bool keyValid = GenerateSessionKey((u8*)encryptionNonce, partnerId, fmKeyId, sessionEncryptionKey);
+	ResetKeystreamPool(encryptionKeystreamPool);
 
 	if(!keyValid){
 		logt("ERROR", "Invalid Key in HD");
@@ -599,40 +606,37 @@ void MeshAccessConnection::EncryptPacket(u8* data, u16 dataLength)
 
 	u8 cleartext[16];
 	u8 keystream[16];
+	u8 micKeystream[16];
 	u8 ciphertext[16];
 
-	//Generate keystream with nonce
-	CheckedMemset(cleartext, 0x00, 16);
-	CheckedMemcpy(cleartext, encryptionNonce, MESH_ACCESS_HANDSHAKE_NONCE_LENGTH);
-	Utility::Aes128BlockEncrypt(
-			(Aes128Block*)cleartext,
-			(Aes128Block*)sessionEncryptionKey,
-			(Aes128Block*)keystream);
+	//Both keystreams only depend on the nonce and are usually precomputed while the connection was idle
+	u8 const * pooledKeystream = GetPooledKeystream(encryptionKeystreamPool, encryptionNonce);
+	if(pooledKeystream != nullptr){
+		keystreamPoolHits++;
+		CheckedMemcpy(keystream, pooledKeystream, 16);
+		CheckedMemcpy(micKeystream, pooledKeystream + 16, 16);
+	} else {
+		keystreamPoolMisses++;
+		//Generate keystream with nonce
+		GenerateKeystream(encryptionNonce, 0, sessionEncryptionKey, keystream);
+		//Generate a new Keystream with an incremented counter for MIC calculation
+		GenerateKeystream(encryptionNonce, 1, sessionEncryptionKey, micKeystream);
+	}
 
 //	TO_HEX(keystream, 16);
 //	logt("ERROR", "Encryption Keystream %s", keystreamHex);
 
 	//Xor cleartext with keystream to get the ciphertext
+	CheckedMemset(cleartext, 0x00, 16);
 	CheckedMemcpy(cleartext, data, dataLength);
 	Utility::XorBytes(keystream, cleartext, 16, ciphertext);
 	CheckedMemcpy(data, ciphertext, dataLength);
 
-	//Increment nonce being used as a counter
-	encryptionNonce[1]++;
-
-	//Generate a new Keystream with an updated counter for MIC calculateion
-	CheckedMemset(cleartext, 0x00, 16);
-	CheckedMemcpy(cleartext, encryptionNonce, MESH_ACCESS_HANDSHAKE_NONCE_LENGTH);
-	Utility::Aes128BlockEncrypt( //encrypts nonce
-				(Aes128Block*)cleartext,
-				(Aes128Block*)sessionEncryptionKey,
-				(Aes128Block*)keystream);
-
 	//To generate the MIC, we xor the new keystream with our cleartext and encrypt it again
 	//we therefore create a pair that cannot be reproduced by an attacker (hopefully :-))
 	CheckedMemset(cleartext, 0x00, 16);
 	CheckedMemcpy(cleartext, data, dataLength);
-	Utility::XorBytes(keystream, cleartext, 16, cleartext);
+	Utility::XorBytes(micKeystream, cleartext, 16, cleartext);
 	Utility::Aes128BlockEncrypt(
 			(Aes128Block*)cleartext,
 			(Aes128Block*)sessionEncryptionKey,
@@ -642,10 +646,9 @@ void MeshAccessConnection::EncryptPacket(u8* data, u16 dataLength)
 //	u8 keystream2[16];
 //	CheckedMemcpy(keystream2, keystream, 16);
 //	TO_HEX(keystream2, 16);
-//	logt("ERROR", "MIC nonce %u produces Keystream %s", encryptionNonce[1], keystream2Hex);
+//	logt("ERROR", "MIC nonce %u produces Keystream %s", encryptionNonce[1] + 1, keystream2Hex);
 
-	//Reset nonce, it is incremented once the packet was successfully queued with the softdevice
-	encryptionNonce[1]--;
+	//The nonce is not modified here, it is incremented once the packet was successfully queued with the softdevice
 
 	//Copy nonce to the end of the packet
 	u8* micPtr = data + dataLength;
@@ -667,43 +670,35 @@ bool MeshAccessConnection::DecryptPacket(u8 const * data, u8 * decryptedOut, u16
 
 	u8 cleartext[16];
 	u8 keystream[16];
+	u8 micKeystream[16];
 	u8 ciphertext[16];
 
-	//We need to calculate the MIC from the ciphertext as was done by the sender
-	decryptionNonce[1]++;
-
-	//Generate a keystream from the nonce
-	CheckedMemset(cleartext, 0x00, 16);
-	CheckedMemcpy(cleartext, decryptionNonce, MESH_ACCESS_HANDSHAKE_NONCE_LENGTH);
-	Utility::Aes128BlockEncrypt( //encrypts nonce
-				(Aes128Block*)cleartext,
-				(Aes128Block*)sessionDecryptionKey,
-				(Aes128Block*)keystream);
+	//Both keystreams only depend on the nonce and are usually precomputed while the connection was idle
+	u8 const * pooledKeystream = GetPooledKeystream(decryptionKeystreamPool, decryptionNonce);
+	if(pooledKeystream != nullptr){
+		keystreamPoolHits++;
+		CheckedMemcpy(keystream, pooledKeystream, 16);
+		CheckedMemcpy(micKeystream, pooledKeystream + 16, 16);
+	} else {
+		keystreamPoolMisses++;
+		GenerateKeystream(decryptionNonce, 0, sessionDecryptionKey, keystream);
+		//We need to calculate the MIC from the ciphertext as was done by the sender with the incremented nonce
+		GenerateKeystream(decryptionNonce, 1, sessionDecryptionKey, micKeystream);
+	}
 
-	//Xor the keystream with the ciphertext
+	//Xor the MIC keystream with the ciphertext
 	CheckedMemset(ciphertext, 0x00, 16);
 	CheckedMemcpy(ciphertext, data, dataLength - MESH_ACCESS_MIC_LENGTH);
-	Utility::XorBytes(ciphertext, keystream, 16, cleartext);
+	Utility::XorBytes(ciphertext, micKeystream, 16, cleartext);
 	//Encrypt the resulting cleartext
 	Utility::Aes128BlockEncrypt(
 			(Aes128Block*)cleartext,
 			(Aes128Block*)sessionDecryptionKey,
-			(Aes128Block*)keystream);
+			(Aes128Block*)micKeystream);
 
 	//Check if the two MICs match
 	u8 const * micPtr = data + (dataLength - MESH_ACCESS_MIC_LENGTH);
-	u32 micCheck = memcmp(keystream, micPtr, MESH_ACCESS_MIC_LENGTH);
-
-	//Reset decryptionNonce for decrypting the message
-	decryptionNonce[1]--;
-
-	//Generate keystream with nonce
-	CheckedMemset(cleartext, 0x00, 16);
-	CheckedMemcpy(cleartext, decryptionNonce, MESH_ACCESS_HANDSHAKE_NONCE_LENGTH);
-	Utility::Aes128BlockEncrypt(
-			(Aes128Block*)cleartext,
-			(Aes128Block*)sessionDecryptionKey,
-			(Aes128Block*)keystream);
+	u32 micCheck = memcmp(micKeystream, micPtr, MESH_ACCESS_MIC_LENGTH);
 
 //	TO_HEX(keystream, 16);
 //	logt("ERROR", "Keystream %s", keystreamHex);
@@ -711,7 +706,7 @@ bool MeshAccessConnection::DecryptPacket(u8 const * data, u8 * decryptedOut, u16
 	//Xor keystream with ciphertext to retrieve original message
 	Utility::XorBytes(keystream, data, dataLength - MESH_ACCESS_MIC_LENGTH, decryptedOut);
 
-	//Increment nonce being used as a counter
+	//Increment nonce being used as a counter, the following value was used for the MIC
 	decryptionNonce[1] += 2;
 
 //	u8 keystream2[16];
@@ -726,6 +721,69 @@ bool MeshAccessConnection::DecryptPacket(u8 const * data, u8 * decryptedOut, u16
 	return micCheck == 0;
 }
 
+void MeshAccessConnection::GenerateKeystream(u32 const * nonce, u32 counterOffset, u8 const * sessionKey, u8* keystreamOut)
+{
+	u32 counter[2] = { nonce[0], nonce[1] + counterOffset };
+
+	u8 cleartext[16];
+	CheckedMemset(cleartext, 0x00, 16);
+	CheckedMemcpy(cleartext, counter, MESH_ACCESS_HANDSHAKE_NONCE_LENGTH);
+	Utility::Aes128BlockEncrypt(
+			(Aes128Block*)cleartext,
+			(Aes128Block*)sessionKey,
+			(Aes128Block*)keystreamOut);
+}
+
+void MeshAccessConnection::ResetKeystreamPool(MeshAccessKeystreamPool& pool)
+{
+	CheckedMemset(&pool, 0x00, sizeof(MeshAccessKeystreamPool));
+}
+
+void MeshAccessConnection::RefillKeystreamPool(MeshAccessKeystreamPool& pool, u32 const * nonce, u8 const * sessionKey)
+{
+	//Drops all entries that were already used, afterwards the pool either starts at the given nonce or is empty
+	GetPooledKeystream(pool, nonce);
+
+	if(pool.numEntries == 0){
+		pool.nonce[0] = nonce[0];
+		pool.nonce[1] = nonce[1];
+		pool.readIndex = 0;
+	}
+
+	while(pool.numEntries < MESH_ACCESS_KEYSTREAM_POOL_SIZE){
+		u8 index = (pool.readIndex + pool.numEntries) % MESH_ACCESS_KEYSTREAM_POOL_SIZE;
+		u32 counterOffset = pool.numEntries * 2;
+		GenerateKeystream(pool.nonce, counterOffset, sessionKey, pool.keystream[index][0]);
+		GenerateKeystream(pool.nonce, counterOffset + 1, sessionKey, pool.keystream[index][1]);
+		pool.numEntries++;
+	}
+}
+
+u8 const * MeshAccessConnection::GetPooledKeystream(MeshAccessKeystreamPool& pool, u32 const * nonce)
+{
+	if(pool.numEntries > 0 && pool.nonce[0] != nonce[0]){
+		pool.numEntries = 0;
+	}
+
+	//Discard entries of nonces that have already been used
+	while(pool.numEntries > 0 && pool.nonce[1] != nonce[1]){
+		pool.nonce[1] += 2;
+		pool.readIndex = (pool.readIndex + 1) % MESH_ACCESS_KEYSTREAM_POOL_SIZE;
+		pool.numEntries--;
+	}
+
+	if(pool.numEntries == 0) return nullptr;
+
+	return pool.keystream[pool.readIndex][0];
+}
+
+void MeshAccessConnection::RefillKeystreamPools()
+{
+	if(encryptionState != EncryptionState::ENCRYPTED || connectionState < ConnectionState::HANDSHAKE_DONE) return;
+
+	RefillKeystreamPool(encryptionKeystreamPool, encryptionNonce, sessionEncryptionKey);
+	RefillKeystreamPool(decryptionKeystreamPool, decryptionNonce, sessionDecryptionKey);
+}
 
 #define ________________________SEND________________________
 
@@ -38,6 +38,8 @@ struct MeshAccessServiceStruct;
 
 constexpr int MESH_ACCESS_MIC_LENGTH = 4;
 constexpr int MESH_ACCESS_HANDSHAKE_NONCE_LENGTH = 8;
+//Number of packets per direction for which the keystream is precomputed while the connection is idle
+constexpr u8 MESH_ACCESS_KEYSTREAM_POOL_SIZE = 2;
 
 enum class MeshAccessTunnelType: u8
 {
@@ -60,6 +62,17 @@ static_assert(sizeof(deadDataMagicNumber) == sizeof(DeadDataMessage::magicNumber
 STATIC_ASSERT_SIZE(DeadDataMessage, 13);
 #pragma pack(pop)
 
+//Holds precomputed keystream blocks for the upcoming nonces of one direction. Each entry contains the
+//keystream that is xored with the payload and the keystream that is used for calculating the MIC.
+//Entry i belongs to the nonce counter nonce[1] + 2 * i as every packet consumes two counter values.
+struct MeshAccessKeystreamPool
+{
+	u32 nonce[2];
+	u8 numEntries;
+	u8 readIndex;
+	u8 keystream[MESH_ACCESS_KEYSTREAM_POOL_SIZE][2][16];
+};
+
 class MeshAccessConnection
 		: public BaseConnection
 {
@@ -84,6 +97,9 @@ private:
 	u32 encryptionNonce[2] = { 0 };
 	u32 decryptionNonce[2] = { 0 };
 
+	MeshAccessKeystreamPool encryptionKeystreamPool;
+	MeshAccessKeystreamPool decryptionKeystreamPool;
+
 
 	MessageType lastProcessedMessageType;
 
@@ -93,6 +109,12 @@ private:
 
 	void LogKeys();
 
+	static void GenerateKeystream(u32 const * nonce, u32 counterOffset, u8 const * sessionKey, u8* keystreamOut);
+	static void ResetKeystreamPool(MeshAccessKeystreamPool& pool);
+	static void RefillKeystreamPool(MeshAccessKeystreamPool& pool, u32 const * nonce, u8 const * sessionKey);
+	//Returns the payload and MIC keystream for the given nonce or nullptr if it was not precomputed
+	static u8 const * GetPooledKeystream(MeshAccessKeystreamPool& pool, u32 const * nonce);
+
 public:
 
 	//The tunnel type describes the direction in which the MeshAccess connection works
@@ -144,6 +166,13 @@ public:
 	//Decrypts the data in place (dataLength includes MIC) with the session key
 	bool DecryptPacket(u8 const * data, u8 * decryptedOut, u16 dataLength);
 
+	//Precomputes the keystream for the next packets so that only the MIC must be encrypted
+	//once a packet is sent or received, should be called while the connection is idle
+	void RefillKeystreamPools();
+
+	u32 keystreamPoolHits = 0;
+	u32 keystreamPoolMisses = 0;
+
 
 	/*############### Sending ##################*/
 	SizedData ProcessDataBeforeTransmission(BaseConnectionSendData* sendData, u8* data, u8* packetBuffer) override;
@@ -248,6 +248,11 @@ void MeshConnection::TryReestablishing()
 
 void MeshConnection::GapReconnectionSuccessfulHandler(const FruityHal::GapConnectedEvent& connectedEvent)
 {
+	//Only save the payload size of the first reconnection, the connection might be lost again during the handshake
+	if (connectionState == ConnectionState::REESTABLISHING && connectionStateBeforeDisconnection == ConnectionState::HANDSHAKE_DONE) {
+		payloadSizeBeforeReestablishing = connectionPayloadSize;
+	}
+
 	BaseConnection::GapReconnectionSuccessfulHandler(connectedEvent);
 
 	GS->logger.logCustomError(CustomErrorTypes::INFO_CONNECTION_SUSTAIN_SUCCESS, partnerId);
@@ -256,12 +261,63 @@ void MeshConnection::GapReconnectionSuccessfulHandler(const FruityHal::GapConnec
 	connectionState = ConnectionState::REESTABLISHING_HANDSHAKE;
 	handshakeStartedDs = GS->appTimerDs;
 
-	//Reset all send queues so that the packets are being sent again
+	//Packets that were sent manually on the old link will never be reported as sent
+	manualPacketsSent = 0;
+
+	//The send queues are reset once the partner told us which writes it has received, see ResumeSendQueues
+	//Our reassembly buffer is kept as the partner continues a split packet where it was interrupted
+}
+
+//Removes all writes that the partner received before the connection was lost and
+//prepares the send queues so that all other packets are sent again
+void MeshConnection::ResumeSendQueues(bool partnerReportedWrites, u16 partnerReceivedWrites)
+{
+	const u16 unconfirmedWrites = queuedWriteCount - sentWriteCount;
+	const u16 deliveredWrites = partnerReceivedWrites - sentWriteCount;
+	u8 deliveredSplitParts = 0;
+
+	if (partnerReportedWrites && deliveredWrites <= unconfirmedWrites)
+	{
+		//The queues must be processed with the payload size that was used for splitting the packets
+		const u16 currentPayloadSize = connectionPayloadSize;
+		connectionPayloadSize = payloadSizeBeforeReestablishing;
+
+		//The partner has received these writes, only the confirmation was lost together with the connection
+		for (u32 i = 0; i < deliveredWrites; i++) {
+			RemoveSentPacket(true);
+			SIMSTATCOUNT("reestablishResendAvoided");
+		}
+		avoidedResends += deliveredWrites;
+		if (deliveredWrites > 0) GS->logger.logCustomError(CustomErrorTypes::COUNT_REESTABLISH_RESEND_AVOIDED, deliveredWrites);
+
+		//If the first packet was only partially delivered, the partner still has the first parts in its reassembly buffer
+		SizedData packet = packetSendQueue.PeekNext();
+		BaseConnectionSendDataPacked* sendDataPacked = (BaseConnectionSendDataPacked*)packet.data;
+		if (sendDataPacked != nullptr && sendDataPacked->dataLength > connectionPayloadSize && currentPayloadSize == connectionPayloadSize)
+		{
+			const u16 payloadPerPart = connectionPayloadSize - SIZEOF_CONN_PACKET_SPLIT_HEADER;
+			//Once the last part was queued, the send position was reset and all parts were queued
+			const u8 queuedSplitParts = packetSendQueue.packetSendPosition != 0 ? packetSendQueue.packetSendPosition : (u8)((sendDataPacked->dataLength + payloadPerPart - 1) / payloadPerPart);
+			if (sendDataPacked->sendHandle != PACKET_QUEUED_HANDLE_NOT_QUEUED_IN_SD || packetSendQueue.packetSendPosition != 0) {
+				deliveredSplitParts = queuedSplitParts - packetSendQueue.packetSentRemaining;
+			}
+		}
+
+		connectionPayloadSize = currentPayloadSize;
+	}
+	else if (partnerReportedWrites)
+	{
+		logt("ERROR", "Partner received %u writes, but only %u were sent", partnerReceivedWrites, queuedWriteCount);
+		GS->logger.logCustomError(CustomErrorTypes::WARN_REESTABLISH_WRITE_COUNT_MISMATCH, partnerId);
+	}
+
+	logt("CONN", "Resuming conn %u after %u writes, split part %u", connectionId, sentWriteCount, deliveredSplitParts);
+
+	//Reset all send queues so that the remaining packets are being sent again
 	ResendAllPackets(packetSendQueue);
 	ResendAllPackets(packetSendQueueHighPrio);
-
-	//Also reset our reassembly buffer
-	packetReassemblyPosition = 0;
+	packetSendQueue.packetSendPosition = deliveredSplitParts;
+	queuedWriteCount = sentWriteCount;
 }
 
 #define __________________SENDING_________________
@@ -466,6 +522,20 @@ void MeshConnection::ReceiveDataHandler(BaseConnectionSendData* sendData, u8 con
 	Logger::convertBufferToHexString(data, sendData->dataLength, stringBuffer, sizeof(stringBuffer));
 	logt("CONN_DATA", "Mesh RX %d,length:%d,deliv:%d,data:%s", (u32)packetHeader->messageType, sendData->dataLength, (u32)sendData->deliveryOption, stringBuffer);
 
+	//Reconnect packets are sent directly and are not part of the writes that are counted for reestablishing
+	if (packetHeader->messageType != MessageType::RECONNECT)
+	{
+		if (duplicateWritesToDrop > 0) {
+			duplicateWritesToDrop--;
+			droppedDuplicateWrites++;
+			SIMSTATCOUNT("reestablishDuplicateDropped");
+			GS->logger.logCustomCount(CustomErrorTypes::COUNT_REESTABLISH_DUPLICATE_DROPPED);
+			logt("CONN", "Dropped duplicate write from partner %u", partnerId);
+			return;
+		}
+		receivedWriteCount++;
+	}
+
 	//This will reassemble the data for us
 	data = ReassembleData(sendData, data);
 
@@ -499,7 +569,8 @@ void MeshConnection::ReceiveMeshMessageHandler(BaseConnectionSendData* sendData,
 		logt("CONN_DATA", "Received type %d,length:%d,deliv:%d,data:%s", (u32)packetHeader->messageType, sendData->dataLength, (u32)sendData->deliveryOption, stringBuffer);
 	}
 
-	if(!handshakeDone() || connectionState == ConnectionState::REESTABLISHING_HANDSHAKE){
+	//The partner might send its last reconnect packet after we have finished the reestablishing handshake
+	if(!handshakeDone() || connectionState == ConnectionState::REESTABLISHING_HANDSHAKE || packetHeader->messageType == MessageType::RECONNECT){
 		ReceiveHandshakePacketHandler(sendData, data);
 	} else {
 		//Dispatch message to node and modules
@@ -596,7 +667,7 @@ void MeshConnection::ReceiveHandshakePacketHandler(BaseConnectionSendData* sendD
 	/*#################### RECONNETING_HANDSHAKE ############################*/
 	if(packetHeader->messageType == MessageType::RECONNECT)
 	{
-		ReceiveReconnectionHandshakePacket((connPacketReconnect const *) data);
+		ReceiveReconnectionHandshakePacket((connPacketReconnect const *) data, sendData->dataLength);
 	}
 
 	/*#################### HANDSHAKE ############################*/
@@ -820,6 +891,9 @@ ErrorType MeshConnection::SendReconnectionHandshakePacketAfterMtuExchange()
 	packet.header.messageType = MessageType::RECONNECT;
 	packet.header.sender = GS->node.configuration.nodeId;
 	packet.header.receiver = partnerId;
+	packet.payload.receivedWrites = receivedWriteCount;
+	//Until the partner has told us which writes it received, this is the last write that we know was delivered
+	packet.payload.resumeWrite = sentWriteCount;
 
 	//TODO: Add a check if the reliable buffer is free?
 
@@ -852,13 +926,28 @@ ErrorType MeshConnection::SendReconnectionHandshakePacketAfterMtuExchange()
 	return ErrorType::SUCCESS;
 }
 
-void MeshConnection::ReceiveReconnectionHandshakePacket(connPacketReconnect const * packet)
+void MeshConnection::ReceiveReconnectionHandshakePacket(connPacketReconnect const * packet, u16 dataLength)
 {
 	logt("HANDSHAKE", "IN <= partner %u RECONNECT", partnerId);
-	if(
-		packet->header.sender == partnerId
-		&& connectionState == ConnectionState::REESTABLISHING_HANDSHAKE
+
+	if (packet->header.sender != partnerId) return;
+
+	//Older firmware does not report its writes and sends all its packets again
+	const bool partnerReportedWrites = dataLength >= SIZEOF_CONN_PACKET_RECONNECT;
+
+	//Each reconnect packet updates where the partner continues sending, no writes from the partner are received inbetween
+	if (
+		partnerReportedWrites
+		&& (connectionState == ConnectionState::REESTABLISHING_HANDSHAKE || connectionState == ConnectionState::HANDSHAKE_DONE)
 	){
+		const i16 duplicateWrites = (i16)(u16)(receivedWriteCount - packet->payload.resumeWrite);
+		duplicateWritesToDrop = duplicateWrites > 0 ? duplicateWrites : 0;
+	}
+
+	if(connectionState == ConnectionState::REESTABLISHING_HANDSHAKE)
+	{
+		ResumeSendQueues(partnerReportedWrites, packet->payload.receivedWrites);
+
 		//Answer the handshake packet
 		ErrorType err = SendReconnectionHandshakePacketAfterMtuExchange();
 
@@ -916,7 +1005,7 @@ void MeshConnection::PrintStatus()
 {
 	const char* directionString = (direction == ConnectionDirection::DIRECTION_IN) ? "IN " : "OUT";
 
-	trace("%s(%d) FM %u, state:%u, cluster:%x(%d), sink:%d, Queue:%u-%u(%u), mb:%u, hnd:%u, tSync:%u, sent:%u, rssi:%d" EOL, directionString, connectionId, this->partnerId, (u32)this->connectionState, this->connectedClusterId, this->connectedClusterSize, this->hopsToSink, (packetSendQueue.readPointer - packetSendQueue.bufferStart), (packetSendQueue.writePointer - packetSendQueue.bufferStart), packetSendQueue._numElements, connectionMasterBit, connectionHandle, (u32)timeSyncState, sentUnreliable, GetAverageRSSI());
+	trace("%s(%d) FM %u, state:%u, cluster:%x(%d), sink:%d, Queue:%u-%u(%u), mb:%u, hnd:%u, tSync:%u, sent:%u, rssi:%d, resendsAvoided:%u, duplicatesDropped:%u" EOL, directionString, connectionId, this->partnerId, (u32)this->connectionState, this->connectedClusterId, this->connectedClusterSize, this->hopsToSink, (packetSendQueue.readPointer - packetSendQueue.bufferStart), (packetSendQueue.writePointer - packetSendQueue.bufferStart), packetSendQueue._numElements, connectionMasterBit, connectionHandle, (u32)timeSyncState, sentUnreliable, GetAverageRSSI(), avoidedResends, droppedDuplicateWrites);
 }
 
 void MeshConnection::setHopsToSink(ClusterSize hops)
@@ -46,6 +46,9 @@ class MeshConnection
 	friend class CherrySim;
 	friend class FruitySimServer;
 	friend class MultiStackFixture_TestSinkDetectionWithSingleSink_Test;
+	friend class TestNode_TestSinkRouteHysteresis_Test;
+	friend class TestNode_TestMultiSinkLoadBalancing_Test;
+	friend class TestNode_TestReconnectionDropsResentWrites_Test;
 #endif
 	friend class ConnectionManager;
 	friend class Node;
@@ -70,6 +73,12 @@ class MeshConnection
 		ClusterSize hopsToSinkBackup;
 		ClusterSize hopsToSink;
 
+		//Sink routing, see ConnectionManager::GetSinkPathCost
+		u8 advertisedSinkPathQueueLoad = 0; //Fullest queue in percent on the partner's path to a sink, reported by the partner
+		u8 advertisedSinkPathRecentDrops = 0; //Packets that were recently dropped on the partner's path to a sink
+		u8 recentDroppedPackets = 0; //Packets that were recently dropped on this connection, halved periodically
+		u16 droppedPacketsAtLastDecay = 0;
+
 		//Timestamp and Clustering messages must be sent immediately and are not queued
 		//Multiple updates can accumulate in this variable
 		//This packet must not be sent during handshakes
@@ -87,6 +96,11 @@ class MeshConnection
 		//Reestablishing
 		bool mustRetryReestablishing = false;
 		u32 reestablishmentStartedDs = 0;
+		u16 payloadSizeBeforeReestablishing = MAX_DATA_SIZE_PER_WRITE; //Split packets can only be continued with the same payload size
+		u16 receivedWriteCount = 0; //Writes received from the partner, counted the same way as the queuedWriteCount of the partner
+		u16 duplicateWritesToDrop = 0; //Writes that the partner sends again after reestablishing although we received them before
+		u16 avoidedResends = 0; //Writes that were not sent again after reestablishing because the partner had received them
+		u16 droppedDuplicateWrites = 0;
 
 #ifdef SIM_ENABLED
 		//Cluster validity checking in the Simulator
@@ -111,7 +125,8 @@ class MeshConnection
 		void ReceiveHandshakePacketHandler(BaseConnectionSendData* sendData, u8 const * data);
 		void SendReconnectionHandshakePacket();
 		ErrorType SendReconnectionHandshakePacketAfterMtuExchange(); //Pay attention as this might disconnect the connection
-		void ReceiveReconnectionHandshakePacket(connPacketReconnect const * packet);
+		void ReceiveReconnectionHandshakePacket(connPacketReconnect const * packet, u16 dataLength);
+		void ResumeSendQueues(bool partnerReportedWrites, u16 partnerReceivedWrites);
 
 		bool SendHandshakeMessage(u8* data, u16 dataLength, bool reliable);
 
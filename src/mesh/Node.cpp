@@ -58,6 +58,10 @@ constexpr u8 NODE_MODULE_CONFIG_VERSION = 2;
 
 //The number of connection attempts to one node before blacklisting this node for some time
 constexpr u8 connectAttemptsBeforeBlacklisting = 5;
+//Connection attempts to a node lower its cluster score for this time
+constexpr u32 recentConnectAttemptTimeDs = SEC_TO_DS(30);
+//Cluster sizes above this value all get the same score so that the score tiers do not overlap
+constexpr ClusterSize maxScoredClusterSize = 999;
 
 // The Service that is used for two nodes to communicate between each other
 // Fruity Mesh Service UUID 310bfe40-ed6b-11e3-a1be-0002a5d5c51b
@@ -334,6 +338,12 @@ void Node::HandshakeDoneHandler(MeshConnection* connection, bool completedAsWinn
 	//the cluster update above, but that requires more debugging to get it correctly working
 	SendClusterInfoUpdate(connection, nullptr);
 
+	//The partner is no longer penalized for the attempts that led to this connection
+	for (int i = 0; i < joinMePackets.length; i++)
+	{
+		if (joinMePackets[i].payload.sender == connection->partnerId) joinMePackets[i].attemptsToConnect = 0;
+	}
+
 	//Call our lovely modules
 	for(u32 i=0; i<GS->amountOfModules; i++){
 		if(GS->activeModules[i]->configurationPointer->moduleActive){
@@ -782,6 +792,19 @@ void Node::MeshMessageReceivedHandler(BaseConnection* connection, BaseConnection
 				}
 
 				logjson("NODE", "{\"type\":\"generate_load_chunk\",\"nodeId\":%d,\"size\":%u,\"payloadCorrect\":%u,\"requestHandle\":%u}" SEP, packetHeader->sender, (u32)payloadLength, (u32)payloadCorrect, (u32)packet->requestHandle);
+				SIMSTATCOUNT("generateLoadChunkReceived");
+			}
+
+			else if (
+				packet->actionType == (u8)NodeModuleTriggerActionMessages::SINK_PATH_LOAD
+				&& connection != nullptr
+				&& connection->connectionType == ConnectionType::FRUITYMESH
+				&& sendData->dataLength >= SIZEOF_CONN_PACKET_MODULE + sizeof(SinkPathLoadMessage)
+			) {
+				SinkPathLoadMessage const * message = (SinkPathLoadMessage const *)packet->data;
+				MeshConnection* meshConnection = (MeshConnection*)connection;
+				meshConnection->advertisedSinkPathQueueLoad = message->queueLoad;
+				meshConnection->advertisedSinkPathRecentDrops = message->recentDrops;
 			}
 			
 
@@ -1590,8 +1613,28 @@ u32 Node::CalculateClusterScoreAsMaster(joinMeBufferPacket& packet) const
 	if(GET_DEVICE_TYPE() == DeviceType::LEAF) return 0;
 
 	//Free in connections are best, free out connections are good as well
-	//TODO: RSSI should be factored into the score as well, maybe battery runtime, device type, etc...
-	u32 score = (u32)(packet.payload.freeMeshInConnections) * 10000 + (u32)(packet.payload.freeMeshOutConnections) * 100 + rssiScore;
+	if (GS->config.useLegacyClusterScore)
+	{
+		return ModifyScoreBasedOnPreferredPartners((u32)(packet.payload.freeMeshInConnections) * 10000 + (u32)(packet.payload.freeMeshOutConnections) * 100 + rssiScore, packet.payload.sender);
+	}
+
+	//Every merge removes one cluster, so we prefer the merges that are most likely to succeed at the first attempt.
+	//A cluster that acked us waits for our connection and will not merge with anybody else in the meantime.
+	//Otherwise, the biggest cluster is merged first so that the remaining small clusters see one big cluster
+	//instead of several medium sized ones that merge in sequence. Free connections and the RSSI decide between similar clusters.
+	//TestClustering.TestConvergenceTime_scheduled compares this with the legacy score
+	const ClusterSize scoredClusterSize = packet.payload.clusterSize < maxScoredClusterSize ? packet.payload.clusterSize : maxScoredClusterSize;
+	u32 score = (packet.payload.ackField == this->clusterId ? 1000000000UL : 0)
+		+ (u32)scoredClusterSize * 1000000UL
+		+ (u32)(packet.payload.freeMeshInConnections) * 10000
+		+ (u32)(packet.payload.freeMeshOutConnections) * 100
+		+ rssiScore;
+
+	//Each recent attempt that did not lead to a connection halves the score so that other clusters are tried first
+	if (packet.lastConnectAttemptDs != 0 && GS->appTimerDs - packet.lastConnectAttemptDs < recentConnectAttemptTimeDs)
+	{
+		score >>= packet.attemptsToConnect < 8 ? packet.attemptsToConnect : 8;
+	}
 
 	return ModifyScoreBasedOnPreferredPartners(score, packet.payload.sender);
 }
@@ -1617,7 +1660,17 @@ u32 Node::CalculateClusterScoreAsSlave(joinMeBufferPacket& packet) const
 	u32 rssiScore = 100 + packet.rssi;
 
 	//Choose the one with the biggest cluster size, if there are more, prefer the most outConnections
-	u32 score = (u32)(packet.payload.clusterSize) * 10000 + (u32)(packet.payload.freeMeshOutConnections) * 100 + rssiScore;
+	if (GS->config.useLegacyClusterScore)
+	{
+		return ModifyScoreBasedOnPreferredPartners((u32)(packet.payload.clusterSize) * 10000 + (u32)(packet.payload.freeMeshOutConnections) * 100 + rssiScore, packet.payload.sender);
+	}
+
+	//A cluster without a free out connection can only connect to us after freeing one, so all others are preferred
+	const ClusterSize scoredClusterSize = packet.payload.clusterSize < maxScoredClusterSize ? packet.payload.clusterSize : maxScoredClusterSize;
+	u32 score = (packet.payload.freeMeshOutConnections > 0 ? 1000000000UL : 0)
+		+ (u32)scoredClusterSize * 1000000UL
+		+ (u32)(packet.payload.freeMeshOutConnections) * 100
+		+ rssiScore;
 
 	return ModifyScoreBasedOnPreferredPartners(score, packet.payload.sender);
 }
@@ -1684,75 +1737,62 @@ void Node::GapAdvertisementMessageHandler(const FruityHal::GapAdvertisementRepor
 
 joinMeBufferPacket* Node::findTargetBuffer(const advPacketJoinMeV0* packet)
 {
-	joinMeBufferPacket* targetBuffer = nullptr;
+	joinMeBufferPacket* emptyBuffer = nullptr;
+	joinMeBufferPacket* oldestOwnClusterBuffer = nullptr;
+	joinMeBufferPacket* worstBuffer = nullptr;
+	u32 worstScore = UINT32_MAX;
 
-	//First, look if a packet from this node is already in the buffer, if yes, we use this space
+	//All candidates are determined in a single pass over the buffer
 	for (int i = 0; i < joinMePackets.length; i++)
 	{
-		targetBuffer = &joinMePackets[i];
+		joinMeBufferPacket* tmpPacket = &joinMePackets[i];
 
-		if (packet->payload.sender == targetBuffer->payload.sender)
+		//If a packet from this node is already in the buffer, we use this space
+		if (packet->payload.sender == tmpPacket->payload.sender)
 		{
 			logt("DISCOVERY", "Updated old buffer packet");
-			return targetBuffer;
+			return tmpPacket;
 		}
-	}
-	targetBuffer = nullptr;
-
-	//Next, we look if there's an empty space
-	for (int i = 0; i < joinMePackets.length; i++)
-	{
-		targetBuffer = &(joinMePackets[i]);
 
-		if(targetBuffer->payload.sender == 0)
+		if (tmpPacket->payload.sender == 0)
 		{
-			logt("DISCOVERY", "Used empty space");
-			KeepHighDiscoveryActive();
-			return targetBuffer;
+			if (emptyBuffer == nullptr) emptyBuffer = tmpPacket;
 		}
-	}
-	targetBuffer = nullptr;
-
-	//Next, we can overwrite the oldest packet that we saved from our own cluster
-	u32 oldestTimestamp = UINT32_MAX;
-	for (int i = 0; i < joinMePackets.length; i++)
-	{
-		joinMeBufferPacket* tmpPacket = &joinMePackets[i];
-
-		if(tmpPacket->payload.clusterId == clusterId && tmpPacket->receivedTimeDs < oldestTimestamp){
-			oldestTimestamp = tmpPacket->receivedTimeDs;
-			targetBuffer = tmpPacket;
+		else if (tmpPacket->payload.clusterId == clusterId)
+		{
+			if (oldestOwnClusterBuffer == nullptr || tmpPacket->receivedTimeDs < oldestOwnClusterBuffer->receivedTimeDs) oldestOwnClusterBuffer = tmpPacket;
+		}
+		else
+		{
+			//A packet is only worth keeping if we could connect to its cluster in either direction
+			const u32 masterScore = CalculateClusterScoreAsMaster(*tmpPacket);
+			const u32 slaveScore = CalculateClusterScoreAsSlave(*tmpPacket);
+			const u32 score = masterScore > slaveScore ? masterScore : slaveScore;
+			if (worstBuffer == nullptr || score < worstScore)
+			{
+				worstScore = score;
+				worstBuffer = tmpPacket;
+			}
 		}
 	}
 
-	if(targetBuffer != nullptr){
-		logt("DISCOVERY", "Overwrote one from our own cluster");
-		return targetBuffer;
+	if (emptyBuffer != nullptr)
+	{
+		logt("DISCOVERY", "Used empty space");
+		KeepHighDiscoveryActive();
+		return emptyBuffer;
 	}
 
-	//If there's still no space, we overwrite the oldest packet that we received, this will not fail
-	//TODO: maybe do not use oldest one but worst candidate?? Use clusterScore on all packets to find the least interesting
-	u32 minScore = UINT32_MAX;
-	for (int i = 0; i < joinMePackets.length; i++)
+	//Next, we can overwrite the oldest packet that we saved from our own cluster
+	if (oldestOwnClusterBuffer != nullptr)
 	{
-		joinMeBufferPacket* tmpPacket = &joinMePackets[i];
-
-		u32 score = 0;
-		if (packet->payload.clusterSize >= clusterSize) {
-			score = CalculateClusterScoreAsMaster(*tmpPacket);
-		}
-		else {
-			score = CalculateClusterScoreAsSlave(*tmpPacket);
-		}
-
-		if(score < minScore){
-			minScore = score;
-			targetBuffer = tmpPacket;
-		}
+		logt("DISCOVERY", "Overwrote one from our own cluster");
+		return oldestOwnClusterBuffer;
 	}
 
+	//If there's still no space, we overwrite the least interesting packet from a different cluster, this will not fail
 	logt("DISCOVERY", "Overwrote worst packet from different cluster");
-	return targetBuffer;
+	return worstBuffer;
 }
 
 /*
@@ -1771,6 +1811,10 @@ void Node::ChangeState(DiscoveryState newState)
 
 	currentDiscoveryState = newState;
 
+	//Every state change starts without a backoff
+	discoveryBackoffLevel = 0;
+	discoveryBackoffTimeDs = 0;
+
 	if (newState == DiscoveryState::HIGH)
 	{
 		logt("STATES", "-- DISCOVERY HIGH --");
@@ -1788,7 +1832,7 @@ void Node::ChangeState(DiscoveryState newState)
 			GS->advertisingController.RefreshJob(meshAdvJobHandle);
 		}
 
-		GS->scanController.UpdateJobPointer(&p_scanJob, ScanState::HIGH, ScanJobState::ACTIVE);
+		GS->scanController.UpdateJobPointer(&p_scanJob, ScanState::HIGH, ScanJobState::ACTIVE, ModuleId::NODE);
 	}
 	else if (newState == DiscoveryState::LOW)
 	{
@@ -1805,6 +1849,7 @@ void Node::ChangeState(DiscoveryState newState)
 		ScanJob scanJob = ScanJob();
 		scanJob.type = ScanState::LOW;
 		scanJob.state = ScanJobState::ACTIVE;
+		scanJob.owner = ModuleId::NODE;
 		GS->scanController.RemoveJob(p_scanJob);
 		p_scanJob = nullptr;
 
@@ -1824,6 +1869,32 @@ void Node::ChangeState(DiscoveryState newState)
 	}
 }
 
+//Doubles the low discovery intervals for each backoff level, limited to the maximum that is allowed for advertising and scanning
+//The MeshAccess advertising is not backed off as it is used by gateways and apps that need to find the node independently of the mesh topology
+void Node::ApplyDiscoveryBackoff()
+{
+	constexpr u32 maxBackoffInterval = MSEC_TO_UNITS(10240, UNIT_0_625_MS);
+
+	logt("STATES", "-- DISCOVERY LOW backoff %u --", discoveryBackoffLevel);
+
+	if (meshAdvJobHandle != nullptr) {
+		const u32 advertisingInterval = (u32)Conf::meshAdvertisingIntervalLow << discoveryBackoffLevel;
+		meshAdvJobHandle->advertisingInterval = (u16)(advertisingInterval > maxBackoffInterval ? maxBackoffInterval : advertisingInterval);
+		GS->advertisingController.RefreshJob(meshAdvJobHandle);
+	}
+
+	const u32 scanInterval = (u32)Conf::getInstance().meshScanIntervalLow << discoveryBackoffLevel;
+	ScanJob scanJob = ScanJob();
+	scanJob.type = ScanState::CUSTOM;
+	scanJob.state = ScanJobState::ACTIVE;
+	scanJob.timeMode = ScanJobTimeMode::ENDLESS;
+	scanJob.interval = (u16)(scanInterval > maxBackoffInterval ? maxBackoffInterval : scanInterval);
+	scanJob.window = Conf::getInstance().meshScanWindowLow;
+	scanJob.owner = ModuleId::NODE;
+	GS->scanController.RemoveJob(p_scanJob);
+	p_scanJob = GS->scanController.AddJob(scanJob);
+}
+
 void Node::DisableStateMachine(bool disable)
 {
 	stateMachineDisabled = disable;
@@ -1840,6 +1911,25 @@ void Node::TimerEventHandler(u16 passedTimeDs)
 		ChangeState(nextDiscoveryState);
 	}
 
+	//The longer the topology stays unchanged in low discovery, the less often we advertise and scan
+	//Any change in the topology will switch back to high discovery through KeepHighDiscoveryActive
+	//The level is clamped so that the shifted intervals always fit
+	const u8 maxDiscoveryBackoffLevel = Conf::getInstance().maxDiscoveryBackoffLevel < MAX_DISCOVERY_BACKOFF_LEVEL ? Conf::getInstance().maxDiscoveryBackoffLevel : MAX_DISCOVERY_BACKOFF_LEVEL;
+	if (
+		currentDiscoveryState == DiscoveryState::LOW
+		&& Conf::getInstance().discoveryBackoffStepTimeSec != 0
+		&& discoveryBackoffLevel < maxDiscoveryBackoffLevel
+	) {
+		discoveryBackoffTimeDs += passedTimeDs;
+		//Shifting the passed time instead of the step time cannot overflow
+		if ((discoveryBackoffTimeDs >> discoveryBackoffLevel) >= SEC_TO_DS((u32)Conf::getInstance().discoveryBackoffStepTimeSec))
+		{
+			discoveryBackoffTimeDs = 0;
+			discoveryBackoffLevel++;
+			ApplyDiscoveryBackoff();
+		}
+	}
+
 	if (DoesBiggerKnownClusterExist())
 	{
 		const u32 emergencyDisconnectTimerBackupDs = emergencyDisconnectTimerDs;
@@ -2040,7 +2130,48 @@ void Node::TimerEventHandler(u16 passedTimeDs)
 		}
 	}
 
+	if (GS->config.enableSinkRouting && SHOULD_IV_TRIGGER(GS->appTimerDs, passedTimeDs, GS->config.sinkLoadReportIntervalDs))
+	{
+		SendSinkPathLoadReports();
+	}
+}
+
+//Tells every partner how loaded our path to a sink is. The path through the partner itself is excluded
+//as the partner would otherwise see its own load reflected back.
+void Node::SendSinkPathLoadReports() const
+{
+	MeshConnections conns = GS->cm.GetMeshConnections(ConnectionDirection::INVALID);
+	for (u32 i = 0; i < conns.count; i++)
+	{
+		MeshConnection* conn = conns.connections[i];
+		if (!conn->handshakeDone()) continue;
+
+		SinkPathLoadMessage message;
+		if (!GS->cm.GetSinkPathLoad(conn, &message.queueLoad, &message.recentDrops)) continue;
+
+		DYNAMIC_ARRAY(buffer, SIZEOF_CONN_PACKET_MODULE + sizeof(SinkPathLoadMessage));
+		CheckedMemset(buffer, 0, SIZEOF_CONN_PACKET_MODULE + sizeof(SinkPathLoadMessage));
+
+		connPacketModule* outPacket = (connPacketModule*)buffer;
+		outPacket->header.messageType = MessageType::MODULE_TRIGGER_ACTION;
+		outPacket->header.sender = configuration.nodeId;
+		outPacket->header.receiver = NODE_ID_HOPS_BASE + 1;
+		outPacket->moduleId = ModuleId::NODE;
+		outPacket->actionType = (u8)NodeModuleTriggerActionMessages::SINK_PATH_LOAD;
+		CheckedMemcpy(outPacket->data, &message, sizeof(SinkPathLoadMessage));
+
+		//The report must get through even if the normal queue is congested, that is what it is about
+		conn->SendData(buffer, SIZEOF_CONN_PACKET_MODULE + sizeof(SinkPathLoadMessage), DeliveryPriority::MESH_INTERNAL_HIGH, false);
+	}
+}
+
+#if IS_ACTIVE(BUTTONS)
+void Node::ButtonHandler(u8 buttonId, u32 holdTimeDs)
+{
+	//Somebody is interacting with the node, e.g. to enroll it, so it should be found quickly
+	KeepHighDiscoveryActive();
 }
+#endif
 
 void Node::KeepHighDiscoveryActive()
 {
@@ -216,6 +216,14 @@ struct EmergencyDisconnectResponseMessage
 	EmergencyDisconnectErrorCode code;
 };
 STATIC_ASSERT_SIZE(EmergencyDisconnectResponseMessage, 1);
+
+//Sent to the direct partners to report the load on the path that our node uses to reach a sink
+struct SinkPathLoadMessage
+{
+	u8 queueLoad; //Fullest queue on the path in percent
+	u8 recentDrops; //Packets that were recently dropped on the path
+};
+STATIC_ASSERT_SIZE(SinkPathLoadMessage, 2);
 #pragma pack(pop)
 
 typedef struct
@@ -267,6 +275,7 @@ private:
 			START_GENERATE_LOAD       = 4,
 			GENERATE_LOAD_CHUNK       = 5,
 			EMERGENCY_DISCONNECT      = 6,
+			SINK_PATH_LOAD            = 7,
 		};
 
 		enum class NodeModuleActionResponseMessages : u8
@@ -350,6 +359,11 @@ private:
 
 		//Timers for state changing
 		i32 currentStateTimeoutDs = 0;
+
+		//The low discovery intervals are doubled for each backoff level
+		static constexpr u8 MAX_DISCOVERY_BACKOFF_LEVEL = 15;
+		u8 discoveryBackoffLevel = 0;
+		u32 discoveryBackoffTimeDs = 0; //Time since the last backoff step
 		u32 lastDecisionTimeDs = 0;
 
 		u8 noNodesFoundCounter = 0; //Incremented every time that no interesting cluster packets are found
@@ -432,6 +446,9 @@ private:
 		void DisableStateMachine(bool disable); //Disables the ChangeState function and does therefore kill all automatic mesh functionality
 
 		void KeepHighDiscoveryActive();
+		void ApplyDiscoveryBackoff();
+
+		void SendSinkPathLoadReports() const;
 
 		//Connection handlers
 		//Message handlers
@@ -441,6 +458,10 @@ private:
 		//Timers
 		void TimerEventHandler(u16 passedTimeDs) override;
 
+#if IS_ACTIVE(BUTTONS)
+		void ButtonHandler(u8 buttonId, u32 holdTimeDs) override;
+#endif
+
 		//Helpers
 		ClusterId GenerateClusterID(void) const;
 
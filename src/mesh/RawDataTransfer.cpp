@@ -0,0 +1,619 @@
+////////////////////////////////////////////////////////////////////////////////
+// /****************************************************************************
+// **
+// ** Copyright (C) 2015-2020 M-Way Solutions GmbH
+// ** Contact: https://www.blureange.io/licensing
+// **
+// ** This file is part of the Bluerange/FruityMesh implementation
+// **
+// ** $BR_BEGIN_LICENSE:GPL-EXCEPT$
+// ** Commercial License Usage
+// ** Licensees holding valid commercial Bluerange licenses may use this file in
+// ** accordance with the commercial license agreement provided with the
+// ** Software or, alternatively, in accordance with the terms contained in
+// ** a written agreement between them and M-Way Solutions GmbH.
+// ** For licensing terms and conditions see https://www.bluerange.io/terms-conditions. For further
+// ** information use the contact form at https://www.bluerange.io/contact.
+// **
+// ** GNU General Public License Usage
+// ** Alternatively, this file may be used under the terms of the GNU
+// ** General Public License version 3 as published by the Free Software
+// ** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+// ** included in the packaging of this file. Please review the following
+// ** information to ensure the GNU General Public License requirements will
+// ** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+// **
+// ** $BR_END_LICENSE$
+// **
+// ****************************************************************************/
+////////////////////////////////////////////////////////////////////////////////
+#include <RawDataTransfer.h>
+#include <GlobalState.h>
+#include <Node.h>
+#include <Logger.h>
+#include <Utility.h>
+
+static void SendRawDataError(NodeId receiver, ModuleId moduleId, u8 requestHandle, RawDataErrorType type)
+{
+	RawDataError packet;
+	CheckedMemset(&packet, 0, sizeof(packet));
+	packet.header.connHeader.messageType = MessageType::MODULE_RAW_DATA;
+	packet.header.connHeader.sender = GS->node.configuration.nodeId;
+	packet.header.connHeader.receiver = receiver;
+	packet.header.moduleId = moduleId;
+	packet.header.requestHandle = requestHandle;
+	packet.header.actionType = RawDataActionType::ERROR_T;
+	packet.type = type;
+	packet.destination = RawDataErrorDestination::BOTH;
+
+	GS->cm.SendMeshMessage((u8*)&packet, sizeof(packet), DeliveryPriority::LOW);
+}
+
+RawDataTransfer & RawDataTransfer::getInstance()
+{
+	return GS->rawDataTransfer;
+}
+
+ErrorType RawDataTransfer::StartTransfer(ModuleId owner, NodeId receiver, ModuleId moduleId, RawDataProtocol protocol, u8 requestHandle, u8 const * data, u32 dataLength)
+{
+	if (data == nullptr || dataLength == 0) return ErrorType::INVALID_LENGTH;
+
+	const u32 numChunks = (dataLength + MAX_RAW_CHUNK_SIZE - 1) / MAX_RAW_CHUNK_SIZE;
+	if (numChunks > 0xFFFFFF) return ErrorType::DATA_SIZE; //The chunkId only has 24 bits
+
+	if (
+		   !(receiver >= NODE_ID_DEVICE_BASE && receiver < NODE_ID_DEVICE_BASE + NODE_ID_DEVICE_BASE_SIZE)
+		&& !(receiver >= NODE_ID_GLOBAL_DEVICE_BASE && receiver < NODE_ID_GLOBAL_DEVICE_BASE + NODE_ID_GLOBAL_DEVICE_BASE_SIZE)
+		&& receiver != NODE_ID_SHORTEST_SINK
+	) {
+		return ErrorType::INVALID_PARAM;
+	}
+
+	if (FindTransfer(receiver, moduleId, requestHandle) != nullptr) return ErrorType::BUSY;
+
+	Transfer* transfer = nullptr;
+	for (u32 i = 0; i < MAX_TRANSFERS; i++) {
+		if (transfers[i].state == TransferState::UNUSED) {
+			transfer = &transfers[i];
+			break;
+		}
+	}
+	if (transfer == nullptr) return ErrorType::BUSY;
+
+	*transfer = Transfer();
+	transfer->state = TransferState::STARTING;
+	transfer->owner = owner;
+	transfer->receiver = receiver;
+	transfer->moduleId = moduleId;
+	transfer->requestHandle = requestHandle;
+	transfer->protocol = protocol;
+	transfer->data = data;
+	transfer->dataLength = dataLength;
+	transfer->numChunks = numChunks;
+	transfer->lastChunkId = numChunks;
+	transfer->timeoutDs = ANSWER_TIMEOUT_DS;
+	transfer->startTimeDs = GS->appTimerDs;
+
+	startedTransfers++;
+
+	logt("RAWDATA", "Starting transfer of %u bytes in %u chunks to %u", dataLength, numChunks, receiver);
+
+	SendStart(*transfer);
+
+	return ErrorType::SUCCESS;
+}
+
+void RawDataTransfer::SendStart(const Transfer& transfer) const
+{
+	RawDataStart packet;
+	CheckedMemset(&packet, 0, sizeof(packet));
+	packet.header.connHeader.messageType = MessageType::MODULE_RAW_DATA;
+	packet.header.connHeader.sender = GS->node.configuration.nodeId;
+	packet.header.connHeader.receiver = transfer.receiver;
+	packet.header.moduleId = transfer.moduleId;
+	packet.header.requestHandle = transfer.requestHandle;
+	packet.header.actionType = RawDataActionType::START;
+	packet.numChunks = transfer.numChunks;
+	packet.protocolId = (u32)transfer.protocol;
+	packet.fmKeyId = (u32)FmKeyId::ZERO;
+
+	GS->cm.SendMeshMessage((u8*)&packet, sizeof(packet), DeliveryPriority::LOW);
+}
+
+//Chunks are only handed to the mesh while the send queue towards the receiver holds less packets than the
+//window. A full queue would drop them right away and we would only learn about that from the raw_data_report.
+void RawDataTransfer::SendChunks(Transfer& transfer)
+{
+	while (transfer.state == TransferState::SENDING && GetQueuedMeshPackets(transfer.receiver) < transfer.window)
+	{
+		u32 chunkId;
+		if (transfer.nextMissingChunk < transfer.numMissingChunks)
+		{
+			chunkId = transfer.missingChunkIds[transfer.nextMissingChunk];
+			transfer.nextMissingChunk++;
+			transfer.retransmittedChunks++;
+			retransmittedChunks++;
+			GS->logger.logCustomCount(CustomErrorTypes::COUNT_RAW_DATA_CHUNK_RETRANSMITTED);
+		}
+		else
+		{
+			chunkId = transfer.nextChunkId;
+			transfer.nextChunkId++;
+		}
+
+		//Changed before sending as the report of a receiver on this node is dispatched immediately
+		if (transfer.nextMissingChunk >= transfer.numMissingChunks && transfer.nextChunkId > transfer.numChunks)
+		{
+			transfer.state = TransferState::WAITING_FOR_REPORT;
+			transfer.timeoutDs = ANSWER_TIMEOUT_DS;
+		}
+
+		SendChunk(transfer, chunkId);
+	}
+}
+
+void RawDataTransfer::SendChunk(Transfer& transfer, u32 chunkId)
+{
+	alignas(RawDataChunk) u8 buffer[sizeof(RawDataChunk) - 1 + MAX_RAW_CHUNK_SIZE];
+	CheckedMemset(buffer, 0, sizeof(buffer));
+	RawDataChunk* packet = (RawDataChunk*)buffer;
+	packet->header.connHeader.messageType = MessageType::MODULE_RAW_DATA;
+	packet->header.connHeader.sender = GS->node.configuration.nodeId;
+	packet->header.connHeader.receiver = transfer.receiver;
+	packet->header.moduleId = transfer.moduleId;
+	packet->header.requestHandle = transfer.requestHandle;
+	packet->header.actionType = RawDataActionType::CHUNK;
+	packet->chunkId = chunkId;
+
+	const u32 offset = (chunkId - 1) * MAX_RAW_CHUNK_SIZE;
+	const u32 payloadLength = transfer.dataLength - offset < (u32)MAX_RAW_CHUNK_SIZE ? transfer.dataLength - offset : (u32)MAX_RAW_CHUNK_SIZE;
+	CheckedMemcpy(packet->payload, transfer.data + offset, payloadLength);
+
+	transfer.sentChunks++;
+	sentChunks++;
+
+	//Additive increase, the window grows by one chunk for every window of chunks that was sent. The receiver
+	//only confirms chunks at the end of a round, so a sent chunk stands in for a confirmed one.
+	transfer.chunksSinceWindowChange++;
+	if (transfer.chunksSinceWindowChange >= transfer.window && transfer.window < MAX_WINDOW)
+	{
+		transfer.window++;
+		transfer.chunksSinceWindowChange = 0;
+	}
+
+	GS->cm.SendMeshMessage(buffer, sizeof(RawDataChunk) - 1 + payloadLength, DeliveryPriority::LOW);
+}
+
+void RawDataTransfer::FinishTransfer(Transfer& transfer, RawDataTransferResult result)
+{
+	const RawDataTransferStatistics statistics = GetStatistics(transfer);
+	const ModuleId owner = transfer.owner;
+	const NodeId receiver = transfer.receiver;
+	const u8 requestHandle = transfer.requestHandle;
+
+	if (result == RawDataTransferResult::SUCCESS)
+	{
+		completedTransfers++;
+	}
+	else
+	{
+		failedTransfers++;
+		GS->logger.logCustomError(CustomErrorTypes::WARN_RAW_DATA_TRANSFER_FAILED, receiver);
+
+		//Lets the receiver close the transmission before its own timeout
+		if (result == RawDataTransferResult::NO_ANSWER) SendRawDataError(receiver, transfer.moduleId, requestHandle, RawDataErrorType::UNEXPECTED_END_OF_TRANSMISSION);
+	}
+
+	logjson("DEBUG",
+		"{"
+			"\"nodeId\":%u,"
+			"\"type\":\"raw_data_transfer_result\","
+			"\"receiver\":%u,"
+			"\"module\":%u,"
+			"\"result\":%u,"
+			"\"bytes\":%u,"
+			"\"sentChunks\":%u,"
+			"\"retransmittedChunks\":%u,"
+			"\"durationDs\":%u,"
+			"\"bytesPerSecond\":%u,"
+			"\"requestHandle\":%u"
+		"}" SEP,
+		GS->node.configuration.nodeId,
+		receiver,
+		(u32)transfer.moduleId,
+		(u32)result,
+		statistics.dataLength,
+		statistics.sentChunks,
+		statistics.retransmittedChunks,
+		statistics.durationDs,
+		statistics.bytesPerSecond,
+		requestHandle
+	);
+
+	//Released before the handler is called so that the owner can start its next transfer from there
+	transfer.state = TransferState::UNUSED;
+
+	Module* module = GS->node.GetModuleById(owner);
+	if (module != nullptr)
+	{
+		module->RawDataTransferCompletedHandler(receiver, requestHandle, result, statistics);
+	}
+}
+
+RawDataTransferStatistics RawDataTransfer::GetStatistics(const Transfer& transfer) const
+{
+	RawDataTransferStatistics statistics;
+	statistics.dataLength = transfer.dataLength;
+	statistics.numChunks = transfer.numChunks;
+	statistics.sentChunks = transfer.sentChunks;
+	statistics.retransmittedChunks = transfer.retransmittedChunks;
+	statistics.durationDs = GS->appTimerDs - transfer.startTimeDs;
+
+	const u32 sentBytes = (transfer.nextChunkId - 1) * MAX_RAW_CHUNK_SIZE < transfer.dataLength ? (transfer.nextChunkId - 1) * MAX_RAW_CHUNK_SIZE : transfer.dataLength;
+	statistics.bytesPerSecond = statistics.durationDs == 0 ? sentBytes * 10 : sentBytes * 10 / statistics.durationDs;
+
+	return statistics;
+}
+
+RawDataTransfer::Transfer* RawDataTransfer::FindTransfer(NodeId receiver, ModuleId moduleId, u8 requestHandle)
+{
+	for (u32 i = 0; i < MAX_TRANSFERS; i++) {
+		if (
+			   transfers[i].state != TransferState::UNUSED
+			&& transfers[i].receiver == receiver
+			&& transfers[i].moduleId == moduleId
+			&& transfers[i].requestHandle == requestHandle
+		) {
+			return &transfers[i];
+		}
+	}
+	return nullptr;
+}
+
+void RawDataTransfer::MeshMessageReceivedHandler(BaseConnectionSendData* sendData, connPacketHeader const * packet)
+{
+	if (packet->messageType != MessageType::MODULE_RAW_DATA || sendData->dataLength < sizeof(RawDataHeader)) return;
+
+	RawDataHeader const * header = (RawDataHeader const *)packet;
+	const NodeId sender = header->connHeader.sender;
+
+	//Only transmissions that are addressed to us are answered, not those to a broadcast or group
+	const bool answerTransmission =
+		   GS->config.enableRawDataReceiver
+		&& (header->connHeader.receiver == GS->node.configuration.nodeId || header->connHeader.receiver == NODE_ID_SHORTEST_SINK);
+
+	if (header->actionType == RawDataActionType::START_RECEIVED && sendData->dataLength >= sizeof(RawDataStartReceived))
+	{
+		StartReceivedHandler(sender, header->moduleId, header->requestHandle);
+	}
+	else if (header->actionType == RawDataActionType::REPORT && sendData->dataLength >= sizeof(RawDataReport))
+	{
+		u32 missings[MAX_REPORTED_MISSINGS];
+		CheckedMemcpy(missings, ((RawDataReport const *)packet)->missings, sizeof(missings));
+		ReportReceivedHandler(sender, header->moduleId, header->requestHandle, missings);
+	}
+	else if (header->actionType == RawDataActionType::ERROR_T && sendData->dataLength >= sizeof(RawDataError))
+	{
+		ErrorReceivedHandler(sender, header->moduleId, header->requestHandle);
+	}
+	else if (answerTransmission && header->actionType == RawDataActionType::START && sendData->dataLength >= sizeof(RawDataStart))
+	{
+		StartMessageReceivedHandler(sender, header->moduleId, header->requestHandle, ((RawDataStart const *)packet)->numChunks);
+	}
+	else if (answerTransmission && header->actionType == RawDataActionType::CHUNK && sendData->dataLength >= sizeof(RawDataChunk))
+	{
+		ChunkReceivedHandler(sender, header->moduleId, header->requestHandle, ((RawDataChunk const *)packet)->chunkId);
+	}
+}
+
+void RawDataTransfer::StartReceivedHandler(NodeId sender, ModuleId moduleId, u8 requestHandle)
+{
+	Transfer* transfer = FindTransfer(sender, moduleId, requestHandle);
+
+	//All chunks of a transfer to the shortest sink go to the sink that answered first
+	if (transfer == nullptr)
+	{
+		transfer = FindTransfer(NODE_ID_SHORTEST_SINK, moduleId, requestHandle);
+		if (transfer == nullptr || transfer->state != TransferState::STARTING) return;
+		transfer->receiver = sender;
+	}
+	if (transfer->state != TransferState::STARTING) return;
+
+	logt("RAWDATA", "Transfer to %u started", sender);
+
+	transfer->state = TransferState::SENDING;
+	transfer->retries = 0;
+	SendChunks(*transfer);
+}
+
+void RawDataTransfer::ReportReceivedHandler(NodeId sender, ModuleId moduleId, u8 requestHandle, u32 const * missings)
+{
+	Transfer* transfer = FindTransfer(sender, moduleId, requestHandle);
+	if (transfer == nullptr || transfer->state != TransferState::WAITING_FOR_REPORT) return;
+
+	transfer->retries = 0;
+	transfer->numMissingChunks = 0;
+	transfer->nextMissingChunk = 0;
+	for (u32 i = 0; i < MAX_REPORTED_MISSINGS; i++) {
+		if (missings[i] != 0 && missings[i] <= transfer->numChunks) {
+			transfer->missingChunkIds[transfer->numMissingChunks] = missings[i];
+			transfer->numMissingChunks++;
+		}
+	}
+
+	if (transfer->numMissingChunks == 0)
+	{
+		logt("RAWDATA", "Transfer to %u complete", sender);
+		FinishTransfer(*transfer, RawDataTransferResult::SUCCESS);
+		return;
+	}
+
+	logt("RAWDATA", "%u chunks missing at %u", transfer->numMissingChunks, sender);
+
+	//Multiplicative decrease, something on the path could not keep up with our chunks
+	transfer->window = transfer->window / 2 > 0 ? transfer->window / 2 : 1;
+	transfer->chunksSinceWindowChange = 0;
+
+	//The last chunk of the report is answered with the next report
+	transfer->lastChunkId = transfer->missingChunkIds[transfer->numMissingChunks - 1];
+	transfer->state = TransferState::SENDING;
+
+	Module* module = GS->node.GetModuleById(transfer->owner);
+	if (module != nullptr)
+	{
+		module->RawDataTransferProgressHandler(transfer->receiver, transfer->requestHandle, GetStatistics(*transfer));
+	}
+
+	SendChunks(*transfer);
+}
+
+void RawDataTransfer::ErrorReceivedHandler(NodeId sender, ModuleId moduleId, u8 requestHandle)
+{
+	//Errors can be sent by any node on the path, so only the module and the requestHandle must match
+	for (u32 i = 0; i < MAX_TRANSFERS; i++) {
+		if (
+			   transfers[i].state != TransferState::UNUSED
+			&& transfers[i].moduleId == moduleId
+			&& transfers[i].requestHandle == requestHandle
+		) {
+			logt("RAWDATA", "Transfer to %u aborted by %u", transfers[i].receiver, sender);
+			FinishTransfer(transfers[i], RawDataTransferResult::ABORTED);
+		}
+	}
+
+	ReceiveState* state = FindReceiveState(sender, moduleId, requestHandle);
+	if (state != nullptr) state->sender = NODE_ID_INVALID;
+}
+
+void RawDataTransfer::StartMessageReceivedHandler(NodeId sender, ModuleId moduleId, u8 requestHandle, u32 numChunks)
+{
+	if (numChunks == 0 || numChunks > MAX_RECEIVE_CHUNKS)
+	{
+		logt("RAWDATA", "Not answering transmission of %u chunks", numChunks);
+		return;
+	}
+
+	ReceiveState* state = FindReceiveState(sender, moduleId, requestHandle);
+
+	//Our raw_data_start_received was probably lost
+	if (state != nullptr && !state->hasReceivedChunks && state->numChunks == numChunks)
+	{
+		state->lastActivityDs = GS->appTimerDs;
+		SendStartReceived(*state);
+		return;
+	}
+
+	if (state == nullptr)
+	{
+		for (u32 i = 0; i < MAX_RECEIVE_TRANSFERS; i++) {
+			if (receiveStates[i].sender == NODE_ID_INVALID) {
+				state = &receiveStates[i];
+				break;
+			}
+		}
+		//The sender repeats its start, we might have a free state once another transmission timed out
+		if (state == nullptr) return;
+	}
+
+	*state = ReceiveState();
+	state->sender = sender;
+	state->moduleId = moduleId;
+	state->requestHandle = requestHandle;
+	state->numChunks = (u16)numChunks;
+	state->lastChunkId = (u16)numChunks;
+	state->lastActivityDs = GS->appTimerDs;
+
+	SendStartReceived(*state);
+}
+
+void RawDataTransfer::ChunkReceivedHandler(NodeId sender, ModuleId moduleId, u8 requestHandle, u32 chunkId)
+{
+	ReceiveState* state = FindReceiveState(sender, moduleId, requestHandle);
+	if (state == nullptr || chunkId == 0 || chunkId > state->numChunks) return;
+
+	state->lastActivityDs = GS->appTimerDs;
+	state->hasReceivedChunks = true;
+
+	//Only once the sender continues with another chunk do we know that it received our last report,
+	//until then, it might send the last chunk again to ask for the report
+	if (state->nextLastChunkId != 0 && chunkId != state->lastChunkId)
+	{
+		state->lastChunkId = state->nextLastChunkId;
+		state->nextLastChunkId = 0;
+	}
+
+	const u32 index = chunkId - 1;
+	if (state->received[index / 32] & (1UL << (index % 32)))
+	{
+		duplicateChunks++;
+	}
+	else
+	{
+		state->received[index / 32] |= 1UL << (index % 32);
+		receivedChunks++;
+	}
+
+	if (chunkId == state->lastChunkId) SendReport(*state);
+}
+
+RawDataTransfer::ReceiveState* RawDataTransfer::FindReceiveState(NodeId sender, ModuleId moduleId, u8 requestHandle)
+{
+	for (u32 i = 0; i < MAX_RECEIVE_TRANSFERS; i++) {
+		if (
+			   receiveStates[i].sender == sender
+			&& receiveStates[i].moduleId == moduleId
+			&& receiveStates[i].requestHandle == requestHandle
+		) {
+			return &receiveStates[i];
+		}
+	}
+	return nullptr;
+}
+
+void RawDataTransfer::SendStartReceived(const ReceiveState& state) const
+{
+	RawDataStartReceived packet;
+	CheckedMemset(&packet, 0, sizeof(packet));
+	packet.header.connHeader.messageType = MessageType::MODULE_RAW_DATA;
+	packet.header.connHeader.sender = GS->node.configuration.nodeId;
+	packet.header.connHeader.receiver = state.sender;
+	packet.header.moduleId = state.moduleId;
+	packet.header.requestHandle = state.requestHandle;
+	packet.header.actionType = RawDataActionType::START_RECEIVED;
+
+	GS->cm.SendMeshMessage((u8*)&packet, sizeof(packet), DeliveryPriority::LOW);
+}
+
+void RawDataTransfer::SendReport(ReceiveState& state)
+{
+	RawDataReport packet;
+	CheckedMemset(&packet, 0, sizeof(packet));
+	packet.header.connHeader.messageType = MessageType::MODULE_RAW_DATA;
+	packet.header.connHeader.sender = GS->node.configuration.nodeId;
+	packet.header.connHeader.receiver = state.sender;
+	packet.header.moduleId = state.moduleId;
+	packet.header.requestHandle = state.requestHandle;
+	packet.header.actionType = RawDataActionType::REPORT;
+
+	u32 numMissings = 0;
+	u32 lastMissing = 0;
+	for (u32 i = 0; i < state.numChunks && numMissings < MAX_REPORTED_MISSINGS; i++) {
+		if (!(state.received[i / 32] & (1UL << (i % 32)))) {
+			lastMissing = i + 1;
+			packet.missings[numMissings] = lastMissing;
+			numMissings++;
+		}
+	}
+
+	if (numMissings == 0)
+	{
+		if (!state.complete)
+		{
+			logt("RAWDATA", "Transmission from %u received", state.sender);
+			state.complete = true;
+			receivedTransfers++;
+		}
+	}
+	else
+	{
+		state.nextLastChunkId = (u16)lastMissing;
+	}
+
+	GS->cm.SendMeshMessage((u8*)&packet, sizeof(packet), DeliveryPriority::LOW);
+}
+
+void RawDataTransfer::TimerEventHandler(u16 passedTimeDs)
+{
+	for (u32 i = 0; i < MAX_TRANSFERS; i++) {
+		Transfer& transfer = transfers[i];
+		if (transfer.state == TransferState::UNUSED) continue;
+
+		if (transfer.state == TransferState::SENDING)
+		{
+			SendChunks(transfer);
+			continue;
+		}
+
+		if (transfer.timeoutDs > passedTimeDs) {
+			transfer.timeoutDs -= passedTimeDs;
+			continue;
+		}
+
+		if (transfer.retries >= MAX_RETRIES) {
+			logt("RAWDATA", "Transfer to %u got no answer", transfer.receiver);
+			FinishTransfer(transfer, RawDataTransferResult::NO_ANSWER);
+			continue;
+		}
+
+		transfer.retries++;
+		transfer.timeoutDs = ANSWER_TIMEOUT_DS;
+
+		if (transfer.state == TransferState::STARTING)
+		{
+			SendStart(transfer);
+		}
+		else
+		{
+			//Either the last chunk or the report was lost, the receiver answers the last chunk again
+			transfer.window = transfer.window / 2 > 0 ? transfer.window / 2 : 1;
+			transfer.chunksSinceWindowChange = 0;
+			transfer.retransmittedChunks++;
+			retransmittedChunks++;
+			GS->logger.logCustomCount(CustomErrorTypes::COUNT_RAW_DATA_CHUNK_RETRANSMITTED);
+			SendChunk(transfer, transfer.lastChunkId);
+		}
+	}
+
+	for (u32 i = 0; i < MAX_RECEIVE_TRANSFERS; i++) {
+		ReceiveState& state = receiveStates[i];
+		if (state.sender == NODE_ID_INVALID || GS->appTimerDs - state.lastActivityDs < RECEIVE_TIMEOUT_DS) continue;
+
+		//Completed transmissions are kept until now in case the sender missed our last report
+		if (!state.complete)
+		{
+			logt("RAWDATA", "Transmission from %u timed out", state.sender);
+			SendRawDataError(state.sender, state.moduleId, state.requestHandle, RawDataErrorType::UNEXPECTED_END_OF_TRANSMISSION);
+		}
+		state.sender = NODE_ID_INVALID;
+	}
+}
+
+//Called whenever packets were sent so that the window is refilled without waiting for the next timer event
+void RawDataTransfer::PacketsSentHandler()
+{
+	for (u32 i = 0; i < MAX_TRANSFERS; i++) {
+		if (transfers[i].state == TransferState::SENDING) SendChunks(transfers[i]);
+	}
+}
+
+u8 RawDataTransfer::GetNumActiveTransfers() const
+{
+	u8 count = 0;
+	for (u32 i = 0; i < MAX_TRANSFERS; i++) {
+		if (transfers[i].state != TransferState::UNUSED) count++;
+	}
+	return count;
+}
+
+//Returns the packets queued on the connection that the ConnectionManager uses for the receiver. Packets
+//that are broadcasted are queued on all mesh connections, so the fullest queue is returned in that case.
+u16 RawDataTransfer::GetQueuedMeshPackets(NodeId receiver)
+{
+	if (receiver == NODE_ID_SHORTEST_SINK && GS->config.enableSinkRouting)
+	{
+		const MeshConnection* connection = GS->cm.GetMeshConnectionToShortestSink(nullptr);
+		if (connection != nullptr) return connection->packetSendQueue._numElements;
+	}
+
+	u16 queuedPackets = 0;
+	const MeshConnections connections = GS->cm.GetMeshConnections(ConnectionDirection::INVALID);
+	for (u32 i = 0; i < connections.count; i++) {
+		if (connections.connections[i]->handshakeDone() && connections.connections[i]->partnerId == receiver) {
+			return connections.connections[i]->packetSendQueue._numElements;
+		}
+		if (connections.connections[i]->packetSendQueue._numElements > queuedPackets) {
+			queuedPackets = connections.connections[i]->packetSendQueue._numElements;
+		}
+	}
+	return queuedPackets;
+}
@@ -0,0 +1,181 @@
+////////////////////////////////////////////////////////////////////////////////
+// /****************************************************************************
+// **
+// ** Copyright (C) 2015-2020 M-Way Solutions GmbH
+// ** Contact: https://www.blureange.io/licensing
+// **
+// ** This file is part of the Bluerange/FruityMesh implementation
+// **
+// ** $BR_BEGIN_LICENSE:GPL-EXCEPT$
+// ** Commercial License Usage
+// ** Licensees holding valid commercial Bluerange licenses may use this file in
+// ** accordance with the commercial license agreement provided with the
+// ** Software or, alternatively, in accordance with the terms contained in
+// ** a written agreement between them and M-Way Solutions GmbH.
+// ** For licensing terms and conditions see https://www.bluerange.io/terms-conditions. For further
+// ** information use the contact form at https://www.bluerange.io/contact.
+// **
+// ** GNU General Public License Usage
+// ** Alternatively, this file may be used under the terms of the GNU
+// ** General Public License version 3 as published by the Free Software
+// ** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+// ** included in the packaging of this file. Please review the following
+// ** information to ensure the GNU General Public License requirements will
+// ** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+// **
+// ** $BR_END_LICENSE$
+// **
+// ****************************************************************************/
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * The RawDataTransfer implements the sender side of the raw data protocol (MODULE_RAW_DATA) so that
+ * modules can send a buffer of a few kilobytes through the mesh without pacing the chunks themselves.
+ * After the receiver answered the raw_data_start, the chunks are pipelined within a window that limits
+ * how many packets may wait in the send queue towards the receiver. Chunks that the receiver lists in its
+ * raw_data_report are retransmitted selectively and the window is halved for every lossy round. As the
+ * receiver only reports at the end of a round, the window grows with the chunks that were sent instead
+ * of the chunks that were confirmed, which is only an approximation of the capacity of the path and is
+ * bounded by MAX_WINDOW. The window only sees our own queue, a relay further along the path that cannot
+ * keep up only shows up as missing chunks in the next report. The module that started a transfer is informed about the progress and
+ * the completion through its RawDataTransfer handlers.
+ *
+ * If enableRawDataReceiver is set in the config, the node also answers raw data transmissions that are
+ * addressed to it with raw_data_start_received and raw_data_report messages, otherwise this is left to
+ * the gateway that receives the logged chunks. The payload of received chunks is not stored.
+ */
+
+#pragma once
+
+#include <types.h>
+
+struct BaseConnectionSendData;
+enum class RawDataProtocol : u8;
+
+enum class RawDataTransferResult : u8
+{
+	SUCCESS   = 0,
+	NO_ANSWER = 1, //The receiver did not answer the start or the last chunk after all retries
+	ABORTED   = 2, //The receiver or a node in the mesh sent a raw_data_error
+};
+
+struct RawDataTransferStatistics
+{
+	u32 dataLength = 0;
+	u32 numChunks = 0;
+	u32 sentChunks = 0; //Including retransmissions
+	u32 retransmittedChunks = 0;
+	u32 durationDs = 0; //Since the transfer was started
+	u32 bytesPerSecond = 0; //Payload bytes that were sent per second, retransmissions are not counted
+};
+
+class RawDataTransfer
+{
+public:
+	static constexpr u8 MAX_TRANSFERS = 2;
+	static constexpr u8 INITIAL_WINDOW = 2;
+	static constexpr u8 MAX_WINDOW = 8; //Must leave some space in the send queues for the remaining traffic
+	static constexpr u8 MAX_RETRIES = 3;
+	static constexpr u16 ANSWER_TIMEOUT_DS = SEC_TO_DS(10); //Until the raw_data_start or the last chunk is sent again
+
+	static constexpr u8 MAX_RECEIVE_TRANSFERS = 2;
+	static constexpr u16 MAX_RECEIVE_CHUNKS = 256; //Bigger transmissions are left to the gateway
+	static constexpr u16 RECEIVE_TIMEOUT_DS = SEC_TO_DS(15);
+
+private:
+	static constexpr u8 MAX_REPORTED_MISSINGS = 3; //See RawDataReport
+
+	enum class TransferState : u8
+	{
+		UNUSED,
+		STARTING, //Waiting for the raw_data_start_received
+		SENDING,
+		WAITING_FOR_REPORT,
+	};
+
+	struct Transfer
+	{
+		TransferState state = TransferState::UNUSED;
+		ModuleId owner = ModuleId::INVALID_MODULE;
+		NodeId receiver = NODE_ID_INVALID; //Replaced with the id of the answering sink for NODE_ID_SHORTEST_SINK
+		ModuleId moduleId = ModuleId::INVALID_MODULE;
+		u8 requestHandle = 0;
+		RawDataProtocol protocol = (RawDataProtocol)0;
+		u8 const * data = nullptr;
+		u32 dataLength = 0;
+		u32 numChunks = 0;
+		u32 nextChunkId = 1; //Next chunk that was not sent yet
+		u32 missingChunkIds[MAX_REPORTED_MISSINGS] = {}; //Reported by the last raw_data_report
+		u8 numMissingChunks = 0;
+		u8 nextMissingChunk = 0;
+		u32 lastChunkId = 0; //Answered by the receiver with a raw_data_report
+		u8 window = INITIAL_WINDOW;
+		u8 chunksSinceWindowChange = 0;
+		u8 retries = 0;
+		u16 timeoutDs = 0;
+		u32 startTimeDs = 0;
+		u32 sentChunks = 0;
+		u32 retransmittedChunks = 0;
+	};
+
+	struct ReceiveState
+	{
+		NodeId sender = NODE_ID_INVALID; //NODE_ID_INVALID marks an unused entry
+		ModuleId moduleId = ModuleId::INVALID_MODULE;
+		u8 requestHandle = 0;
+		u16 numChunks = 0;
+		u16 lastChunkId = 0; //The chunk that is answered with a raw_data_report
+		u16 nextLastChunkId = 0; //Becomes the last chunk once the sender continues after our report
+		bool hasReceivedChunks = false;
+		bool complete = false;
+		u32 lastActivityDs = 0;
+		u32 received[MAX_RECEIVE_CHUNKS / 32] = {}; //Bit n is set if chunk n + 1 was received
+	};
+
+	Transfer transfers[MAX_TRANSFERS];
+	ReceiveState receiveStates[MAX_RECEIVE_TRANSFERS];
+
+	void SendStart(const Transfer& transfer) const;
+	void SendChunks(Transfer& transfer);
+	void SendChunk(Transfer& transfer, u32 chunkId);
+	void FinishTransfer(Transfer& transfer, RawDataTransferResult result);
+	RawDataTransferStatistics GetStatistics(const Transfer& transfer) const;
+	Transfer* FindTransfer(NodeId receiver, ModuleId moduleId, u8 requestHandle);
+
+	void StartReceivedHandler(NodeId sender, ModuleId moduleId, u8 requestHandle);
+	void ReportReceivedHandler(NodeId sender, ModuleId moduleId, u8 requestHandle, u32 const * missings);
+	void ErrorReceivedHandler(NodeId sender, ModuleId moduleId, u8 requestHandle);
+
+	void StartMessageReceivedHandler(NodeId sender, ModuleId moduleId, u8 requestHandle, u32 numChunks);
+	void ChunkReceivedHandler(NodeId sender, ModuleId moduleId, u8 requestHandle, u32 chunkId);
+	ReceiveState* FindReceiveState(NodeId sender, ModuleId moduleId, u8 requestHandle);
+	void SendStartReceived(const ReceiveState& state) const;
+	void SendReport(ReceiveState& state);
+
+	static u16 GetQueuedMeshPackets(NodeId receiver);
+
+public:
+	static RawDataTransfer& getInstance();
+
+	//Statistics
+	u32 startedTransfers = 0;
+	u32 completedTransfers = 0;
+	u32 failedTransfers = 0;
+	u32 sentChunks = 0; //Including retransmissions
+	u32 retransmittedChunks = 0;
+	u32 receivedTransfers = 0; //Transmissions that were received completely while enableRawDataReceiver was set
+	u32 receivedChunks = 0;
+	u32 duplicateChunks = 0;
+
+	//Starts sending the data to the given module of the receiver, only unicast receivers and NODE_ID_SHORTEST_SINK are supported
+	//The data is not copied and must stay valid until the RawDataTransferCompletedHandler of the owner was called
+	//Returns BUSY if all transfers are in use or a transfer with the same receiver, module and requestHandle is running
+	ErrorType StartTransfer(ModuleId owner, NodeId receiver, ModuleId moduleId, RawDataProtocol protocol, u8 requestHandle, u8 const * data, u32 dataLength);
+
+	void MeshMessageReceivedHandler(BaseConnectionSendData* sendData, connPacketHeader const * packet);
+
+	void TimerEventHandler(u16 passedTimeDs);
+	void PacketsSentHandler();
+
+	u8 GetNumActiveTransfers() const;
+};
@@ -0,0 +1,385 @@
+////////////////////////////////////////////////////////////////////////////////
+// /****************************************************************************
+// **
+// ** Copyright (C) 2015-2020 M-Way Solutions GmbH
+// ** Contact: https://www.blureange.io/licensing
+// **
+// ** This file is part of the Bluerange/FruityMesh implementation
+// **
+// ** $BR_BEGIN_LICENSE:GPL-EXCEPT$
+// ** Commercial License Usage
+// ** Licensees holding valid commercial Bluerange licenses may use this file in
+// ** accordance with the commercial license agreement provided with the
+// ** Software or, alternatively, in accordance with the terms contained in
+// ** a written agreement between them and M-Way Solutions GmbH. 
+// ** For licensing terms and conditions see https://www.bluerange.io/terms-conditions. For further
+// ** information use the contact form at https://www.bluerange.io/contact.
+// **
+// ** GNU General Public License Usage
+// ** Alternatively, this file may be used under the terms of the GNU
+// ** General Public License version 3 as published by the Free Software
+// ** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+// ** included in the packaging of this file. Please review the following
+// ** information to ensure the GNU General Public License requirements will
+// ** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+// **
+// ** $BR_END_LICENSE$
+// **
+// ****************************************************************************/
+////////////////////////////////////////////////////////////////////////////////
+#include <ReliableMessaging.h>
+#include <GlobalState.h>
+#include <Logger.h>
+#include <Utility.h>
+
+ReliableMessaging & ReliableMessaging::getInstance()
+{
+	return GS->reliableMessaging;
+}
+
+ErrorType ReliableMessaging::SendMeshMessage(u8 const * data, u16 dataLength)
+{
+	if (dataLength < SIZEOF_CONN_PACKET_HEADER) return ErrorType::INVALID_LENGTH;
+	if (dataLength > MAX_MESSAGE_SIZE) return ErrorType::DATA_SIZE;
+
+	connPacketHeader const * packetHeader = (connPacketHeader const *)data;
+	const NodeId receiver = packetHeader->receiver;
+
+	if (
+		   !(receiver >= NODE_ID_DEVICE_BASE && receiver < NODE_ID_DEVICE_BASE + NODE_ID_DEVICE_BASE_SIZE)
+		&& !(receiver >= NODE_ID_GLOBAL_DEVICE_BASE && receiver < NODE_ID_GLOBAL_DEVICE_BASE + NODE_ID_GLOBAL_DEVICE_BASE_SIZE)
+		&& receiver != NODE_ID_SHORTEST_SINK
+		&& receiver != NODE_ID_LOCAL_LOOPBACK
+	) {
+		return ErrorType::INVALID_PARAM;
+	}
+
+	//Packets for ourself never leave the node, so there is nothing to acknowledge
+	if (receiver == NODE_ID_LOCAL_LOOPBACK || GS->cm.IsReceiverOfNodeId(receiver))
+	{
+		BaseConnectionSendData sendData;
+		sendData.characteristicHandle = BLE_CONN_HANDLE_INVALID;
+		sendData.dataLength = dataLength;
+		sendData.deliveryOption = DeliveryOption::WRITE_CMD;
+
+		GS->cm.DispatchMeshMessage(nullptr, &sendData, packetHeader, true);
+		return ErrorType::SUCCESS;
+	}
+
+	PendingMessage* message = nullptr;
+	for (u32 i = 0; i < MAX_PENDING_MESSAGES; i++) {
+		if (pendingMessages[i].destinationIndex == INVALID_INDEX) {
+			message = &pendingMessages[i];
+			break;
+		}
+	}
+	if (message == nullptr) return ErrorType::BUSY;
+
+	const u8 destinationIndex = GetOrCreateDestination(receiver);
+	if (destinationIndex == INVALID_INDEX) return ErrorType::BUSY;
+
+	Destination& destination = destinations[destinationIndex];
+
+	message->destinationIndex = destinationIndex;
+	message->sequenceNumber = destination.nextSequenceNumber;
+	message->sent = false;
+	message->retries = 0;
+	message->timeoutDs = 0;
+	message->length = (u8)dataLength;
+	CheckedMemcpy(message->data, data, dataLength);
+
+	destination.nextSequenceNumber++;
+	sentMessages++;
+
+	TransmitPendingMessages(destinationIndex);
+
+	return ErrorType::SUCCESS;
+}
+
+u8 ReliableMessaging::GetOrCreateDestination(NodeId nodeId)
+{
+	u8 freeIndex = INVALID_INDEX;
+	for (u32 i = 0; i < MAX_DESTINATIONS; i++) {
+		if (destinations[i].nodeId == nodeId) return i;
+		if (freeIndex == INVALID_INDEX && destinations[i].nodeId == NODE_ID_INVALID) freeIndex = i;
+	}
+
+	//Destinations without pending messages can be reused
+	if (freeIndex == INVALID_INDEX) {
+		for (u32 i = 0; i < MAX_DESTINATIONS && freeIndex == INVALID_INDEX; i++) {
+			freeIndex = i;
+			for (u32 k = 0; k < MAX_PENDING_MESSAGES; k++) {
+				if (pendingMessages[k].destinationIndex == i) {
+					freeIndex = INVALID_INDEX;
+					break;
+				}
+			}
+		}
+	}
+	if (freeIndex == INVALID_INDEX) return INVALID_INDEX;
+
+	//A new session tells the receiver to forget the sequence numbers that it knows from us
+	destinations[freeIndex].nodeId = nodeId;
+	destinations[freeIndex].sessionId = (u16)Utility::GetRandomInteger();
+	destinations[freeIndex].nextSequenceNumber = 0;
+
+	return freeIndex;
+}
+
+//The lowest sequence number of a destination that was neither acknowledged nor given up
+u16 ReliableMessaging::GetWindowStart(u8 destinationIndex) const
+{
+	u16 windowStart = destinations[destinationIndex].nextSequenceNumber;
+	for (u32 i = 0; i < MAX_PENDING_MESSAGES; i++) {
+		if (
+			   pendingMessages[i].destinationIndex == destinationIndex
+			&& IsSequenceBefore(pendingMessages[i].sequenceNumber, windowStart)
+		) {
+			windowStart = pendingMessages[i].sequenceNumber;
+		}
+	}
+	return windowStart;
+}
+
+//Sends all messages of a destination that were not sent yet and fit into the window
+void ReliableMessaging::TransmitPendingMessages(u8 destinationIndex)
+{
+	const u16 windowStart = GetWindowStart(destinationIndex);
+	for (u32 i = 0; i < MAX_PENDING_MESSAGES; i++) {
+		PendingMessage& message = pendingMessages[i];
+		if (
+			   message.destinationIndex == destinationIndex
+			&& !message.sent
+			&& (u16)(message.sequenceNumber - windowStart) < WINDOW_SIZE
+		) {
+			message.sent = true;
+			message.timeoutDs = RETRANSMISSION_TIMEOUT_DS;
+			TransmitMessage(message);
+		}
+	}
+}
+
+void ReliableMessaging::TransmitMessage(PendingMessage& message)
+{
+	const Destination& destination = destinations[message.destinationIndex];
+
+	DYNAMIC_ARRAY(buffer, SIZEOF_RELIABLE_DATA_MESSAGE_HEADER + message.length);
+	ReliableDataMessage* packet = (ReliableDataMessage*)buffer;
+	packet->header.messageType = MessageType::RELIABLE_DATA;
+	packet->header.sender = GS->node.configuration.nodeId;
+	packet->header.receiver = destination.nodeId;
+	packet->sessionId = destination.sessionId;
+	packet->sequenceNumber = message.sequenceNumber;
+	packet->windowStart = GetWindowStart(message.destinationIndex);
+	CheckedMemcpy(packet->payload, message.data, message.length);
+
+	logt("RELIABLE", "Sending seq %u to %u (retry %u)", message.sequenceNumber, destination.nodeId, message.retries);
+
+	GS->cm.SendMeshMessageInternal(buffer, SIZEOF_RELIABLE_DATA_MESSAGE_HEADER + message.length, DeliveryPriority::LOW, false, false, true);
+}
+
+void ReliableMessaging::ReleaseMessage(PendingMessage& message)
+{
+	message.destinationIndex = INVALID_INDEX;
+	message.sent = false;
+}
+
+bool ReliableMessaging::MeshMessageReceivedHandler(BaseConnection* connection, BaseConnectionSendData* sendData, connPacketHeader const * packet)
+{
+	if (packet->messageType == MessageType::RELIABLE_DATA)
+	{
+		DataMessageReceivedHandler(connection, sendData, packet);
+		return true;
+	}
+	else if (packet->messageType == MessageType::RELIABLE_ACK)
+	{
+		AckMessageReceivedHandler(sendData, packet);
+		return true;
+	}
+	return false;
+}
+
+void ReliableMessaging::DataMessageReceivedHandler(BaseConnection* connection, BaseConnectionSendData* sendData, connPacketHeader const * packet)
+{
+	if (sendData->dataLength < SIZEOF_RELIABLE_DATA_MESSAGE_HEADER + SIZEOF_CONN_PACKET_HEADER) return;
+
+	ReliableDataMessage const * dataMessage = (ReliableDataMessage const *)packet;
+	connPacketHeader const * innerPacket = (connPacketHeader const *)dataMessage->payload;
+
+	//The wrapped packet must be addressed the same way as the message that carried it
+	if (innerPacket->sender != packet->sender || innerPacket->receiver != packet->receiver) return;
+
+	ReceiveState& state = GetReceiveState(packet->sender, packet->receiver);
+	if (state.sessionId != dataMessage->sessionId)
+	{
+		state.sessionId = dataMessage->sessionId;
+		state.base = dataMessage->windowStart;
+		state.received = 0;
+	}
+	state.lastActivityDs = GS->appTimerDs;
+
+	//The sender does not retransmit anything before its window, so we can move on
+	if (IsSequenceBefore(state.base, dataMessage->windowStart))
+	{
+		const u16 shift = dataMessage->windowStart - state.base;
+		state.received = shift >= 32 ? 0 : state.received >> shift;
+		state.base = dataMessage->windowStart;
+	}
+
+	const u16 offset = dataMessage->sequenceNumber - state.base;
+	bool deliver = false;
+	if (IsSequenceBefore(dataMessage->sequenceNumber, state.base) || (offset < 32 && (state.received & (1UL << offset))))
+	{
+		duplicateMessages++;
+		logt("RELIABLE", "Duplicate seq %u from %u", dataMessage->sequenceNumber, packet->sender);
+	}
+	else if (offset < 32)
+	{
+		state.received |= 1UL << offset;
+		deliver = true;
+	}
+	else
+	{
+		//Far outside of the window, the sender will retransmit it
+		return;
+	}
+
+	while (state.received & 1)
+	{
+		state.received >>= 1;
+		state.base++;
+	}
+
+	//The ack is sent before dispatching, the dispatched message might already queue an answer
+	SendAck(state);
+
+	if (deliver)
+	{
+		deliveredMessages++;
+
+		BaseConnectionSendData innerSendData = *sendData;
+		innerSendData.dataLength = sendData->dataLength - SIZEOF_RELIABLE_DATA_MESSAGE_HEADER;
+		GS->cm.DispatchMeshMessage(connection, &innerSendData, innerPacket, false);
+	}
+}
+
+void ReliableMessaging::AckMessageReceivedHandler(BaseConnectionSendData* sendData, connPacketHeader const * packet)
+{
+	if (sendData->dataLength < sizeof(ReliableAckMessage)) return;
+
+	ReliableAckMessage const * ackMessage = (ReliableAckMessage const *)packet;
+
+	u8 destinationIndex = INVALID_INDEX;
+	for (u32 i = 0; i < MAX_DESTINATIONS; i++) {
+		if (destinations[i].nodeId == ackMessage->destination && destinations[i].sessionId == ackMessage->sessionId) {
+			destinationIndex = i;
+			break;
+		}
+	}
+	if (destinationIndex == INVALID_INDEX) return;
+
+	for (u32 i = 0; i < MAX_PENDING_MESSAGES; i++) {
+		PendingMessage& message = pendingMessages[i];
+		if (message.destinationIndex != destinationIndex || !message.sent) continue;
+
+		const u16 offset = message.sequenceNumber - ackMessage->cumulativeAck;
+		if (
+			   IsSequenceBefore(message.sequenceNumber, ackMessage->cumulativeAck)
+			|| (offset < 32 && (ackMessage->selectiveAcks & (1UL << offset)))
+		) {
+			logt("RELIABLE", "Seq %u acked by %u", message.sequenceNumber, packet->sender);
+			acknowledgedMessages++;
+			ReleaseMessage(message);
+		}
+	}
+
+	TransmitPendingMessages(destinationIndex);
+}
+
+//Returns the state for the given sender and destination, the least recently used state is replaced if necessary
+ReliableMessaging::ReceiveState& ReliableMessaging::GetReceiveState(NodeId sender, NodeId destination)
+{
+	ReceiveState* oldest = &receiveStates[0];
+	for (u32 i = 0; i < MAX_RECEIVE_STATES; i++) {
+		if (receiveStates[i].sender == sender && receiveStates[i].destination == destination) return receiveStates[i];
+
+		if (oldest->sender != NODE_ID_INVALID
+			&& (receiveStates[i].sender == NODE_ID_INVALID || receiveStates[i].lastActivityDs < oldest->lastActivityDs)
+		) {
+			oldest = &receiveStates[i];
+		}
+	}
+
+	//Forgetting a state means that retransmissions that are still in flight from this sender could be dispatched twice
+	oldest->sender = sender;
+	oldest->destination = destination;
+	oldest->sessionId = 0;
+	oldest->base = 0;
+	oldest->received = 0;
+	oldest->lastActivityDs = GS->appTimerDs;
+
+	return *oldest;
+}
+
+void ReliableMessaging::SendAck(const ReceiveState& state) const
+{
+	ReliableAckMessage ack;
+	CheckedMemset(&ack, 0x00, sizeof(ack));
+	ack.header.messageType = MessageType::RELIABLE_ACK;
+	ack.header.sender = GS->node.configuration.nodeId;
+	ack.header.receiver = state.sender;
+	ack.destination = state.destination;
+	ack.sessionId = state.sessionId;
+	ack.cumulativeAck = state.base;
+	ack.selectiveAcks = state.received;
+
+	GS->cm.SendMeshMessageInternal((u8*)&ack, sizeof(ack), DeliveryPriority::LOW, false, false, true);
+}
+
+void ReliableMessaging::TimerEventHandler(u16 passedTimeDs)
+{
+	for (u32 i = 0; i < MAX_PENDING_MESSAGES; i++) {
+		PendingMessage& message = pendingMessages[i];
+		if (message.destinationIndex == INVALID_INDEX || !message.sent) continue;
+
+		if (message.timeoutDs > passedTimeDs) {
+			message.timeoutDs -= passedTimeDs;
+			continue;
+		}
+
+		if (message.retries >= MAX_RETRIES) {
+			logt("RELIABLE", "Giving up seq %u to %u", message.sequenceNumber, destinations[message.destinationIndex].nodeId);
+			givenUpMessages++;
+			GS->logger.logCustomError(CustomErrorTypes::WARN_RELIABLE_MESSAGE_GIVEN_UP, destinations[message.destinationIndex].nodeId);
+			ReleaseMessage(message);
+			continue;
+		}
+
+		//Exponential backoff so that we do not add to the congestion that probably caused the loss
+		message.retries++;
+		const u32 timeoutDs = (u32)RETRANSMISSION_TIMEOUT_DS << message.retries;
+		message.timeoutDs = timeoutDs > MAX_RETRANSMISSION_TIMEOUT_DS ? MAX_RETRANSMISSION_TIMEOUT_DS : (u16)timeoutDs;
+		retransmissions++;
+		GS->logger.logCustomCount(CustomErrorTypes::COUNT_RELIABLE_MESSAGE_RETRANSMITTED);
+		TransmitMessage(message);
+	}
+
+	//Given up messages might have opened the window
+	for (u32 i = 0; i < MAX_DESTINATIONS; i++) {
+		if (destinations[i].nodeId != NODE_ID_INVALID) TransmitPendingMessages(i);
+	}
+}
+
+u8 ReliableMessaging::GetNumPendingMessages() const
+{
+	u8 count = 0;
+	for (u32 i = 0; i < MAX_PENDING_MESSAGES; i++) {
+		if (pendingMessages[i].destinationIndex != INVALID_INDEX) count++;
+	}
+	return count;
+}
+
+bool ReliableMessaging::IsSequenceBefore(u16 a, u16 b)
+{
+	return (i16)(a - b) < 0;
+}
@@ -0,0 +1,132 @@
+////////////////////////////////////////////////////////////////////////////////
+// /****************************************************************************
+// **
+// ** Copyright (C) 2015-2020 M-Way Solutions GmbH
+// ** Contact: https://www.blureange.io/licensing
+// **
+// ** This file is part of the Bluerange/FruityMesh implementation
+// **
+// ** $BR_BEGIN_LICENSE:GPL-EXCEPT$
+// ** Commercial License Usage
+// ** Licensees holding valid commercial Bluerange licenses may use this file in
+// ** accordance with the commercial license agreement provided with the
+// ** Software or, alternatively, in accordance with the terms contained in
+// ** a written agreement between them and M-Way Solutions GmbH.
+// ** For licensing terms and conditions see https://www.bluerange.io/terms-conditions. For further
+// ** information use the contact form at https://www.bluerange.io/contact.
+// **
+// ** GNU General Public License Usage
+// ** Alternatively, this file may be used under the terms of the GNU
+// ** General Public License version 3 as published by the Free Software
+// ** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+// ** included in the packaging of this file. Please review the following
+// ** information to ensure the GNU General Public License requirements will
+// ** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+// **
+// ** $BR_END_LICENSE$
+// **
+// ****************************************************************************/
+////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * The ReliableMessaging provides an optional end-to-end delivery service on top of the mesh.
+ * A WRITE_REQ only confirms the transmission to the next hop, so a packet that is dropped by
+ * a relay because its queue is full is lost without the sender knowing about it.
+ * Packets that are sent through this class are wrapped in a RELIABLE_DATA message with a
+ * sequence number and are retransmitted until the receiver acknowledges them or the maximum
+ * number of retries is reached. The receiver acknowledges each packet with a cumulative and a
+ * selective acknowledgement and filters out duplicates. Only unicast receivers and
+ * NODE_ID_SHORTEST_SINK are supported.
+ */
+
+#pragma once
+
+#include <types.h>
+
+class BaseConnection;
+struct BaseConnectionSendData;
+
+class ReliableMessaging
+{
+public:
+	static constexpr u8 WINDOW_SIZE = 4; //Number of unacknowledged messages in flight per destination, must not exceed 32
+	static constexpr u8 MAX_DESTINATIONS = 4;
+	static constexpr u8 MAX_PENDING_MESSAGES = 8; //Shared between all destinations
+	static constexpr u8 MAX_MESSAGE_SIZE = 64; //Size of the wrapped packet including its connPacketHeader
+	static constexpr u8 MAX_RECEIVE_STATES = 8;
+	static constexpr u8 MAX_RETRIES = 5;
+	static constexpr u16 RETRANSMISSION_TIMEOUT_DS = SEC_TO_DS(3);
+	static constexpr u16 MAX_RETRANSMISSION_TIMEOUT_DS = SEC_TO_DS(30);
+
+private:
+	static constexpr u8 INVALID_INDEX = 0xFF;
+
+	struct Destination
+	{
+		NodeId nodeId = NODE_ID_INVALID; //NODE_ID_INVALID marks an unused entry
+		u16 sessionId = 0;
+		u16 nextSequenceNumber = 0;
+	};
+
+	struct PendingMessage
+	{
+		u8 destinationIndex = INVALID_INDEX; //INVALID_INDEX marks an unused slot
+		u16 sequenceNumber = 0;
+		bool sent = false;
+		u8 retries = 0;
+		u16 timeoutDs = 0;
+		u8 length = 0;
+		u8 data[MAX_MESSAGE_SIZE];
+	};
+
+	//Which sequence numbers were received from a sender for one of our receiver ids
+	struct ReceiveState
+	{
+		NodeId sender = NODE_ID_INVALID; //NODE_ID_INVALID marks an unused entry
+		NodeId destination = NODE_ID_INVALID;
+		u16 sessionId = 0;
+		u16 base = 0; //All sequence numbers before base were received
+		u32 received = 0; //Bit n is set if base + n was received
+		u32 lastActivityDs = 0;
+	};
+
+	Destination destinations[MAX_DESTINATIONS];
+	PendingMessage pendingMessages[MAX_PENDING_MESSAGES];
+	ReceiveState receiveStates[MAX_RECEIVE_STATES];
+
+	u8 GetOrCreateDestination(NodeId nodeId);
+	u16 GetWindowStart(u8 destinationIndex) const;
+	void TransmitPendingMessages(u8 destinationIndex);
+	void TransmitMessage(PendingMessage& message);
+	void ReleaseMessage(PendingMessage& message);
+
+	void DataMessageReceivedHandler(BaseConnection* connection, BaseConnectionSendData* sendData, connPacketHeader const * packet);
+	void AckMessageReceivedHandler(BaseConnectionSendData* sendData, connPacketHeader const * packet);
+	ReceiveState& GetReceiveState(NodeId sender, NodeId destination);
+	void SendAck(const ReceiveState& state) const;
+
+	static bool IsSequenceBefore(u16 a, u16 b);
+
+public:
+	static ReliableMessaging& getInstance();
+
+	//Statistics
+	u32 sentMessages = 0; //Messages that were accepted for sending
+	u32 acknowledgedMessages = 0;
+	u32 retransmissions = 0;
+	u32 givenUpMessages = 0; //Messages that were not acknowledged after MAX_RETRIES retransmissions
+	u32 deliveredMessages = 0; //Messages that were received and dispatched
+	u32 duplicateMessages = 0; //Messages that were received again and were not dispatched
+
+	//Queues a mesh packet (including its connPacketHeader) for acknowledged delivery to its receiver
+	//If we are the receiver ourselves, the packet is dispatched locally without any acknowledgement
+	//Returns BUSY if no more messages can be queued for now
+	ErrorType SendMeshMessage(u8 const * data, u16 dataLength);
+
+	//Returns true if the packet was a RELIABLE_DATA or RELIABLE_ACK message and was consumed
+	bool MeshMessageReceivedHandler(BaseConnection* connection, BaseConnectionSendData* sendData, connPacketHeader const * packet);
+
+	void TimerEventHandler(u16 passedTimeDs);
+
+	u8 GetNumPendingMessages() const;
+};
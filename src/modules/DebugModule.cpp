@@ -667,6 +667,30 @@ TerminalCommandHandlerReturnType DebugModule::TerminalCommandHandler(const char*
 
 		return TerminalCommandHandlerReturnType::SUCCESS;
 	}
+	//Prints how much of the record storage is used, free and could be reclaimed by a defragmentation
+	else if (TERMARGS(0, "recstats"))
+	{
+		RecordStorageFragmentationInfo info = GS->recordStorage.GetFragmentationInfo();
+
+		logjson("DEBUGMOD", "{\"type\":\"record_storage_stats\",\"free\":%u,\"used\":%u,\"reclaimable\":%u,\"maxFreeOnPage\":%u,\"fragmentation\":%u,",
+			info.freeSpace, info.usedSpace, info.reclaimableSpace, info.maxFreeSpaceOnPage, info.fragmentationPercent);
+		logjson("DEBUGMOD", "\"defragForeground\":%u,\"defragBackground\":%u}" SEP,
+			GS->recordStorage.GetNumDefragmentations(false), GS->recordStorage.GetNumDefragmentations(true));
+
+		return TerminalCommandHandlerReturnType::SUCCESS;
+	}
+	//Prints the statistics of the end-to-end acknowledged messages
+	else if (TERMARGS(0, "reliablestats"))
+	{
+		const ReliableMessaging& rm = GS->reliableMessaging;
+
+		logjson("DEBUGMOD", "{\"type\":\"reliable_stats\",\"sent\":%u,\"acked\":%u,\"retries\":%u,\"givenUp\":%u,",
+			rm.sentMessages, rm.acknowledgedMessages, rm.retransmissions, rm.givenUpMessages);
+		logjson("DEBUGMOD", "\"delivered\":%u,\"duplicates\":%u,\"pending\":%u}" SEP,
+			rm.deliveredMessages, rm.duplicateMessages, rm.GetNumPendingMessages());
+
+		return TerminalCommandHandlerReturnType::SUCCESS;
+	}
 	else if (TERMARGS(0, "send"))
 	{
 		if(commandArgsSize <= 1) return TerminalCommandHandlerReturnType::NOT_ENOUGH_ARGUMENTS;
@@ -81,6 +81,8 @@ void EnrollmentModule::ConfigurationLoadedHandler(ModuleConfiguration* migratabl
 {
 	//Do additional initialization upon loading the config
 	CheckedMemset(&ted, 0x00, sizeof(TemporaryEnrollmentData));
+	CheckedMemset(overMeshTargets, 0x00, sizeof(overMeshTargets));
+	overMeshProgressChanged = false;
 	CheckedMemset(&proposal, 0x00, sizeof(EnrollmentModuleEnrollmentProposalMessage));
 	proposalIndexCounter = 0;
 
@@ -97,38 +99,48 @@ void EnrollmentModule::TimerEventHandler(u16 passedTimeDs)
 		PreEnrollmentFailed();
 	}
 
-	MeshAccessConnection* conn = nullptr;
-	if(ted.state > EnrollmentStates::PREENROLLMENT_RUNNING) conn = (MeshAccessConnection*)GS->cm.GetConnectionByUniqueId(ted.uniqueConnId);
-
-	//Check if the current enrollment over the mesh should time out
-	if (ted.state > EnrollmentStates::PREENROLLMENT_RUNNING && GS->appTimerDs > ted.endTimeDs) {
-		logt("ENROLLMOD", "Enrollment over mesh timed out");
-
-		//Check if the current enrollment over a mesh access connection should time out
-		if (ted.state == EnrollmentStates::SCANNING) {
-			//We do not stop the scanner as the node also needs it //TODO: scanning should be stopped once we have a scanController
-		} else if (ted.state == EnrollmentStates::CONNECTING) {
-			//Stop connecting and ensure that if the connection was already made by the softdevice, we do not accept it
-			FruityHal::ConnectCancel();
-			if (GS->cm.pendingConnection != nullptr) {
-				GS->cm.DeleteConnection(GS->cm.pendingConnection, AppDisconnectReason::ENROLLMENT_TIMEOUT);
+	for(u32 i=0; i<MAX_ENROLLMENT_OVER_MESH_TARGETS; i++){
+		EnrollmentOverMeshTarget& target = overMeshTargets[i];
+		if(target.state == EnrollmentOverMeshState::FREE || target.state == EnrollmentOverMeshState::TIMED_OUT) continue;
+
+		MeshAccessConnection* conn = nullptr;
+		if(target.state >= EnrollmentOverMeshState::CONNECTING) conn = (MeshAccessConnection*)GS->cm.GetConnectionByUniqueId(target.uniqueConnId);
+
+		//Check if the enrollment of this target over the mesh should time out
+		if (GS->appTimerDs > target.endTimeDs) {
+			logt("ENROLLMOD", "Enrollment over mesh of %u timed out", target.requestData.serialNumberIndex);
+
+			if (target.state == EnrollmentOverMeshState::CONNECTING) {
+				//Stop connecting and ensure that if the connection was already made by the softdevice, we do not accept it
+				if (GS->cm.pendingConnection != nullptr && GS->cm.pendingConnection->uniqueConnectionId == target.uniqueConnId) {
+					FruityHal::ConnectCancel();
+					GS->cm.DeleteConnection(GS->cm.pendingConnection, AppDisconnectReason::ENROLLMENT_TIMEOUT);
+				}
 			}
-		}
-		else if(ted.state >= EnrollmentStates::CONNECTED)
-		{
-			if(conn != nullptr){
-				conn->DisconnectAndRemove(AppDisconnectReason::ENROLLMENT_TIMEOUT2);
+			else if(target.state >= EnrollmentOverMeshState::CONNECTED)
+			{
+				if(conn != nullptr){
+					conn->DisconnectAndRemove(AppDisconnectReason::ENROLLMENT_TIMEOUT2);
+				}
 			}
+
+			//Targets that were never reported are freed right away, the others are freed once the timeout was reported
+			SetOverMeshTargetState(target, target.reportProgress ? EnrollmentOverMeshState::TIMED_OUT : EnrollmentOverMeshState::FREE);
+			continue;
 		}
 
-		ted.state = EnrollmentStates::NOT_ENROLLING;
+		//If the connection could not be established or was lost, we try again with the next advertisement of the target
+		if(target.state >= EnrollmentOverMeshState::CONNECTING && conn == nullptr) {
+			SetOverMeshTargetState(target, EnrollmentOverMeshState::SCANNING);
+		}
+		//Check if the enrollment connection was handshaked as we have no handler for that
+		else if(target.state == EnrollmentOverMeshState::CONNECTING && conn->connectionState == ConnectionState::HANDSHAKE_DONE) {
+			EnrollmentConnectionConnectedHandler(target);
+		}
 	}
 
-	//Check if the enrollment connection was handshaked as we have no handler for that
-	if(ted.state == EnrollmentStates::CONNECTING && conn != nullptr) {
-		if(conn->connectionState == ConnectionState::HANDSHAKE_DONE) {
-			EnrollmentConnectionConnectedHandler();
-		}
+	if(overMeshProgressChanged && GS->appTimerDs >= lastOverMeshProgressReportDs + ENROLLMENT_PROGRESS_REPORT_INTERVAL_DS){
+		SendEnrollmentProgress();
 	}
 }
 
@@ -425,13 +437,21 @@ void EnrollmentModule::MeshMessageReceivedHandler(BaseConnection* connection, Ba
 				char serialNumber[NODE_SERIAL_NUMBER_LENGTH+1];
 				Utility::GenerateBeaconSerialForIndex(data->serialNumberIndex, serialNumber);
 
-				//Check if this came over our EnrollmentOverMesh Connection and terminate that connection
-				BaseConnection* tedConn = GS->cm.GetConnectionByUniqueId(ted.uniqueConnId);
-				if(ted.state >= EnrollmentStates::CONNECTED && (tedConn == nullptr || tedConn == connection)){
-					ted.state = EnrollmentStates::NOT_ENROLLING;
-					if (connection != nullptr) {
-						connection->DisconnectAndRemove(AppDisconnectReason::ENROLLMENT_RESPONSE_RECEIVED);
+				//Check if this came over one of our EnrollmentOverMesh Connections and terminate that connection
+				EnrollmentOverMeshTarget* target = nullptr;
+				for(u32 i=0; i<MAX_ENROLLMENT_OVER_MESH_TARGETS && connection != nullptr; i++){
+					if(overMeshTargets[i].state >= EnrollmentOverMeshState::CONNECTED
+						&& overMeshTargets[i].state != EnrollmentOverMeshState::TIMED_OUT
+						&& overMeshTargets[i].uniqueConnId == connection->uniqueConnectionId
+					){
+						target = &overMeshTargets[i];
+						break;
 					}
+				}
+				if(target != nullptr){
+					//The response itself tells the requester about the result, so the target does not need to be reported anymore
+					target->state = EnrollmentOverMeshState::FREE;
+					connection->DisconnectAndRemove(AppDisconnectReason::ENROLLMENT_RESPONSE_RECEIVED);
 
 					//We need to send that packet back to our mesh that we were handling the enrollment
 					//This is not done automatically as the packet is not whitelisted by the MeshAccessConnection
@@ -465,6 +485,24 @@ void EnrollmentModule::MeshMessageReceivedHandler(BaseConnection* connection, Ba
 
 				logjson("ENROLLMOD", "{\"nodeId\":%u,\"type\":\"set_network_response\",\"code\":%d,\"module\":%d,\"requestHandle\":%d}" SEP, packet->header.sender, (u32)data->response, (u32)packet->moduleId, (u32)packet->requestHandle);
 			}
+			else if (actionType == EnrollmentModuleActionResponseMessages::ENROLLMENT_PROGRESS)
+			{
+				EnrollmentModuleEnrollmentProgressMessage const * data = (EnrollmentModuleEnrollmentProgressMessage const *)packet->data;
+				const u32 numEntries = (sendData->dataLength - SIZEOF_CONN_PACKET_MODULE) / sizeof(EnrollmentModuleEnrollmentProgressEntry);
+
+				logjson_partial("ENROLLMOD", "{\"nodeId\":%u,\"type\":\"enroll_over_mesh_progress\",\"module\":%d,\"targets\":[", packet->header.sender, (u32)moduleId);
+				for (u32 i = 0; i < numEntries; i++)
+				{
+					char serialBuffer[NODE_SERIAL_NUMBER_LENGTH + 1];
+					Utility::GenerateBeaconSerialForIndex(data->entries[i].serialNumberIndex, serialBuffer);
+					logjson_partial("ENROLLMOD", "{\"serialNumber\":\"%s\",\"state\":%u}", serialBuffer, (u32)data->entries[i].state);
+					if (i != numEntries - 1)
+					{
+						logjson_partial("ENROLLMOD", ",");
+					}
+				}
+				logjson("ENROLLMOD", "]}" SEP);
+			}
 			else if (actionType == EnrollmentModuleActionResponseMessages::REQUEST_PROPOSALS_RESPONSE)
 			{
 				EnrollmentModuleRequestProposalResponse const * data = (EnrollmentModuleRequestProposalResponse const *)packet->data;
@@ -482,7 +520,7 @@ void EnrollmentModule::MeshMessageReceivedHandler(BaseConnection* connection, Ba
 
 void EnrollmentModule::RefreshScanJob()
 {
-	GS->scanController.UpdateJobPointer(&p_scanJob, ScanState::HIGH, ScanJobState::ACTIVE);
+	GS->scanController.UpdateJobPointer(&p_scanJob, ScanState::HIGH, ScanJobState::ACTIVE, moduleId);
 	if (p_scanJob != nullptr)
 	{
 		p_scanJob->timeMode = ScanJobTimeMode::TIMED;
@@ -784,6 +822,8 @@ void EnrollmentModule::EnrollOverMesh(connPacketModule const * packet, u16 packe
 {
 	logt("ENROLLMOD", "Received Enrollment over the mesh request");
 
+	if(packetLength < SIZEOF_CONN_PACKET_MODULE) return;
+
 	EnrollmentModuleSetEnrollmentBySerialMessage const * data = (EnrollmentModuleSetEnrollmentBySerialMessage const *)packet->data;
 
 
@@ -812,120 +852,188 @@ void EnrollmentModule::EnrollOverMesh(connPacketModule const * packet, u16 packe
 	}
 
 
-	//Check if another enrollment is in progress, if yes, return
-	if(ted.state != EnrollmentStates::NOT_ENROLLING){
-		logt("ENROLLMOD", "Still busy");
-		return;
+	//A gateway that retries its request should not interrupt a running enrollment of the same target
+	EnrollmentOverMeshTarget* target = nullptr;
+	for(u32 i=0; i<MAX_ENROLLMENT_OVER_MESH_TARGETS; i++){
+		if(overMeshTargets[i].state != EnrollmentOverMeshState::FREE && overMeshTargets[i].requestData.serialNumberIndex == data->serialNumberIndex){
+			target = &overMeshTargets[i];
+			break;
+		}
 	}
-
-	//If the enrollment was directed to broadcast, only perform the request at a
-	//chance of 50% => Helps us to not block all nodes in a mesh at once
-	if(packet->header.receiver == NODE_ID_BROADCAST && GS->node.clusterSize > 1 && rand < UINT32_MAX/2){
-		logt("ENROLLMOD", "Random skip");
+	if(target != nullptr && target->state != EnrollmentOverMeshState::TIMED_OUT){
+		logt("ENROLLMOD", "Enrollment of %u already pending", data->serialNumberIndex);
+		if(target->endTimeDs < GS->appTimerDs + SEC_TO_DS(data->timeoutSec)){
+			target->endTimeDs = GS->appTimerDs + SEC_TO_DS(data->timeoutSec);
+		}
 		return;
 	}
 
-	//If there are any open MeshAccessConnections, we disconnect these so we can use them after
-	//our scan returned a positive result. This will throw out users that try to connect during an
-	//enrollment, but we cannot easily distinguish between used and unused meshAccessConnections
-	BaseConnections conns = GS->cm.GetConnectionsOfType(ConnectionType::MESH_ACCESS, ConnectionDirection::INVALID);
-	for(u32 i=0; i<conns.count; i++){
-		MeshAccessConnection *conn = (MeshAccessConnection*)GS->cm.allConnections[conns.connectionIndizes[i]];
-		//We make sure that we do not disconnect the sender of the enrollment
-		if (conn != nullptr && conn->virtualPartnerId != packet->header.sender) {
-			conn->DisconnectAndRemove(AppDisconnectReason::NEEDED_FOR_ENROLLMENT);
-		}
+	for(u32 i=0; i<MAX_ENROLLMENT_OVER_MESH_TARGETS && target == nullptr; i++){
+		if(overMeshTargets[i].state == EnrollmentOverMeshState::FREE) target = &overMeshTargets[i];
+	}
+	if(target == nullptr){
+		logt("ENROLLMOD", "Still busy");
+		return;
 	}
 
 	//Save the enrollment data
 	//If this data is saved, we will check incoming advertisements if they match
 	//If yes, we will connect to the other node and try to enroll it
-	CheckedMemset(&ted, 0x00, sizeof(TemporaryEnrollmentData));
-	ted.requestHeader = *packet;
-	ted.requestData = *data;
+	CheckedMemset(target, 0x00, sizeof(EnrollmentOverMeshTarget));
+	CheckedMemcpy(&target->requestHeader, packet, SIZEOF_CONN_PACKET_MODULE);
+	u32 requestDataLength = (u32)packetLength - SIZEOF_CONN_PACKET_MODULE;
+	if(requestDataLength > sizeof(target->requestData)) requestDataLength = sizeof(target->requestData);
+	CheckedMemcpy(&target->requestData, data, requestDataLength);
+
+	//All nodes of the mesh receive a broadcasted request, only the one that connects to the target reports its progress
+	target->reportProgress = packet->header.receiver == GS->node.configuration.nodeId;
 
 	//Set timeout time for enrollment
-	ted.endTimeDs = GS->appTimerDs + SEC_TO_DS(data->timeoutSec);
+	target->endTimeDs = GS->appTimerDs + SEC_TO_DS(data->timeoutSec);
 
 	//Start scanning for mesh access packets
-	//TODO: Should use a scancontroller that allows job handling
-	ted.state = EnrollmentStates::SCANNING;
+	SetOverMeshTargetState(*target, EnrollmentOverMeshState::SCANNING);
 
 	RefreshScanJob();
 
 	//=> Next, we simple wait for the timeout or if a handler is called with a matching advertisement
-
-	//TODO: Pay attention that scanning and the meshaccess connection are killed even if we could not enroll the node
 }
 
 //This is triggered once we receive an advertising of a node that should be enrolled over the mesh
-void EnrollmentModule::EnrollNodeViaMeshAccessConnection(FruityHal::BleGapAddr& addr, const meshAccessServiceAdvMessage* advMessage)
+void EnrollmentModule::EnrollNodeViaMeshAccessConnection(EnrollmentOverMeshTarget& target, FruityHal::BleGapAddr& addr)
 {
-	if(ted.state != EnrollmentStates::SCANNING) return;
+	if(target.state != EnrollmentOverMeshState::SCANNING) return;
+
+	//Check if we still have enough time for connecting
+	if(GS->appTimerDs + SEC_TO_DS(2) > target.endTimeDs) return;
+
+	//Only one connection can be established at a time, the other targets are connected once it is done
+	if(GS->cm.pendingConnection != nullptr) return;
+
+	//We must not use up all the connections that the node needs for the mesh
+	if(GetNumOverMeshTargetsConnecting() >= MAX_PARALLEL_ENROLLMENT_CONNECTIONS) return;
+	if(GS->cm.GetBaseConnections(ConnectionDirection::DIRECTION_OUT).count >= GS->config.totalOutConnections) return;
 
 	logt("ENROLLMOD", "Received message from beacon to be enrolled");
 
 	logt("ENROLLMOD", "Connecting to %02X:%02X:%02X:%02X:%02X:%02X",
 			addr.addr[5],addr.addr[4],addr.addr[3],addr.addr[2],addr.addr[1],addr.addr[0]);
 
-	//Check if we still have enough time for connecting
-	if(GS->appTimerDs + SEC_TO_DS(2) > ted.endTimeDs) return;
-
 	//TODO: Build Mesh access connection, remove hardcoded values
-	u16 timeLeftSec = DS_TO_SEC(ted.endTimeDs - GS->appTimerDs);
+	u16 timeLeftSec = DS_TO_SEC(target.endTimeDs - GS->appTimerDs);
 	//Clamp to reasonable values.
 	if (timeLeftSec > 10) timeLeftSec = 10;
 	if (timeLeftSec < 1 ) timeLeftSec = 1;
 
-	//Try to connect to the device using a MeshAccess Connection
-	//TODO: replace hardcoded value
-	ted.state = EnrollmentStates::CONNECTING;
-
 	FmKeyId fmKeyId = FmKeyId::NODE;
 
 	//If the given key was 000....000, we try to connect using key id none
-	if(Utility::CompareMem(0x00, ted.requestData.nodeKey.getRaw(), ted.requestData.nodeKey.length)){
+	if(Utility::CompareMem(0x00, target.requestData.nodeKey.getRaw(), target.requestData.nodeKey.length)){
 		fmKeyId = FmKeyId::ZERO;
 	}
 
-	ted.uniqueConnId = MeshAccessConnection::ConnectAsMaster(&addr, 10, timeLeftSec, fmKeyId, ted.requestData.nodeKey.getRaw(), MeshAccessTunnelType::PEER_TO_PEER);
+	//Try to connect to the device using a MeshAccess Connection
+	//TODO: replace hardcoded value
+	const u32 uniqueConnId = MeshAccessConnection::ConnectAsMaster(&addr, 10, timeLeftSec, fmKeyId, target.requestData.nodeKey.getRaw(), MeshAccessTunnelType::PEER_TO_PEER);
+
+	logt("ENROLLMOD", "uiniqueId: %u", uniqueConnId);
+
+	//We try again with the next advertisement
+	if(uniqueConnId == 0) return;
 
-	logt("ENROLLMOD", "uiniqueId: %u", ted.uniqueConnId);
+	target.uniqueConnId = uniqueConnId;
+	target.reportProgress = true;
+	SetOverMeshTargetState(target, EnrollmentOverMeshState::CONNECTING);
 
 	//Now, we use our Timer handler to check if the Connection reaches the handshake state
 }
 
-void EnrollmentModule::EnrollmentConnectionConnectedHandler()
+void EnrollmentModule::EnrollmentConnectionConnectedHandler(EnrollmentOverMeshTarget& target)
 {
 	logt("ENROLLMOD", "Enrollment Connection handshaked");
 
-	ted.state = EnrollmentStates::CONNECTED;
+	SetOverMeshTargetState(target, EnrollmentOverMeshState::CONNECTED);
 	//Increase timeout if we do not have enough time to send the enrollment
-	if(GS->appTimerDs + SEC_TO_DS(4) > ted.endTimeDs){
-		ted.endTimeDs = GS->appTimerDs + SEC_TO_DS(4);
+	if(GS->appTimerDs + SEC_TO_DS(4) > target.endTimeDs){
+		target.endTimeDs = GS->appTimerDs + SEC_TO_DS(4);
 	}
 
 
-	MeshAccessConnection* conn = (MeshAccessConnection*)GS->cm.GetConnectionByUniqueId(ted.uniqueConnId);
+	MeshAccessConnection* conn = (MeshAccessConnection*)GS->cm.GetConnectionByUniqueId(target.uniqueConnId);
 	
 	//We need to overwrite the receiver as our node might have been instructed to enroll the remote node
 	//If we send the message unmodified, our partner would not accept the packet as it was not adressed to him
-	ted.requestHeader.header.receiver = conn != nullptr ? conn->virtualPartnerId : 0;
+	target.requestHeader.header.receiver = conn != nullptr ? conn->virtualPartnerId : 0;
 
 	//Send the enrollment to our partner after we are connected
 	u8 len = SIZEOF_CONN_PACKET_MODULE + SIZEOF_ENROLLMENT_MODULE_SET_ENROLLMENT_BY_SERIAL_MESSAGE;
 	DYNAMIC_ARRAY(buffer, len);
-	CheckedMemcpy(buffer, &ted.requestHeader, SIZEOF_CONN_PACKET_MODULE);
-	CheckedMemcpy(buffer + SIZEOF_CONN_PACKET_MODULE, &ted.requestData, SIZEOF_ENROLLMENT_MODULE_SET_ENROLLMENT_BY_SERIAL_MESSAGE);
+	CheckedMemcpy(buffer, &target.requestHeader, SIZEOF_CONN_PACKET_MODULE);
+	CheckedMemcpy(buffer + SIZEOF_CONN_PACKET_MODULE, &target.requestData, SIZEOF_ENROLLMENT_MODULE_SET_ENROLLMENT_BY_SERIAL_MESSAGE);
 
-	logt("ENROLLMOD", "Sender was %u", ted.requestHeader.header.sender);
+	logt("ENROLLMOD", "Sender was %u", target.requestHeader.header.sender);
 
 	if(conn != nullptr){
 		conn->SendData(buffer, len, DeliveryPriority::LOW, false);
 	}
 
 	//Final state reached, will be cleared after timeout is reached
-	ted.state = EnrollmentStates::MESSAGE_SENT;
+	SetOverMeshTargetState(target, EnrollmentOverMeshState::MESSAGE_SENT);
+}
+
+void EnrollmentModule::SetOverMeshTargetState(EnrollmentOverMeshTarget& target, EnrollmentOverMeshState state)
+{
+	target.state = state;
+	if(target.reportProgress) overMeshProgressChanged = true;
+}
+
+u8 EnrollmentModule::GetNumOverMeshTargetsConnecting() const
+{
+	u8 count = 0;
+	for(u32 i=0; i<MAX_ENROLLMENT_OVER_MESH_TARGETS; i++){
+		if(overMeshTargets[i].state >= EnrollmentOverMeshState::CONNECTING && overMeshTargets[i].state <= EnrollmentOverMeshState::MESSAGE_SENT) count++;
+	}
+	return count;
+}
+
+//Sends the state of all targets in a single message to each requester and removes timed out targets afterwards
+void EnrollmentModule::SendEnrollmentProgress()
+{
+	bool reported[MAX_ENROLLMENT_OVER_MESH_TARGETS] = { false };
+
+	for(u32 i=0; i<MAX_ENROLLMENT_OVER_MESH_TARGETS; i++){
+		if(overMeshTargets[i].state == EnrollmentOverMeshState::FREE || !overMeshTargets[i].reportProgress || reported[i]) continue;
+
+		const NodeId requester = overMeshTargets[i].requestHeader.header.sender;
+
+		EnrollmentModuleEnrollmentProgressEntry entries[MAX_ENROLLMENT_OVER_MESH_TARGETS];
+		u32 numEntries = 0;
+		for(u32 k=i; k<MAX_ENROLLMENT_OVER_MESH_TARGETS; k++){
+			if(overMeshTargets[k].state == EnrollmentOverMeshState::FREE || !overMeshTargets[k].reportProgress || overMeshTargets[k].requestHeader.header.sender != requester) continue;
+
+			entries[numEntries].serialNumberIndex = overMeshTargets[k].requestData.serialNumberIndex;
+			entries[numEntries].state = overMeshTargets[k].state;
+			numEntries++;
+			reported[k] = true;
+		}
+
+		SendModuleActionMessage(
+			MessageType::MODULE_ACTION_RESPONSE,
+			requester,
+			(u8)EnrollmentModuleActionResponseMessages::ENROLLMENT_PROGRESS,
+			0,
+			(u8*)entries,
+			numEntries * sizeof(EnrollmentModuleEnrollmentProgressEntry),
+			false
+		);
+	}
+
+	for(u32 i=0; i<MAX_ENROLLMENT_OVER_MESH_TARGETS; i++){
+		if(overMeshTargets[i].state == EnrollmentOverMeshState::TIMED_OUT) overMeshTargets[i].state = EnrollmentOverMeshState::FREE;
+	}
+
+	overMeshProgressChanged = false;
+	lastOverMeshProgressReportDs = GS->appTimerDs;
 }
 
 void EnrollmentModule::SendEnrollmentResponse(EnrollmentModuleActionResponseMessages responseType, EnrollmentResponseCode result, u8 requestHandle) const
@@ -1010,9 +1118,11 @@ void EnrollmentModule::GapAdvertisementReportEventHandler(const FruityHal::GapAd
 		}
 
 		// Check if we received a message from a beacon that must be enrolled
-		if(ted.state == EnrollmentStates::SCANNING && ted.requestData.serialNumberIndex == message->serviceData.serialIndex)
-		{
-			EnrollNodeViaMeshAccessConnection(addr, message);
+		for(u32 i=0; i<MAX_ENROLLMENT_OVER_MESH_TARGETS; i++){
+			if(overMeshTargets[i].state == EnrollmentOverMeshState::SCANNING && overMeshTargets[i].requestData.serialNumberIndex == message->serviceData.serialIndex)
+			{
+				EnrollNodeViaMeshAccessConnection(overMeshTargets[i], addr);
+			}
 		}
 	}
 }
@@ -133,12 +133,38 @@ struct EnrollmentModuleConfiguration : ModuleConfiguration {
 	};
 	STATIC_ASSERT_SIZE(EnrollmentModuleRequestProposalResponse, 4);
 
+	enum class EnrollmentOverMeshState : u8
+	{
+		FREE         = 0, //Never reported
+		SCANNING     = 1,
+		CONNECTING   = 2,
+		CONNECTED    = 3,
+		MESSAGE_SENT = 4,
+		TIMED_OUT    = 5,
+	};
+
+	struct EnrollmentModuleEnrollmentProgressEntry
+	{
+		u32 serialNumberIndex;
+		EnrollmentOverMeshState state;
+	};
+	STATIC_ASSERT_SIZE(EnrollmentModuleEnrollmentProgressEntry, 5);
+
+	struct EnrollmentModuleEnrollmentProgressMessage
+	{
+		EnrollmentModuleEnrollmentProgressEntry entries[1]; //One entry for each target of the requester
+	};
+	STATIC_ASSERT_SIZE(EnrollmentModuleEnrollmentProgressMessage, 5);
+
 #pragma pack(pop)
 //####### Module messages end
 
 
 class EnrollmentModule: public Module
 {
+#ifdef SIM_ENABLED
+	friend class TestEnrollmentModule_TestEnrollingMultipleTargetsOverMesh_Test;
+#endif
 	public:
 		enum class EnrollmentModuleTriggerActionMessages : u8{
 			SET_ENROLLMENT_BY_SERIAL   = 0,
@@ -154,6 +180,7 @@ class EnrollmentModule: public Module
 			ENROLLMENT_PROPOSAL        = 2,
 			SET_NETWORK_RESPONSE       = 3,
 			REQUEST_PROPOSALS_RESPONSE = 4,
+			ENROLLMENT_PROGRESS        = 5,
 		};
 
 		void DispatchPreEnrollment(Module* lastModuleCalled, PreEnrollmentReturnCode lastStatus);
@@ -170,13 +197,9 @@ class EnrollmentModule: public Module
 		enum class EnrollmentStates : u8 {
 			NOT_ENROLLING,
 			PREENROLLMENT_RUNNING,
-			SCANNING,
-			CONNECTING,
-			CONNECTED,
-			MESSAGE_SENT
 		};
 
-		//Data for enrolling over mesh access connections
+		//Data for enrolling this node
 #pragma pack(push)
 #pragma pack(1)
 		struct TemporaryEnrollmentData{
@@ -188,8 +211,6 @@ class EnrollmentModule: public Module
 				EnrollmentModuleRemoveEnrollmentMessage unenrollData;
 			};
 			u32 endTimeDs;
-
-			u32 uniqueConnId;
 		};
 #pragma pack(pop)
 
@@ -197,6 +218,25 @@ class EnrollmentModule: public Module
 		//This can be used for an enrollment request
 		TemporaryEnrollmentData ted;
 
+		//A node that should be enrolled over a mesh access connection by this node
+		struct EnrollmentOverMeshTarget{
+			EnrollmentOverMeshState state;
+			connPacketModule requestHeader;
+			EnrollmentModuleSetEnrollmentBySerialMessage requestData;
+			u32 endTimeDs;
+			u32 uniqueConnId;
+			bool reportProgress;
+		};
+
+		//Enrollments over the mesh are kept in a small table so that all pending targets are matched against
+		//each scanned advertisement and a few of them can be connected at the same time
+		static constexpr u8 MAX_ENROLLMENT_OVER_MESH_TARGETS = 4;
+		static constexpr u8 MAX_PARALLEL_ENROLLMENT_CONNECTIONS = 2;
+		static constexpr u32 ENROLLMENT_PROGRESS_REPORT_INTERVAL_DS = SEC_TO_DS(5);
+		EnrollmentOverMeshTarget overMeshTargets[MAX_ENROLLMENT_OVER_MESH_TARGETS];
+		bool overMeshProgressChanged = false;
+		u32 lastOverMeshProgressReportDs = 0;
+
 
 
 		//Save a few nearby node serials in this proposal message
@@ -224,9 +264,13 @@ class EnrollmentModule: public Module
 
 		void SaveUnenrollment(connPacketModule* packet, u16 packetLength);
 
-		void EnrollmentConnectionConnectedHandler();
+		void EnrollmentConnectionConnectedHandler(EnrollmentOverMeshTarget& target);
+
+		void EnrollNodeViaMeshAccessConnection(EnrollmentOverMeshTarget& target, FruityHal::BleGapAddr& addr);
 
-		void EnrollNodeViaMeshAccessConnection(FruityHal::BleGapAddr& addr, const meshAccessServiceAdvMessage* advMessage);
+		void SetOverMeshTargetState(EnrollmentOverMeshTarget& target, EnrollmentOverMeshState state);
+
+		void SendEnrollmentProgress();
 
 		void SendEnrollmentResponse(EnrollmentModuleActionResponseMessages responseType, EnrollmentResponseCode result, u8 requestHandle) const;
 
@@ -238,6 +282,9 @@ class EnrollmentModule: public Module
 
 		void SendRequestProposalResponse(u32 serialIndex);
 
+		//Number of targets that currently have an open or pending enrollment connection
+		u8 GetNumOverMeshTargetsConnecting() const;
+
 	public:
 		DECLARE_CONFIG_AND_PACKED_STRUCT(EnrollmentModuleConfiguration);
 
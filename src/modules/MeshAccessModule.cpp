@@ -82,6 +82,14 @@ void MeshAccessModule::ConfigurationLoadedHandler(ModuleConfiguration* migratabl
 
 void MeshAccessModule::TimerEventHandler(u16 passedTimeDs)
 {
+	//Precompute the keystreams for the next packets outside of the send and receive path
+	BaseConnections conns = GS->cm.GetConnectionsOfType(ConnectionType::MESH_ACCESS, ConnectionDirection::INVALID);
+	for(u32 i=0; i<conns.count; i++){
+		MeshAccessConnection* conn = (MeshAccessConnection*)GS->cm.allConnections[conns.connectionIndizes[i]];
+		if(conn != nullptr){
+			conn->RefillKeystreamPools();
+		}
+	}
 }
 
 void MeshAccessModule::RegisterGattService()
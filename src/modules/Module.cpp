@@ -71,6 +71,16 @@ void Module::SendModuleActionMessage(MessageType messageType, NodeId toNode, u8
 	GS->cm.SendModuleActionMessage(messageType, moduleId, toNode, actionType, requestHandle, additionalData, additionalDataSize, reliable, loopback);
 }
 
+ErrorType Module::SendModuleActionMessageAcknowledged(MessageType messageType, NodeId toNode, u8 actionType, u8 requestHandle, const u8* additionalData, u16 additionalDataSize) const
+{
+	return GS->cm.SendModuleActionMessageAcknowledged(messageType, moduleId, toNode, actionType, requestHandle, additionalData, additionalDataSize);
+}
+
+ErrorType Module::StartRawDataTransfer(NodeId toNode, ModuleId destinationModuleId, RawDataProtocol protocol, u8 requestHandle, u8 const * data, u32 dataLength) const
+{
+	return GS->rawDataTransfer.StartTransfer(moduleId, toNode, destinationModuleId, protocol, requestHandle, data, dataLength);
+}
+
 #ifdef TERMINAL_ENABLED
 TerminalCommandHandlerReturnType Module::TerminalCommandHandler(const char* commandArgs[], u8 commandArgsSize)
 {
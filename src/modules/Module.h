@@ -58,6 +58,7 @@ constexpr int INVALID_U32_CONFIG = 0xFFFFFFFF;
 #include <Terminal.h>
 #include <RecordStorage.h>
 #include <MeshConnection.h>
+#include <RawDataTransfer.h>
 #include <BaseConnection.h>
 
 enum class CapabilityEntryType : u8
@@ -139,6 +140,10 @@ protected:
 		//Constructs a simple TriggerAction message and sends it
 		void SendModuleActionMessage(MessageType messageType, NodeId toNode, u8 actionType, u8 requestHandle, const u8* additionalData, u16 additionalDataSize, bool reliable, bool loopback) const;
 		void SendModuleActionMessage(MessageType messageType, NodeId toNode, u8 actionType, u8 requestHandle, const u8* additionalData, u16 additionalDataSize, bool reliable) const;
+		//The reliable flag above only confirms the delivery to the next hop, this one is retransmitted until the receiver acknowledges it
+		ErrorType SendModuleActionMessageAcknowledged(MessageType messageType, NodeId toNode, u8 actionType, u8 requestHandle, const u8* additionalData, u16 additionalDataSize) const;
+		//Sends the data with the raw data protocol, the data must stay valid until the RawDataTransferCompletedHandler was called
+		ErrorType StartRawDataTransfer(NodeId toNode, ModuleId destinationModuleId, RawDataProtocol protocol, u8 requestHandle, u8 const * data, u32 dataLength) const;
 
 
 		//##### Handlers that can be implemented by any module, but are implemented empty here
@@ -176,6 +181,10 @@ protected:
 		//This handler receives all connection packets addressed to this node
 		virtual void MeshMessageReceivedHandler(BaseConnection* connection, BaseConnectionSendData* sendData, connPacketHeader const * packetHeader);
 
+		//Raw data transfers that were started by this module report each raw_data_report with missing chunks and their completion here
+		virtual void RawDataTransferProgressHandler(NodeId receiver, u8 requestHandle, const RawDataTransferStatistics& statistics) {};
+		virtual void RawDataTransferCompletedHandler(NodeId receiver, u8 requestHandle, RawDataTransferResult result, const RawDataTransferStatistics& statistics) {};
+
 		//This handler is called before the node is enrolled, it can return PRE_ENROLLMENT_ codes
 		virtual PreEnrollmentReturnCode PreEnrollmentHandler(connPacketModule* packet, u16 packetLength);
 
@@ -38,7 +38,7 @@
 #include <Node.h>
 #include <stdlib.h>
 #include <GlobalState.h>
-constexpr u8 SCAN_MODULE_CONFIG_VERSION = 2;
+constexpr u8 SCAN_MODULE_CONFIG_VERSION = 4;
 
 #if IS_ACTIVE(ASSET_MODULE)
 #ifndef GITHUB_RELEASE
@@ -67,9 +67,7 @@ ScanningModule::ScanningModule() :
 		scanFilters[i].active = 0;
 	}
 
-	//resetAssetTrackingTable();
-
-	assetInsPackets.zeroData();
+	resetAssetTrackingTable();
 
 	//Set defaults
 	ResetToDefaultConfiguration();
@@ -91,6 +89,13 @@ void ScanningModule::ResetToDefaultConfiguration()
 	filter.minRSSI = -100;
 	filter.maxRSSI = 100;
 
+	configuration.assetReportingMode = AssetReportingMode::FULL;
+	configuration.assetRssiDeltaThreshold = 6;
+	configuration.assetLostTimeoutDs = SEC_TO_DS(60);
+	configuration.assetFullReportIntervalDs = SEC_TO_DS(600);
+	configuration.assetAggregationEnabled = false;
+	configuration.assetAggregationDelayDs = SEC_TO_DS(2);
+
 	SET_FEATURESET_CONFIGURATION(&configuration, this);
 }
 
@@ -106,16 +111,40 @@ void ScanningModule::ConfigurationLoadedHandler(ModuleConfiguration* migratableC
 	totalMessages = 0;
 	totalRSSI = 0;
 
-	assetPackets.zeroData();
+	resetAssetTrackingTable();
+	lastFullAssetReportDs = GS->appTimerDs;
+
+	aggregatedAssets.zeroData();
+	numAggregatedAssets = 0;
+	aggregatedAssetsIndex.Clear();
 
 #if IS_INACTIVE(GW_SAVE_SPACE)
 	if (configuration.moduleActive && assetReportingIntervalDs != 0) {
-		GS->scanController.UpdateJobPointer(&p_scanJob, ScanState::HIGH, ScanJobState::ACTIVE);
+		RefreshScanJob();
 	}
 #endif
 	//Start the Module...
 }
 
+//An asset only has to be found once per reporting interval, so short bursts are enough if the interval is long.
+//Otherwise the scan keeps running with the high discovery parameters.
+void ScanningModule::RefreshScanJob()
+{
+	ScanJob scanJob = ScanJob();
+	scanJob.state = ScanJobState::ACTIVE;
+	scanJob.timeMode = ScanJobTimeMode::ENDLESS;
+	scanJob.owner = moduleId;
+	ScanController::SetDetectionGoal(scanJob, ASSET_MAX_ADVERTISING_INTERVAL_MS, assetReportingIntervalDs, ASSET_DETECTION_PROBABILITY_PERCENT);
+
+	if (scanJob.burstPeriodDs == 0) {
+		GS->scanController.UpdateJobPointer(&p_scanJob, ScanState::HIGH, ScanJobState::ACTIVE, moduleId);
+	}
+	else {
+		GS->scanController.RemoveJob(p_scanJob);
+		p_scanJob = GS->scanController.AddJob(scanJob);
+	}
+}
+
 #ifdef TERMINAL_ENABLED
 TerminalCommandHandlerReturnType ScanningModule::TerminalCommandHandler(const char* commandArgs[], u8 commandArgsSize)
 {
@@ -141,10 +170,24 @@ void ScanningModule::TimerEventHandler(u16 passedTimeDs)
 	}
 
 	if(SHOULD_IV_TRIGGER(GS->appTimerDs, passedTimeDs, assetReportingIntervalDs)){
+		//In DELTA mode, all assets are only reported from time to time so that the sink can refresh its state
+		bool fullReport = configuration.assetReportingMode == AssetReportingMode::FULL;
+		if (
+			configuration.assetReportingMode == AssetReportingMode::DELTA
+			&& configuration.assetFullReportIntervalDs != 0
+			&& GS->appTimerDs - lastFullAssetReportDs >= configuration.assetFullReportIntervalDs
+		) {
+			fullReport = true;
+			lastFullAssetReportDs = GS->appTimerDs;
+		}
+
 		//Send asset tracking packets
-		SendTrackedAssets();
-		SendTrackedAssetsIns();
-//		resetAssetTrackingTable();
+		SendTrackedAssets(fullReport);
+		SendTrackedAssetsIns(fullReport);
+	}
+
+	if (numAggregatedAssets > 0 && GS->appTimerDs - aggregationStartDs >= configuration.assetAggregationDelayDs) {
+		FlushAggregatedAssets();
 	}
 }
 
@@ -168,9 +211,38 @@ void ScanningModule::MeshMessageReceivedHandler(BaseConnection* connection, Base
 			u32 amount = (sendData->dataLength - SIZEOF_CONN_PACKET_MODULE) / sizeof(TrackedAssetInsMessage);
 			ReceiveTrackedAssetsIns(msg, amount, packetHeader->sender);
 		}
+		else if (connPacket->moduleId == moduleId && connPacket->actionType == (u8)ScanModuleMessages::ASSET_AGGREGATED_TRACKING_PACKET && GET_DEVICE_TYPE() == DeviceType::SINK)
+		{
+			//The sink consolidates the aggregated reports of all paths before printing them
+			AggregateAssetRecords(connPacket->data, sendData->dataLength - SIZEOF_CONN_PACKET_MODULE);
+		}
 	}
 }
 
+RoutingDecision ScanningModule::MessageRoutingInterceptor(BaseConnection* connection, BaseConnectionSendData* sendData, connPacketHeader const * packetHeader)
+{
+	//Aggregated asset reports on their way to the sink are merged with our own ones and forwarded later
+	//This is only done if we have a route to the sink, otherwise the reports would circle between the nodes
+	if (
+		configuration.assetAggregationEnabled
+		&& packetHeader->messageType == MessageType::ASSET_GENERIC
+		&& packetHeader->receiver == NODE_ID_SHORTEST_SINK
+		&& sendData->dataLength >= SIZEOF_CONN_PACKET_MODULE
+		&& GET_DEVICE_TYPE() != DeviceType::SINK
+		&& GS->config.enableSinkRouting
+		&& GS->cm.GetMeshConnectionToShortestSink(connection) != nullptr
+	) {
+		connPacketModule const * connPacket = (connPacketModule const *)packetHeader;
+		if (connPacket->moduleId == moduleId && connPacket->actionType == (u8)ScanModuleMessages::ASSET_AGGREGATED_TRACKING_PACKET)
+		{
+			AggregateAssetRecords(connPacket->data, sendData->dataLength - SIZEOF_CONN_PACKET_MODULE);
+			return ROUTING_DECISION_BLOCK_TO_MESH | ROUTING_DECISION_BLOCK_TO_MESH_ACCESS;
+		}
+	}
+
+	return 0;
+}
+
 
 void ScanningModule::GapAdvertisementReportEventHandler(const FruityHal::GapAdvertisementReportEvent& advertisementReportEvent)
 {
@@ -259,86 +331,185 @@ void ScanningModule::HandleAssetInsPackets(const FruityHal::GapAdvertisementRepo
 }
 
 /**
- * Finds a free slot in our buffer of asset packets and adds the packet
+ * Looks up the slot of the asset in our buffer of asset packets and adds the packet
+ * If the buffer is full, the asset that was not scanned for the longest time is replaced
  */
 bool ScanningModule::addTrackedAsset(const advPacketAssetServiceData* packet, i8 rssi){
-	ScannedAssetTrackingStorage* slot = nullptr;
-
-	//Look for an old entry of this asset or a free space
-	//Because we fill this buffer from the beginning, we can use the first slot that is empty
-	for(int i = 0; i<ASSET_PACKET_BUFFER_SIZE; i++){
-		if(assetPackets[i].serialNumberIndex == packet->serialNumberIndex || assetPackets[i].serialNumberIndex == 0){
-			slot = &assetPackets[i];
-			break;
+	i32 slotNum = assetPacketsIndex.Find(packet->serialNumberIndex);
+
+	if (slotNum < 0) {
+		if (numAssetPackets < ASSET_PACKET_BUFFER_SIZE) {
+			slotNum = numAssetPackets;
+			numAssetPackets++;
+		}
+		else {
+			//Evicting only happens with a full buffer so the linear search is fine here
+			slotNum = 0;
+			for (int i = 1; i < numAssetPackets; i++) {
+				if (GS->appTimerDs - assetPackets[i].lastSeenDs > GS->appTimerDs - assetPackets[slotNum].lastSeenDs) slotNum = i;
+			}
+			const ScannedAssetTrackingStorage& evicted = assetPackets[slotNum];
+			logt("SCANMOD", "Evicting asset %u from slot %d", evicted.serialNumberIndex, slotNum);
+			if (evicted.reportedRssi != 0) {
+				RememberEvictedAsset(evictedAssets, numEvictedAssets, evicted.serialNumberIndex, evicted.nodeId != 0 ? evicted.nodeId : evicted.serialNumberIndex, evicted.lastSeenDs, evicted.reportedRssi);
+			}
+			assetPacketsIndex.Remove(evicted.serialNumberIndex);
 		}
+
+		ScannedAssetTrackingStorage* slot = &assetPackets[slotNum];
+		CheckedMemset(slot, 0, sizeof(ScannedAssetTrackingStorage));
+		slot->serialNumberIndex = packet->serialNumberIndex;
+		slot->nodeId = packet->nodeId;
+		slot->reportedRssi = RestoreEvictedAsset(evictedAssets, numEvictedAssets, packet->serialNumberIndex);
+		ResetRssiContainer(slot->rssiContainer);
+		assetPacketsIndex.Insert(packet->serialNumberIndex, (u8)slotNum);
 	}
 
-	//If a slot was found, add the packet
-	if(slot != nullptr){
-		u16 slotNum = ((u32)slot - (u32)assetPackets.getRaw()) / sizeof(ScannedAssetTrackingStorage);
-		logt("SCANMOD", "Tracked packet %u in slot %d", packet->serialNumberIndex, slotNum);
+	ScannedAssetTrackingStorage* slot = &assetPackets[slotNum];
+	logt("SCANMOD", "Tracked packet %u in slot %d", packet->serialNumberIndex, slotNum);
+
+	slot->pressure = packet->pressure;
+	slot->speed = packet->speed;
+
+	slot->hasFreeInConnection = packet->hasFreeInConnection;
+	slot->interestedInConnection = packet->interestedInConnection;
+	slot->hasSameNetworkId = packet->networkId == GS->node.configuration.networkId;
+	slot->lastSeenDs = GS->appTimerDs;
+
+	RssiRunningAverageCalculationInPlace(slot->rssiContainer, packet->advertisingChannel, rssi);
+
+	return true;
+}
+bool ScanningModule::addTrackedAssetIns(const advPacketAssetInsServiceData * packet, i8 rssi)
+{
+	i32 slotNum = assetInsPacketsIndex.Find(packet->assetNodeId);
 
-		//Clean up first, if we overwrite another assetId
-		if(slot->serialNumberIndex != packet->serialNumberIndex){
-			slot->serialNumberIndex = packet->serialNumberIndex;
-			slot->nodeId = packet->nodeId;
-			slot->rssiContainer.count = 0;
-			slot->rssiContainer.rssi37 = slot->rssiContainer.rssi38 = slot->rssiContainer.rssi39 = UINT8_MAX;
-			slot->rssiContainer.channelCount[0] = slot->rssiContainer.channelCount[1] = slot->rssiContainer.channelCount[2] = 0;
+	if (slotNum < 0) {
+		if (numAssetInsPackets < ASSET_INS_PACKET_BUFFER_SIZE) {
+			slotNum = numAssetInsPackets;
+			numAssetInsPackets++;
+		}
+		else {
+			//Evicting only happens with a full buffer so the linear search is fine here
+			slotNum = 0;
+			for (int i = 1; i < numAssetInsPackets; i++) {
+				if (GS->appTimerDs - assetInsPackets[i].lastSeenDs > GS->appTimerDs - assetInsPackets[slotNum].lastSeenDs) slotNum = i;
+			}
+			const ScannedAssetInsTrackingStorage& evicted = assetInsPackets[slotNum];
+			logt("SCANMOD", "Evicting asset %u from slot %d", evicted.assetNodeId, slotNum);
+			if (evicted.reportedRssi != 0) {
+				RememberEvictedAsset(evictedAssetsIns, numEvictedAssetsIns, evicted.assetNodeId, evicted.assetNodeId, evicted.lastSeenDs, evicted.reportedRssi);
+			}
+			assetInsPacketsIndex.Remove(evicted.assetNodeId);
 		}
-		slot->pressure = packet->pressure;
-		slot->speed = packet->speed;
 
-		slot->hasFreeInConnection = packet->hasFreeInConnection;
-		slot->interestedInConnection = packet->interestedInConnection;
-		slot->hasSameNetworkId = packet->networkId == GS->node.configuration.networkId;
+		ScannedAssetInsTrackingStorage* slot = &assetInsPackets[slotNum];
+		CheckedMemset(slot, 0, sizeof(ScannedAssetInsTrackingStorage));
+		slot->assetNodeId = packet->assetNodeId;
+		slot->reportedRssi = RestoreEvictedAsset(evictedAssetsIns, numEvictedAssetsIns, packet->assetNodeId);
+		ResetRssiContainer(slot->rssiContainer);
+		assetInsPacketsIndex.Insert(packet->assetNodeId, (u8)slotNum);
+	}
+
+	ScannedAssetInsTrackingStorage* slot = &assetInsPackets[slotNum];
+	logt("SCANMOD", "Tracked packet %u in slot %d", packet->assetNodeId, slotNum);
 
-		RssiRunningAverageCalculationInPlace(slot->rssiContainer, packet->advertisingChannel, rssi);
+	slot->batteryPower = packet->batteryPower;
+	slot->absolutePositionX = packet->absolutePositionX;
+	slot->absolutePositionY = packet->absolutePositionY;
+	slot->pressure = packet->pressure;
+	slot->moving = packet->moving;
 
-		return true;
+	slot->hasFreeInConnection = packet->hasFreeInConnection;
+	slot->interestedInConnection = packet->interestedInConnection;
+	slot->hasSameNetworkId = packet->networkId == GS->node.configuration.networkId;
+	slot->lastSeenDs = GS->appTimerDs;
+
+	RssiRunningAverageCalculationInPlace(slot->rssiContainer, 0, rssi);
+
+	return true;
+}
+
+void ScanningModule::RemoveTrackedAsset(u8 slot)
+{
+	//Keep the buffer compact by moving the last asset into the free slot
+	assetPacketsIndex.Remove(assetPackets[slot].serialNumberIndex);
+	numAssetPackets--;
+	if (slot != numAssetPackets) {
+		assetPackets[slot] = assetPackets[numAssetPackets];
+		assetPacketsIndex.UpdateSlot(assetPackets[slot].serialNumberIndex, slot);
 	}
-	return false;
+	CheckedMemset(&assetPackets[numAssetPackets], 0, sizeof(ScannedAssetTrackingStorage));
 }
-bool ScanningModule::addTrackedAssetIns(const advPacketAssetInsServiceData * packet, i8 rssi)
+
+void ScanningModule::RemoveTrackedAssetIns(u8 slot)
 {
-	ScannedAssetInsTrackingStorage* slot = nullptr;
+	//Keep the buffer compact by moving the last asset into the free slot
+	assetInsPacketsIndex.Remove(assetInsPackets[slot].assetNodeId);
+	numAssetInsPackets--;
+	if (slot != numAssetInsPackets) {
+		assetInsPackets[slot] = assetInsPackets[numAssetInsPackets];
+		assetInsPacketsIndex.UpdateSlot(assetInsPackets[slot].assetNodeId, slot);
+	}
+	CheckedMemset(&assetInsPackets[numAssetInsPackets], 0, sizeof(ScannedAssetInsTrackingStorage));
+}
 
-	//Look for an old entry of this asset or a free space
-	//Because we fill this buffer from the beginning, we can use the first slot that is empty
-	for (int i = 0; i < ASSET_INS_PACKET_BUFFER_SIZE; i++) {
-		if (assetInsPackets[i].assetNodeId == packet->assetNodeId || assetInsPackets[i].assetNodeId == 0) {
-			slot = &assetInsPackets[i];
-			break;
+void ScanningModule::RememberEvictedAsset(EvictedAssetBuffer &buffer, u8 &numEvicted, u32 key, u32 assetId, u32 lastSeenDs, u8 reportedRssi)
+{
+	u8 slot = numEvicted;
+	if (numEvicted < EVICTED_ASSET_BUFFER_SIZE) {
+		numEvicted++;
+	}
+	else {
+		//The oldest asset is forgotten, the sink only learns about it with the next full report
+		slot = 0;
+		for (u8 i = 1; i < numEvicted; i++) {
+			if (GS->appTimerDs - buffer[i].lastSeenDs > GS->appTimerDs - buffer[slot].lastSeenDs) slot = i;
 		}
 	}
 
-	//If a slot was found, add the packet
-	if (slot != nullptr) {
-		u16 slotNum = ((u32)slot - (u32)assetInsPackets.getRaw()) / sizeof(ScannedAssetInsTrackingStorage);
-		logt("SCANMOD", "Tracked packet %u in slot %d", packet->assetNodeId, slotNum);
+	buffer[slot].key = key;
+	buffer[slot].assetId = assetId;
+	buffer[slot].lastSeenDs = lastSeenDs;
+	buffer[slot].reportedRssi = reportedRssi;
+}
 
-		//Clean up first, if we overwrite another assetId
-		if (slot->assetNodeId != packet->assetNodeId) {
-			slot->assetNodeId = packet->assetNodeId;
-			slot->rssiContainer.count = 0;
-			slot->rssiContainer.rssi37 = slot->rssiContainer.rssi38 = slot->rssiContainer.rssi39 = UINT8_MAX;
-			slot->rssiContainer.channelCount[0] = slot->rssiContainer.channelCount[1] = slot->rssiContainer.channelCount[2] = 0;
+//Returns the rssi with which the asset was last reported, 0 if it was not evicted
+u8 ScanningModule::RestoreEvictedAsset(EvictedAssetBuffer &buffer, u8 &numEvicted, u32 key)
+{
+	for (u8 i = 0; i < numEvicted; i++) {
+		if (buffer[i].key == key) {
+			const u8 reportedRssi = buffer[i].reportedRssi;
+			RemoveEvictedAsset(buffer, numEvicted, i);
+			return reportedRssi;
 		}
-		slot->batteryPower = packet->batteryPower;
-		slot->absolutePositionX = packet->absolutePositionX;
-		slot->absolutePositionY = packet->absolutePositionY;
-		slot->pressure = packet->pressure;
-		slot->moving = packet->moving;
+	}
+	return 0;
+}
+
+void ScanningModule::RemoveEvictedAsset(EvictedAssetBuffer &buffer, u8 &numEvicted, u8 slot)
+{
+	numEvicted--;
+	if (slot != numEvicted) buffer[slot] = buffer[numEvicted];
+	CheckedMemset(&buffer[numEvicted], 0, sizeof(EvictedAsset));
+}
 
-		slot->hasFreeInConnection = packet->hasFreeInConnection;
-		slot->interestedInConnection = packet->interestedInConnection;
-		slot->hasSameNetworkId = packet->networkId == GS->node.configuration.networkId;
+bool ScanningModule::IsAssetLost(u32 lastSeenDs) const
+{
+	return configuration.assetReportingMode == AssetReportingMode::DELTA
+		&& configuration.assetLostTimeoutDs != 0
+		&& GS->appTimerDs - lastSeenDs >= configuration.assetLostTimeoutDs;
+}
 
-		RssiRunningAverageCalculationInPlace(slot->rssiContainer, 0, rssi);
+bool ScanningModule::ShouldReportAsset(const RssiContainer &container, u8 reportedRssi, bool fullReport) const
+{
+	//Assets that were not scanned during the last interval are only reported once they are lost
+	if (container.count == 0) return false;
+	if (fullReport || reportedRssi == 0) return true;
 
-		return true;
-	}
-	return false;
+	const u8 rssi = GetStrongestRssi(container);
+	const u8 rssiDifference = rssi > reportedRssi ? rssi - reportedRssi : reportedRssi - rssi;
+	return rssiDifference >= configuration.assetRssiDeltaThreshold;
 }
 #endif
 
@@ -349,114 +520,363 @@ bool ScanningModule::addTrackedAssetIns(const advPacketAssetInsServiceData * pac
 //FIXME: rssi threshold must be used somewhere, apply when receiving packet?
 //FIXME: do we average packets or do we just take the best rssi
 
-void ScanningModule::SendTrackedAssets()
+void ScanningModule::SendTrackedAssets(bool fullReport)
 {
 #if IS_INACTIVE(GW_SAVE_SPACE)
-	//Find out how many assets were tracked
-	u8 count = 0;
-	for(int i=0; i<ASSET_PACKET_BUFFER_SIZE; i++){
-		if(assetPackets[i].serialNumberIndex == 0) break;
-		count++;
-	}
-
-	if(count == 0) return;
+	if(numAssetPackets == 0 && numEvictedAssets == 0) return;
 
-	//jstodo add test for tracked assets
-	u16 messageLength = SIZEOF_CONN_PACKET_HEADER + SIZEOF_SCAN_MODULE_TRACKED_ASSET_V2 * count;
-
-	//Allocate a buffer big enough and fill the packet
-	DYNAMIC_ARRAY(buffer, messageLength);
-	CheckedMemset(buffer, 0, messageLength);
+	//The assets are split into multiple messages if they do not fit into a single one
+	constexpr u8 maxAssetsPerMessage = (MAX_MESH_PACKET_SIZE - SIZEOF_CONN_PACKET_HEADER) / SIZEOF_SCAN_MODULE_TRACKED_ASSET_V2;
+	DYNAMIC_ARRAY(buffer, SIZEOF_CONN_PACKET_HEADER + SIZEOF_SCAN_MODULE_TRACKED_ASSET_V2 * maxAssetsPerMessage);
+	CheckedMemset(buffer, 0, SIZEOF_CONN_PACKET_HEADER + SIZEOF_SCAN_MODULE_TRACKED_ASSET_V2 * maxAssetsPerMessage);
 	ScanModuleTrackedAssetsV2Message* message = (ScanModuleTrackedAssetsV2Message*) buffer;
 
 	message->header.messageType = MessageType::ASSET_V2;
 	message->header.sender = GS->node.configuration.nodeId;
 	message->header.receiver = NODE_ID_SHORTEST_SINK;
 
-	for(int i=0; i<count; i++){
-		if (assetPackets[i].nodeId != 0)
-		{
-			message->trackedAssets[i].assetId = assetPackets[i].nodeId;
+	//Iterates backwards as removing an asset moves the last asset into its slot
+	u8 count = 0;
+	for(int i = numAssetPackets - 1; i >= 0; i--){
+		ScannedAssetTrackingStorage& asset = assetPackets[i];
+		const bool lost = IsAssetLost(asset.lastSeenDs);
+
+		if (configuration.assetAggregationEnabled && ((lost && asset.reportedRssi != 0) || (!lost && ShouldReportAsset(asset.rssiContainer, asset.reportedRssi, fullReport)))) {
+			asset.reportedRssi = GetStrongestRssi(asset.rssiContainer);
+			AggregateAssetObservation(
+				asset.nodeId != 0 ? asset.nodeId : asset.serialNumberIndex,
+				ConvertServiceDataToMeshMessageSpeed(asset.speed),
+				ConvertServiceDataToMeshMessagePressure(asset.pressure),
+				GS->node.configuration.nodeId,
+				lost ? 0 : asset.reportedRssi);
 		}
-		else
-		{
-			message->trackedAssets[i].assetId = assetPackets[i].serialNumberIndex;
+		else if ((lost && asset.reportedRssi != 0) || (!lost && ShouldReportAsset(asset.rssiContainer, asset.reportedRssi, fullReport))) {
+			trackedAssetV2& trackedAsset = message->trackedAssets[count];
+			count++;
+
+			if (asset.nodeId != 0)
+			{
+				trackedAsset.assetId = asset.nodeId;
+			}
+			else
+			{
+				trackedAsset.assetId = asset.serialNumberIndex;
+			}
+			trackedAsset.rssi37 = asset.rssiContainer.rssi37;
+			trackedAsset.rssi38 = asset.rssiContainer.rssi38;
+			trackedAsset.rssi39 = asset.rssiContainer.rssi39;
+
+			trackedAsset.speed = ConvertServiceDataToMeshMessageSpeed(asset.speed);
+
+			trackedAsset.hasFreeInConnection = asset.hasFreeInConnection;
+			trackedAsset.interestedInConnection = asset.interestedInConnection;
+			trackedAsset.hasSameNetworkId = asset.hasSameNetworkId;
+			trackedAsset.lost = lost;
+
+			trackedAsset.pressure = ConvertServiceDataToMeshMessagePressure(asset.pressure);
+
+			asset.reportedRssi = GetStrongestRssi(asset.rssiContainer);
+
+			if (count == maxAssetsPerMessage) {
+				//Send the packet as a non-module message to save some bytes in the header
+				GS->cm.SendMeshMessage(buffer, SIZEOF_CONN_PACKET_HEADER + SIZEOF_SCAN_MODULE_TRACKED_ASSET_V2 * count, DeliveryPriority::LOW);
+				count = 0;
+			}
 		}
-		message->trackedAssets[i].rssi37 = assetPackets[i].rssiContainer.rssi37;
-		message->trackedAssets[i].rssi38 = assetPackets[i].rssiContainer.rssi38;
-		message->trackedAssets[i].rssi39 = assetPackets[i].rssiContainer.rssi39;
 
-		message->trackedAssets[i].speed = ConvertServiceDataToMeshMessageSpeed(assetPackets[i].speed);
+		if (lost) RemoveTrackedAsset((u8)i);
+		else ResetRssiContainer(asset.rssiContainer);
+	}
+
+	//Evicted assets are reported as lost at the time they would have been lost in the buffer
+	for (int i = numEvictedAssets - 1; i >= 0; i--) {
+		const EvictedAsset& evicted = evictedAssets[i];
+		if (!IsAssetLost(evicted.lastSeenDs)) continue;
+
+		if (configuration.assetAggregationEnabled) {
+			AggregateAssetObservation(evicted.assetId, 0xF, 0xFF, GS->node.configuration.nodeId, 0);
+		}
+		else {
+			trackedAssetV2& trackedAsset = message->trackedAssets[count];
+			count++;
+
+			CheckedMemset(&trackedAsset, 0, sizeof(trackedAssetV2));
+			trackedAsset.assetId = evicted.assetId;
+			trackedAsset.rssi37 = -1;
+			trackedAsset.rssi38 = -1;
+			trackedAsset.rssi39 = -1;
+			trackedAsset.speed = 0xF; //Not available
+			trackedAsset.pressure = 0xFF; //Not available
+			trackedAsset.lost = 1;
+
+			if (count == maxAssetsPerMessage) {
+				//Send the packet as a non-module message to save some bytes in the header
+				GS->cm.SendMeshMessage(buffer, SIZEOF_CONN_PACKET_HEADER + SIZEOF_SCAN_MODULE_TRACKED_ASSET_V2 * count, DeliveryPriority::LOW);
+				count = 0;
+			}
+		}
 
-		message->trackedAssets[i].hasFreeInConnection = assetPackets[i].hasFreeInConnection;
-		message->trackedAssets[i].interestedInConnection = assetPackets[i].interestedInConnection;
-		message->trackedAssets[i].hasSameNetworkId = assetPackets[i].hasSameNetworkId;
+		RemoveEvictedAsset(evictedAssets, numEvictedAssets, (u8)i);
+	}
 
-		message->trackedAssets[i].pressure = ConvertServiceDataToMeshMessagePressure(assetPackets[i].pressure);
+	//In FULL mode, the buffer only contains the assets of one interval
+	if (configuration.assetReportingMode == AssetReportingMode::FULL) {
+		assetPackets.zeroData();
+		numAssetPackets = 0;
+		assetPacketsIndex.Clear();
 	}
 
-	//Send the packet as a non-module message to save some bytes in the header
-	GS->cm.SendMeshMessage(
-			buffer,
-			(u8)messageLength,
-			DeliveryPriority::LOW
-			);
+	if(count == 0) return;
 
-	//Clear the buffer
-	assetPackets.zeroData();
+	//Send the packet as a non-module message to save some bytes in the header
+	GS->cm.SendMeshMessage(buffer, SIZEOF_CONN_PACKET_HEADER + SIZEOF_SCAN_MODULE_TRACKED_ASSET_V2 * count, DeliveryPriority::LOW);
 #endif
 }
 
-void ScanningModule::SendTrackedAssetsIns()
+void ScanningModule::SendTrackedAssetsIns(bool fullReport)
 {
 #if IS_INACTIVE(GW_SAVE_SPACE)
-	//Find out how many assets were tracked
+	if (numAssetInsPackets == 0 && numEvictedAssetsIns == 0) return;
+
+	//The assets are split into multiple messages if they do not fit into a single one
+	constexpr u8 maxAssetsPerMessage = (MAX_MESH_PACKET_SIZE - SIZEOF_CONN_PACKET_MODULE) / sizeof(TrackedAssetInsMessage);
+	DYNAMIC_ARRAY(buffer, sizeof(TrackedAssetInsMessage) * maxAssetsPerMessage);
+	CheckedMemset(buffer, 0, sizeof(TrackedAssetInsMessage) * maxAssetsPerMessage);
+	TrackedAssetInsMessage* trackedAssets = (TrackedAssetInsMessage*)buffer;
+
+	//Iterates backwards as removing an asset moves the last asset into its slot
 	u8 count = 0;
-	for (int i = 0; i < ASSET_INS_PACKET_BUFFER_SIZE; i++) {
-		if (assetInsPackets[i].assetNodeId == 0) break;
-		count++;
-	}
+	for (int i = numAssetInsPackets - 1; i >= 0; i--) {
+		ScannedAssetInsTrackingStorage& asset = assetInsPackets[i];
+		const bool lost = IsAssetLost(asset.lastSeenDs);
+
+		if ((lost && asset.reportedRssi != 0) || (!lost && ShouldReportAsset(asset.rssiContainer, asset.reportedRssi, fullReport))) {
+			TrackedAssetInsMessage& trackedAsset = trackedAssets[count];
+			count++;
+
+			trackedAsset.assetNodeId = asset.assetNodeId;
+			trackedAsset.rssi37 = asset.rssiContainer.rssi37;
+			trackedAsset.rssi38 = asset.rssiContainer.rssi38;
+			trackedAsset.rssi39 = asset.rssiContainer.rssi39;
+			trackedAsset.batteryPower = asset.batteryPower;
+			trackedAsset.absolutePositionX = asset.absolutePositionX;
+			trackedAsset.absolutePositionY = asset.absolutePositionY;
+
+			trackedAsset.moving = asset.moving;
+			trackedAsset.pressure = ConvertServiceDataToMeshMessagePressure(asset.pressure);
+
+			trackedAsset.hasFreeInConnection = asset.hasFreeInConnection;
+			trackedAsset.interestedInConnection = asset.interestedInConnection;
+			trackedAsset.hasSameNetworkId = asset.hasSameNetworkId;
+			trackedAsset.lost = lost;
+
+			asset.reportedRssi = GetStrongestRssi(asset.rssiContainer);
+
+			if (count == maxAssetsPerMessage) {
+				SendModuleActionMessage(MessageType::ASSET_GENERIC, NODE_ID_SHORTEST_SINK, (u8)ScanModuleMessages::ASSET_INS_TRACKING_PACKET, 0, buffer, sizeof(TrackedAssetInsMessage) * count, false);
+				count = 0;
+			}
+		}
 
-	if (count == 0) return;
+		if (lost) RemoveTrackedAssetIns((u8)i);
+		else ResetRssiContainer(asset.rssiContainer);
+	}
 
-	//jstodo add test for tracked assets
-	u16 messageLength = sizeof(TrackedAssetInsMessage) * count;
+	//Evicted assets are reported as lost at the time they would have been lost in the buffer
+	for (int i = numEvictedAssetsIns - 1; i >= 0; i--) {
+		const EvictedAsset& evicted = evictedAssetsIns[i];
+		if (!IsAssetLost(evicted.lastSeenDs)) continue;
 
-	//Allocate a buffer big enough and fill the packet
-	DYNAMIC_ARRAY(buffer, messageLength);
-	CheckedMemset(buffer, 0, messageLength);
-	TrackedAssetInsMessage* trackedAssets = (TrackedAssetInsMessage*)buffer;
+		TrackedAssetInsMessage& trackedAsset = trackedAssets[count];
+		count++;
 
-	for (int i = 0; i < count; i++) {
-		trackedAssets[i].assetNodeId = assetInsPackets[i].assetNodeId;
-		trackedAssets[i].rssi37 = assetInsPackets[i].rssiContainer.rssi37;
-		trackedAssets[i].rssi38 = assetInsPackets[i].rssiContainer.rssi38;
-		trackedAssets[i].rssi39 = assetInsPackets[i].rssiContainer.rssi39;
-		trackedAssets[i].batteryPower = assetInsPackets[i].batteryPower;
-		trackedAssets[i].absolutePositionX = assetInsPackets[i].absolutePositionX;
-		trackedAssets[i].absolutePositionY = assetInsPackets[i].absolutePositionY;
+		CheckedMemset(&trackedAsset, 0, sizeof(TrackedAssetInsMessage));
+		trackedAsset.assetNodeId = (NodeId)evicted.assetId;
+		trackedAsset.rssi37 = -1;
+		trackedAsset.rssi38 = -1;
+		trackedAsset.rssi39 = -1;
+		trackedAsset.pressure = 0xFF; //Not available
+		trackedAsset.lost = 1;
+
+		if (count == maxAssetsPerMessage) {
+			SendModuleActionMessage(MessageType::ASSET_GENERIC, NODE_ID_SHORTEST_SINK, (u8)ScanModuleMessages::ASSET_INS_TRACKING_PACKET, 0, buffer, sizeof(TrackedAssetInsMessage) * count, false);
+			count = 0;
+		}
 
-		trackedAssets[i].moving = assetInsPackets[i].moving;
-		trackedAssets[i].pressure = ConvertServiceDataToMeshMessagePressure(assetInsPackets[i].pressure);
+		RemoveEvictedAsset(evictedAssetsIns, numEvictedAssetsIns, (u8)i);
+	}
 
-		trackedAssets[i].hasFreeInConnection = assetInsPackets[i].hasFreeInConnection;
-		trackedAssets[i].interestedInConnection = assetInsPackets[i].interestedInConnection;
-		trackedAssets[i].hasSameNetworkId = assetInsPackets[i].hasSameNetworkId;
+	//In FULL mode, the buffer only contains the assets of one interval
+	if (configuration.assetReportingMode == AssetReportingMode::FULL) {
+		assetInsPackets.zeroData();
+		numAssetInsPackets = 0;
+		assetInsPacketsIndex.Clear();
 	}
 
+	if (count == 0) return;
+
 	SendModuleActionMessage(
 		MessageType::ASSET_GENERIC,
 		NODE_ID_SHORTEST_SINK,
 		(u8)ScanModuleMessages::ASSET_INS_TRACKING_PACKET,
 		0,
 		buffer,
-		messageLength,
+		sizeof(TrackedAssetInsMessage) * count,
 		false
 	);
+#endif
+}
+
+#define _______________________ASSET_AGGREGATION______________________
+
+void ScanningModule::AggregateAssetObservation(u32 assetId, u8 speed, u8 pressure, NodeId observerId, u8 rssi)
+{
+	//Assets are only identified by 24 bits in the messages
+	assetId &= 0xFFFFFF;
+
+	i32 slot = aggregatedAssetsIndex.Find(assetId);
+	if (slot < 0) {
+		if (numAggregatedAssets >= MAX_AGGREGATED_ASSETS) FlushAggregatedAssets();
+		if (numAggregatedAssets == 0) aggregationStartDs = GS->appTimerDs;
+
+		slot = numAggregatedAssets;
+		numAggregatedAssets++;
+		CheckedMemset(&aggregatedAssets[slot], 0, sizeof(AggregatedAssetEntry));
+		aggregatedAssets[slot].assetId = assetId;
+		aggregatedAssetsIndex.Insert(assetId, (u8)slot);
+	}
+
+	AggregatedAssetEntry& entry = aggregatedAssets[slot];
+	entry.speed = speed;
+	entry.pressure = pressure;
+
+	//Multiple reports of the same observer, e.g. received over different paths, are merged
+	for (u32 i = 0; i < entry.numObservations; i++) {
+		if (entry.observations[i].observerId == observerId) {
+			entry.observations[i].rssi = rssi;
+			return;
+		}
+	}
+
+	if (entry.numObservations < MAX_AGGREGATED_ASSET_OBSERVATIONS) {
+		entry.observations[entry.numObservations].observerId = observerId;
+		entry.observations[entry.numObservations].rssi = rssi;
+		entry.numObservations++;
+		return;
+	}
+
+	//If the entry is full, only the strongest observations are kept (a lower positive rssi is stronger)
+	if (rssi == 0) return;
+	u32 weakest = 0;
+	for (u32 i = 1; i < entry.numObservations; i++) {
+		if (entry.observations[i].rssi == 0) continue;
+		if (entry.observations[weakest].rssi == 0 || entry.observations[i].rssi > entry.observations[weakest].rssi) weakest = i;
+	}
+	if (entry.observations[weakest].rssi > rssi) {
+		entry.observations[weakest].observerId = observerId;
+		entry.observations[weakest].rssi = rssi;
+	}
+}
+
+void ScanningModule::AggregateAssetRecords(u8 const * data, u16 dataLength)
+{
+	u16 offset = 0;
+	while (offset + SIZEOF_AGGREGATED_ASSET_RECORD_HEADER <= dataLength) {
+		AggregatedAssetRecord const * record = (AggregatedAssetRecord const *)(data + offset);
+		const u16 recordLength = SIZEOF_AGGREGATED_ASSET_RECORD_HEADER + SIZEOF_AGGREGATED_ASSET_OBSERVATION * record->numObservations;
+		if (offset + recordLength > dataLength) {
+			logt("WARNING", "Aggregated asset record too short");
+			return;
+		}
+
+		for (u32 i = 0; i < record->numObservations; i++) {
+			AggregateAssetObservation(record->assetId, record->speed, record->pressure, record->observations[i].observerId, record->observations[i].rssi);
+		}
+
+		offset += recordLength;
+	}
+}
+
+void ScanningModule::FlushAggregatedAssets()
+{
+	if (GET_DEVICE_TYPE() == DeviceType::SINK) PrintAggregatedAssets();
+	else SendAggregatedAssets();
+
+	aggregatedAssets.zeroData();
+	numAggregatedAssets = 0;
+	aggregatedAssetsIndex.Clear();
+}
+
+void ScanningModule::PrintAggregatedAssets() const
+{
+	//One record is printed per asset, no matter how many nodes have reported it
+	for (u32 i = 0; i < numAggregatedAssets; i++) {
+		AggregatedAssetEntry const & entry = aggregatedAssets[i];
+
+		i8 speed = entry.speed == 0xF ? -1 : entry.speed;
+		i16 pressure = entry.pressure == 0xFF ? -1 : entry.pressure;
+
+		logjson_partial("SCANMOD", "{\"nodeId\":%u,\"type\":\"tracked_asset\",\"module\":%u,\"id\":%u,\"speed\":%d,\"pressure\":%d,\"observers\":[",
+			GS->node.configuration.nodeId,
+			(u32)moduleId,
+			entry.assetId,
+			speed,
+			pressure);
+
+		for (u32 j = 0; j < entry.numObservations; j++) {
+			if (j != 0) logjson_partial("SCANMOD", ",");
+			logjson_partial("SCANMOD", "{\"nodeId\":%u,\"rssi\":%u}", entry.observations[j].observerId, entry.observations[j].rssi);
+		}
+
+		logjson("SCANMOD", "]}" SEP);
+	}
+}
+
+void ScanningModule::SendAggregatedAssets() const
+{
+	//The records are packed into as few messages as possible
+	constexpr u16 maxDataLength = MAX_MESH_PACKET_SIZE - SIZEOF_CONN_PACKET_MODULE;
+	DYNAMIC_ARRAY(buffer, maxDataLength);
+	u16 dataLength = 0;
+
+	for (u32 i = 0; i < numAggregatedAssets; i++) {
+		AggregatedAssetEntry const & entry = aggregatedAssets[i];
+		const u16 recordLength = SIZEOF_AGGREGATED_ASSET_RECORD_HEADER + SIZEOF_AGGREGATED_ASSET_OBSERVATION * entry.numObservations;
+
+		if (dataLength + recordLength > maxDataLength) {
+			SendModuleActionMessage(MessageType::ASSET_GENERIC, NODE_ID_SHORTEST_SINK, (u8)ScanModuleMessages::ASSET_AGGREGATED_TRACKING_PACKET, 0, buffer, dataLength, false);
+			dataLength = 0;
+		}
+
+		AggregatedAssetRecord* record = (AggregatedAssetRecord*)(buffer + dataLength);
+		record->assetId = entry.assetId;
+		record->numObservations = entry.numObservations;
+		record->speed = entry.speed;
+		record->pressure = entry.pressure;
+		CheckedMemcpy(record->observations, entry.observations, SIZEOF_AGGREGATED_ASSET_OBSERVATION * entry.numObservations);
+
+		dataLength += recordLength;
+	}
+
+	if (dataLength > 0) {
+		SendModuleActionMessage(MessageType::ASSET_GENERIC, NODE_ID_SHORTEST_SINK, (u8)ScanModuleMessages::ASSET_AGGREGATED_TRACKING_PACKET, 0, buffer, dataLength, false);
+	}
+}
+
+void ScanningModule::resetAssetTrackingTable()
+{
+	assetPackets.zeroData();
+	numAssetPackets = 0;
+	assetPacketsIndex.Clear();
 
-	//Clear the buffer
 	assetInsPackets.zeroData();
-#endif
+	numAssetInsPackets = 0;
+	assetInsPacketsIndex.Clear();
+
+	evictedAssets.zeroData();
+	numEvictedAssets = 0;
+	evictedAssetsIns.zeroData();
+	numEvictedAssetsIns = 0;
 }
 
 void ScanningModule::ReceiveTrackedAssets(BaseConnectionSendData* sendData, ScanModuleTrackedAssetsV2Message const * packet) const
@@ -472,7 +892,7 @@ void ScanningModule::ReceiveTrackedAssets(BaseConnectionSendData* sendData, Scan
 		i16 pressure = assetData->pressure == 0xFF ? -1 : assetData->pressure; //(taken %250 to exclude 0xFF)
 
 		if(i != 0) logjson_partial("SCANMOD", ",");
-		logjson_partial("SCANMOD", "{\"id\":%u,\"rssi1\":%d,\"rssi2\":%d,\"rssi3\":%d,\"speed\":%d,\"pressure\":%d,\"hasFreeInConnection\":%u,\"interestedInConnection\":%u,\"hasSameNetworkId\":%u}",
+		logjson_partial("SCANMOD", "{\"id\":%u,\"rssi1\":%d,\"rssi2\":%d,\"rssi3\":%d,\"speed\":%d,\"pressure\":%d,\"hasFreeInConnection\":%u,\"interestedInConnection\":%u,\"hasSameNetworkId\":%u,\"lost\":%u}",
 				assetData->assetId,
 				assetData->rssi37,
 				assetData->rssi38,
@@ -481,7 +901,8 @@ void ScanningModule::ReceiveTrackedAssets(BaseConnectionSendData* sendData, Scan
 				pressure,
 				assetData->hasFreeInConnection,
 				assetData->interestedInConnection,
-				assetData->hasSameNetworkId);
+				assetData->hasSameNetworkId,
+				assetData->lost);
 
 		//logt("SCANMOD", "MESH RX id: %u, rssi %u, speed %u", assetData->assetId, assetData->rssi, assetData->speed);
 	}
@@ -497,7 +918,7 @@ void ScanningModule::ReceiveTrackedAssetsIns(TrackedAssetInsMessage const * msg,
 
 		i16 pressure = msg[i].pressure == 0xFF ? -1 : msg[i].pressure; //(taken %250 to exclude 0xFF)
 		if (i != 0) logjson_partial("SCANMOD", ",");
-		logjson_partial("SCANMOD", "{\"id\":%u,\"rssi1\":%d,\"rssi2\":%d,\"rssi3\":%d,\"batteryPower\":%u,\"absolutePositionX\":%u,\"absolutePositionY\":%u,\"moving\":%u,\"pressure\":%d,\"hasFreeInConnection\":%u,\"interestedInConnection\":%u,\"hasSameNetworkId\":%u}",
+		logjson_partial("SCANMOD", "{\"id\":%u,\"rssi1\":%d,\"rssi2\":%d,\"rssi3\":%d,\"batteryPower\":%u,\"absolutePositionX\":%u,\"absolutePositionY\":%u,\"moving\":%u,\"pressure\":%d,\"hasFreeInConnection\":%u,\"interestedInConnection\":%u,\"hasSameNetworkId\":%u,\"lost\":%u}",
 			msg[i].assetNodeId,
 			msg[i].rssi37,
 			msg[i].rssi38,
@@ -509,7 +930,8 @@ void ScanningModule::ReceiveTrackedAssetsIns(TrackedAssetInsMessage const * msg,
 			pressure,
 			msg[i].hasFreeInConnection,
 			msg[i].interestedInConnection,
-			msg[i].hasSameNetworkId);
+			msg[i].hasSameNetworkId,
+			msg[i].lost);
 
 	}
 
@@ -520,9 +942,7 @@ void ScanningModule::RssiRunningAverageCalculationInPlace(RssiContainer &contain
 {
 	//If the count is at its max, we reset the rssi
 	if (container.count == UINT8_MAX) {
-		container.count = 0;
-		container.rssi37 = container.rssi38 = container.rssi39 = UINT8_MAX;
-		container.channelCount[0] = container.channelCount[1] = container.channelCount[2] = 0;
+		ResetRssiContainer(container);
 	}
 
 	container.count++;
@@ -549,6 +969,22 @@ void ScanningModule::RssiRunningAverageCalculationInPlace(RssiContainer &contain
 	}
 }
 
+void ScanningModule::ResetRssiContainer(RssiContainer &container)
+{
+	container.count = 0;
+	container.rssi37 = container.rssi38 = container.rssi39 = UINT8_MAX;
+	container.channelCount[0] = container.channelCount[1] = container.channelCount[2] = 0;
+}
+
+u8 ScanningModule::GetStrongestRssi(const RssiContainer &container)
+{
+	//The rssi is stored as a positive value, so the strongest one is the smallest
+	u8 rssi = container.rssi37;
+	if (container.rssi38 < rssi) rssi = container.rssi38;
+	if (container.rssi39 < rssi) rssi = container.rssi39;
+	return rssi;
+}
+
 u8 ScanningModule::ConvertServiceDataToMeshMessageSpeed(u8 serviceDataSpeed)
 {
 	if      (serviceDataSpeed == 0xFF) return 0xF;
@@ -563,3 +999,73 @@ u8 ScanningModule::ConvertServiceDataToMeshMessagePressure(u16 serviceDataPressu
 	else return (u8)(serviceDataPressure % 250); //Will wrap, which is ok (we still have a relative pressure, but not the absolute one, mod 250 to reserve 0xFF for not available)
 
 }
+
+#define _______________________ASSET_SLOT_INDEX______________________
+
+u32 ScanningModule::AssetSlotIndex::GetHomeBucket(u32 key)
+{
+	//Fibonacci hashing, the upper bits are well distributed even for consecutive ids
+	return (u32)(key * 2654435769u) >> (32 - ASSET_TRACKING_HASH_TABLE_BITS);
+}
+
+i32 ScanningModule::AssetSlotIndex::FindBucket(u32 key) const
+{
+	u32 bucket = GetHomeBucket(key);
+	while (slots[bucket] != EMPTY_SLOT) {
+		if (keys[bucket] == key) return bucket;
+		bucket = (bucket + 1) & BUCKET_MASK;
+	}
+	return -1;
+}
+
+void ScanningModule::AssetSlotIndex::Clear()
+{
+	for (u32 i = 0; i < ASSET_TRACKING_HASH_TABLE_SIZE; i++) {
+		keys[i] = 0;
+		slots[i] = EMPTY_SLOT;
+	}
+}
+
+i32 ScanningModule::AssetSlotIndex::Find(u32 key) const
+{
+	const i32 bucket = FindBucket(key);
+	return bucket < 0 ? -1 : slots[bucket];
+}
+
+void ScanningModule::AssetSlotIndex::Insert(u32 key, u8 slot)
+{
+	//The table is always bigger than the asset buffers, so there is always a free bucket
+	u32 bucket = GetHomeBucket(key);
+	while (slots[bucket] != EMPTY_SLOT && keys[bucket] != key) {
+		bucket = (bucket + 1) & BUCKET_MASK;
+	}
+	keys[bucket] = key;
+	slots[bucket] = slot;
+}
+
+void ScanningModule::AssetSlotIndex::Remove(u32 key)
+{
+	const i32 bucket = FindBucket(key);
+	if (bucket < 0) return;
+
+	//Shift all following entries of the probe sequence back so that no tombstones are needed
+	u32 hole = bucket;
+	u32 next = (hole + 1) & BUCKET_MASK;
+	while (slots[next] != EMPTY_SLOT) {
+		const u32 home = GetHomeBucket(keys[next]);
+		if (((next - home) & BUCKET_MASK) >= ((next - hole) & BUCKET_MASK)) {
+			keys[hole] = keys[next];
+			slots[hole] = slots[next];
+			hole = next;
+		}
+		next = (next + 1) & BUCKET_MASK;
+	}
+	keys[hole] = 0;
+	slots[hole] = EMPTY_SLOT;
+}
+
+void ScanningModule::AssetSlotIndex::UpdateSlot(u32 key, u8 slot)
+{
+	const i32 bucket = FindBucket(key);
+	if (bucket >= 0) slots[bucket] = slot;
+}
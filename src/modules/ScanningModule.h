@@ -54,6 +54,15 @@ constexpr int ASSET_PACKET_BUFFER_SIZE = 30;
 constexpr int ASSET_INS_PACKET_BUFFER_SIZE = 30;
 constexpr int ASSET_PACKET_RSSI_SEND_THRESHOLD = -88;
 
+//The asset scan is planned so that an asset advertising at least this often is found once per reporting interval
+constexpr u16 ASSET_MAX_ADVERTISING_INTERVAL_MS = 1000;
+constexpr u8 ASSET_DETECTION_PROBABILITY_PERCENT = 95;
+
+//The asset buffers are indexed by an open addressing hash table, it must be bigger than the buffers
+constexpr int ASSET_TRACKING_HASH_TABLE_BITS = 6;
+constexpr int ASSET_TRACKING_HASH_TABLE_SIZE = 1 << ASSET_TRACKING_HASH_TABLE_BITS;
+static_assert(ASSET_TRACKING_HASH_TABLE_SIZE > ASSET_PACKET_BUFFER_SIZE && ASSET_TRACKING_HASH_TABLE_SIZE > ASSET_INS_PACKET_BUFFER_SIZE, "Hash table too small");
+
 constexpr int SCAN_BUFFERS_SIZE = 10; //Max number of packets that are buffered
 
 enum class GroupingType : u8 {
@@ -61,6 +70,11 @@ enum class GroupingType : u8 {
 	NO_GROUPING      =2,
 };
 
+enum class AssetReportingMode : u8 {
+	FULL  = 0, //All assets that were scanned during the interval are reported
+	DELTA = 1, //Only new, lost and moved assets are reported, all others only with the periodic full report
+};
+
 typedef struct
 {
 	u8 active;
@@ -77,6 +91,12 @@ typedef struct
 #pragma pack(push, 1)
 //Module configuration that is saved persistently
 struct ScanningModuleConfiguration : ModuleConfiguration{
+	AssetReportingMode assetReportingMode;
+	u8 assetRssiDeltaThreshold; //Change of the rssi in dBm after which a moved asset is reported again
+	u16 assetLostTimeoutDs; //An asset that was not scanned for this time is reported as lost
+	u16 assetFullReportIntervalDs; //Interval in which all assets are reported in DELTA mode
+	u8 assetAggregationEnabled; //Asset reports are merged with the reports of other nodes on their way to the sink
+	u16 assetAggregationDelayDs; //Time that reports are held back for merging before they are forwarded or printed by the sink
 	//Insert more persistent config values here
 };
 #pragma pack(pop)
@@ -114,9 +134,37 @@ private:
 		u8 interestedInConnection : 1;
 		u8 hasSameNetworkId : 1;
 		u8 reservedBits : 5;
+		u32 lastSeenDs;
+		u8 reportedRssi; //Strongest rssi of the last report, 0 if the asset was not reported yet
+	};
+
+	//Maps the id of an asset to its slot in one of the asset buffers so that a scanned
+	//advertisement does not have to be compared with the whole buffer
+	class AssetSlotIndex
+	{
+	private:
+		static constexpr u8 EMPTY_SLOT = 0xFF;
+		static constexpr u32 BUCKET_MASK = ASSET_TRACKING_HASH_TABLE_SIZE - 1;
+
+		SimpleArray<u32, ASSET_TRACKING_HASH_TABLE_SIZE> keys;
+		SimpleArray<u8, ASSET_TRACKING_HASH_TABLE_SIZE> slots;
+
+		static u32 GetHomeBucket(u32 key);
+		i32 FindBucket(u32 key) const;
+
+	public:
+		void Clear();
+		i32 Find(u32 key) const;
+		void Insert(u32 key, u8 slot);
+		void Remove(u32 key);
+		void UpdateSlot(u32 key, u8 slot);
 	};
 
+	//The asset buffers are kept compact, entries are only valid up to the number of assets
 	SimpleArray<ScannedAssetTrackingStorage, ASSET_PACKET_BUFFER_SIZE> assetPackets;
+	u8 numAssetPackets = 0;
+	AssetSlotIndex assetPacketsIndex;
+	u32 lastFullAssetReportDs = 0;
 
 	typedef struct
 	{
@@ -149,6 +197,7 @@ private:
 		//TOTAL_SCANNED_PACKETS=0,  //Removed as of 21.05.2019
 		//ASSET_TRACKING_PACKET=1,  //Removed as of 24.10.2019
 		ASSET_INS_TRACKING_PACKET = 2,
+		ASSET_AGGREGATED_TRACKING_PACKET = 3,
 	};
 
 	//####### Module specific message structs (these need to be packed)
@@ -167,7 +216,7 @@ private:
 		u8 hasFreeInConnection : 1;
 		u8 interestedInConnection : 1;
 		u8 hasSameNetworkId : 1;
-		u8 reservedBits : 1;
+		u8 lost : 1;
 		u8 pressure;
 	} trackedAssetV2;
 	STATIC_ASSERT_SIZE(trackedAssetV2, 8);
@@ -192,7 +241,8 @@ private:
 		u8 hasFreeInConnection : 1;
 		u8 interestedInConnection : 1;
 		u8 hasSameNetworkId : 1;
-		u8 reservedBits : 4;
+		u8 lost : 1;
+		u8 reservedBits : 3;
 	};
 	STATIC_ASSERT_SIZE(TrackedAssetInsMessage, 12);
 
@@ -210,13 +260,71 @@ private:
 		u8 interestedInConnection : 1;
 		u8 hasSameNetworkId : 1;
 		u8 reservedBits : 5;
+		u32 lastSeenDs;
+		u8 reportedRssi; //Strongest rssi of the last report, 0 if the asset was not reported yet
 	};
 
 	SimpleArray<ScannedAssetInsTrackingStorage, ASSET_INS_PACKET_BUFFER_SIZE> assetInsPackets;
+	u8 numAssetInsPackets = 0;
+	AssetSlotIndex assetInsPacketsIndex;
+
+	//Reported assets that were evicted from a full buffer are remembered so that they are reported as lost after
+	//the lost timeout and are not reported as new if they are scanned again before that
+	static constexpr u8 EVICTED_ASSET_BUFFER_SIZE = 8;
+	struct EvictedAsset
+	{
+		u32 key; //Key of the asset in its buffer, the serialNumberIndex or the assetNodeId
+		u32 assetId; //Id with which the asset was reported
+		u32 lastSeenDs;
+		u8 reportedRssi;
+	};
+	typedef SimpleArray<EvictedAsset, EVICTED_ASSET_BUFFER_SIZE> EvictedAssetBuffer;
+	EvictedAssetBuffer evictedAssets;
+	u8 numEvictedAssets = 0;
+	EvictedAssetBuffer evictedAssetsIns;
+	u8 numEvictedAssetsIns = 0;
+
+	//Aggregated assets contain the rssi of every node that scanned the asset
+	static constexpr int SIZEOF_AGGREGATED_ASSET_OBSERVATION = 3;
+	struct AggregatedAssetObservation
+	{
+		NodeId observerId;
+		u8 rssi; //Positive rssi of the strongest channel, 0 if the observer lost the asset
+	};
+	STATIC_ASSERT_SIZE(AggregatedAssetObservation, SIZEOF_AGGREGATED_ASSET_OBSERVATION);
+
+	static constexpr int SIZEOF_AGGREGATED_ASSET_RECORD_HEADER = 6;
+	struct AggregatedAssetRecord
+	{
+		u32 assetId : 24;
+		u32 numObservations : 8;
+		u8 speed; //Same as in the trackedAssetV2
+		u8 pressure;
+		AggregatedAssetObservation observations[1];
+	};
+	STATIC_ASSERT_SIZE(AggregatedAssetRecord, SIZEOF_AGGREGATED_ASSET_RECORD_HEADER + SIZEOF_AGGREGATED_ASSET_OBSERVATION);
 
 	//####### End of Module specitic messages
 #pragma pack(pop)
 
+	static constexpr u8 MAX_AGGREGATED_ASSETS = 16;
+	static constexpr u8 MAX_AGGREGATED_ASSET_OBSERVATIONS = 6;
+
+	//Reports of the same asset from different nodes are merged into a single entry
+	struct AggregatedAssetEntry
+	{
+		u32 assetId;
+		u8 speed;
+		u8 pressure;
+		u8 numObservations;
+		AggregatedAssetObservation observations[MAX_AGGREGATED_ASSET_OBSERVATIONS];
+	};
+
+	SimpleArray<AggregatedAssetEntry, MAX_AGGREGATED_ASSETS> aggregatedAssets;
+	u8 numAggregatedAssets = 0;
+	AssetSlotIndex aggregatedAssetsIndex;
+	u32 aggregationStartDs = 0; //Time at which the oldest report of the aggregated assets was received
+
 
 //Asset packet handling
 	void HandleAssetV2Packets(const FruityHal::GapAdvertisementReportEvent& advertisementReportEvent);
@@ -226,6 +334,22 @@ private:
 	void ReceiveTrackedAssets(BaseConnectionSendData* sendData, ScanModuleTrackedAssetsV2Message const * packet) const;
 	void ReceiveTrackedAssetsIns(TrackedAssetInsMessage const * msg, u32 amount, NodeId sender) const;
 	void RssiRunningAverageCalculationInPlace(RssiContainer &container, u8 advertisingChannel, i8 rssi);
+	static void ResetRssiContainer(RssiContainer &container);
+	static u8 GetStrongestRssi(const RssiContainer &container);
+	bool IsAssetLost(u32 lastSeenDs) const;
+	bool ShouldReportAsset(const RssiContainer &container, u8 reportedRssi, bool fullReport) const;
+	void RemoveTrackedAsset(u8 slot);
+	void RemoveTrackedAssetIns(u8 slot);
+	static void RememberEvictedAsset(EvictedAssetBuffer &buffer, u8 &numEvicted, u32 key, u32 assetId, u32 lastSeenDs, u8 reportedRssi);
+	static u8 RestoreEvictedAsset(EvictedAssetBuffer &buffer, u8 &numEvicted, u32 key);
+	static void RemoveEvictedAsset(EvictedAssetBuffer &buffer, u8 &numEvicted, u8 slot);
+
+	//Asset aggregation
+	void AggregateAssetObservation(u32 assetId, u8 speed, u8 pressure, NodeId observerId, u8 rssi);
+	void AggregateAssetRecords(u8 const * data, u16 dataLength);
+	void FlushAggregatedAssets();
+	void PrintAggregatedAssets() const;
+	void SendAggregatedAssets() const;
 
 	//Byte muss gesetzt sein, byte darf nicht gesetzt sein, byte ist egal
 	bool setScanFilter(scanFilterEntry* filter);
@@ -234,8 +358,8 @@ private:
 
 	bool isAssetTrackingData(u8* data, u8 dataLength);
 	void resetAssetTrackingTable();
-	void SendTrackedAssets();
-	void SendTrackedAssetsIns();
+	void SendTrackedAssets(bool fullReport);
+	void SendTrackedAssetsIns(bool fullReport);
 	bool isAssetTrackingDataFromiOSDeviceInForegroundMode(u8* data, u8 dataLength);
 
 	bool advertiseDataWasSentFromMobileDevice(u8* data, u8 dataLength);
@@ -255,6 +379,8 @@ private:
 	static u8 ConvertServiceDataToMeshMessageSpeed(u8 serviceDataSpeed);
 	u8 ConvertServiceDataToMeshMessagePressure(u16 serviceDataPressure);
 
+	void RefreshScanJob();
+
 
 public:
 	u16 assetReportingIntervalDs = 0;
@@ -275,6 +401,8 @@ public:
 
 	void MeshMessageReceivedHandler(BaseConnection* connection, BaseConnectionSendData* sendData, connPacketHeader const * packetHeader) override;
 
+	RoutingDecision MessageRoutingInterceptor(BaseConnection* connection, BaseConnectionSendData* sendData, connPacketHeader const * packetHeader) override;
+
 #ifdef TERMINAL_ENABLED
 	TerminalCommandHandlerReturnType TerminalCommandHandler(const char* commandArgs[], u8 commandArgsSize) override;
 #endif
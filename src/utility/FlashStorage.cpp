@@ -36,7 +36,6 @@
 //TODO: NRF_BUSY and other errors of FruityHal::FlashWrite should be handled
 //TODO: callback should use task pointer instead of struct
 //TODO: Is it necessary to provide a validation method after saving / erasing or does the softdevice already handle this?
-//TODO: if a transaction is started, first item will be executed even if not all transaction items could be saved
 //TODO: Does only support items with about 220 bytes because of PacketQueue element length limitation
 //TODO: WriteData is only able to write multiples of words
 
@@ -85,14 +84,7 @@ FlashStorageError FlashStorage::ErasePages(u16 startPage, u16 numPages, FlashSto
 	task.params.erasePages.startPage = startPage;
 	task.params.erasePages.numPages = numPages;
 
-	if (!taskQueue.Put((u8*)&task, SIZEOF_FLASH_STORAGE_TASK_ITEM_ERASE_PAGES))
-	{
-		return FlashStorageError::QUEUE_FULL;
-	}
-
-	ProcessQueue(false);
-
-	return FlashStorageError::SUCCESS;
+	return QueueTask(task, SIZEOF_FLASH_STORAGE_TASK_ITEM_ERASE_PAGES);
 }
 
 FlashStorageError FlashStorage::WriteData(u32* source, u32* destination, u16 length, FlashStorageEventListener* callback, u32 userType, u32 extraInfo)
@@ -109,14 +101,7 @@ FlashStorageError FlashStorage::WriteData(u32* source, u32* destination, u16 len
 	task.params.writeData.dataDestination = destination;
 	task.params.writeData.dataLength = length;
 
-	if (!taskQueue.Put((u8*)&task, SIZEOF_FLASH_STORAGE_TASK_ITEM_WRITE_DATA))
-	{
-		return FlashStorageError::QUEUE_FULL;
-	}
-
-	ProcessQueue(false);
-
-	return FlashStorageError::SUCCESS;
+	return QueueTask(task, SIZEOF_FLASH_STORAGE_TASK_ITEM_WRITE_DATA);
 }
 
 FlashStorageError FlashStorage::CacheAndWriteData(u32 const * source, u32* destination, u16 length, FlashStorageEventListener* callback, u32 userType, u32 extraInfo)
@@ -136,12 +121,15 @@ FlashStorageError FlashStorage::CacheAndWriteData(u32 const * source, u32* desti
 		//Write data into reserved space
 		FlashStorageTaskItem* task = (FlashStorageTaskItem*)buffer;
 		task->header.command = FlashStorageCommand::WRITE_AND_CACHE_DATA;
+		task->header.transactionId = openTransactionId;
 		task->header.callback = callback;
 		task->header.userType = userType;
 		task->header.extraInfo = extraInfo;
 		task->params.writeCachedData.dataDestination = destination;
 		task->params.writeCachedData.dataLength = length;
 		CheckedMemcpy(task->params.writeCachedData.data, source, length);
+
+		if (openTransactionId != 0) openTransactionNumTasks++;
 	}
 	else 
 	{
@@ -156,9 +144,92 @@ FlashStorageError FlashStorage::CacheAndWriteData(u32 const * source, u32* desti
 	return FlashStorageError::SUCCESS;
 }
 
+FlashStorageError FlashStorage::QueueTask(FlashStorageTaskItem& task, u16 length)
+{
+	task.header.transactionId = openTransactionId;
+
+	if (!taskQueue.Put((u8*)&task, length))
+	{
+		return FlashStorageError::QUEUE_FULL;
+	}
+
+	if (openTransactionId != 0) openTransactionNumTasks++;
+
+	ProcessQueue(false);
+
+	return FlashStorageError::SUCCESS;
+}
+
+FlashStorageError FlashStorage::StartTransaction()
+{
+	//Nested transactions are not supported
+	if (openTransactionId != 0) return FlashStorageError::TRANSACTION_IN_PROGRESS;
+
+	//Transaction id 0 is reserved for tasks that do not belong to a transaction
+	transactionCounter++;
+	if (transactionCounter == 0) transactionCounter++;
+
+	openTransactionId = transactionCounter;
+	openTransactionNumTasks = 0;
+
+	logt("FLASH", "Start transaction %u", openTransactionId);
+
+	return FlashStorageError::SUCCESS;
+}
+
+void FlashStorage::EndTransaction()
+{
+	logt("FLASH", "End transaction %u with %u tasks", openTransactionId, openTransactionNumTasks);
+
+	openTransactionId = 0;
+	openTransactionNumTasks = 0;
+
+	ProcessQueue(false);
+}
+
+void FlashStorage::AbortTransaction()
+{
+	logt("FLASH", "Abort transaction %u with %u tasks", openTransactionId, openTransactionNumTasks);
+
+	//Tasks of an open transaction are never executed, so they are always the last ones in the queue
+	while (openTransactionNumTasks > 0)
+	{
+		taskQueue.DiscardLast();
+		openTransactionNumTasks--;
+	}
+
+	openTransactionId = 0;
+
+	ProcessQueue(false);
+}
+
 //Aborts the transaction in progress because of a flash fail
 void FlashStorage::AbortTransactionInProgress(FlashStorageError errorCode)
 {
+	//All tasks that were merged into the failed flash operation have failed as well
+	for (u8 i = 1; i < currentTaskCount; i++)
+	{
+		if (currentTask->header.callback != nullptr) {
+			currentTask->header.callback->FlashStorageItemExecuted(currentTask, errorCode);
+		}
+		taskQueue.DiscardNext();
+		currentTask = (FlashStorageTaskItem*)taskQueue.PeekNext().data;
+	}
+
+	//Drop the remaining tasks of the transaction so that it is never executed partially
+	const u8 transactionId = currentTask->header.transactionId;
+	while (transactionId != 0 && taskQueue._numElements > 1)
+	{
+		FlashStorageTaskItem* nextTask = (FlashStorageTaskItem*)taskQueue.PeekNext(1).data;
+		if (nextTask->header.transactionId != transactionId) break;
+
+		if (currentTask->header.callback != nullptr) {
+			currentTask->header.callback->FlashStorageItemExecuted(currentTask, errorCode);
+		}
+		taskQueue.DiscardNext();
+		currentTask = nextTask;
+	}
+
 	//Finally, call the callback of the failing task
 	if (currentTask->header.callback != nullptr) {
 		currentTask->header.callback->FlashStorageItemExecuted(currentTask, errorCode);
@@ -170,16 +241,83 @@ void FlashStorage::AbortTransactionInProgress(FlashStorageError errorCode)
 void FlashStorage::RemoveExecutingTask()
 {
 	currentTask = nullptr;
+	currentTaskCount = 0;
 	taskQueue.DiscardNext();
 	if (taskQueue._numElements == 0) GS->recordStorage.FlashStorageQueueEmptyHandler();
 }
 
 void FlashStorage::OnCommandSuccessful()
 {
+	//Tasks that were merged into the executed flash operation are finished in the order they were queued
+	for (u8 i = 1; i < currentTaskCount; i++)
+	{
+		if (currentTask->header.callback != nullptr) currentTask->header.callback->FlashStorageItemExecuted(currentTask, FlashStorageError::SUCCESS);
+		taskQueue.DiscardNext();
+		currentTask = (FlashStorageTaskItem*)taskQueue.PeekNext().data;
+	}
+
 	if (currentTask->header.callback != nullptr) currentTask->header.callback->FlashStorageItemExecuted(currentTask, FlashStorageError::SUCCESS);
 	RemoveExecutingTask();
 }
 
+void FlashStorage::CoalesceWrites()
+{
+	FlashStorageTaskItemWriteCachedData* params = &currentTask->params.writeCachedData;
+	u16 length = params->dataLength + (4 - params->dataLength % 4) % 4;
+	u8* nextDestination = ((u8*)params->dataDestination) + length;
+
+	coalescedLength = 0;
+
+	while (currentTaskCount < FLASH_STORAGE_MAX_MERGED_TASKS && currentTaskCount < taskQueue._numElements)
+	{
+		FlashStorageTaskItem* nextTask = (FlashStorageTaskItem*)taskQueue.PeekNext(currentTaskCount).data;
+		FlashStorageTaskItemWriteCachedData* nextParams = &nextTask->params.writeCachedData;
+		u16 nextLength = nextParams->dataLength + (4 - nextParams->dataLength % 4) % 4;
+
+		//Only writes of the same transaction that continue exactly where the previous one ended can be merged
+		if (nextTask->header.command != FlashStorageCommand::WRITE_AND_CACHE_DATA
+			|| nextTask->header.transactionId != currentTask->header.transactionId
+			|| (u8*)nextParams->dataDestination != nextDestination
+			|| length + nextLength > FLASH_STORAGE_COALESCE_BUFFER_SIZE) {
+			break;
+		}
+
+		if (coalescedLength == 0) {
+			CheckedMemcpy(coalesceBuffer, params->data, length);
+		}
+		CheckedMemcpy(((u8*)coalesceBuffer) + length, nextParams->data, nextLength);
+
+		length += nextLength;
+		coalescedLength = length;
+		nextDestination += nextLength;
+		currentTaskCount++;
+	}
+}
+
+void FlashStorage::MergeErases()
+{
+	FlashStorageTaskItemErasePages* params = &currentTask->params.erasePages;
+
+	while (currentTaskCount < FLASH_STORAGE_MAX_MERGED_TASKS && currentTaskCount < taskQueue._numElements)
+	{
+		FlashStorageTaskItem* nextTask = (FlashStorageTaskItem*)taskQueue.PeekNext(currentTaskCount).data;
+		if (nextTask->header.command != FlashStorageCommand::ERASE_PAGES
+			|| nextTask->header.transactionId != currentTask->header.transactionId) break;
+
+		u16 startPage = params->startPage;
+		u16 endPage = params->startPage + params->numPages;
+		u16 nextStartPage = nextTask->params.erasePages.startPage;
+		u16 nextEndPage = nextStartPage + nextTask->params.erasePages.numPages;
+
+		//Only adjacent or overlapping page ranges are merged so that no additional pages are erased
+		if (nextStartPage > endPage || nextEndPage < startPage) break;
+
+		params->startPage = nextStartPage < startPage ? nextStartPage : startPage;
+		params->numPages = (nextEndPage > endPage ? nextEndPage : endPage) - params->startPage;
+		currentTaskCount++;
+	}
+}
+
 void FlashStorage::ProcessQueue(bool continueCurrentTask)
 {
 	//When starting flash operations, we want to make sure that we do not get interrupted by the Watchdog
@@ -190,11 +328,21 @@ void FlashStorage::ProcessQueue(bool continueCurrentTask)
 	//Do not execute next task if there is a task running or if there are no more tasks
 	if((currentTask != nullptr && !continueCurrentTask) || taskQueue._numElements < 1) return;
 
+	//Tasks are not started while a transaction is queued so that they can be merged once it is committed
+	if(openTransactionId != 0 && !continueCurrentTask) return;
+
 	//Get one item from the queue and execute it
 	SizedData data = taskQueue.PeekNext();
 	currentTask = (FlashStorageTaskItem*)data.data;
 
-	logt("FLASH", "processing command %u", (u32)currentTask->header.command);
+	if(!continueCurrentTask)
+	{
+		currentTaskCount = 1;
+		if(currentTask->header.command == FlashStorageCommand::WRITE_AND_CACHE_DATA) CoalesceWrites();
+		else if(currentTask->header.command == FlashStorageCommand::ERASE_PAGES) MergeErases();
+	}
+
+	logt("FLASH", "processing command %u (%u tasks)", (u32)currentTask->header.command, currentTaskCount);
 
 	if(currentTask->header.command == FlashStorageCommand::ERASE_PAGES)
 	{
@@ -243,11 +391,18 @@ void FlashStorage::ProcessQueue(bool continueCurrentTask)
 	else if (currentTask->header.command == FlashStorageCommand::WRITE_AND_CACHE_DATA) {
 		FlashStorageTaskItemWriteCachedData* params = &currentTask->params.writeCachedData;
 
-		u8 padding = (4-params->dataLength%4)%4;
+		if (currentTaskCount > 1) {
+			logt("FLASH", "copy %u coalesced writes to %u, length %u", currentTaskCount, (u32)params->dataDestination, coalescedLength);
 
-		logt("FLASH", "copy cached data to %u, length %u", (u32)params->dataDestination, params->dataLength);
+			err = FruityHal::FlashWrite(params->dataDestination, coalesceBuffer, coalescedLength / 4); //FIXME: NRF_ERROR_BUSY and others not handeled
+		}
+		else {
+			u8 padding = (4-params->dataLength%4)%4;
 
-		err = FruityHal::FlashWrite(params->dataDestination, (u32*)params->data, (params->dataLength+padding) / 4); //FIXME: NRF_ERROR_BUSY and others not handeled
+			logt("FLASH", "copy cached data to %u, length %u", (u32)params->dataDestination, params->dataLength);
+
+			err = FruityHal::FlashWrite(params->dataDestination, (u32*)params->data, (params->dataLength+padding) / 4); //FIXME: NRF_ERROR_BUSY and others not handeled
+		}
 	}
 	else {
 		logt("ERROR", "Wrong command %u", (u32)currentTask->header.command);
@@ -62,7 +62,8 @@ constexpr int SIZEOF_FLASH_STORAGE_TASK_ITEM_HEADER = 16;
 struct FlashStorageTaskItemHeader
 {
 	FlashStorageCommand command;
-	u8 reserved[3];
+	u8 transactionId; //0 if the task does not belong to a transaction
+	u8 reserved[2];
 	FlashStorageEventListener* callback;
 	u32 userType;
 	u32 extraInfo;
@@ -116,9 +117,13 @@ struct FlashStorageTaskItem
 constexpr int FLASH_STORAGE_RETRY_COUNT = 10;
 #if defined(NRF51)
 constexpr int FLASH_STORAGE_QUEUE_SIZE = 512;
+constexpr int FLASH_STORAGE_COALESCE_BUFFER_SIZE = 128;
 #else
 constexpr int FLASH_STORAGE_QUEUE_SIZE = 2048;
+constexpr int FLASH_STORAGE_COALESCE_BUFFER_SIZE = 512;
 #endif
+//Maximum number of queued tasks that are executed together as a single flash operation
+constexpr int FLASH_STORAGE_MAX_MERGED_TASKS = 16;
 
 class FlashStorage
 {
@@ -127,21 +132,36 @@ class FlashStorage
 		u32 taskBuffer[FLASH_STORAGE_QUEUE_SIZE / sizeof(u32)] = { 0 };
 		PacketQueue taskQueue;
 
+		//Contiguous cached writes are copied here so that they can be written with a single flash operation
+		u32 coalesceBuffer[FLASH_STORAGE_COALESCE_BUFFER_SIZE / sizeof(u32)] = { 0 };
+		u16 coalescedLength = 0;
+
 		FlashStorageTaskItem* currentTask = nullptr;
+		//Number of queued tasks (starting with currentTask) that are executed by the current flash operation
+		u8 currentTaskCount = 0;
 		i8 retryCount = 0;
-		u16 transactionCounter = 0;
+		u8 transactionCounter = 0;
+		//Id of the transaction that is currently being queued, 0 if none
+		u8 openTransactionId = 0;
+		u16 openTransactionNumTasks = 0;
 		bool retryCallingSoftdevice = false;
 
 		FlashStorageEventListener* emptyHandler = nullptr;
 
 		//Starts or continues to execute flash tasks
 		void ProcessQueue(bool continueCurrentTask);
-		
+
+		//Merges the current write with all following cached writes to contiguous addresses
+		void CoalesceWrites();
+		//Merges the current erase with all following erases of adjacent or overlapping pages
+		void MergeErases();
+
 		//Drops all task items belonging to a transaction after there was one fail and finally, calls the callback
 		void AbortTransactionInProgress(FlashStorageError errorCode);
 
 		void RemoveExecutingTask();
 		void OnCommandSuccessful();
+		FlashStorageError QueueTask(FlashStorageTaskItem& task, u16 length);
 
 	public:
 		FlashStorage();
@@ -163,6 +183,14 @@ class FlashStorage
 		//Caches the data in an internal buffer before saving (destination page must be empty)
 		FlashStorageError CacheAndWriteData(u32 const * source, u32* destination, u16 length, FlashStorageEventListener* callback, u32 userType, u32 extraInfo = 0);
 
+		//Starts a transaction. All tasks queued until EndTransaction is called are executed as a batch,
+		//contiguous writes are coalesced and if one task fails, the remaining tasks of the transaction are dropped
+		FlashStorageError StartTransaction();
+		//Commits the open transaction and starts executing its tasks
+		void EndTransaction();
+		//Removes all tasks of the open transaction from the queue without calling their callbacks
+		void AbortTransaction();
+
 		//Return the number of tasks
 		u16 GetNumberOfActiveTasks() const;
 
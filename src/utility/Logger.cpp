@@ -118,8 +118,15 @@ void Logger::log_f(bool printLine, bool isJson, bool isEndOfMessage, bool skipJs
 				currentJsonCrc = 0;
 			}
 #ifdef SIM_ENABLED
-			nlohmann::json j = nlohmann::json::parse(currentString);
-			currentString = "";
+			//Swapping keeps the capacity of both strings so that logging does not allocate
+			lastJsonString.swap(currentString);
+			currentString.clear();
+			lastJsonValidated = false;
+			jsonMessageCounter++;
+			if (jsonValidationSampleRate != 0 && jsonMessageCounter % jsonValidationSampleRate == 0)
+			{
+				ValidateLastJson();
+			}
 #endif
 		}
 
@@ -129,6 +136,21 @@ void Logger::log_f(bool printLine, bool isJson, bool isEndOfMessage, bool skipJs
 	}
 }
 
+#ifdef SIM_ENABLED
+//Throws if the last json message is not valid json
+void Logger::ValidateLastJson()
+{
+	if (lastJsonValidated) return;
+	nlohmann::json::parse(lastJsonString);
+	lastJsonValidated = true;
+}
+
+const std::string& Logger::GetLastJsonString() const
+{
+	return lastJsonString;
+}
+#endif
+
 void Logger::logTag_f(LogType logType, const char* file, i32 line, const char* tag, const char* message, ...) const
 {
 #if IS_ACTIVE(LOGGING) && defined(TERMINAL_ENABLED)
@@ -543,6 +565,20 @@ const char* Logger::getErrorLogCustomError(CustomErrorTypes type)
 		return "WARN_CONNECTION_SUSTAIN_FAILED";
 	case CustomErrorTypes::FATAL_SENSOR_PINS_NOT_DEFINED_IN_BOARD_ID:
 		return "FATAL_SENSOR_PINS_NOT_DEFINED_IN_BOARD_ID";
+	case CustomErrorTypes::COUNT_RELIABLE_MESSAGE_RETRANSMITTED:
+		return "COUNT_RELIABLE_MESSAGE_RETRANSMITTED";
+	case CustomErrorTypes::WARN_RELIABLE_MESSAGE_GIVEN_UP:
+		return "WARN_RELIABLE_MESSAGE_GIVEN_UP";
+	case CustomErrorTypes::COUNT_RAW_DATA_CHUNK_RETRANSMITTED:
+		return "COUNT_RAW_DATA_CHUNK_RETRANSMITTED";
+	case CustomErrorTypes::WARN_RAW_DATA_TRANSFER_FAILED:
+		return "WARN_RAW_DATA_TRANSFER_FAILED";
+	case CustomErrorTypes::COUNT_REESTABLISH_RESEND_AVOIDED:
+		return "COUNT_REESTABLISH_RESEND_AVOIDED";
+	case CustomErrorTypes::COUNT_REESTABLISH_DUPLICATE_DROPPED:
+		return "COUNT_REESTABLISH_DUPLICATE_DROPPED";
+	case CustomErrorTypes::WARN_REESTABLISH_WRITE_COUNT_MISMATCH:
+		return "WARN_REESTABLISH_WRITE_COUNT_MISMATCH";
 	default:
 		SIMEXCEPTION(ErrorCodeUnknownException); //Could be an error or should be added to the list
 		return "UNKNOWN_ERROR";
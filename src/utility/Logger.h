@@ -128,6 +128,13 @@ enum class CustomErrorTypes : u8 {
 	WARN_REQUEST_PROPOSALS_UNEXPECTED_LENGTH = 61,
 	WARN_REQUEST_PROPOSALS_TOO_LONG = 62,
 	FATAL_SENSOR_PINS_NOT_DEFINED_IN_BOARD_ID = 63,
+	COUNT_RELIABLE_MESSAGE_RETRANSMITTED = 64,
+	WARN_RELIABLE_MESSAGE_GIVEN_UP = 65,
+	COUNT_RAW_DATA_CHUNK_RETRANSMITTED = 66,
+	WARN_RAW_DATA_TRANSFER_FAILED = 67,
+	COUNT_REESTABLISH_RESEND_AVOIDED = 68,
+	COUNT_REESTABLISH_DUPLICATE_DROPPED = 69,
+	WARN_REESTABLISH_WRITE_COUNT_MISMATCH = 70,
 };
 
 #ifdef _MSC_VER
@@ -147,6 +154,11 @@ private:
 
 #ifdef SIM_ENABLED
 	std::string currentString = "";
+	std::string lastJsonString = "";
+	bool lastJsonValidated = false;
+	u32 jsonMessageCounter = 0;
+
+	void ValidateLastJson();
 #endif
 
 public:
@@ -229,6 +241,23 @@ public:
 	static const char* getErrorLogRebootReason(RebootReason type);
 	static const char* getErrorLogError(LoggingError type, u32 code);
 
+#ifdef SIM_ENABLED
+	//0: Json is only parsed once it is accessed, 1: every json message is parsed for validation, N: every Nth message is parsed
+	u32 jsonValidationSampleRate = 0;
+
+	//Returns the last complete json message that was logged
+	const std::string& GetLastJsonString() const;
+	//Parses and returns the last json message, Json must be nlohmann::json, which is only included by the caller
+	template<typename Json>
+	Json GetLastJson()
+	{
+		//Only marked as validated once parsing did not throw
+		Json json = Json::parse(lastJsonString);
+		lastJsonValidated = true;
+		return json;
+	}
+#endif
+
 	//Other printing functions
 	void blePrettyPrintAdvData(SizedData advData) const;
 	static void convertBufferToBase64String(const u8* srcBuffer, u32 srcLength, char* dstBuffer, u16 bufferLength);
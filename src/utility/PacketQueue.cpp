@@ -255,6 +255,18 @@ void PacketQueue::DiscardLast()
 	logt("PQ", "DiscardLast, now %u elements", _numElements);
 }
 
+u8 PacketQueue::GetUsagePercent() const
+{
+	if (_numElements == 0) return 0;
+
+	//Space that is left unused at the end of the buffer after wrapping counts as occupied
+	const u32 usedBytes = writePointer > readPointer
+		? (u32)(writePointer - readPointer)
+		: (u32)bufferLength - (u32)(readPointer - writePointer);
+
+	return usedBytes >= bufferLength ? 100 : (u8)(usedBytes * 100 / bufferLength);
+}
+
 void PacketQueue::Clean(void)
 {
 	_numElements = 0;
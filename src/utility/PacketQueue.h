@@ -53,6 +53,8 @@ public:
 	SizedData PeekLast();
 	void DiscardLast();
 	void Clean(void);
+	//Returns the occupied part of the buffer in percent
+	u8 GetUsagePercent() const;
 
 	void Print() const;
 
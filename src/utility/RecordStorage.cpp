@@ -193,6 +193,7 @@ void RecordStorage::SaveRecordInternal(SaveRecordOperation& op)
 			RecordStoragePage* pageToDefragment = FindPageToDefragment();
 			if (pageToDefragment != nullptr) {
 				op.stage = RecordStorageSaveStage::SAVE;
+				numForegroundDefragmentations++;
 				return DefragmentPage(*pageToDefragment, false);
 			}
 		}
@@ -226,14 +227,8 @@ void RecordStorage::SaveRecordInternal(SaveRecordOperation& op)
 
 			//Build the record in a buffer
 			DYNAMIC_ARRAY(buffer, recordLength);
-			CheckedMemset(buffer, 0xFF, recordLength);
+			BuildRecord(op, recordVersion, buffer, recordLength);
 			RecordStorageRecord* newRecord = (RecordStorageRecord*)buffer;
-			newRecord->recordActive = 1;
-			newRecord->padding = padding; //Padding must be stored so we can substract it later when retrieving the record
-			newRecord->recordLength = recordLength;
-			newRecord->recordId = op.recordId;
-			newRecord->versionCounter = recordVersion;
-			CheckedMemcpy(newRecord->data, op.data, op.dataLength);
 
 			//Check if the old record matches the new record and do not write to flash in this case
 			if(oldRecord != nullptr && oldRecord->recordActive && oldRecord->recordLength == newRecord->recordLength && oldRecord->padding == newRecord->padding){
@@ -243,9 +238,19 @@ void RecordStorage::SaveRecordInternal(SaveRecordOperation& op)
 				}
 			}
 
-			//The crc is calculated over the record header and data, excluding the first two byte (crc and flags)
-			newRecord->crc = Utility::CalculateCrc8(((u8*)newRecord) + 2, newRecord->recordLength - 2);
 			op.stage = RecordStorageSaveStage::CALLBACKS_AND_FINISH;
+
+			//If other save operations are queued, their records are written directly behind this one in the same
+			//flash transaction so that the FlashStorage can coalesce them into a single flash write
+			if (opQueue._numElements > 1 && GS->flashStorage.StartTransaction() == FlashStorageError::SUCCESS)
+			{
+				GS->flashStorage.CacheAndWriteData((u32*)newRecord, (u32*)freeSpace, recordLength, this, (u32)FlashUserTypes::BATCH);
+				batchedOperations = 1 + QueueBatchedSaves(freeSpace + recordLength, recordLength);
+				logt("RS", "Saving %u records in a batch", batchedOperations);
+				GS->flashStorage.EndTransaction();
+				return;
+			}
+
 			GS->flashStorage.CacheAndWriteData((u32*)newRecord, (u32*)freeSpace, recordLength, this, (u32)FlashUserTypes::DEFAULT);
 			return;
 
@@ -270,6 +275,78 @@ void RecordStorage::SaveRecordInternal(SaveRecordOperation& op)
 	}
 }
 
+//Checks the operations that follow the current one in the queue and adds all save operations to the
+//flash transaction as long as their records fit on the same page, returns the number of added operations
+u8 RecordStorage::QueueBatchedSaves(u8* freeSpace, u16 batchLength)
+{
+	const u32 pageEnd = FLASH_REGION_START_ADDRESS + (TO_PAGE(freeSpace) + 1) * FruityHal::GetCodePageSize();
+	u8 numBatched = 0;
+
+	for (u8 pos = 1; pos < opQueue._numElements && pos < RECORD_STORAGE_MAX_BATCHED_OPERATIONS; pos++)
+	{
+		SaveRecordOperation* op = (SaveRecordOperation*)opQueue.PeekNext(pos).data;
+		if (op->op.type != (u8)RecordStorageOperationType::SAVE_RECORD || op->stage != RecordStorageSaveStage::FIRST_STAGE) break;
+
+		//A record that is updated twice within the batch needs the version of the record that is not yet written
+		for (u8 i = 0; i < pos; i++) {
+			if (((SaveRecordOperation*)opQueue.PeekNext(i).data)->recordId == op->recordId) return numBatched;
+		}
+
+		u8 padding = (4 - op->dataLength % 4) % 4;
+		u16 recordLength = op->dataLength + SIZEOF_RECORD_STORAGE_RECORD_HEADER + padding;
+
+		//The batch is limited to what the FlashStorage can write with a single flash operation
+		if ((u32)freeSpace + recordLength > pageEnd || batchLength + recordLength > FLASH_STORAGE_COALESCE_BUFFER_SIZE) break;
+
+		if (!QueueBatchedSave(*op, freeSpace, recordLength)) break;
+
+		freeSpace += recordLength;
+		batchLength += recordLength;
+		numBatched++;
+	}
+
+	return numBatched;
+}
+
+bool RecordStorage::QueueBatchedSave(SaveRecordOperation& op, u8* freeSpace, u16 recordLength)
+{
+	RecordStorageRecord* oldRecord = GetRecord(op.recordId);
+	if (oldRecord != nullptr && oldRecord->versionCounter == UINT16_MAX) return false;
+
+	DYNAMIC_ARRAY(buffer, recordLength);
+	BuildRecord(op, oldRecord == nullptr ? 1 : oldRecord->versionCounter + 1, buffer, recordLength);
+	RecordStorageRecord* newRecord = (RecordStorageRecord*)buffer;
+
+	//Unchanged records are not written, they are finished once they reach the front of the queue
+	if (oldRecord != nullptr && oldRecord->recordActive && oldRecord->recordLength == newRecord->recordLength && oldRecord->padding == newRecord->padding) {
+		if (memcmp(oldRecord->data, newRecord->data, op.dataLength) == 0) return false;
+	}
+
+	if (GS->flashStorage.CacheAndWriteData((u32*)newRecord, (u32*)freeSpace, recordLength, this, (u32)FlashUserTypes::BATCH) != FlashStorageError::SUCCESS) {
+		return false;
+	}
+
+	//The operation will be finished by the flash callback of its record
+	op.stage = RecordStorageSaveStage::CALLBACKS_AND_FINISH;
+
+	return true;
+}
+
+void RecordStorage::BuildRecord(const SaveRecordOperation& op, u16 recordVersion, u8* buffer, u16 recordLength) const
+{
+	CheckedMemset(buffer, 0xFF, recordLength);
+	RecordStorageRecord* newRecord = (RecordStorageRecord*)buffer;
+	newRecord->recordActive = 1;
+	newRecord->padding = (4 - op.dataLength % 4) % 4; //Padding must be stored so we can substract it later when retrieving the record
+	newRecord->recordLength = recordLength;
+	newRecord->recordId = op.recordId;
+	newRecord->versionCounter = recordVersion;
+	CheckedMemcpy(newRecord->data, op.data, op.dataLength);
+
+	//The crc is calculated over the record header and data, excluding the first two byte (crc and flags)
+	newRecord->crc = Utility::CalculateCrc8(((u8*)newRecord) + 2, newRecord->recordLength - 2);
+}
+
 //Deactivating a record will set the deleted flag of the newest entry for this recordId, it will be deleted after a page is defragmented
 void RecordStorage::DeactivateRecordInternal(DeactivateRecordOperation& op)
 {
@@ -317,6 +394,8 @@ RecordStorageResultCode RecordStorage::LockDownAndClearAllSettings(ModuleId resp
 		opQueue.DiscardNext();
 	}
 	opQueue.Clean();
+	//Callbacks of a batch that is still being written must not finish any operation
+	batchedOperations = 0;
 	lockDownCallback = callback;
 	lockDownUserType = userType;
 	lockDownModuleId = responsibleModuleForShutDown;
@@ -336,6 +415,74 @@ RecordStorageResultCode RecordStorage::LockDownAndClearAllSettings(ModuleId resp
 # Repair and Defragment Pages
 #################################*/
 
+void RecordStorage::TimerEventHandler(u16 passedTimeDs)
+{
+	//A background defragmentation is only started while neither the record storage, the flash nor the radio are busy
+	if (
+		   !isInit
+		|| recordStorageLockDown
+		|| repairStage != RepairStage::NO_REPAIR
+		|| defragmentationStage != DefragmentationStage::NO_DEFRAGMENTATION
+		|| opQueue._numElements > 0
+		|| GS->flashStorage.GetNumberOfActiveTasks() > 0
+		|| GS->cm.GetPendingPackets() > 0
+		|| GS->cm.pendingConnection != nullptr
+	) {
+		idleTimeDs = 0;
+		return;
+	}
+
+	idleTimeDs += passedTimeDs;
+	if (idleTimeDs < RECORD_STORAGE_BACKGROUND_DEFRAGMENTATION_IDLE_TIME_DS) return;
+	idleTimeDs = 0;
+
+	RecordStorageFragmentationInfo info = GetFragmentationInfo();
+	if (info.reclaimableSpace == 0) return;
+	if (info.fragmentationPercent < RECORD_STORAGE_BACKGROUND_DEFRAGMENTATION_THRESHOLD_PERCENT
+		&& info.maxFreeSpaceOnPage >= RECORD_STORAGE_BACKGROUND_DEFRAGMENTATION_MIN_FREE_SPACE) return;
+
+	RecordStoragePage* pageToDefragment = FindPageToDefragment();
+	if (pageToDefragment == nullptr) return;
+
+	logt("RS", "Background defragmentation (fragmentation %u%%, max free %u)", info.fragmentationPercent, info.maxFreeSpaceOnPage);
+
+	//Only a single page is defragmented at a time, the next one is picked after the node was idle again
+	numBackgroundDefragmentations++;
+	DefragmentPage(*pageToDefragment, false);
+}
+
+RecordStorageFragmentationInfo RecordStorage::GetFragmentationInfo() const
+{
+	RecordStorageFragmentationInfo info;
+	CheckedMemset(&info, 0, sizeof(info));
+
+	u32 activeSpace = 0;
+	for (u32 i = 0; i < RECORD_STORAGE_NUM_PAGES; i++) {
+		RecordStoragePage& page = getPage(i);
+		if (GetPageState(page) != RecordStoragePageState::ACTIVE) continue;
+
+		u16 freeSpace = GetFreeSpaceOnPage(page);
+		u16 freeSpaceWhenDefragmented = GetFreeSpaceWhenDefragmented(page);
+
+		activeSpace += FruityHal::GetCodePageSize() - SIZEOF_RECORD_STORAGE_PAGE_HEADER;
+		info.freeSpace += freeSpace;
+		info.usedSpace += FruityHal::GetCodePageSize() - SIZEOF_RECORD_STORAGE_PAGE_HEADER - freeSpaceWhenDefragmented;
+		info.reclaimableSpace += freeSpaceWhenDefragmented - freeSpace;
+		if (freeSpace > info.maxFreeSpaceOnPage) info.maxFreeSpaceOnPage = freeSpace;
+	}
+
+	if (activeSpace > 0) {
+		info.fragmentationPercent = (u8)(info.reclaimableSpace * 100 / activeSpace);
+	}
+
+	return info;
+}
+
+u16 RecordStorage::GetNumDefragmentations(bool background) const
+{
+	return background ? numBackgroundDefragmentations : numForegroundDefragmentations;
+}
+
 
 //This will heal corruption caused by power loss or write errors
 //This will always produce one empty swap page with all other pages being active
@@ -863,7 +1010,8 @@ void RecordStorage::FlashStorageItemExecuted(FlashStorageTaskItem* task, FlashSt
 		//TODO: Use errorCode
 
 		//If either a repair or defrag is in Progress, do nothing, these are called from the QueueEmptyHandler
-		if (repairStage != RepairStage::NO_REPAIR || defragmentationStage != DefragmentationStage::NO_DEFRAGMENTATION) {
+		//The same is true for a batch, which continues the queue once all of its records are written
+		if (repairStage != RepairStage::NO_REPAIR || defragmentationStage != DefragmentationStage::NO_DEFRAGMENTATION || batchedOperations > 0) {
 			processQueueInProgress = false;
 			return;
 		}
@@ -889,6 +1037,23 @@ void RecordStorage::FlashStorageItemExecuted(FlashStorageTaskItem* task, FlashSt
 			processQueueInProgress = false;
 		}
 	}
+	else if (task != nullptr && task->header.userType == (u32)FlashUserTypes::BATCH)
+	{
+		//The batch was cancelled by a lock down
+		if (batchedOperations == 0) return;
+
+		//Records of a batch are written in queue order, so each executed task finishes the next operation
+		RecordStorageOperation* op = (RecordStorageOperation*)opQueue.PeekNext().data;
+		op->flashStorageErrorCode = errorCode;
+		batchedOperations--;
+
+		ExecuteCallback(*op, errorCode == FlashStorageError::SUCCESS ? RecordStorageResultCode::SUCCESS : RecordStorageResultCode::BUSY);
+		opQueue.DiscardNext();
+
+		if (batchedOperations == 0) {
+			ProcessQueue(true);
+		}
+	}
 	else if (task != nullptr && task->header.userType == (u32)FlashUserTypes::LOCK_DOWN)
 	{
 		//If we were not successful and havn't exceeded our retry counter, we try again. 
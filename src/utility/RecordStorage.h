@@ -159,6 +159,15 @@ typedef struct
 STATIC_ASSERT_SIZE(DeactivateRecordOperation, SIZEOF_RECORD_STORAGE_DEACTIVATE_RECORD_OP);
 #pragma pack(pop)
 
+struct RecordStorageFragmentationInfo
+{
+	u32 freeSpace;           //Space after the last record of all active pages
+	u32 usedSpace;           //Space used by the latest version of all active records
+	u32 reclaimableSpace;    //Space used by outdated or deactivated records that is freed by a defragmentation
+	u16 maxFreeSpaceOnPage;  //Biggest record that can be saved without a defragmentation
+	u8 fragmentationPercent; //Part of the active pages that is occupied by reclaimable records
+};
+
 enum class RecordStorageResultCode : u8
 {
 	SUCCESS                  = 0,
@@ -178,6 +187,15 @@ enum class RecordStoragePageState : u8
 class RecordStorageEventListener;
 
 constexpr int RECORD_STORAGE_QUEUE_SIZE = 256;
+//Maximum number of queued save operations that are written in a single flash transaction
+constexpr int RECORD_STORAGE_MAX_BATCHED_OPERATIONS = 8;
+
+//Time without record storage or radio activity before a background defragmentation is considered
+constexpr u16 RECORD_STORAGE_BACKGROUND_DEFRAGMENTATION_IDLE_TIME_DS = SEC_TO_DS(10);
+//A background defragmentation is started once this much of the active pages is occupied by reclaimable records...
+constexpr u8 RECORD_STORAGE_BACKGROUND_DEFRAGMENTATION_THRESHOLD_PERCENT = 25;
+//...or once no page has enough free space left for a record of this size
+constexpr u16 RECORD_STORAGE_BACKGROUND_DEFRAGMENTATION_MIN_FREE_SPACE = 256;
 
 
 class RecordStorage : public FlashStorageEventListener
@@ -189,6 +207,7 @@ class RecordStorage : public FlashStorageEventListener
 		{
 			DEFAULT   = 0, //FIXME: All usages of this value should be refactored to use a distinct user type instead.
 			LOCK_DOWN = 1,
+			BATCH     = 2,
 		};
 
 		u8* startPage = nullptr;
@@ -205,10 +224,23 @@ class RecordStorage : public FlashStorageEventListener
 		RecordStoragePage* defragmentSwapPage = nullptr;
 		DefragmentationStage defragmentationStage = DefragmentationStage::NO_DEFRAGMENTATION;
 
+		//Variables for the background defragmentation
+		u16 idleTimeDs = 0;
+		u16 numForegroundDefragmentations = 0;
+		u16 numBackgroundDefragmentations = 0;
+
 		bool processQueueInProgress = false;
 
+		//Number of save operations whose records are currently written in a flash transaction
+		u8 batchedOperations = 0;
+
 		//Stores a record
 		void SaveRecordInternal(SaveRecordOperation& op);
+		//Writes the records of save operations that follow the current one in the same flash transaction
+		u8 QueueBatchedSaves(u8* freeSpace, u16 batchLength);
+		bool QueueBatchedSave(SaveRecordOperation& op, u8* freeSpace, u16 recordLength);
+		//Builds a record in the given buffer as it will be written to flash
+		void BuildRecord(const SaveRecordOperation& op, u16 recordVersion, u8* buffer, u16 recordLength) const;
 		//Removes a record
 		void DeactivateRecordInternal(DeactivateRecordOperation& op);
 				
@@ -263,6 +295,12 @@ class RecordStorage : public FlashStorageEventListener
 		SizedData GetRecordData(u16 recordId) const;
 		//Resets all settings
 		RecordStorageResultCode LockDownAndClearAllSettings(ModuleId responsibleModuleForLockDown, RecordStorageEventListener * callback, u32 userType);
+
+		//Defragments pages in the background while the node is idle so that saving a record does not have to
+		void TimerEventHandler(u16 passedTimeDs);
+		//Calculates how much space is used, free and reclaimable in all active pages
+		RecordStorageFragmentationInfo GetFragmentationInfo() const;
+		u16 GetNumDefragmentations(bool background) const;
 		
 		//Listener
 		void FlashStorageItemExecuted(FlashStorageTaskItem* task, FlashStorageError errorCode) override;